@@ -9,7 +9,12 @@
  * Copyright IBM Corp. 1999,2007
  */
 
+#define _GNU_SOURCE	/* for O_DIRECT */
+
 #include <sys/utsname.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include <linux/version.h>
 
 #include "zt_common.h"
@@ -27,6 +32,7 @@ static int disk_disabled;
 static format_data_t format_params;
 char *prog_name;
 volatile sig_atomic_t program_interrupt_in_progress;
+static volatile sig_atomic_t parallel_interrupt_signal;
 
 /*
  * Print version information.
@@ -47,6 +53,8 @@ static void exit_usage(int exitcode)
 	       "	       [-l <volser>      | --label=<volser>]\n"
 	       "               [-b <blocksize>   | --blocksize=<blocksize>]\n"
 	       "               [-d <disk layout> | --disk_layout=<disk layout>]\n"
+	       "               [-r <cylinders>   | --requestsize=<cylinders>]\n"
+	       "               [--parallel=<count>] [--mode=<mode>]\n"
 	       "               <diskspec>\n\n",prog_name);
 
 	printf("       -t or --test     means testmode\n"
@@ -59,6 +67,14 @@ static void exit_usage(int exitcode)
 	       "       -v means verbose mode\n"
 	       "       -F means don't check if the device is in use\n"
 	       "       -k means keep volume serial\n"
+	       "       -r x or --requestsize=x means format x cylinders "
+	       "with one request\n"
+	       "       --parallel=x means format up to x devices at the "
+	       "same time\n"
+	       "       --mode=quick means only rewrite label and VTOC of a "
+	       "formatted device\n"
+	       "       --mode=expand means only format the cylinders added "
+	       "to a device\n"
                "       --norecordzero prevent storage server from modifying"
                " record 0\n\n"
 	       "       <volser> is the volume identifier, which is converted\n"
@@ -77,7 +93,10 @@ static void exit_usage(int exitcode)
 	       "           and alternatively\n"
 	       "           -n xxxx or --devno=xxxx\n"
 	       "           in case you are using devfs.\n"
-	       "           xxxx is your hexadecimal device number.\n");
+	       "           xxxx is your hexadecimal device number.\n"
+	       "       Several devices /dev/dasdX /dev/dasdY ... can be "
+	       "formatted\n"
+	       "       in one run, see --parallel.\n");
 	exit(exitcode);
 }
 
@@ -206,6 +225,11 @@ static void init_info(dasdfmt_info_t *info)
 	info->devno_specified   = 0;
 	info->device_id         = 0;
 	info->keep_volser	= 0;
+	info->reqsize		= DEFAULT_REQUESTSIZE;
+	info->parallel		= 1;
+	info->progress_fd	= -1;
+	info->device_index	= 0;
+	info->mode		= DASDFMT_MODE_FULL;
 }
 
 
@@ -393,6 +417,9 @@ static void dasdfmt_print_info(dasdfmt_info_t *info, volume_label_t *vlabel,
 	printf("   Compatible Disk Layout  : %s\n",
 	       (p->intensity & DASD_FMT_INT_COMPAT)?"yes":"no");
 	printf("   Blocksize               : %d\n", p->blksize);
+	printf("   Format mode             : %s\n",
+	       (info->mode == DASDFMT_MODE_QUICK) ? "quick" :
+	       (info->mode == DASDFMT_MODE_EXPAND) ? "expand" : "full");
 
 	if (info->testmode) 
 		printf("Test mode active, omitting ioctl.\n");
@@ -590,14 +617,50 @@ static void dasdfmt_write_labels(dasdfmt_info_t *info, volume_label_t *vlabel,
 
 
 /*
- * formats the disk cylinderwise
+ * send the number of formatted cylinders to the main process
+ */
+static void dasdfmt_report_progress(dasdfmt_info_t *info, unsigned int cyl,
+				    unsigned int cylinders)
+{
+	struct dasdfmt_progress progress;
+
+	if (info->progress_fd < 0)
+		return;
+	progress.device_index = info->device_index;
+	progress.cyl = cyl;
+	progress.cylinders = cylinders;
+	/* writes of up to PIPE_BUF bytes to a pipe are atomic */
+	if (write(info->progress_fd, &progress, sizeof(progress)) !=
+	    sizeof(progress))
+		ERRMSG("%s: %s: Could not report progress (%s)\n",
+		       prog_name, info->devname, strerror(errno));
+}
+
+
+/*
+ * return the number of seconds since start
+ */
+static double dasdfmt_elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) +
+		(now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+
+/*
+ * formats the disk in steps of info->reqsize cylinders
  */
 static void dasdfmt_format(dasdfmt_info_t *info, unsigned int cylinders,
 			   unsigned int heads, format_data_t *format_params)
 {
 	format_data_t format_step;
-	int j, cyl, tmp, p1, p2;
-	unsigned int k;
+	struct timeval start;
+	unsigned int k, step, cyl, hashcyl;
+	int j, tmp, p1;
+	double secs;
 
 	if (info->print_hashmarks) {
 		if ((info->hashstep < 1) || (info->hashstep > 1000)) {
@@ -613,68 +676,72 @@ static void dasdfmt_format(dasdfmt_info_t *info, unsigned int cylinders,
 	format_step.blksize   = format_params->blksize;
 	format_step.intensity = format_params->intensity;
 		
-	k = 0;
-	cyl = 1;
+	step = info->reqsize * heads;
+	hashcyl = 0;
 	if (info->print_progressbar || info->print_hashmarks)
 		printf("\n");
 
-	while (1) {
-		p1 = -1; 
-		p2 =  0;
-
+	gettimeofday(&start, NULL);
+	/* format whole cylinders, except for the first track */
+	k = format_params->start_unit - format_params->start_unit % heads;
+	for (; k <= format_params->stop_unit; k += step) {
 		format_step.start_unit = k;
-		format_step.stop_unit  = k + heads - 1;
+		if (format_step.start_unit < format_params->start_unit)
+			format_step.start_unit = format_params->start_unit;
+		format_step.stop_unit = k + step - 1;
+		if (format_step.stop_unit > format_params->stop_unit)
+			format_step.stop_unit = format_params->stop_unit;
 
-		if (cyl == 1)
-			format_step.start_unit += 1;
-			
 		if (ioctl(filedes, BIODASDFMT, &format_step) != 0)
 			ERRMSG_EXIT(EXIT_FAILURE,"%s: (format cylinder) IOCTL "
 				    "BIODASDFMT failed. (%s)\n",
 				    prog_name, strerror(errno));
 
+		cyl = (format_step.stop_unit + 1) / heads;
+
 		if (info->print_progressbar) {
 			printf("cyl %5d of %5d |", cyl, cylinders);
-			p2 = p1;
 			p1 = cyl*100/cylinders;
-			if (p1 != p2)
-			{
-				/* percent value has changed */
-				tmp = cyl*50/cylinders;
-				for (j=1; j<=tmp; j++)
-					printf("#");
-				for (j=tmp+1; j<=50; j++) 
-					printf("-");
-				printf("| %3d%%  ", p1);
-			}
+			tmp = cyl*50/cylinders;
+			for (j=1; j<=tmp; j++)
+				printf("#");
+			for (j=tmp+1; j<=50; j++) 
+				printf("-");
+			printf("| %3d%%  ", p1);
 			printf("\r");
 			fflush(stdout);
 		}
 		
-		if (info->print_hashmarks)
-			if (cyl % info->hashstep == 0) {
+		if (info->print_hashmarks) {
+			while (hashcyl + info->hashstep <= cyl) {
+				hashcyl += info->hashstep;
 				printf("#");
-				fflush(stdout);
 			}
+			fflush(stdout);
+		}
 		if (info->print_percentage) {
 			printf("cyl %5i of %5i |  %3i%%\n", cyl, cylinders,
 			       cyl*100/cylinders);
 			fflush(stdout);
 		}
 
-		if (k % heads == 0) {
-			k += heads;
-			cyl++;
-		}
-		else 
-			k += format_params->stop_unit % heads;
-
-		if (k > format_params->stop_unit) 
-			break;
+		dasdfmt_report_progress(info, cyl, cylinders);
 	}
 
 	if (info->print_progressbar || info->print_hashmarks)
 		printf("\n\n");	
+
+	if ((info->verbosity > 0) || (info->progress_fd >= 0)) {
+		secs = dasdfmt_elapsed(&start);
+		/* the first track is not part of the range */
+		cyl = (format_params->stop_unit - format_params->start_unit +
+		       heads) / heads;
+		printf("%s: formatted %u cylinders in %.1f s", info->devname,
+		       cyl, secs);
+		if (secs > 0)
+			printf(" (%.1f cylinders/s)", cyl / secs);
+		printf("\n");
+	}
 }
 
 
@@ -735,6 +802,213 @@ static void dasdfmt_prepare_and_format (dasdfmt_info_t *info,
 }
 
 
+/*
+ * read one block from each of the first and the last track of the given
+ * track range and from sample tracks in between; return 0 if all blocks
+ * could be read, i.e. the tracks are formatted with the given blocksize
+ */
+static int dasdfmt_sample_tracks(dasdfmt_info_t *info, unsigned int first,
+				 unsigned int last, unsigned int sectors,
+				 int blksize)
+{
+	unsigned long long track;
+	void *buffer;
+	off_t offset;
+	int f, i, rc;
+
+	/* bypass the page cache, fall back to buffered reads otherwise */
+	f = open(info->devname, O_RDONLY | O_DIRECT);
+	if (f == -1)
+		f = open(info->devname, O_RDONLY);
+	if (f == -1)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: Unable to open device %s: %s\n",
+			    prog_name, info->devname, strerror(errno));
+	if (posix_memalign(&buffer, blksize, blksize) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: Out of memory\n", prog_name);
+
+	rc = 0;
+	for (i = 0; i <= SAMPLE_TRACKS && rc == 0; i++) {
+		track = first + (unsigned long long) (last - first) * i /
+			SAMPLE_TRACKS;
+		offset = (off_t) track * sectors * blksize;
+		if ((pread(f, buffer, blksize, offset) != blksize) ||
+		    (pread(f, buffer, blksize, offset + (off_t) (sectors - 1) *
+			   blksize) != blksize))
+			rc = -1;
+	}
+
+	free(buffer);
+	close(f);
+	return rc;
+}
+
+
+/*
+ * check that the volume is formatted with the requested blocksize and
+ * disk layout; returns the number of formatted cylinders
+ */
+static unsigned int dasdfmt_check_format(dasdfmt_info_t *info,
+					 format_data_t *p,
+					 unsigned int cylinders,
+					 unsigned int heads)
+{
+	dasd_information_t dasd_info;
+	struct hd_geometry geo;
+	volume_label_t vlabel;
+	format4_label_t f4;
+	char label[5];
+	const char *expected, *layout;
+	unsigned int formatted;
+	unsigned long position;
+	int blksize;
+
+	if (info->verbosity > 0) printf("Checking the current format...\n");
+
+	if (ioctl(filedes, BIODASDINFO, &dasd_info) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: (check format) IOCTL BIODASD"
+			    "INFO failed (%s).\n",prog_name, strerror(errno));
+
+	if (ioctl(filedes, BLKSSZGET, &blksize) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: (check format) IOCTL BLKSSZGET "
+			    "failed (%s).\n", prog_name, strerror(errno));
+
+	if (ioctl(filedes, HDIO_GETGEO, &geo) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: (check format) IOCTL HDIO_GET"
+			    "GEO failed (%s).\n", prog_name, strerror(errno));
+
+	layout = (p->intensity & DASD_FMT_INT_COMPAT) ? "cdl" : "ldl";
+	if (blksize != (int) p->blksize)
+		goto out_mismatch;
+
+	/* ldl labels are stored without key, see vtoc.h */
+	position = dasd_info.label_block * blksize;
+	if (p->intensity & DASD_FMT_INT_COMPAT) {
+		expected = "VOL1";
+		vtoc_read_volume_label(info->devname, position, &vlabel);
+	} else {
+		expected = "LNX1";
+		vtoc_read_volume_label(info->devname,
+				       position - sizeof(vlabel.volkey),
+				       &vlabel);
+	}
+	vtoc_volume_label_get_label(&vlabel, label);
+	if (strncmp(label, expected, 4) != 0)
+		goto out_mismatch;
+
+	formatted = cylinders;
+	if (info->mode == DASDFMT_MODE_EXPAND) {
+		/* size of the volume when the labels were written */
+		if (p->intensity & DASD_FMT_INT_COMPAT) {
+			position = (VTOC_START_CC * heads + VTOC_START_HH) *
+				geo.sectors * blksize;
+			vtoc_read_label(info->devname, position, NULL, &f4,
+					NULL, NULL);
+			if (f4.DS4IDFMT != 0xf4)
+				goto out_mismatch;
+			if (f4.DS4DEVCT.DS4DSCYL == LV_COMPAT_CYL &&
+			    f4.DS4DCYL)
+				formatted = f4.DS4DCYL;
+			else
+				formatted = f4.DS4DEVCT.DS4DSCYL;
+		} else {
+			if ((unsigned char) vlabel.ldl_version < 0xf2)
+				goto out_mismatch;
+			formatted = vlabel.formatted_blocks /
+				(heads * geo.sectors);
+		}
+		if (formatted == 0)
+			goto out_mismatch;
+		if (formatted > cylinders)
+			formatted = cylinders;
+	}
+
+	/* the first two tracks have a special layout in cdl */
+	if ((formatted * heads > 2) &&
+	    dasdfmt_sample_tracks(info, 2, formatted * heads - 1,
+				  geo.sectors, blksize))
+		goto out_mismatch;
+	return formatted;
+
+out_mismatch:
+	ERRMSG_EXIT(EXIT_FAILURE, "%s: Device %s is not formatted with "
+		    "blocksize %d and the %s disk layout.\nUse --mode=full "
+		    "to format the whole device.\n", prog_name,
+		    info->devname, p->blksize, layout);
+}
+
+
+/*
+ * format the tracks added to an expanded volume
+ */
+static void dasdfmt_expand(dasdfmt_info_t *info, unsigned int cylinders,
+			   unsigned int heads, format_data_t *p)
+{
+	dasd_information_t dasd_info;
+	struct hd_geometry geo;
+	volume_label_t vlabel;
+	format4_label_t f4;
+	unsigned long position;
+	int blksize, rc;
+
+	if (info->verbosity > 0) printf("Detaching the device...\n");
+
+	if (ioctl(filedes, BIODASDDISABLE, p) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: (prepare device) IOCTL "
+			    "BIODASDDISABLE failed. (%s)\n", prog_name, 
+			    strerror(errno));
+	disk_disabled = 1;
+
+	dasdfmt_format(info, cylinders, heads, p);
+
+	if (info->verbosity > 0) printf("Re-accessing the device...\n");
+
+	if (ioctl(filedes, BIODASDENABLE, p) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: (prepare device) IOCTL "
+			    "BIODASDENABLE failed. (%s)\n", prog_name, 
+			    strerror(errno));
+	disk_disabled = 0;
+
+	if ((ioctl(filedes, BIODASDINFO, &dasd_info) != 0) ||
+	    (ioctl(filedes, BLKSSZGET, &blksize) != 0) ||
+	    (ioctl(filedes, HDIO_GETGEO, &geo) != 0))
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: (update label) IOCTL failed "
+			    "(%s).\n", prog_name, strerror(errno));
+
+	if (p->intensity & DASD_FMT_INT_COMPAT) {
+		/* the size of a cdl volume is part of its FMT4 DSCB */
+		if (info->verbosity > 0) printf("Updating VTOC...\n");
+
+		position = (VTOC_START_CC * heads + VTOC_START_HH) *
+			geo.sectors * blksize;
+		vtoc_read_label(info->devname, position, NULL, &f4, NULL,
+				NULL);
+		f4.DS4DEVCT.DS4DSCYL = geo.cylinders;
+		f4.DS4DCYL = cylinders;
+		rc = pwrite(filedes, &f4, sizeof(f4), position);
+		if (rc != sizeof(f4))
+			ERRMSG_EXIT(EXIT_FAILURE, "%s: Error writing FMT4 "
+				    "label (%d).\n", prog_name, rc);
+		fsync(filedes);
+		return;
+	}
+
+	/* the size of an ldl volume is part of its label */
+	if (info->verbosity > 0) printf("Updating label...\n");
+
+	position = dasd_info.label_block * blksize;
+	vtoc_read_volume_label(info->devname, position - sizeof(vlabel.volkey),
+			       &vlabel);
+	vlabel.formatted_blocks = (unsigned long long) cylinders * heads *
+		geo.sectors;
+	rc = pwrite(filedes, (char *) &vlabel + sizeof(vlabel.volkey),
+		    sizeof(vlabel) - sizeof(vlabel.volkey), position);
+	if (rc != sizeof(vlabel) - sizeof(vlabel.volkey))
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: Error writing volume label "
+			    "(%d).\n", prog_name, rc);
+	fsync(filedes);
+}
+
+
 /*
  *
  */
@@ -744,7 +1018,7 @@ static void do_format_dasd(dasdfmt_info_t *info, format_data_t *p,
 	char               inp_buffer[5];
 	dasd_information_t  dasd_info;
 	struct dasd_eckd_characteristics *characteristics;
-	unsigned int cylinders, heads;
+	unsigned int cylinders, heads, formatted;
 
 	if (info->verbosity > 0) printf("Retrieving disk geometry...\n");
 
@@ -765,6 +1039,22 @@ static void do_format_dasd(dasdfmt_info_t *info, format_data_t *p,
 	p->start_unit = 0;
 	p->stop_unit  = (cylinders * heads) - 1;
 
+	dasdfmt_report_progress(info, 0, cylinders);
+
+	if (info->mode == DASDFMT_MODE_QUICK) {
+		dasdfmt_check_format(info, p, cylinders, heads);
+		/* reformat the first cylinder with label and VTOC only */
+		p->stop_unit = QUICK_CYLINDERS * heads - 1;
+	} else if (info->mode == DASDFMT_MODE_EXPAND) {
+		formatted = dasdfmt_check_format(info, p, cylinders, heads);
+		if (formatted >= cylinders) {
+			printf("Device %s has no new cylinders to format.\n",
+			       info->devname);
+			return;
+		}
+		p->start_unit = formatted * heads;
+	}
+
 	if (info->writenolabel) {
 		if (cylinders > LV_COMPAT_CYL && !info->withoutprompt) {
 			printf("\n--->> ATTENTION! <<---\n");
@@ -807,9 +1097,15 @@ static void do_format_dasd(dasdfmt_info_t *info, format_data_t *p,
 	if (!info->testmode) {
 		if (!info->withoutprompt) {
 			printf("\n--->> ATTENTION! <<---\n");
-			printf("All data of that device will be lost.\nType "
-			       "\"yes\" to continue, no will leave the disk "
-			       "untouched: ");
+			if (info->mode == DASDFMT_MODE_EXPAND)
+				printf("The tracks %u to %u of that device "
+				       "will be formatted.\n", p->start_unit,
+				       p->stop_unit);
+			else
+				printf("All data of that device will be "
+				       "lost.\n");
+			printf("Type \"yes\" to continue, no will leave the "
+			       "disk untouched: ");
 			if (fgets(inp_buffer, sizeof(inp_buffer), stdin) == NULL)
 				return;
 			if (strcasecmp(inp_buffer,"yes") &&
@@ -824,28 +1120,278 @@ static void do_format_dasd(dasdfmt_info_t *info, format_data_t *p,
 			printf("Formatting the device. This may take a "
 			       "while (get yourself a coffee).\n");
 		
-		dasdfmt_prepare_and_format(info, cylinders, heads, p);
+		if (info->mode == DASDFMT_MODE_EXPAND)
+			dasdfmt_expand(info, cylinders, heads, p);
+		else if (info->mode == DASDFMT_MODE_QUICK)
+			dasdfmt_prepare_and_format(info, QUICK_CYLINDERS,
+						   heads, p);
+		else
+			dasdfmt_prepare_and_format(info, cylinders, heads, p);
 
-		printf("Finished formatting the device.\n");
+		if (info->progress_fd < 0)
+			printf("Finished formatting the device.\n");
 
-		if (!info->writenolabel) 
+		if (!info->writenolabel && info->mode != DASDFMT_MODE_EXPAND)
 			dasdfmt_write_labels(info, vlabel, cylinders, heads);
 
-		printf("Rereading the partition table... ");
+		if (info->progress_fd < 0)
+			printf("Rereading the partition table... ");
 		if (reread_partition_table()) {
-			ERRMSG("%s: error during rereading the partition "
-			       "table: %s.\n", prog_name, strerror(errno));
-		} else
+			ERRMSG("%s: %s: error during rereading the partition "
+			       "table: %s.\n", prog_name, info->devname,
+			       strerror(errno));
+		} else if (info->progress_fd < 0)
 			printf("ok\n");
 	}
 }
 
 
+/*
+ * format the device info->devname
+ */
+static void dasdfmt_format_device(dasdfmt_info_t *info, format_data_t *p,
+				  volume_label_t *vlabel)
+{
+	char old_volser[7];
+
+	if (info->keep_volser) {
+		if(dasdfmt_get_volser(info->devname, old_volser) == 0)
+			vtoc_volume_label_set_volser(vlabel, old_volser);
+		else
+			ERRMSG_EXIT(EXIT_FAILURE,"%s: VOLSER not found on device %s\n", 
+			       prog_name, info->devname);
+	}
+
+	if ((filedes = open(info->devname, O_RDWR)) == -1)
+		ERRMSG_EXIT(EXIT_FAILURE,"%s: Unable to open device %s: %s\n", 
+			    prog_name, info->devname, strerror(errno));
+
+	check_disk(info);
+
+	do_format_dasd(info, p, vlabel);
+
+	if (close(filedes) != 0)
+		ERRMSG("%s: error during close: %s\ncontinuing...\n", 
+		       prog_name, strerror(errno));
+}
+
+
+/*
+ * signal handler of the main process in multi-device mode:
+ * the signal is passed on to the formatting processes by the main loop
+ */
+static void parallel_interrupt(int sig)
+{
+	parallel_interrupt_signal = sig;
+}
+
+
+/*
+ * ask once for all devices in multi-device mode
+ */
+static void dasdfmt_confirm_devices(char *devices[], int count)
+{
+	char inp_buffer[5];
+	int i;
+
+	printf("\n--->> ATTENTION! <<---\n");
+	printf("All data of the following %d devices will be lost:\n", count);
+	for (i = 0; i < count; i++)
+		printf("   %s\n", devices[i]);
+	printf("Type \"yes\" to continue, no will leave the disks "
+	       "untouched: ");
+	if (fgets(inp_buffer, sizeof(inp_buffer), stdin) == NULL ||
+	    (strcasecmp(inp_buffer,"yes") &&
+	     strcasecmp(inp_buffer,"yes\n"))) {
+		printf("Omitting ioctl call (disks will NOT be formatted).\n");
+		exit(0);
+	}
+}
+
+
+/*
+ * print the overall progress in multi-device mode and the estimated time
+ * until all devices are formatted
+ */
+static void dasdfmt_print_parallel_progress(dasdfmt_info_t *info,
+					    struct dasdfmt_progress *progress,
+					    int count, int finished,
+					    struct timeval *start)
+{
+	static int last_percent = -1, last_finished = -1;
+	unsigned long long done = 0, total = 0;
+	unsigned int eta;
+	int i, known = 0, unknown = 0, percent;
+	double secs;
+
+	for (i = 0; i < count; i++) {
+		/* failed devices do not count */
+		if (progress[i].device_index < 0)
+			continue;
+		if (progress[i].cylinders == 0) {
+			unknown++;
+			continue;
+		}
+		done += progress[i].cyl;
+		total += progress[i].cylinders;
+		known++;
+	}
+	/* assume average size for devices which have not been started yet */
+	if (known > 0)
+		total += total / known * unknown;
+	percent = (total > 0) ? done * 100 / total : 0;
+	if (!info->print_progressbar && percent == last_percent &&
+	    finished == last_finished)
+		return;
+	last_percent = percent;
+	last_finished = finished;
+
+	printf("%d of %d devices finished |  %3d%%", finished, count,
+	       percent);
+	secs = dasdfmt_elapsed(start);
+	if (done > 0 && done < total) {
+		eta = secs * (total - done) / done;
+		printf(" | ETA %u:%02u:%02u", eta / 3600, eta / 60 % 60,
+		       eta % 60);
+	}
+	printf(info->print_progressbar ? "        \r" : "\n");
+	fflush(stdout);
+}
+
+
+/*
+ * format several devices with up to info->parallel formatting processes
+ * at a time, return the exit code of the program
+ */
+static int dasdfmt_format_parallel(dasdfmt_info_t *info, format_data_t *p,
+				   volume_label_t *vlabel, char *devices[],
+				   int count)
+{
+	struct dasdfmt_progress buffer[64], *progress;
+	struct timeval start;
+	struct pollfd pfd;
+	pid_t *pid, child;
+	int pipefd[2];
+	int started, running, finished, failed, forwarded, show;
+	int status, i, j, n;
+
+	progress = calloc(count, sizeof(struct dasdfmt_progress));
+	pid = calloc(count, sizeof(pid_t));
+	if (progress == NULL || pid == NULL)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: Out of memory\n", prog_name);
+	if (pipe(pipefd) != 0)
+		ERRMSG_EXIT(EXIT_FAILURE, "%s: Could not create pipe (%s)\n",
+			    prog_name, strerror(errno));
+
+	show = info->print_progressbar || info->print_hashmarks ||
+		info->print_percentage;
+	signal(SIGTERM, parallel_interrupt);
+	signal(SIGINT,  parallel_interrupt);
+	signal(SIGQUIT, parallel_interrupt);
+
+	gettimeofday(&start, NULL);
+	started = running = finished = failed = forwarded = 0;
+	while ((started < count && !parallel_interrupt_signal) ||
+	       running > 0) {
+		while (running < info->parallel && started < count &&
+		       !parallel_interrupt_signal) {
+			i = started++;
+			fflush(stdout);
+			pid[i] = fork();
+			if (pid[i] == 0) {
+				signal(SIGTERM, program_interrupt_signal);
+				signal(SIGINT,  program_interrupt_signal);
+				signal(SIGQUIT, program_interrupt_signal);
+				close(pipefd[0]);
+				setvbuf(stdout, NULL, _IOLBF, 0);
+				info->progress_fd = pipefd[1];
+				info->device_index = i;
+				info->print_progressbar = 0;
+				info->print_hashmarks = 0;
+				info->print_percentage = 0;
+				strncpy(info->devname, devices[i],
+					PATH_MAX - 1);
+				info->devname[PATH_MAX - 1] = '\0';
+				dasdfmt_format_device(info, p, vlabel);
+				exit(0);
+			}
+			if (pid[i] == -1) {
+				ERRMSG("%s: Could not start formatting device "
+				       "%s (%s)\n", prog_name, devices[i],
+				       strerror(errno));
+				pid[i] = 0;
+				progress[i].device_index = -1;
+				finished++;
+				failed++;
+				continue;
+			}
+			running++;
+		}
+
+		if (parallel_interrupt_signal && !forwarded) {
+			for (i = 0; i < started; i++)
+				if (pid[i] != 0)
+					kill(pid[i], parallel_interrupt_signal);
+			forwarded = 1;
+		}
+
+		pfd.fd = pipefd[0];
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1000) > 0 && (pfd.revents & POLLIN)) {
+			n = read(pipefd[0], buffer, sizeof(buffer));
+			for (j = 0; j < n / (int) sizeof(buffer[0]); j++) {
+				i = buffer[j].device_index;
+				/* ignore late reports of finished devices */
+				if (i >= 0 && i < started && pid[i] != 0)
+					progress[i] = buffer[j];
+			}
+		}
+
+		while ((child = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (i = 0; i < started && pid[i] != child; i++)
+				;
+			if (i == started)
+				continue;
+			pid[i] = 0;
+			running--;
+			finished++;
+			if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+				progress[i].cyl = progress[i].cylinders;
+			else {
+				progress[i].device_index = -1;
+				failed++;
+				ERRMSG("%s: Formatting device %s failed\n",
+				       prog_name, devices[i]);
+			}
+		}
+
+		if (show)
+			dasdfmt_print_parallel_progress(info, progress, count,
+							finished, &start);
+	}
+	if (show && info->print_progressbar)
+		printf("\n");
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+	free(progress);
+	free(pid);
+
+	if (parallel_interrupt_signal) {
+		signal(parallel_interrupt_signal, SIG_DFL);
+		raise(parallel_interrupt_signal);
+	}
+
+	printf("Finished formatting %d of %d devices.\n", count - failed,
+	       count);
+	return failed ? EXIT_FAILURE : 0;
+}
+
+
 int main(int argc,char *argv[]) 
 {
 	dasdfmt_info_t info;
 	volume_label_t vlabel;
-	char old_volser[7];
 
 	char dev_filename[PATH_MAX];
 	char str[ERR_LENGTH];
@@ -854,8 +1400,11 @@ int main(int argc,char *argv[])
 	char *devno_param_str   = NULL;
 	char *blksize_param_str = NULL;
 	char *hashstep_str      = NULL;
+	char *reqsize_str       = NULL;
+	char *parallel_str      = NULL;
+	char *mode_str          = NULL;
 
-	int rc, index;
+	int rc, index, count;
 
 	/* Establish a handler for interrupt signals. */
 	signal (SIGTERM, program_interrupt_signal);
@@ -988,6 +1537,15 @@ int main(int argc,char *argv[])
 		case 'k' :
 			info.keep_volser=1;
 			break;
+		case 'r' :
+			reqsize_str=optarg;
+			break;
+		case 'N' :
+			parallel_str=optarg;
+			break;
+		case 'M' :
+			mode_str=optarg;
+			break;
 		case -1:
 			/* End of options string - start of devices list */
 			info.device_id = optind;
@@ -1012,9 +1570,47 @@ int main(int argc,char *argv[])
 				 "blocksize");
 	if (info.print_hashmarks)
 		PARSE_PARAM_INTO(info.hashstep, hashstep_str,10,"hashstep");
+	if (reqsize_str) {
+		PARSE_PARAM_INTO(info.reqsize, reqsize_str, 10,
+				 "request size");
+		if ((info.reqsize < 1) || (info.reqsize > MAX_REQUESTSIZE))
+			ERRMSG_EXIT(EXIT_MISUSE, "%s: Request size must be "
+				    "in range <1,%d>\n", prog_name,
+				    MAX_REQUESTSIZE);
+	}
+	if (parallel_str) {
+		PARSE_PARAM_INTO(info.parallel, parallel_str, 10,
+				 "number of parallel devices");
+		if (info.parallel < 1)
+			ERRMSG_EXIT(EXIT_MISUSE, "%s: Number of parallel "
+				    "devices must be at least 1\n", prog_name);
+	}
+
+	if (mode_str) {
+		if (strcmp(mode_str, "full") == 0)
+			info.mode = DASDFMT_MODE_FULL;
+		else if (strcmp(mode_str, "quick") == 0)
+			info.mode = DASDFMT_MODE_QUICK;
+		else if (strcmp(mode_str, "expand") == 0)
+			info.mode = DASDFMT_MODE_EXPAND;
+		else
+			ERRMSG_EXIT(EXIT_MISUSE, "%s: Mode '%s' is not "
+				    "valid, use full, quick or expand\n",
+				    prog_name, mode_str);
+		if ((info.mode != DASDFMT_MODE_FULL) && info.writenolabel)
+			ERRMSG_EXIT(EXIT_MISUSE, "%s: Mode %s needs the disk "
+				    "label and cannot be used with -L\n",
+				    prog_name, mode_str);
+	}
 
 	get_device_name(&info, dev_filename, argc, argv);
 
+	/* more than one device node selects multi-device mode */
+	count = (info.device_id < argc) ? argc - info.device_id : 1;
+	if ((count > 1) && info.labelspec)
+		ERRMSG_EXIT(EXIT_MISUSE, "%s: A label can only be specified "
+			    "for a single device\n", prog_name);
+
         if (!info.blksize_specified)
                 format_params = ask_user_for_blksize(format_params);
 
@@ -1028,29 +1624,20 @@ int main(int argc,char *argv[])
 			       "when using the ldl format!\n");
 			exit(1);
 		}
-			
-		if(dasdfmt_get_volser(info.devname, old_volser) == 0)
-			vtoc_volume_label_set_volser(&vlabel, old_volser);
-		else
-			ERRMSG_EXIT(EXIT_FAILURE,"%s: VOLSER not found on device %s\n", 
-			       prog_name, info.devname);
-			
 	}
 
-	if ((filedes = open(info.devname, O_RDWR)) == -1)
-		ERRMSG_EXIT(EXIT_FAILURE,"%s: Unable to open device %s: %s\n", 
-			    prog_name, info.devname, strerror(errno));
-
-	check_disk(&info);
-
 	if (check_param(str, &format_params) < 0)
 		ERRMSG_EXIT(EXIT_MISUSE, "%s: %s\n", prog_name, str);
 
-	do_format_dasd(&info, &format_params, &vlabel);
+	if (count > 1) {
+		if (!info.testmode && !info.withoutprompt)
+			dasdfmt_confirm_devices(&argv[info.device_id], count);
+		info.withoutprompt = 1;
+		return dasdfmt_format_parallel(&info, &format_params, &vlabel,
+					       &argv[info.device_id], count);
+	}
 
-	if (close(filedes) != 0)
-		ERRMSG("%s: error during close: %s\ncontinuing...\n", 
-		       prog_name, strerror(errno));
+	dasdfmt_format_device(&info, &format_params, &vlabel);
 
 	return 0;
 }
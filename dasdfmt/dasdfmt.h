@@ -197,6 +197,14 @@ typedef struct format_data_t {
 #define ERR_LENGTH   80
 
 #define DEFAULT_BLOCKSIZE  4096
+#define DEFAULT_REQUESTSIZE 1
+#define MAX_REQUESTSIZE    1024
+#define QUICK_CYLINDERS    1
+#define SAMPLE_TRACKS      64
+
+#define DASDFMT_MODE_FULL   0
+#define DASDFMT_MODE_QUICK  1
+#define DASDFMT_MODE_EXPAND 2
 #define USABLE_PARTITIONS  ((1 << DASD_PARTN_BITS) - 1)
 
 #define ERRMSG(x...) {fflush(stdout);fprintf(stderr,x);}
@@ -211,7 +219,7 @@ typedef struct format_data_t {
 	if (*endptr) ERRMSG_EXIT(EXIT_MISUSE,"%s: " str " "    \
 	"is in invalid format\n",prog_name);}
 
-#define dasdfmt_getopt_string "b:n:l:f:d:m:hpPLtyvVFk"
+#define dasdfmt_getopt_string "b:n:l:f:d:m:r:hpPLtyvVFk"
 
 static struct option dasdfmt_getopt_long_options[]=
 {
@@ -230,6 +238,9 @@ static struct option dasdfmt_getopt_long_options[]=
         { "help",        0, 0, 'h'},
         { "keep_volser", 0, 0, 'k'},
         { "norecordzero",  0, 0, 'z'},
+        { "requestsize", 1, 0, 'r'},
+        { "parallel",    1, 0, 'N'},
+        { "mode",        1, 0, 'M'},
         {0, 0, 0, 0}
 };
 
@@ -262,8 +273,23 @@ typedef struct dasdfmt_info {
         int   devno_specified;
         int   device_id;
         int   keep_volser;
+        int   reqsize;
+        int   parallel;
+        int   progress_fd;
+        int   device_index;
+        int   mode;
 } dasdfmt_info_t;
 
+/*
+ * progress of one device in multi-device mode, sent from the process
+ * formatting the device to the main process
+ */
+struct dasdfmt_progress {
+	int          device_index;
+	unsigned int cyl;
+	unsigned int cylinders;
+};
+
 
 /*
 C9D7D3F1 000A0000 0000000F 03000000  00000001 00000000 00000000
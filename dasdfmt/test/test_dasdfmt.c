@@ -0,0 +1,416 @@
+/*
+ * test_dasdfmt - Test program for dasdfmt
+ *
+ * Runs dasdfmt on regular files with the DASD ioctls replaced by a mock
+ * implementation. The mock records all formatted tracks in memory which is
+ * shared with the formatting processes. Checks that every track of every
+ * device is formatted exactly once with single and multiple devices,
+ * different request sizes and a limited number of parallel devices. Also
+ * checks that the quick and expand modes only format the first cylinder
+ * or the added cylinders of a volume which is already formatted and that
+ * expand mode updates the size in the VTOC or volume label.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "vtoc.h"
+/* dasdfmt.h defines the bootstrap records, which are part of dasdfmt.o */
+#define ipl1 test_ipl1
+#define ipl2 test_ipl2
+#include "dasdfmt.h"
+
+#define VOLUMES		5
+#define HEADS		15
+#define SECTORS		12
+#define BLKSIZE		4096
+#define MAX_CYLINDERS	64
+
+int dasdfmt_main(int argc, char *argv[]);
+
+struct volume {
+	char name[32];
+	ino_t ino;
+	unsigned int cylinders;
+	unsigned int fail_track;	/* fail formatting this track */
+	int disabled;
+	int invalidated;
+	int revalidated;
+	unsigned int requests;
+	unsigned int max_request;
+	unsigned char count[MAX_CYLINDERS * HEADS];
+};
+
+struct mock_state {
+	struct volume volume[VOLUMES];
+	int disabled;		/* number of currently disabled volumes */
+	int max_disabled;
+};
+
+static struct mock_state *state;
+static const unsigned int cylinders[VOLUMES] = { 10, 23, 7, 50, 31 };
+
+
+static struct volume *find_volume(int fd)
+{
+	struct stat stats;
+	int i;
+
+	if (fstat(fd, &stats))
+		return NULL;
+	for (i = 0; i < VOLUMES; i++)
+		if (state->volume[i].ino == stats.st_ino)
+			return &state->volume[i];
+	return NULL;
+}
+
+
+static int mock_format(struct volume *v, format_data_t *data)
+{
+	unsigned int track;
+
+	if (data->start_unit > data->stop_unit ||
+	    data->stop_unit >= v->cylinders * HEADS ||
+	    data->blksize != BLKSIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (data->intensity & DASD_FMT_INT_INVAL) {
+		assert(data->start_unit == 0 && data->stop_unit == 0);
+		v->invalidated++;
+		return 0;
+	}
+	if (data->start_unit == 0 && data->stop_unit == 0) {
+		v->revalidated++;
+		return 0;
+	}
+	assert(v->disabled);
+	if (v->fail_track >= data->start_unit &&
+	    v->fail_track <= data->stop_unit) {
+		errno = EIO;
+		return -1;
+	}
+	for (track = data->start_unit; track <= data->stop_unit; track++)
+		v->count[track]++;
+	v->requests++;
+	if (data->stop_unit - data->start_unit + 1 > v->max_request)
+		v->max_request = data->stop_unit - data->start_unit + 1;
+	return 0;
+}
+
+
+/* Replaces the ioctl() of the C library for dasdfmt */
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct dasd_eckd_characteristics *characteristics;
+	dasd_information_t *dasd_info;
+	struct hd_geometry *geo;
+	struct volume *v;
+	va_list args;
+	void *arg;
+	int n;
+
+	va_start(args, request);
+	arg = va_arg(args, void *);
+	va_end(args);
+	v = find_volume(fd);
+	if (v == NULL) {
+		errno = ENOTTY;
+		return -1;
+	}
+	switch (request) {
+	case BLKROGET:
+		*(int *) arg = 0;
+		return 0;
+	case BLKSSZGET:
+		*(int *) arg = BLKSIZE;
+		return 0;
+	case BLKRRPART:
+		return 0;
+	case HDIO_GETGEO:
+		geo = arg;
+		memset(geo, 0, sizeof(*geo));
+		geo->heads = HEADS;
+		geo->sectors = SECTORS;
+		geo->cylinders = v->cylinders;
+		return 0;
+	case BIODASDINFO:
+		dasd_info = arg;
+		memset(dasd_info, 0, sizeof(*dasd_info));
+		dasd_info->devno = 0x100 + (v - state->volume);
+		dasd_info->open_count = 1;
+		dasd_info->label_block = 2;
+		memcpy(dasd_info->type, "ECKD", 4);
+		characteristics = (struct dasd_eckd_characteristics *)
+			&dasd_info->characteristics;
+		characteristics->no_cyl = v->cylinders;
+		characteristics->trk_per_cyl = HEADS;
+		return 0;
+	case BIODASDDISABLE:
+		assert(!v->disabled);
+		v->disabled = 1;
+		n = __sync_add_and_fetch(&state->disabled, 1);
+		while (n > state->max_disabled)
+			__sync_bool_compare_and_swap(&state->max_disabled,
+						     state->max_disabled, n);
+		/* keep the device busy so that devices overlap */
+		usleep(20000);
+		return 0;
+	case BIODASDENABLE:
+		assert(v->disabled);
+		v->disabled = 0;
+		__sync_sub_and_fetch(&state->disabled, 1);
+		return 0;
+	case BIODASDFMT:
+		return mock_format(v, arg);
+	}
+	errno = ENOTTY;
+	return -1;
+}
+
+
+static void init_volumes(void)
+{
+	struct stat stats;
+	int fd, i;
+
+	memset(state, 0, sizeof(*state));
+	for (i = 0; i < VOLUMES; i++) {
+		strcpy(state->volume[i].name, "/tmp/test_dasdfmt.XXXXXX");
+		fd = mkstemp(state->volume[i].name);
+		assert(fd != -1);
+		assert(fstat(fd, &stats) == 0);
+		close(fd);
+		state->volume[i].ino = stats.st_ino;
+		state->volume[i].cylinders = cylinders[i];
+		state->volume[i].fail_track = UINT_MAX;
+	}
+}
+
+
+/* Forget all formatted tracks of volume V */
+static void reset_volume(struct volume *v)
+{
+	v->invalidated = 0;
+	v->revalidated = 0;
+	v->requests = 0;
+	v->max_request = 0;
+	memset(v->count, 0, sizeof(v->count));
+}
+
+
+/* Make all tracks of the first CYLINDERS cylinders of volume V readable */
+static void set_formatted(struct volume *v, unsigned int cylinders)
+{
+	assert(truncate(v->name, (off_t) cylinders * HEADS * SECTORS *
+			BLKSIZE) == 0);
+}
+
+
+static void remove_volumes(void)
+{
+	int i;
+
+	for (i = 0; i < VOLUMES; i++)
+		unlink(state->volume[i].name);
+}
+
+
+/* Run dasdfmt with options OPTS on the first COUNT volumes, return the
+ * exit code */
+static int run_dasdfmt(const char *opts[], int count)
+{
+	char *argv[32];
+	int argc, status, fd, i;
+	pid_t pid;
+
+	argc = 0;
+	argv[argc++] = "dasdfmt";
+	for (i = 0; opts[i] != NULL; i++)
+		argv[argc++] = (char *) opts[i];
+	for (i = 0; i < count; i++)
+		argv[argc++] = state->volume[i].name;
+	argv[argc] = NULL;
+	fflush(stdout);
+	pid = fork();
+	assert(pid != -1);
+	if (pid == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		dup2(fd, STDOUT_FILENO);
+		optind = 0;
+		exit(dasdfmt_main(argc, argv));
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status));
+	return WEXITSTATUS(status);
+}
+
+
+/* Check that volume V was formatted completely in requests of up to
+ * REQSIZE cylinders */
+static void check_volume(struct volume *v, unsigned int reqsize)
+{
+	char label[4];
+	unsigned int track;
+	int fd;
+
+	assert(!v->disabled);
+	assert(v->invalidated == 1 && v->revalidated == 1);
+	assert(v->count[0] == 0);
+	for (track = 1; track < v->cylinders * HEADS; track++)
+		assert(v->count[track] == 1);
+	assert(v->max_request <= reqsize * HEADS);
+	assert(v->requests == (v->cylinders + reqsize - 1) / reqsize);
+	/* Volume label in EBCDIC */
+	fd = open(v->name, O_RDONLY);
+	assert(fd != -1);
+	assert(pread(fd, label, 4, 2 * BLKSIZE) == 4);
+	assert(memcmp(label, "\xe5\xd6\xd3\xf1", 4) == 0);
+	close(fd);
+}
+
+
+int main(void)
+{
+	const char *single[] = { "-y", "-b", "4096", NULL };
+	const char *parallel[] = { "-y", "-b", "4096", "-r", "4",
+				   "--parallel", "3", "-P", NULL };
+	const char *serial[] = { "-y", "-b", "4096", "--requestsize=1024",
+				 NULL };
+	const char *invalid[] = { "-y", "-b", "4096", "--parallel", "0",
+				  NULL };
+	const char *quick[] = { "-y", "-b", "4096", "--mode=quick", NULL };
+	const char *quick_2k[] = { "-y", "-b", "2048", "--mode=quick", NULL };
+	const char *expand[] = { "-y", "-b", "4096", "--mode=expand", NULL };
+	const char *ldl[] = { "-y", "-b", "4096", "-d", "ldl", NULL };
+	const char *expand_ldl[] = { "-y", "-b", "4096", "-d", "ldl",
+				     "--mode=expand", NULL };
+	struct volume *v;
+	volume_label_t vlabel;
+	format4_label_t f4;
+	unsigned int track;
+	int fd, i;
+
+	/* Only used by dasdfmt itself */
+	(void) dasdfmt_getopt_long_options;
+	state = mmap(NULL, sizeof(*state), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	assert(state != MAP_FAILED);
+
+	/* Single device, one cylinder per request */
+	init_volumes();
+	assert(run_dasdfmt(single, 1) == 0);
+	check_volume(&state->volume[0], 1);
+	assert(state->volume[1].requests == 0);
+	remove_volumes();
+
+	/* Several devices, three at a time */
+	init_volumes();
+	assert(run_dasdfmt(parallel, VOLUMES) == 0);
+	for (i = 0; i < VOLUMES; i++)
+		check_volume(&state->volume[i], 4);
+	assert(state->max_disabled > 1 && state->max_disabled <= 3);
+	remove_volumes();
+
+	/* Several devices, one at a time, each with a single request */
+	init_volumes();
+	assert(run_dasdfmt(serial, VOLUMES) == 0);
+	for (i = 0; i < VOLUMES; i++)
+		check_volume(&state->volume[i], MAX_REQUESTSIZE);
+	assert(state->max_disabled == 1);
+	remove_volumes();
+
+	/* One device fails, all others are formatted */
+	init_volumes();
+	state->volume[1].fail_track = 100;
+	assert(run_dasdfmt(parallel, VOLUMES) == EXIT_FAILURE);
+	for (i = 0; i < VOLUMES; i++)
+		if (i != 1)
+			check_volume(&state->volume[i], 4);
+	assert(state->volume[1].revalidated == 0);
+	remove_volumes();
+
+	/* Quick mode formats the first cylinder of a formatted volume */
+	init_volumes();
+	v = &state->volume[3];
+	assert(run_dasdfmt(quick, VOLUMES) == EXIT_FAILURE);
+	for (i = 0; i < VOLUMES; i++)
+		assert(state->volume[i].requests == 0);
+	assert(run_dasdfmt(single, VOLUMES) == 0);
+	for (i = 0; i < VOLUMES; i++) {
+		set_formatted(&state->volume[i], state->volume[i].cylinders);
+		reset_volume(&state->volume[i]);
+	}
+	assert(run_dasdfmt(quick_2k, VOLUMES) == EXIT_FAILURE);
+	assert(v->requests == 0);
+	assert(run_dasdfmt(quick, VOLUMES) == 0);
+	for (i = 0; i < VOLUMES; i++) {
+		v = &state->volume[i];
+		assert(v->requests == 1 && v->max_request == HEADS - 1);
+		assert(v->invalidated == 1 && v->revalidated == 1);
+		for (track = 1; track < v->cylinders * HEADS; track++)
+			assert(v->count[track] == (track < HEADS));
+	}
+	remove_volumes();
+
+	/* Expand mode formats the cylinders added to a volume */
+	init_volumes();
+	v = &state->volume[0];
+	v->cylinders = 20;
+	assert(run_dasdfmt(single, 1) == 0);
+	set_formatted(v, 20);
+	reset_volume(v);
+	assert(run_dasdfmt(expand, 1) == 0);
+	assert(v->requests == 0);
+	v->cylinders = 50;
+	assert(run_dasdfmt(expand, 1) == 0);
+	assert(v->invalidated == 0 && v->revalidated == 0);
+	assert(v->requests == 30);
+	for (track = 0; track < v->cylinders * HEADS; track++)
+		assert(v->count[track] == (track >= 20 * HEADS));
+	fd = open(v->name, O_RDONLY);
+	assert(fd != -1);
+	assert(pread(fd, &f4, sizeof(f4), (VTOC_START_CC * HEADS +
+		     VTOC_START_HH) * SECTORS * BLKSIZE) == sizeof(f4));
+	close(fd);
+	assert(f4.DS4IDFMT == 0xf4);
+	assert(f4.DS4DEVCT.DS4DSCYL == 50 && f4.DS4DCYL == 50);
+	/* The updated size is used by the next expansion */
+	set_formatted(v, 50);
+	reset_volume(v);
+	assert(run_dasdfmt(expand, 1) == 0);
+	assert(v->requests == 0);
+	remove_volumes();
+
+	/* Expand mode updates the size in the ldl volume label */
+	init_volumes();
+	v = &state->volume[0];
+	v->cylinders = 20;
+	assert(run_dasdfmt(ldl, 1) == 0);
+	set_formatted(v, 20);
+	reset_volume(v);
+	assert(run_dasdfmt(expand, 1) == EXIT_FAILURE);
+	v->cylinders = 25;
+	assert(run_dasdfmt(expand_ldl, 1) == 0);
+	assert(v->requests == 5 && v->count[20 * HEADS] == 1);
+	assert(v->count[20 * HEADS - 1] == 0);
+	fd = open(v->name, O_RDONLY);
+	assert(fd != -1);
+	assert(pread(fd, (char *) &vlabel + 4, sizeof(vlabel) - 4,
+		     2 * BLKSIZE) == sizeof(vlabel) - 4);
+	close(fd);
+	assert(vlabel.formatted_blocks == 25 * HEADS * SECTORS);
+	remove_volumes();
+
+	/* Invalid parameters */
+	init_volumes();
+	assert(run_dasdfmt(invalid, VOLUMES) == EXIT_MISUSE);
+	for (i = 0; i < VOLUMES; i++)
+		assert(state->volume[i].requests == 0);
+	remove_volumes();
+	return 0;
+}
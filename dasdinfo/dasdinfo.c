@@ -17,7 +17,6 @@
 #include <unistd.h>
 #include <errno.h>
 #include <dirent.h>
-#include <ftw.h>
 #include <sys/utsname.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -31,15 +30,22 @@
 #define BIODASDINFO  _IOR(DASD_IOCTL_LETTER,1,struct dasd_information)
 #define BIODASDINFO2 _IOR(DASD_IOCTL_LETTER,3,struct dasd_information2)
 #define TEMP_DEV_MAX_RETRIES    1000
+#define SYSFS_ROOT "/sys"
 
 #define MAX(x,y) ((x)<(y)?(y):(x))
 
 static const char tool_name[] = "dasdinfo: zSeries DASD information program";
 static const char copyright_notice[] = "Copyright IBM Corp. 2007";
 
-/* needed because ftw can not pass arbitrary arguments */
-static char *searchbusid;
-static char *busiddir;
+/* sysfs mount point, can be changed with SYSFS_PATH for testing */
+static const char *sysfs_root = SYSFS_ROOT;
+
+struct dinfo_options {
+	int print_uid;
+	int print_extended_uid;
+	int print_vlabel;
+	int export;
+};
 
 struct volume_label {
 	char volkey[4];
@@ -119,6 +125,7 @@ static void dinfo_print_usage(char *cmd)
 	       "\n"
 	       "Usage: %s [-a] [-u] [-x] [-l] [-e]\n"
 	       "                {-i <busid> | -b <blockdev> | -d <devnode>}\n"
+	       "       %s [-a] [-u] [-x] [-l] -A\n"
 	       "       %s [-h] [-v]\n"
 	       "\n"
 	       "where:\n"
@@ -138,13 +145,15 @@ static void dinfo_print_usage(char *cmd)
 	       "             device node, e.g. /dev/dasda\n"
 	       "    -e|--export\n"
 	       "             print all values (ID_BUS, ID_TYPE, ID_SERIAL)\n"
+	       "    -A|--all-devices\n"
+	       "             print the values of all DASDs, implies -e\n"
 	       "    -h|--help\n"
 	       "             prints this usage text\n"
 	       "    -v|--version\n"
 	       "             prints the version number\n"
 	       "\n"
 	       "Example: %s -u -b dasda\n",
-	       cmd,cmd,cmd);
+	       cmd,cmd,cmd,cmd);
 }
 
 static char EBCtoASC[256] =
@@ -233,6 +242,7 @@ static int dinfo_read_dasd_uid (char *uidfile, char *readbuf, int readbuflen)
 	if ((dasduid = fopen(uidfile,"r")) == NULL)
 		return -1;
 
+	readbuf[0] = '\0';
 	while (fgets(readbuf + offset, READCHUNK, dasduid)  &&
 	       readbuf[strlen(readbuf)-1] != '\n' ) {
 		offset += READCHUNK-1;
@@ -430,17 +440,17 @@ static int dinfo_get_dev_from_blockdev(char *blockdev, dev_t *dev)
 	char *readbuf = NULL;
 	int readbuflen = READCHUNK;
 
-	if ((devfile = dinfo_malloc(readbuflen)) == NULL)
+	if (asprintf(&devfile, "%s/block/%s/dev", sysfs_root, blockdev) < 0)
 		return -1;
 
-	sprintf(devfile,"/sys/block/%s/dev", blockdev);
-
 	if ((readbuf = dinfo_malloc(readbuflen)) == NULL) {
 		printf("Error: Not enough memory to allocate readbuffer\n");
 		return -1;
 	}
 
-	if ((dasddev = fopen(devfile,"r")) == NULL)
+	dasddev = fopen(devfile,"r");
+	free(devfile);
+	if (dasddev == NULL)
 		return -1;
 
 	while (fgets(readbuf + offset, READCHUNK, dasddev)  &&
@@ -460,38 +470,6 @@ static int dinfo_get_dev_from_blockdev(char *blockdev, dev_t *dev)
 	return 0;
 }
 
-static int
-dinfo_is_busiddir(const char *fpath, const struct stat *sb,
-		  int tflag, struct FTW *ftwbuf)
-{
-	char *tempdir;
-	char linkdir[128];
-	ssize_t i;
-	if (tflag != FTW_D || (strncmp((fpath + ftwbuf->base), searchbusid,
-				       strlen(searchbusid)) != 0))
-		return FTW_CONTINUE;
-	/*
-	 * ensure that the found entry is a busid and not a
-	 * subchannel ID
-	 * for large systems subchannel IDs may look like busids
-	 */
-	if (asprintf(&tempdir, "%s/driver", fpath) < 0)
-		return -1;
-	i = readlink(tempdir, linkdir, 128);
-	free(tempdir);
-	if ((i < 0) || (i >= 128))
-		return -1;
-	/* append '\0' because readlink returns non zero terminated string */
-	tempdir[i+1] = '\0';
-	if (strstr(linkdir, "dasd") == NULL)
-		return FTW_CONTINUE;
-	free(busiddir);
-	busiddir = strdup(fpath);
-	if (busiddir == NULL)
-		return -1;
-	return FTW_STOP;
-}
-
 static int
 dinfo_find_entry(const char *dir, const char *searchstring,
 		 char type, char **result)
@@ -522,16 +500,32 @@ out:
 static int
 dinfo_get_blockdev_from_busid(char *busid, char **blkdev)
 {
-	int flags = FTW_PHYS; /* do not follow links */
 	int rc = -1;
 
+	char *busiddir = NULL;
 	char *tempdir = NULL;
 	char *result = NULL;
-	char *sysfsdir = "/sys/devices/";
+	char linkdir[128];
+	ssize_t i;
+
+	/* the ccw bus lists each device by its busid */
+	if (asprintf(&busiddir, "%s/bus/ccw/devices/%s", sysfs_root,
+		     busid) < 0)
+		return -1;
 
-	/* dinfo_is_devnode needs to know the busid */
-	searchbusid = busid;
-	if (nftw(sysfsdir, dinfo_is_busiddir, 200, flags) != FTW_STOP)
+	/* ensure that the device is bound to a DASD driver */
+	if (asprintf(&tempdir, "%s/driver", busiddir) < 0) {
+		tempdir = NULL;
+		goto out;
+	}
+	i = readlink(tempdir, linkdir, sizeof(linkdir) - 1);
+	free(tempdir);
+	tempdir = NULL;
+	if (i < 0)
+		goto out;
+	/* append '\0' because readlink returns non zero terminated string */
+	linkdir[i] = '\0';
+	if (strstr(linkdir, "dasd") == NULL)
 		goto out;
 
 	/*
@@ -541,8 +535,9 @@ dinfo_get_blockdev_from_busid(char *busid, char **blkdev)
 	rc = dinfo_find_entry(busiddir, "block", DT_DIR, &result);
 	if (rc == 0) {
 		if (asprintf(&tempdir, "%s/%s/", busiddir, result) < 0) {
+			tempdir = NULL;
 			rc = -1;
-			goto out2;
+			goto out;
 		}
 		rc = dinfo_find_entry(tempdir, "dasd", DT_DIR, blkdev);
 	} else {
@@ -552,7 +547,7 @@ dinfo_get_blockdev_from_busid(char *busid, char **blkdev)
 		 */
 		rc = dinfo_find_entry(busiddir, "block:", DT_LNK, &result);
 		if (rc != 0)
-			goto out2;
+			goto out;
 		*blkdev = strdup(strchr(result, ':') + 1);
 		if (*blkdev == NULL)
 			rc = -1;
@@ -560,7 +555,6 @@ dinfo_get_blockdev_from_busid(char *busid, char **blkdev)
 
 out:
 	free(tempdir);
-out2:
 	free(busiddir);
 	free(result);
 	return rc;
@@ -570,13 +564,14 @@ static int dinfo_get_uid_from_devnode(char **uidfile, char *devnode)
 {
 	struct stat stat_buffer;
 	char stat_dev[READCHUNK];
-	char sys_dev_path[READCHUNK];
+	char *sys_dev_path;
 	char *readbuf;
 	DIR *directory = NULL;
 	struct dirent *dir_entry = NULL;
 	FILE *block_dev;
 	int readbuflen = READCHUNK;
 	int offset;
+	int rc;
 
 	if (stat(devnode, &stat_buffer) != 0) {
 		printf("Error: could not stat %s\n", devnode);
@@ -586,10 +581,31 @@ static int dinfo_get_uid_from_devnode(char **uidfile, char *devnode)
 	sprintf(stat_dev, "%d:%d", major(stat_buffer.st_rdev),
 		minor(stat_buffer.st_rdev));
 
-	if ((directory = opendir("/sys/block/")) == NULL) {
-		printf("Error: could not open directory /sys/block\n");
+	/* newer kernels provide a link for each block device number */
+	if (asprintf(&sys_dev_path, "%s/dev/block/%s", sysfs_root,
+		     stat_dev) < 0)
+		return -1;
+	rc = stat(sys_dev_path, &stat_buffer);
+	free(sys_dev_path);
+	if (rc == 0) {
+		free(*uidfile);
+		if (asprintf(uidfile, "%s/dev/block/%s/device/uid",
+			     sysfs_root, stat_dev) < 0) {
+			*uidfile = NULL;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (asprintf(&sys_dev_path, "%s/block", sysfs_root) < 0)
+		return -1;
+	directory = opendir(sys_dev_path);
+	if (directory == NULL) {
+		printf("Error: could not open directory %s\n", sys_dev_path);
+		free(sys_dev_path);
 		return -1;
 	}
+	free(sys_dev_path);
 
 	if ((readbuf = dinfo_malloc(readbuflen)) == NULL) {
 		printf("Error: Not enough memory to allocate readbuffer\n");
@@ -597,9 +613,12 @@ static int dinfo_get_uid_from_devnode(char **uidfile, char *devnode)
 	}
 
 	while ((dir_entry = readdir(directory)) != NULL) {
-		sprintf(sys_dev_path, "/sys/block/%s/dev", dir_entry->d_name);
-
-		if ((block_dev = fopen(sys_dev_path,"r")) == NULL)
+		if (asprintf(&sys_dev_path, "%s/block/%s/dev", sysfs_root,
+			     dir_entry->d_name) < 0)
+			break;
+		block_dev = fopen(sys_dev_path,"r");
+		free(sys_dev_path);
+		if (block_dev == NULL)
 			continue;
 
 		offset = 0;
@@ -616,8 +635,10 @@ static int dinfo_get_uid_from_devnode(char **uidfile, char *devnode)
 
 		if (strncmp(stat_dev, readbuf,
 			    MAX(strlen(stat_dev), strlen(readbuf)-1)) == 0) {
-			sprintf(*uidfile,"/sys/block/%s/device/uid",
-				dir_entry->d_name);
+			free(*uidfile);
+			if (asprintf(uidfile, "%s/block/%s/device/uid",
+				     sysfs_root, dir_entry->d_name) < 0)
+				*uidfile = NULL;
 			break;
 		}
 	}
@@ -626,134 +647,47 @@ static int dinfo_get_uid_from_devnode(char **uidfile, char *devnode)
 	return 0;
 }
 
-int main(int argc, char * argv[])
+/*
+ * prints the information selected by OPTS for the DASD given by either
+ * BUSID, BLOCKDEV or DEVNODE
+ */
+static void dinfo_print_dasd(struct dinfo_options *opts, char *busid,
+			     char *blockdev, char *devnode)
 {
-	struct utsname uname_buf;
-	int version, release;
 	char *uidfile = NULL;
 	char *device = NULL;
 	char *readbuf = NULL;
 	int readbuflen = READCHUNK;
 	dev_t dev;
-	int export = 0;
-	int c;
-	int print_uid = 0;
-	int print_extended_uid = 0;
-	int print_vlabel = 0;
-	char *blockdev = NULL;
-	char *busid = NULL;
-	char *devnode = NULL;
 	struct volume_label vlabel;
 	char *srchuid;
 	int i;
 
-	while (1) {
-		int option_index = 0;
-		static struct option long_options[] = {
-			{"all",          0, 0, 'a'},
-			{"uid",          0, 0, 'u'},
-			{"extended-uid", 0, 0, 'x'},
-			{"label",        0, 0, 'l'},
-			{"busid",        1, 0, 'i'},
-			{"block",        1, 0, 'b'},
-			{"devnode",      1, 0, 'd'},
-			{"export",       0, 0, 'e'},
-			{"help",         0, 0, 'h'},
-			{"version",      0, 0, 'v'},
-			{0, 0, 0, 0}
-		};
-
-		c = getopt_long (argc, argv, "vhaeuxlb:i:d:",
-				 long_options, &option_index);
-		if (c == -1)
-			break;
-
-		switch (c) {
-		case 'a':
-			print_uid = 1;
-			print_vlabel = 1;
-			print_extended_uid = 1;
-			break;
-		case 'u':
-			print_uid = 1;
-			break;
-		case 'x':
-			print_extended_uid = 1;
-			break;
-		case 'l':
-			print_vlabel = 1;
-			break;
-		case 'i':
-			busid=strdup(optarg);
-			break;
-		case 'b':
-			blockdev=strdup(optarg);
-			break;
-		case 'd':
-			devnode=strdup(optarg);
-			break;
-		case 'e':
-			export = 1;
-			break;
-		case 'h':
-			dinfo_print_usage(argv[0]);
-			exit(0);
-		case 'v':
-			dinfo_print_version();
-			exit(0);
-		default:
-			fprintf(stderr, "Try 'dasdinfo --help' for more "
-				"information.\n");
-			exit(1);
-		}
-	}
-
-	uname(&uname_buf);
-	sscanf(uname_buf.release, "%d.%d", &version,&release);
-	if (strcmp(uname_buf.sysname,"Linux") ||
-	    version < 2 || release < 6) {
-		printf("%s %d.%d is not supported\n", uname_buf.sysname,
-			version,release);
-		return -1;
-	}
-
-	if (!busid && !blockdev && !devnode) {
-		printf("Error: please specify a device using either -b, -i "
-		       "or -d\n");
-		return -1;
-	}
-
-	if ((busid && blockdev) || (busid && devnode) || (blockdev && devnode)) {
-		printf("Error: please specify device only once,  either -b, -i "
-		       "or -d\n");
-		return -1;
-	}
-
-	if (!print_uid && !print_extended_uid && !print_vlabel) {
-		printf("Error: no action specified (e.g. -u)\n");
-		return -1;
-	}
-
-	if (((readbuf = dinfo_malloc(readbuflen)) == NULL) ||
-	    ((uidfile = dinfo_malloc(readbuflen)) == NULL))
-		return -1;
+	if ((readbuf = dinfo_malloc(readbuflen)) == NULL)
+		return;
 
 	/* try to read the uid attribute */
 	if (busid) {
-		sprintf(uidfile,"/sys/bus/ccw/devices/%s/uid", busid);
+		if (asprintf(&uidfile, "%s/bus/ccw/devices/%s/uid",
+			     sysfs_root, busid) < 0)
+			uidfile = NULL;
 	} else if (blockdev) {
-		sprintf(uidfile,"/sys/block/%s/device/uid", blockdev);
+		if (asprintf(&uidfile, "%s/block/%s/device/uid",
+			     sysfs_root, blockdev) < 0)
+			uidfile = NULL;
 	} else if (devnode) {
 		if (dinfo_get_uid_from_devnode(&uidfile, devnode) != 0)
 			goto error;
 	}
+	if (uidfile == NULL)
+		goto error;
 
-	if (export) {
+	if (opts->export) {
 		printf("ID_BUS=ccw\n");
 		printf("ID_TYPE=disk\n");
 	}
 
-	if (print_uid) {
+	if (opts->print_uid) {
 		if (dinfo_read_dasd_uid(uidfile, readbuf, readbuflen) == 0) {
 			/* look for the 4th '.' and cut there */
 			srchuid = readbuf - 1;
@@ -766,22 +700,22 @@ int main(int argc, char * argv[])
 				srchuid[0] = '\n';
 				srchuid[1] = 0;
 			}
-			if (export) {
+			if (opts->export) {
 				printf("ID_UID=%s",readbuf);
 			} else
 				printf("%s",readbuf);
-			if (!print_vlabel && !print_extended_uid)
+			if (!opts->print_vlabel && !opts->print_extended_uid)
 				goto out;
 		}
 	}
 
-	if (print_extended_uid) {
+	if (opts->print_extended_uid) {
 		if (dinfo_read_dasd_uid(uidfile, readbuf, readbuflen) == 0) {
-			if (export) {
+			if (opts->export) {
 				printf("ID_XUID=%s",readbuf);
 			} else
 				printf("%s",readbuf);
-			if (!print_vlabel)
+			if (!opts->print_vlabel)
 				goto out;
 		}
 	}
@@ -810,12 +744,12 @@ int main(int argc, char * argv[])
 
 	} else if (devnode) {
 		if ((device = dinfo_malloc(readbuflen)) == NULL)
-		    return -1;
+			goto out;
 		strcpy(device, devnode);
 	}
 
 	if (dinfo_read_dasd_vlabel(device, &vlabel, readbuf) == 0) {
-		if (export) {
+		if (opts->export) {
 			printf("ID_SERIAL=%s\n",readbuf);
 		} else
 			printf("%s\n", readbuf);
@@ -823,7 +757,11 @@ int main(int argc, char * argv[])
 	}
 
 error:
-	printf("Error: could not read unique DASD ID\n");
+	/* keep the udev properties free of error messages */
+	if (opts->export)
+		fprintf(stderr, "Error: could not read unique DASD ID\n");
+	else
+		printf("Error: could not read unique DASD ID\n");
 
 out:
 	if (device && (busid || blockdev))
@@ -832,6 +770,173 @@ out:
 	free(uidfile);
 	free(device);
 	free(readbuf);
+}
+
+/*
+ * prints the information selected by OPTS for all DASDs which have a
+ * block device, one record per DASD in the order of their bus IDs
+ */
+static int dinfo_print_all(struct dinfo_options *opts)
+{
+	struct dirent **namelist;
+	char *busdir;
+	char *blockdev;
+	int i, n;
+
+	if (asprintf(&busdir, "%s/bus/ccw/devices", sysfs_root) < 0)
+		return -1;
+	n = scandir(busdir, &namelist, NULL, alphasort);
+	if (n < 0) {
+		printf("Error: could not open directory %s\n", busdir);
+		free(busdir);
+		return -1;
+	}
+	free(busdir);
+
+	for (i = 0; i < n; i++) {
+		blockdev = NULL;
+		/* skip devices of other drivers and offline DASDs */
+		if ((namelist[i]->d_name[0] != '.') &&
+		    (dinfo_get_blockdev_from_busid(namelist[i]->d_name,
+						   &blockdev) == 0)) {
+			printf("ID_PATH=ccw-%s\n", namelist[i]->d_name);
+			printf("DEVNAME=/dev/%s\n", blockdev);
+			dinfo_print_dasd(opts, NULL, blockdev, NULL);
+			printf("\n");
+		}
+		free(blockdev);
+		free(namelist[i]);
+	}
+	free(namelist);
+
+	return 0;
+}
+
+int main(int argc, char * argv[])
+{
+	struct utsname uname_buf;
+	struct dinfo_options opts;
+	int version, release;
+	int all_devices = 0;
+	int c;
+	char *blockdev = NULL;
+	char *busid = NULL;
+	char *devnode = NULL;
+
+	memset(&opts, 0, sizeof(opts));
+
+	while (1) {
+		int option_index = 0;
+		static struct option long_options[] = {
+			{"all",          0, 0, 'a'},
+			{"uid",          0, 0, 'u'},
+			{"extended-uid", 0, 0, 'x'},
+			{"label",        0, 0, 'l'},
+			{"busid",        1, 0, 'i'},
+			{"block",        1, 0, 'b'},
+			{"devnode",      1, 0, 'd'},
+			{"export",       0, 0, 'e'},
+			{"all-devices",  0, 0, 'A'},
+			{"help",         0, 0, 'h'},
+			{"version",      0, 0, 'v'},
+			{0, 0, 0, 0}
+		};
+
+		c = getopt_long (argc, argv, "vhaeuxlAb:i:d:",
+				 long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'a':
+			opts.print_uid = 1;
+			opts.print_vlabel = 1;
+			opts.print_extended_uid = 1;
+			break;
+		case 'u':
+			opts.print_uid = 1;
+			break;
+		case 'x':
+			opts.print_extended_uid = 1;
+			break;
+		case 'l':
+			opts.print_vlabel = 1;
+			break;
+		case 'i':
+			busid=strdup(optarg);
+			break;
+		case 'b':
+			blockdev=strdup(optarg);
+			break;
+		case 'd':
+			devnode=strdup(optarg);
+			break;
+		case 'e':
+			opts.export = 1;
+			break;
+		case 'A':
+			all_devices = 1;
+			break;
+		case 'h':
+			dinfo_print_usage(argv[0]);
+			exit(0);
+		case 'v':
+			dinfo_print_version();
+			exit(0);
+		default:
+			fprintf(stderr, "Try 'dasdinfo --help' for more "
+				"information.\n");
+			exit(1);
+		}
+	}
+
+	uname(&uname_buf);
+	sscanf(uname_buf.release, "%d.%d", &version,&release);
+	if (strcmp(uname_buf.sysname,"Linux") ||
+	    version < 2 || (version == 2 && release < 6)) {
+		printf("%s %d.%d is not supported\n", uname_buf.sysname,
+			version,release);
+		return -1;
+	}
+
+	if (getenv("SYSFS_PATH"))
+		sysfs_root = getenv("SYSFS_PATH");
+
+	if (all_devices) {
+		if (busid || blockdev || devnode) {
+			printf("Error: -A can not be used with -b, -i "
+			       "or -d\n");
+			return -1;
+		}
+		/* udev imports all values of all DASDs */
+		if (!opts.print_uid && !opts.print_extended_uid &&
+		    !opts.print_vlabel) {
+			opts.print_uid = 1;
+			opts.print_vlabel = 1;
+			opts.print_extended_uid = 1;
+		}
+		opts.export = 1;
+		return dinfo_print_all(&opts);
+	}
+
+	if (!busid && !blockdev && !devnode) {
+		printf("Error: please specify a device using either -b, -i "
+		       "or -d\n");
+		return -1;
+	}
+
+	if ((busid && blockdev) || (busid && devnode) || (blockdev && devnode)) {
+		printf("Error: please specify device only once,  either -b, -i "
+		       "or -d\n");
+		return -1;
+	}
+
+	if (!opts.print_uid && !opts.print_extended_uid && !opts.print_vlabel) {
+		printf("Error: no action specified (e.g. -u)\n");
+		return -1;
+	}
+
+	dinfo_print_dasd(&opts, busid, blockdev, devnode);
 
 	return 0;
 }
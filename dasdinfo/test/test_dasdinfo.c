@@ -0,0 +1,218 @@
+/*
+ * test_dasdinfo - Test program for dasdinfo
+ *
+ * Builds a fake sysfs tree with two online DASDs, an offline DASD and a
+ * device of another driver and runs dasdinfo on it through SYSFS_PATH.
+ * Checks that the uids are found by bus ID, block device and device node,
+ * also without /sys/dev, and that -A prints one record for each online
+ * DASD only and no error messages to the records.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OUTPUT_SIZE	4096
+
+#define UID_0100	"IBM.75000000092461.e900.10"
+#define XUID_0101	"IBM.75000000092461.e900.11.00000000000037400000000000000000"
+#define UID_0101	"IBM.75000000092461.e900.11"
+
+
+static char root[] = "/tmp/test_dasdinfo.XXXXXX";
+static char devnode_dev[32];
+
+
+static void
+make_dir(const char *path)
+{
+	char name[PATH_MAX];
+
+	snprintf(name, sizeof(name), "%s/%s", root, path);
+	assert(mkdir(name, 0755) == 0);
+}
+
+
+static void
+make_file(const char *path, const char *content)
+{
+	char name[PATH_MAX];
+	FILE *file;
+
+	snprintf(name, sizeof(name), "%s/%s", root, path);
+	file = fopen(name, "w");
+	assert(file);
+	fputs(content, file);
+	assert(fclose(file) == 0);
+}
+
+
+static void
+make_link(const char *target, const char *path)
+{
+	char name[PATH_MAX];
+
+	snprintf(name, sizeof(name), "%s/%s", root, path);
+	assert(symlink(target, name) == 0);
+}
+
+
+/* Create the sysfs directories of ccw device BUSID bound to DRIVER */
+static void
+make_ccw_device(const char *busid, const char *driver)
+{
+	char path[PATH_MAX];
+	char target[PATH_MAX];
+
+	snprintf(path, sizeof(path), "devices/css0/%s", busid);
+	make_dir(path);
+	snprintf(path, sizeof(path), "devices/css0/%s/driver", busid);
+	snprintf(target, sizeof(target), "../../../bus/ccw/drivers/%s",
+		 driver);
+	make_link(target, path);
+	snprintf(path, sizeof(path), "bus/ccw/devices/%s", busid);
+	snprintf(target, sizeof(target), "../../../devices/css0/%s", busid);
+	make_link(target, path);
+}
+
+
+/* Add block device BLOCKDEV with number DEV and UID to DASD BUSID */
+static void
+make_block_device(const char *busid, const char *blockdev, const char *dev,
+		  const char *uid)
+{
+	char path[PATH_MAX];
+	char target[PATH_MAX];
+
+	snprintf(path, sizeof(path), "devices/css0/%s/uid", busid);
+	make_file(path, uid);
+	snprintf(path, sizeof(path), "devices/css0/%s/block", busid);
+	make_dir(path);
+	snprintf(path, sizeof(path), "devices/css0/%s/block/%s", busid,
+		 blockdev);
+	make_dir(path);
+	snprintf(path, sizeof(path), "devices/css0/%s/block/%s/dev", busid,
+		 blockdev);
+	make_file(path, dev);
+	snprintf(path, sizeof(path), "devices/css0/%s/block/%s/device", busid,
+		 blockdev);
+	make_link("../..", path);
+	snprintf(path, sizeof(path), "block/%s", blockdev);
+	snprintf(target, sizeof(target), "../devices/css0/%s/block/%s", busid,
+		 blockdev);
+	make_link(target, path);
+	snprintf(path, sizeof(path), "dev/block/%.*s", (int) strlen(dev) - 1,
+		 dev);
+	snprintf(target, sizeof(target), "../../devices/css0/%s/block/%s",
+		 busid, blockdev);
+	make_link(target, path);
+}
+
+
+static void
+make_sysfs(void)
+{
+	struct stat stats;
+
+	assert(mkdtemp(root));
+	make_dir("bus");
+	make_dir("bus/ccw");
+	make_dir("bus/ccw/devices");
+	make_dir("block");
+	make_dir("dev");
+	make_dir("dev/block");
+	make_dir("devices");
+	make_dir("devices/css0");
+
+	/* /dev/null serves as device node of the second DASD */
+	assert(stat("/dev/null", &stats) == 0);
+	snprintf(devnode_dev, sizeof(devnode_dev), "%u:%u\n",
+		 major(stats.st_rdev), minor(stats.st_rdev));
+
+	make_ccw_device("0.0.0100", "dasd-eckd");
+	make_block_device("0.0.0100", "dasda", "94:0\n", UID_0100 "\n");
+	make_ccw_device("0.0.0101", "dasd-eckd");
+	make_block_device("0.0.0101", "dasdb", devnode_dev, XUID_0101 "\n");
+	make_ccw_device("0.0.0102", "dasd-fba");
+	make_ccw_device("0.0.0200", "ctcm");
+}
+
+
+/* Run dasdinfo with ARGS and check that it prints EXPECTED */
+static void
+check(const char *args, const char *expected)
+{
+	char command[PATH_MAX];
+	char output[OUTPUT_SIZE];
+	size_t size;
+	FILE *pipe;
+
+	snprintf(command, sizeof(command), "SYSFS_PATH=%s ../dasdinfo %s",
+		 root, args);
+	pipe = popen(command, "r");
+	assert(pipe);
+	size = fread(output, 1, sizeof(output) - 1, pipe);
+	output[size] = 0;
+	assert(pclose(pipe) == 0);
+	if (strcmp(output, expected) != 0) {
+		fprintf(stderr, "dasdinfo %s:\n%s\nexpected:\n%s\n", args,
+			output, expected);
+		exit(1);
+	}
+}
+
+
+int
+main(void)
+{
+	char command[PATH_MAX];
+
+	make_sysfs();
+
+	check("-u -i 0.0.0100", UID_0100 "\n");
+	check("-u -b dasdb", UID_0101 "\n");
+	check("-x -b dasdb", XUID_0101 "\n");
+	check("-u -x -e -d /dev/null",
+	      "ID_BUS=ccw\nID_TYPE=disk\n"
+	      "ID_UID=" UID_0101 "\nID_XUID=" XUID_0101 "\n");
+
+	/* all online DASDs ordered by bus ID */
+	check("-u -x -A",
+	      "ID_PATH=ccw-0.0.0100\nDEVNAME=/dev/dasda\n"
+	      "ID_BUS=ccw\nID_TYPE=disk\n"
+	      "ID_UID=" UID_0100 "\nID_XUID=" UID_0100 "\n\n"
+	      "ID_PATH=ccw-0.0.0101\nDEVNAME=/dev/dasdb\n"
+	      "ID_BUS=ccw\nID_TYPE=disk\n"
+	      "ID_UID=" UID_0101 "\nID_XUID=" XUID_0101 "\n\n");
+	check("-u --all-devices",
+	      "ID_PATH=ccw-0.0.0100\nDEVNAME=/dev/dasda\n"
+	      "ID_BUS=ccw\nID_TYPE=disk\nID_UID=" UID_0100 "\n\n"
+	      "ID_PATH=ccw-0.0.0101\nDEVNAME=/dev/dasdb\n"
+	      "ID_BUS=ccw\nID_TYPE=disk\nID_UID=" UID_0101 "\n\n");
+
+	/* without /sys/dev the device number is searched in /sys/block */
+	snprintf(command, sizeof(command), "rm -rf %s/dev", root);
+	assert(system(command) == 0);
+	check("-u -d /dev/null", UID_0101 "\n");
+
+	/* a DASD without uid and device number gets an empty record */
+	snprintf(command, sizeof(command), "rm %s/devices/css0/0.0.0100/uid "
+		 "%s/devices/css0/0.0.0100/block/dasda/dev", root, root);
+	assert(system(command) == 0);
+	check("-u -A 2>/dev/null",
+	      "ID_PATH=ccw-0.0.0100\nDEVNAME=/dev/dasda\n"
+	      "ID_BUS=ccw\nID_TYPE=disk\n\n"
+	      "ID_PATH=ccw-0.0.0101\nDEVNAME=/dev/dasdb\n"
+	      "ID_BUS=ccw\nID_TYPE=disk\nID_UID=" UID_0101 "\n\n");
+
+	snprintf(command, sizeof(command), "rm -rf %s", root);
+	assert(system(command) == 0);
+	return 0;
+}
@@ -610,10 +610,11 @@ static void
 dasdview_read_vtoc(dasdview_info_t *info)
 {
         volume_label_t vlabel;
-	format1_label_t tmp;
+	format1_label_t *tmp;
+	vtoc_handle_t *vtoc;
 	unsigned long maxblk, pos;
 	u_int64_t vtocblk;
-	int i;
+	unsigned int i;
 
 	pos = info->dasd_info.label_block * info->blksize;
 
@@ -653,8 +654,11 @@ dasdview_read_vtoc(dasdview_info_t *info)
 		exit(-1);
 	}
 
-	vtoc_read_label(info->device, (vtocblk - 1) * info->blksize,
-			NULL, &info->f4, NULL, NULL);
+	/* read the whole VTOC with one request */
+	vtoc = vtoc_open_vtoc(info->device, O_RDONLY,
+			      (vtocblk - 1) * info->blksize, info->blksize,
+			      &info->geo);
+	memcpy(&info->f4, vtoc_get_dscb(vtoc, 0), sizeof(format4_label_t));
 
 	if ((info->f4.DS4KEYCD[0] != 0x04) ||
 	    (info->f4.DS4KEYCD[43] != 0x04) ||
@@ -667,47 +671,58 @@ dasdview_read_vtoc(dasdview_info_t *info)
 	}
 
 	info->f4c++;
-	pos = (vtocblk - 1) * info->blksize;
 
-	for (i=1; i<info->geo.sectors; i++)
+	for (i = 1; i < vtoc->count; i++)
 	{
-	        pos += info->blksize;
-	        vtoc_read_label(info->device, pos, &tmp, NULL, NULL, NULL);
+		tmp = vtoc_get_dscb(vtoc, i);
 
-		switch (tmp.DS1FMTID) {
+		switch (tmp->DS1FMTID) {
 		case 0xf1:
-			memcpy(&info->f1[info->f1c], &tmp,
-			       sizeof(format1_label_t));
+			if (info->f1c < NO_PART_LABELS)
+				memcpy(&info->f1[info->f1c], tmp,
+				       sizeof(format1_label_t));
 			info->f1c++;
 			break;
 		case 0xf4:
 			info->f4c++;
 			break;
 		case 0xf5:
-			memcpy(&info->f5, &tmp, sizeof(format1_label_t));
+			memcpy(&info->f5, tmp, sizeof(format1_label_t));
 			info->f5c++;
 			break;
 		case 0xf7:
-			memcpy(&info->f7, &tmp, sizeof(format1_label_t));
+			memcpy(&info->f7, tmp, sizeof(format1_label_t));
 			info->f7c++;
 			break;
 		case 0xf8:
-			memcpy(&info->f8[info->f8c], &tmp,
-			       sizeof(format1_label_t));
+			if (info->f8c < NO_PART_LABELS)
+				memcpy(&info->f8[info->f8c], tmp,
+				       sizeof(format1_label_t));
 			info->f8c++;
 			break;
 		case 0xf9:
-			memcpy(&info->f9[info->f9c], &tmp,
-			       sizeof(format1_label_t));
+			if (info->f9c < NO_PART_LABELS)
+				memcpy(&info->f9[info->f9c], tmp,
+				       sizeof(format1_label_t));
 			info->f9c++;
 			break;
 		case 0x00:
 			break;
 		default:
 			printf("Unknown label in VTOC detected (id=%x)\n",
-				 tmp.DS1FMTID);
+				 tmp->DS1FMTID);
 		}
 	}
+	vtoc_close(vtoc);
+
+	if ((info->f1c > NO_PART_LABELS) || (info->f8c > NO_PART_LABELS) ||
+	    (info->f9c > NO_PART_LABELS))
+	{
+		zt_error_print("dasdview: VTOC error\n" \
+			"More than %d data set labels of one format!\n",
+			NO_PART_LABELS);
+		exit(-1);
+	}
 
 	if (info->f4c > 1)
         {
@@ -1058,11 +1058,12 @@ static void
 fdasd_write_vtoc_labels (fdasd_anchor_t *anc) 
 {
         partition_info_t *part_info;
-	unsigned long blk, maxblk;
+	unsigned long blk, maxblk, start;
 	char dsno[6], volser[VOLSER_LENGTH + 1], s2[45], *c1, *c2, *ch;
 	int i=0, k=0;
 	cchhb_t f9addr;
 	format1_label_t emptyf1;
+	vtoc_handle_t *vtoc;
 
 	if (!anc->silent) printf("writing VTOC...\n");
 	if (anc->verbose) printf("DSCBs: ");
@@ -1072,20 +1073,26 @@ fdasd_write_vtoc_labels (fdasd_anchor_t *anc)
 		fdasd_error(anc, vlabel_corrupted, "");
 	maxblk = blk + anc->blksize * 9; /* f4+f5+f7+3*f8+3*f9 */
 
+	/* collect all DSCBs and write them with as few requests as possible */
+	start = blk;
+	vtoc = vtoc_open(options.device, O_RDWR, start, anc->blksize, 9);
+
 	/* write FMT4 DSCB */
-	vtoc_write_label(options.device, blk, NULL, anc->f4, NULL, NULL, NULL);
+	vtoc_put_dscb(vtoc, (blk - start) / anc->blksize, anc->f4,
+		      sizeof(format4_label_t));
 	if (anc->verbose) printf("f4 ");
 	blk += anc->blksize;
 
 	/* write FMT5 DSCB */
-	vtoc_write_label(options.device, blk, NULL, NULL, anc->f5, NULL, NULL);
+	vtoc_put_dscb(vtoc, (blk - start) / anc->blksize, anc->f5,
+		      sizeof(format5_label_t));
 	if (anc->verbose) printf("f5 ");
 	blk += anc->blksize;
 
 	/* write FMT7 DSCB */
 	if (anc->big_disk) {
-		vtoc_write_label(options.device, blk,  NULL, NULL,
-				 NULL, anc->f7, NULL);
+		vtoc_put_dscb(vtoc, (blk - start) / anc->blksize, anc->f7,
+			      sizeof(format7_label_t));
 		if (anc->verbose) printf("f7 ");
 		blk += anc->blksize;
 	}
@@ -1164,16 +1171,16 @@ fdasd_write_vtoc_labels (fdasd_anchor_t *anc)
 				       ((blk / anc->blksize) % geo.sectors)
 				       + 2);
 			vtoc_update_format8_label(&f9addr, part_info->f1);
-			vtoc_write_label(options.device, blk, part_info->f1,
-					 NULL, NULL, NULL, NULL);
+			vtoc_put_dscb(vtoc, (blk - start) / anc->blksize,
+				      part_info->f1, sizeof(format1_label_t));
 			blk += anc->blksize;
-			vtoc_write_label(options.device, blk,  NULL, NULL,
-					 NULL, NULL, anc->f9);
+			vtoc_put_dscb(vtoc, (blk - start) / anc->blksize,
+				      anc->f9, sizeof(format9_label_t));
 			if (anc->verbose) printf("f9 ");
 			blk += anc->blksize;
 		} else {
-			vtoc_write_label(options.device, blk, part_info->f1,
-					 NULL, NULL, NULL, NULL);
+			vtoc_put_dscb(vtoc, (blk - start) / anc->blksize,
+				      part_info->f1, sizeof(format1_label_t));
 			blk += anc->blksize;
 		}
 	}
@@ -1181,11 +1188,13 @@ fdasd_write_vtoc_labels (fdasd_anchor_t *anc)
 	/* write empty labels to the rest of the blocks */
 	bzero(&emptyf1, sizeof(emptyf1));
 	while (blk < maxblk) {
-		vtoc_write_label(options.device, blk, &emptyf1, NULL,
-				 NULL, NULL, NULL);
+		vtoc_put_dscb(vtoc, (blk - start) / anc->blksize, &emptyf1,
+			      sizeof(format1_label_t));
 		if (anc->verbose) printf("empty ");
 		blk += anc->blksize;
 	}
+	vtoc_flush(vtoc);
+	vtoc_close(vtoc);
 
 	if (anc->verbose) printf("\n");
 }
@@ -1623,7 +1632,7 @@ fdasd_process_invalid_vtoc(fdasd_anchor_t *anc)
  *
  */
 static void
-fdasd_process_valid_vtoc(fdasd_anchor_t *anc, unsigned long blk)
+fdasd_process_valid_vtoc(fdasd_anchor_t *anc, vtoc_handle_t *vtoc)
 {
 	int f1_counter = 0, f7_counter = 0, f5_counter = 0;
 	int i, part_no, f1_size = sizeof(format1_label_t);
@@ -1640,7 +1649,6 @@ fdasd_process_valid_vtoc(fdasd_anchor_t *anc, unsigned long blk)
 		anc->formatted_cylinders = anc->f4->DS4DEVCT.DS4DSCYL;
 	anc->fspace_trk = anc->formatted_cylinders * geo.heads
 		- FIRST_USABLE_TRK;
-	blk += anc->blksize;
 
 	if (anc->formatted_cylinders < anc->hw_cylinders)
 		printf("WARNING: This device is not fully formatted! "
@@ -1650,9 +1658,7 @@ fdasd_process_valid_vtoc(fdasd_anchor_t *anc, unsigned long blk)
 	if (anc->verbose) printf("VTOC DSCBs          : ");
 
 	for (i = 1; i <= geo.sectors; i++) {
-		bzero(&f1_label, f1_size);
-		vtoc_read_label(options.device, blk, &f1_label, NULL, NULL,
-				NULL);
+		memcpy(&f1_label, vtoc_get_dscb(vtoc, i), f1_size);
 
 		switch (f1_label.DS1FMTID) {
 		case 0xf1:
@@ -1711,7 +1717,6 @@ fdasd_process_valid_vtoc(fdasd_anchor_t *anc, unsigned long blk)
 				printf("'%d' is not supported!\n", 
 				       f1_label.DS1FMTID);
 		}
-		blk += anc->blksize;
 	}
 		
 	if (anc->verbose) printf("\n");
@@ -1733,20 +1738,28 @@ fdasd_process_valid_vtoc(fdasd_anchor_t *anc, unsigned long blk)
 static int
 fdasd_valid_vtoc_pointer(fdasd_anchor_t *anc, unsigned long blk)
 {
+	vtoc_handle_t *vtoc;
+
 	/* VOL1 label contains valid VTOC pointer */
 	if (!anc->silent)
 		printf("reading vtoc ..........:");
 
-	vtoc_read_label(options.device, blk, NULL, anc->f4, NULL, NULL);
+	/* read the format 4 DSCB and the track behind it at once */
+	vtoc = vtoc_open(options.device, O_RDONLY, blk, anc->blksize,
+			 geo.sectors + 1);
+	memcpy(anc->f4, vtoc_get_dscb(vtoc, 0), sizeof(format4_label_t));
 
 	if (anc->f4->DS4IDFMT != 0xf4) { 
+		vtoc_close(vtoc);
 		if (anc->print_table) {
 			printf("Your VTOC is corrupted!\n");
 			return -1;
 		}
 		fdasd_process_invalid_vtoc(anc);
-	} else
-		fdasd_process_valid_vtoc(anc, blk);
+	} else {
+		fdasd_process_valid_vtoc(anc, vtoc);
+		vtoc_close(vtoc);
+	}
 
 	return 0;
 }
@@ -0,0 +1,266 @@
+/*
+ * Dump formats and dump I/O functions shared by the dump tools
+ *
+ * The lkcd dump format written by zfcpdump, zgetdump and vmconvert, the
+ * zcore dump header, a map of the memory chunks to be dumped and a
+ * pipeline that compresses memory pages with several threads into lkcd
+ * page records.
+ *
+ * Copyright IBM Corp. 2003, 2009.
+ */
+
+#ifndef LIBDUMP_H
+#define LIBDUMP_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * lkcd dump format
+ */
+#define DUMP_MAGIC_NUMBER	0xa8190173618f23edULL	/* lkcd magic */
+#define DUMP_VERSION_NUMBER	0x8
+#define DUMP_HEADER_SIZE	0x10000	/* Header is padded to this size */
+#define DUMP_PANIC_LEN		0x100
+#define DUMP_UTS_LEN		65
+#define DUMP_PAGE_SIZE		4096
+
+/* dump levels */
+#define DUMP_LEVEL_ALL		0x10	/* dump all memory */
+
+/* dump compression options */
+#define DUMP_COMPRESS_NONE	0x0
+#define DUMP_COMPRESS_GZIP	0x2
+
+/* page record flags */
+#define DUMP_DH_RAW		0x1	/* raw page (no compression) */
+#define DUMP_DH_COMPRESSED	0x2	/* page is compressed */
+#define DUMP_DH_END		0x4	/* end marker on a full dump */
+
+/*
+ * This is the header dumped at the top of every valid lkcd dump
+ */
+struct dump_hdr_lkcd {
+	uint64_t	magic_number;
+	uint32_t	version;
+	uint32_t	header_size;
+	uint32_t	dump_level;
+	uint32_t	page_size;
+	uint64_t	memory_size;
+	uint64_t	memory_start;
+	uint64_t	memory_end;
+	uint32_t	num_dump_pages;
+	char		panic_string[DUMP_PANIC_LEN];
+	struct {
+		uint64_t tv_sec;
+		uint64_t tv_usec;
+	} time;
+	char		utsname_sysname[DUMP_UTS_LEN];
+	char		utsname_nodename[DUMP_UTS_LEN];
+	char		utsname_release[DUMP_UTS_LEN];
+	char		utsname_version[DUMP_UTS_LEN];
+	char		utsname_machine[DUMP_UTS_LEN];
+	char		utsname_domainname[DUMP_UTS_LEN];
+	uint64_t	current_task;
+	uint32_t	dump_compress;
+	uint32_t	dump_flags;
+	uint32_t	dump_device;
+} __attribute__((packed));
+
+/*
+ * Header of each page record, followed by the (compressed) page
+ */
+struct dump_page {
+	uint64_t	address;
+	uint32_t	size;
+	uint32_t	flags;
+} __attribute__((packed));
+
+/*
+ * s390 standalone dump header as provided by zcore
+ */
+#define DUMP_MAGIC_S390SA	0xa8190173618f23fdULL
+#define DUMP_HEADER_SZ_S390SA	4096
+
+#define DH_ARCH_ID_S390		1
+#define DH_ARCH_ID_S390X	2
+
+struct dump_hdr_s390 {
+	uint64_t	magic_number;
+	uint32_t	version;
+	uint32_t	header_size;
+	uint32_t	dump_level;
+	uint32_t	page_size;
+	uint64_t	memory_size;
+	uint64_t	memory_start;
+	uint64_t	memory_end;
+	uint32_t	num_pages;
+	uint32_t	pad;
+	uint64_t	tod;
+	uint64_t	cpu_id;
+	uint32_t	arch_id;
+	uint32_t	build_arch_id;
+} __attribute__((packed));
+
+void dump_s390_to_lkcd_hdr(const struct dump_hdr_s390 *s390_dh,
+			   struct dump_hdr_lkcd *dh);
+
+/*
+ * Map of the memory chunks to be dumped, sorted by address. Adjacent and
+ * overlapping chunks are merged.
+ */
+#define DUMP_CHUNK_INFO_SIZE	34	/* zcore memmap: 2 x 16 hex digits */
+
+struct dump_chunk {
+	uint64_t	addr;
+	uint64_t	size;
+};
+
+struct dump_map {
+	struct dump_chunk	*chunk;
+	int			count;
+	int			max;
+};
+
+void dump_map_init(struct dump_map *map);
+void dump_map_free(struct dump_map *map);
+int dump_map_add(struct dump_map *map, uint64_t addr, uint64_t size);
+int dump_map_read_zcore(struct dump_map *map, int fd);
+void dump_map_clip(struct dump_map *map, uint64_t end);
+uint64_t dump_map_size(const struct dump_map *map);
+
+/*
+ * Compression pipeline: The caller (reader) fills batches of memory
+ * pages, compressor threads convert the batches into lkcd page records
+ * and a writer thread writes the records in the original order. The
+ * number of batches is limited, so memory usage does not depend on the
+ * dump size.
+ */
+#define PIPE_PAGE_SIZE		DUMP_PAGE_SIZE
+#define PIPE_BATCH_PAGES	64
+#define PIPE_BATCH_SIZE		(PIPE_BATCH_PAGES * PIPE_PAGE_SIZE)
+#define PIPE_MAX_THREADS	8
+#define PIPE_SLOTS		(2 * PIPE_MAX_THREADS)
+#define PIPE_WRITE_SIZE		(1024 * 1024)	/* Size of aligned writes */
+#define PIPE_WRITE_ALIGN	4096
+
+enum pipe_compress {
+	PIPE_COMPRESS_NONE,
+	PIPE_COMPRESS_GZIP,
+};
+
+/* Maximum size of the page records of one batch */
+#define PIPE_OUT_SIZE \
+	(PIPE_BATCH_PAGES * (sizeof(struct dump_page) + PIPE_PAGE_SIZE))
+
+/*
+ * Counters for the pipeline stages, times are in microseconds
+ */
+struct pipe_stats {
+	uint64_t	read_bytes;	/* Memory read by the reader */
+	uint64_t	read_usecs;
+	uint64_t	read_wait_usecs; /* Reader waited for free batch */
+	uint64_t	conv_usecs;	/* Sum of all compressor threads */
+	uint64_t	write_bytes;	/* Page records written */
+	uint64_t	write_usecs;
+	uint64_t	pages;		/* Pages written */
+	uint64_t	zero_pages;
+	uint64_t	total_usecs;	/* Time since pipeline start */
+} __attribute__((packed));
+
+/*
+ * Trailer record, written behind the lkcd end marker
+ */
+#define PIPE_TRAILER_MAGIC	0x5a46435053544154ULL	/* ZFCPSTAT */
+#define PIPE_TRAILER_VERSION	1
+
+struct pipe_trailer {
+	uint64_t		magic;
+	uint32_t		version;
+	uint32_t		size;		/* Size of trailer */
+	uint32_t		threads;
+	uint32_t		compress;
+	struct pipe_stats	stats;
+} __attribute__((packed));
+
+typedef ssize_t (*pipe_write_fn_t)(int fd, const void *buf, size_t count);
+
+/*
+ * Memory pages to be dumped. The pages are stored without gaps in "buf",
+ * "addr" contains the memory address of each page.
+ */
+struct pipe_batch {
+	char		*buf;
+	uint64_t	addr[PIPE_BATCH_PAGES];
+	int		pages;
+	char		*out;		/* Page records */
+	size_t		out_len;
+	int		zero_pages;
+	int		state;
+	uint64_t	get_usecs;	/* Time of dump_pipe_get() */
+};
+
+struct dump_pipe {
+	int			fd;
+	pipe_write_fn_t		write_fn;
+	enum pipe_compress	compress;
+	int			threads;
+	pthread_t		conv_thread[PIPE_MAX_THREADS];
+	pthread_t		write_thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct pipe_batch	slot[PIPE_SLOTS];
+	int			nslots;
+	uint64_t		seq_read;	/* Batches filled by reader */
+	uint64_t		seq_conv;	/* Batches taken by compressors */
+	uint64_t		seq_write;	/* Batches written */
+	int			read_done;
+	int			err;
+	/* Records are collected in an aligned buffer for large writes */
+	char			*wbuf;
+	size_t			wbuf_len;
+	/* Record for a zero page, only the address has to be set */
+	char			zero_rec[128];
+	size_t			zero_rec_len;
+	/* Statistics, protected by lock */
+	struct pipe_stats	stats;
+	uint64_t		start_usecs;
+};
+
+/* Called after each batch with the memory address read next */
+typedef void (*pipe_progress_fn_t)(struct dump_pipe *p, uint64_t addr,
+				   uint64_t copied, void *data);
+
+/* Return codes of dump_pipe_copy_map() */
+#define PIPE_ERR_READ		-1
+#define PIPE_ERR_WRITE		-2
+
+int dump_pipe_threads(void);
+int dump_page_is_zero(const char *page);
+size_t dump_pipe_rec_size(enum pipe_compress compress, const char *page);
+struct dump_pipe *dump_pipe_open(int fd, pipe_write_fn_t write_fn,
+				 enum pipe_compress compress, int threads);
+struct pipe_batch *dump_pipe_get(struct dump_pipe *p);
+void dump_pipe_put(struct dump_pipe *p, struct pipe_batch *batch);
+int dump_pipe_read(struct pipe_batch *batch, int fd, off_t off,
+		   uint64_t addr, uint64_t count);
+int dump_pipe_copy_map(struct dump_pipe *p, int fd, off_t off,
+		       const struct dump_map *map,
+		       pipe_progress_fn_t progress, void *data);
+int dump_pipe_close(struct dump_pipe *p);
+void dump_pipe_free(struct dump_pipe *p);
+void dump_pipe_stats(struct dump_pipe *p, struct pipe_stats *stats);
+void dump_pipe_trailer(struct dump_pipe *p, struct pipe_trailer *trailer);
+void dump_pipe_format_stats(const struct pipe_stats *stats, char *buf,
+			    size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBDUMP_H */
@@ -0,0 +1,68 @@
+/*
+ * libvmcp - Client library for z/VM CP commands
+ *
+ * Copyright IBM Corp. 2009
+ *
+ * Client library for issuing z/VM CP commands through /dev/vmcp. A session
+ * keeps the device open and reuses its response buffer for all commands.
+ */
+
+#ifndef LIBVMCP_H
+#define LIBVMCP_H
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VMCP_DEVICE_NODE	"/dev/vmcp"
+
+#define VMCP_GETCODE		_IOR(0x10, 1, int)
+#define VMCP_SETBUF		_IOW(0x10, 2, int)
+#define VMCP_GETSIZE		_IOR(0x10, 3, int)
+
+#define VMCP_MINBUFFER		4096
+#define VMCP_MAXBUFFER		1048576
+#define VMCP_MAXCMDLEN		240
+
+/* Command flags */
+#define VMCP_RETRY		0x1	/* Reissue command with larger buffer */
+					/* if the response was truncated */
+
+/*
+ * Device access functions. The default functions use the corresponding
+ * system calls, tests can provide a fake /dev/vmcp instead.
+ */
+struct vmcp_dev_ops {
+	int	(*open)(const char *path, int flags);
+	int	(*close)(int fd);
+	ssize_t	(*read)(int fd, void *buf, size_t count);
+	ssize_t	(*write)(int fd, const void *buf, size_t count);
+	int	(*ioctl)(int fd, unsigned long request, int *arg);
+};
+
+struct vmcp_session {
+	const struct vmcp_dev_ops *ops;
+	int	fd;
+	int	bufsize;	/* Response buffer size set in the kernel */
+	char	*resp;		/* Response of last command */
+	int	resp_alloc;	/* Allocated size of resp */
+	int	resp_size;	/* Full response size reported by CP */
+	int	cmd_count;	/* Number of issued commands */
+	const char *err_msg;	/* Description of last Linux error */
+};
+
+int vmcp_open(struct vmcp_session *session, const char *devnode,
+	      const struct vmcp_dev_ops *ops);
+void vmcp_close(struct vmcp_session *session);
+int vmcp_set_bufsize(struct vmcp_session *session, int bufsize);
+int vmcp_cmd(struct vmcp_session *session, const char *cmd, int flags,
+	     int *cprc, char **resp, int *resp_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBVMCP_H */
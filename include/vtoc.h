@@ -24,6 +24,7 @@
 
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 
 #define LINE_LENGTH 80
@@ -46,6 +47,9 @@
 
 #define VTOC_ERROR "VTOC error:"
 
+#define VTOC_BUFFER_ALIGN 4096
+#define VTOC_MAX_IOV 64
+
 /* definition from hdreq.h */
 struct hd_geometry {
       unsigned char heads;
@@ -255,6 +259,18 @@ typedef struct format9_label
 	u_int8_t  res2[95];       /* reserved */
 } __attribute__ ((packed)) format9_label_t;
 
+/* DSCB blocks of a VTOC read into memory, see vtoc_open */
+typedef struct vtoc_handle
+{
+	char *device;
+	int fd;
+	unsigned long start;      /* position of the first DSCB block        */
+	unsigned int blksize;     /* size of a DSCB block                    */
+	unsigned int count;       /* number of DSCB blocks                   */
+	char *buffer;             /* DSCB blocks                             */
+	char *changed;            /* DSCB blocks to be written by vtoc_flush */
+} vtoc_handle_t;
+
 char * vtoc_ebcdic_enc (char *source, char *target, int l);
 char * vtoc_ebcdic_dec (char *source, char *target, int l);
 void vtoc_set_extent (
@@ -335,6 +351,35 @@ void vtoc_write_label (
 	format7_label_t *f7,
 	format9_label_t *f9);
 
+vtoc_handle_t *vtoc_open (
+        char *device,
+        int flags,
+        unsigned long position,
+        unsigned int blksize,
+        unsigned int count);
+
+vtoc_handle_t *vtoc_open_vtoc (
+        char *device,
+        int flags,
+        unsigned long position,
+        unsigned int blksize,
+        struct hd_geometry *geo);
+
+void *vtoc_get_dscb (
+        vtoc_handle_t *h,
+        unsigned int index);
+
+void vtoc_put_dscb (
+        vtoc_handle_t *h,
+        unsigned int index,
+        void *dscb,
+        unsigned int size);
+
+void vtoc_flush (
+        vtoc_handle_t *h);
+
+void vtoc_close (
+        vtoc_handle_t *h);
 
 void vtoc_init_format1_label (
         char *volid,
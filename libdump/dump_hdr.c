@@ -0,0 +1,54 @@
+/*
+ * Conversion of dump headers
+ *
+ * Copyright IBM Corp. 2003, 2009.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "libdump.h"
+
+/*
+ * Convert s390 standalone dump header to lkcd dump header
+ * Parameter: s390_dh - s390 dump header (in)
+ *            dh      - lkcd dump header (out)
+ */
+void dump_s390_to_lkcd_hdr(const struct dump_hdr_s390 *s390_dh,
+			   struct dump_hdr_lkcd *dh)
+{
+	/* adjust todclock to 1970 */
+	uint64_t tod = s390_dh->tod;
+
+	tod -= 0x8126d60e46000000LL - (0x3c26700LL * 1000000 * 4096);
+	tod >>= 12;
+
+	dh->memory_size    = s390_dh->memory_size;
+	dh->memory_start   = s390_dh->memory_start;
+	dh->memory_end     = s390_dh->memory_end;
+	dh->num_dump_pages = s390_dh->num_pages;
+	dh->page_size      = s390_dh->page_size;
+	dh->dump_level     = s390_dh->dump_level;
+
+	snprintf(dh->panic_string, sizeof(dh->panic_string),
+		 "zSeries-dump (CPUID = %16llx)",
+		 (unsigned long long) s390_dh->cpu_id);
+
+	if (s390_dh->arch_id == DH_ARCH_ID_S390)
+		strcpy(dh->utsname_machine, "s390");
+	else if (s390_dh->arch_id == DH_ARCH_ID_S390X)
+		strcpy(dh->utsname_machine, "s390x");
+	else
+		strcpy(dh->utsname_machine, "<unknown>");
+
+	strcpy(dh->utsname_sysname, "<unknown>");
+	strcpy(dh->utsname_nodename, "<unknown>");
+	strcpy(dh->utsname_release, "<unknown>");
+	strcpy(dh->utsname_version, "<unknown>");
+	strcpy(dh->utsname_domainname, "<unknown>");
+
+	dh->magic_number   = DUMP_MAGIC_NUMBER;
+	dh->version        = DUMP_VERSION_NUMBER;
+	dh->header_size    = sizeof(struct dump_hdr_lkcd);
+	dh->time.tv_sec    = tod / 1000000;
+	dh->time.tv_usec   = tod % 1000000;
+}
@@ -0,0 +1,146 @@
+/*
+ * Map of the memory chunks to be dumped
+ *
+ * Copyright IBM Corp. 2003, 2009.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "libdump.h"
+
+#define MAP_MIN_CHUNKS	16
+
+void dump_map_init(struct dump_map *map)
+{
+	memset(map, 0, sizeof(*map));
+}
+
+void dump_map_free(struct dump_map *map)
+{
+	free(map->chunk);
+	dump_map_init(map);
+}
+
+/*
+ * Add chunk ADDR, SIZE to MAP. Chunks that overlap or touch the new
+ * chunk are merged with it.
+ *
+ * Returns 0 on success, -1 if no memory is available.
+ */
+int dump_map_add(struct dump_map *map, uint64_t addr, uint64_t size)
+{
+	struct dump_chunk *chunk;
+	uint64_t end;
+	int first, last, max;
+
+	if (size == 0)
+		return 0;
+	end = addr + size;
+	if (end < addr)
+		end = UINT64_MAX;
+	/* first chunk that ends at or behind ADDR */
+	for (first = 0; first < map->count; first++)
+		if (map->chunk[first].addr + map->chunk[first].size >= addr)
+			break;
+	/* behind the last chunk that starts at or before END */
+	for (last = first; last < map->count; last++)
+		if (map->chunk[last].addr > end)
+			break;
+	if (first < last) {
+		/* merge chunks FIRST to LAST - 1 into FIRST */
+		chunk = &map->chunk[last - 1];
+		if (chunk->addr + chunk->size > end)
+			end = chunk->addr + chunk->size;
+		if (map->chunk[first].addr < addr)
+			addr = map->chunk[first].addr;
+		memmove(&map->chunk[first + 1], &map->chunk[last],
+			(map->count - last) * sizeof(*chunk));
+		map->count -= last - first - 1;
+	} else {
+		if (map->count == map->max) {
+			max = map->max ? 2 * map->max : MAP_MIN_CHUNKS;
+			chunk = realloc(map->chunk, max * sizeof(*chunk));
+			if (!chunk)
+				return -1;
+			map->chunk = chunk;
+			map->max = max;
+		}
+		memmove(&map->chunk[first + 1], &map->chunk[first],
+			(map->count - first) * sizeof(*chunk));
+		map->count++;
+	}
+	map->chunk[first].addr = addr;
+	map->chunk[first].size = end - addr;
+	return 0;
+}
+
+/*
+ * Read the chunks from the zcore memory map file FD. Each entry consists
+ * of start address and size as 16 hex digits, each followed by a blank.
+ * The list ends with an entry of size 0.
+ *
+ * Returns 0 on success, -1 on error (errno is set, EINVAL for an invalid
+ * entry).
+ */
+int dump_map_read_zcore(struct dump_map *map, int fd)
+{
+	char info[DUMP_CHUNK_INFO_SIZE + 1], *end;
+	uint64_t addr, size;
+	ssize_t rc;
+
+	info[DUMP_CHUNK_INFO_SIZE] = 0;
+	while (1) {
+		rc = read(fd, info, DUMP_CHUNK_INFO_SIZE);
+		if (rc != DUMP_CHUNK_INFO_SIZE) {
+			if (rc >= 0)
+				errno = EINVAL;
+			return -1;
+		}
+		size = strtoull(info + 17, &end, 16);
+		if (end != info + 33 || *end != ' ')
+			goto invalid;
+		if (size == 0)
+			return 0;
+		addr = strtoull(info, &end, 16);
+		if (end != info + 16 || *end != ' ')
+			goto invalid;
+		if (dump_map_add(map, addr, size))
+			return -1;
+	}
+invalid:
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * Remove all memory at and behind END from MAP
+ */
+void dump_map_clip(struct dump_map *map, uint64_t end)
+{
+	struct dump_chunk *chunk;
+	int i;
+
+	for (i = 0; i < map->count; i++) {
+		chunk = &map->chunk[i];
+		if (chunk->addr >= end)
+			break;
+		if (chunk->size > end - chunk->addr)
+			chunk->size = end - chunk->addr;
+	}
+	map->count = i;
+}
+
+/*
+ * Number of bytes in all chunks of MAP
+ */
+uint64_t dump_map_size(const struct dump_map *map)
+{
+	uint64_t size = 0;
+	int i;
+
+	for (i = 0; i < map->count; i++)
+		size += map->chunk[i].size;
+	return size;
+}
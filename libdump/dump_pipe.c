@@ -0,0 +1,563 @@
+/*
+ * Compression pipeline for the dump tools
+ *
+ * Copyright IBM Corp. 2003, 2009.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <zlib.h>
+#include "libdump.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+enum slot_state {
+	SLOT_FREE,		/* Can be filled by reader */
+	SLOT_READ,		/* Filled, waiting for compressor */
+	SLOT_CONV,		/* Compressor is working on it */
+	SLOT_DONE,		/* Records are ready for writer */
+};
+
+/*
+ * Current time in microseconds
+ */
+static uint64_t get_usecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Number of compressor threads: One per online CPU
+ */
+int dump_pipe_threads(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cpus < 1)
+		return 1;
+	if (cpus > PIPE_MAX_THREADS)
+		return PIPE_MAX_THREADS;
+	return cpus;
+}
+
+/*
+ * Check if page contains only zeros. Eight words are checked per loop
+ * iteration without branches in between, so the compiler can use vector
+ * instructions.
+ */
+int dump_page_is_zero(const char *page)
+{
+	const uint64_t *p = (const uint64_t *) page;
+	unsigned int i;
+
+	for (i = 0; i < PIPE_PAGE_SIZE / sizeof(*p); i += 8) {
+		if (p[i] | p[i + 1] | p[i + 2] | p[i + 3] |
+		    p[i + 4] | p[i + 5] | p[i + 6] | p[i + 7])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Compress page into NEW. Returns size of compressed data or -1, if the
+ * page could not be compressed into NEW_SIZE bytes.
+ */
+static int compress_page(enum pipe_compress compress, const char *page,
+			 char *new, uint32_t new_size)
+{
+	uLongf len = new_size;
+
+	if (compress != PIPE_COMPRESS_GZIP)
+		return -1;
+	if (compress2((Bytef *) new, &len, (const Bytef *) page,
+		      PIPE_PAGE_SIZE, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return -1;
+	return len;
+}
+
+/*
+ * Size of the page record that is written for PAGE
+ */
+size_t dump_pipe_rec_size(enum pipe_compress compress, const char *page)
+{
+	char buf[PIPE_PAGE_SIZE];
+	int size;
+
+	size = compress_page(compress, page, buf, sizeof(buf));
+	if (size < 0)
+		size = PIPE_PAGE_SIZE;
+	return sizeof(struct dump_page) + size;
+}
+
+/*
+ * Compress a zero page once. All zero pages of the dump use this record,
+ * only the address is different.
+ */
+static void init_zero_rec(struct dump_pipe *p)
+{
+	static const char zero_page[PIPE_PAGE_SIZE];
+	struct dump_page rec;
+	int size;
+
+	size = compress_page(p->compress, zero_page,
+			     p->zero_rec + sizeof(rec),
+			     sizeof(p->zero_rec) - sizeof(rec));
+	if (size < 0)
+		return;
+	rec.address = 0;
+	rec.size = size;
+	rec.flags = DUMP_DH_COMPRESSED;
+	memcpy(p->zero_rec, &rec, sizeof(rec));
+	p->zero_rec_len = sizeof(rec) + size;
+}
+
+/*
+ * Create page records for all pages of a batch
+ */
+static void convert_batch(struct dump_pipe *p, struct pipe_batch *batch)
+{
+	struct dump_page rec;
+	const char *page;
+	char *out;
+	int i, size;
+
+	batch->out_len = 0;
+	batch->zero_pages = 0;
+	for (i = 0; i < batch->pages; i++) {
+		page = batch->buf + i * PIPE_PAGE_SIZE;
+		out = batch->out + batch->out_len;
+		if (p->zero_rec_len && dump_page_is_zero(page)) {
+			memcpy(out, p->zero_rec, p->zero_rec_len);
+			memcpy(out, &batch->addr[i], sizeof(batch->addr[i]));
+			batch->out_len += p->zero_rec_len;
+			batch->zero_pages++;
+			continue;
+		}
+		/* compress directly behind the record header */
+		size = compress_page(p->compress, page, out + sizeof(rec),
+				     PIPE_PAGE_SIZE);
+		/* if compression failed or compressed was ineffective,
+		 * we write an uncompressed page */
+		if (size < 0) {
+			rec.flags = DUMP_DH_RAW;
+			rec.size = PIPE_PAGE_SIZE;
+			memcpy(out + sizeof(rec), page, PIPE_PAGE_SIZE);
+		} else {
+			rec.flags = DUMP_DH_COMPRESSED;
+			rec.size = size;
+		}
+		rec.address = batch->addr[i];
+		memcpy(out, &rec, sizeof(rec));
+		batch->out_len += sizeof(rec) + rec.size;
+	}
+}
+
+/*
+ * Compressor thread: Converts batches in the order they were filled
+ */
+static void *conv_thread(void *data)
+{
+	struct dump_pipe *p = data;
+	struct pipe_batch *batch;
+	uint64_t start;
+
+	pthread_mutex_lock(&p->lock);
+	while (1) {
+		while (!p->err && p->seq_conv == p->seq_read && !p->read_done)
+			pthread_cond_wait(&p->cond, &p->lock);
+		if (p->err || p->seq_conv == p->seq_read)
+			break;
+		batch = &p->slot[p->seq_conv % p->nslots];
+		p->seq_conv++;
+		batch->state = SLOT_CONV;
+		pthread_mutex_unlock(&p->lock);
+		start = get_usecs();
+		convert_batch(p, batch);
+		pthread_mutex_lock(&p->lock);
+		p->stats.conv_usecs += get_usecs() - start;
+		batch->state = SLOT_DONE;
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/*
+ * Write the collected records. Called by the writer without lock.
+ */
+static int flush_wbuf(struct dump_pipe *p)
+{
+	uint64_t start;
+	ssize_t rc;
+
+	if (p->wbuf_len == 0)
+		return 0;
+	start = get_usecs();
+	rc = p->write_fn(p->fd, p->wbuf, p->wbuf_len);
+	if (rc != (ssize_t) p->wbuf_len)
+		return -1;
+	pthread_mutex_lock(&p->lock);
+	p->stats.write_usecs += get_usecs() - start;
+	p->stats.write_bytes += p->wbuf_len;
+	pthread_mutex_unlock(&p->lock);
+	p->wbuf_len = 0;
+	return 0;
+}
+
+/*
+ * Copy records of a batch into the write buffer and write all full
+ * buffers. Called by the writer without lock.
+ */
+static int write_batch(struct dump_pipe *p, struct pipe_batch *batch)
+{
+	size_t off = 0, len;
+
+	while (off < batch->out_len) {
+		len = batch->out_len - off;
+		if (len > PIPE_WRITE_SIZE - p->wbuf_len)
+			len = PIPE_WRITE_SIZE - p->wbuf_len;
+		memcpy(p->wbuf + p->wbuf_len, batch->out + off, len);
+		p->wbuf_len += len;
+		off += len;
+		if (p->wbuf_len == PIPE_WRITE_SIZE && flush_wbuf(p))
+			return -1;
+	}
+	pthread_mutex_lock(&p->lock);
+	p->stats.pages += batch->pages;
+	p->stats.zero_pages += batch->zero_pages;
+	pthread_mutex_unlock(&p->lock);
+	return 0;
+}
+
+/*
+ * Writer thread: Writes the records of the batches in ascending order
+ */
+static void *write_thread(void *data)
+{
+	struct dump_pipe *p = data;
+	struct pipe_batch *batch;
+	int rc;
+
+	pthread_mutex_lock(&p->lock);
+	while (1) {
+		batch = &p->slot[p->seq_write % p->nslots];
+		while (!p->err && batch->state != SLOT_DONE &&
+		       !(p->read_done && p->seq_write == p->seq_read))
+			pthread_cond_wait(&p->cond, &p->lock);
+		if (p->err)
+			break;
+		if (batch->state != SLOT_DONE) {
+			/* All batches are written */
+			pthread_mutex_unlock(&p->lock);
+			rc = flush_wbuf(p);
+			pthread_mutex_lock(&p->lock);
+			if (rc)
+				p->err = 1;
+			break;
+		}
+		pthread_mutex_unlock(&p->lock);
+		rc = write_batch(p, batch);
+		pthread_mutex_lock(&p->lock);
+		if (rc)
+			p->err = 1;
+		batch->state = SLOT_FREE;
+		p->seq_write++;
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/*
+ * Free pipeline after dump_pipe_close()
+ */
+void dump_pipe_free(struct dump_pipe *p)
+{
+	int i;
+
+	for (i = 0; i < p->nslots; i++) {
+		free(p->slot[i].buf);
+		free(p->slot[i].out);
+	}
+	free(p->wbuf);
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+	free(p);
+}
+
+/*
+ * Start pipeline that writes page records to FD using WRITE_FN
+ *
+ * Returns NULL, if memory or threads are not available.
+ */
+struct dump_pipe *dump_pipe_open(int fd, pipe_write_fn_t write_fn,
+				 enum pipe_compress compress, int threads)
+{
+	struct dump_pipe *p;
+	int i;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	/* Without compression one thread is fast enough to copy pages */
+	if (compress == PIPE_COMPRESS_NONE || threads < 1)
+		threads = 1;
+	if (threads > PIPE_MAX_THREADS)
+		threads = PIPE_MAX_THREADS;
+	p->fd = fd;
+	p->write_fn = write_fn;
+	p->compress = compress;
+	p->nslots = 2 * threads;
+	p->start_usecs = get_usecs();
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	for (i = 0; i < p->nslots; i++) {
+		/* Aligned, so that the reader can use O_DIRECT */
+		if (posix_memalign((void **) &p->slot[i].buf, PIPE_WRITE_ALIGN,
+				   PIPE_BATCH_SIZE))
+			p->slot[i].buf = NULL;
+		p->slot[i].out = malloc(PIPE_OUT_SIZE);
+		if (!p->slot[i].buf || !p->slot[i].out)
+			goto fail;
+	}
+	if (posix_memalign((void **) &p->wbuf, PIPE_WRITE_ALIGN,
+			   PIPE_WRITE_SIZE)) {
+		p->wbuf = NULL;
+		goto fail;
+	}
+	init_zero_rec(p);
+	if (pthread_create(&p->write_thread, NULL, write_thread, p))
+		goto fail;
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&p->conv_thread[i], NULL, conv_thread, p))
+			break;
+		p->threads++;
+	}
+	if (p->threads == 0) {
+		dump_pipe_close(p);
+		dump_pipe_free(p);
+		return NULL;
+	}
+	return p;
+fail:
+	dump_pipe_free(p);
+	return NULL;
+}
+
+/*
+ * Get next free batch for the reader
+ *
+ * Returns NULL, if writing failed.
+ */
+struct pipe_batch *dump_pipe_get(struct dump_pipe *p)
+{
+	struct pipe_batch *batch;
+	uint64_t start = get_usecs();
+
+	pthread_mutex_lock(&p->lock);
+	batch = &p->slot[p->seq_read % p->nslots];
+	while (!p->err && batch->state != SLOT_FREE)
+		pthread_cond_wait(&p->cond, &p->lock);
+	if (p->err)
+		batch = NULL;
+	pthread_mutex_unlock(&p->lock);
+	if (!batch)
+		return NULL;
+	batch->pages = 0;
+	/* The time until dump_pipe_put() is the read time */
+	batch->get_usecs = get_usecs();
+	pthread_mutex_lock(&p->lock);
+	p->stats.read_wait_usecs += batch->get_usecs - start;
+	pthread_mutex_unlock(&p->lock);
+	return batch;
+}
+
+/*
+ * Pass batch filled by the reader to the compressors
+ */
+void dump_pipe_put(struct dump_pipe *p, struct pipe_batch *batch)
+{
+	pthread_mutex_lock(&p->lock);
+	p->stats.read_usecs += get_usecs() - batch->get_usecs;
+	p->stats.read_bytes += (uint64_t) batch->pages * PIPE_PAGE_SIZE;
+	batch->state = SLOT_READ;
+	p->seq_read++;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Read COUNT bytes of memory at address ADDR page by page into BATCH,
+ * because the range contains a memory hole. Pages of the hole are skipped.
+ */
+static int read_pages_single(struct pipe_batch *batch, int fd, off_t off,
+			     uint64_t addr, uint64_t count)
+{
+	uint64_t pos;
+	char *buf;
+
+	for (pos = 0; pos < count; pos += PIPE_PAGE_SIZE) {
+		if (lseek(fd, off + addr + pos, SEEK_SET) < 0)
+			return -1;
+		buf = batch->buf + batch->pages * PIPE_PAGE_SIZE;
+		if (read(fd, buf, PIPE_PAGE_SIZE) != PIPE_PAGE_SIZE) {
+			if (errno == EFAULT)
+				/* probably memory hole. Skip page */
+				continue;
+			return -1;
+		}
+		batch->addr[batch->pages++] = addr + pos;
+	}
+	/* The next read starts behind the range */
+	if (lseek(fd, off + addr + count, SEEK_SET) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * Read COUNT bytes of memory at address ADDR into BATCH. The memory is
+ * read from the current position of FD, which is OFF + ADDR. If reading
+ * fails with EFAULT, the range contains a memory hole and is read page
+ * by page.
+ *
+ * Returns 0 on success, -1 on error (errno is set).
+ */
+int dump_pipe_read(struct pipe_batch *batch, int fd, off_t off,
+		   uint64_t addr, uint64_t count)
+{
+	ssize_t size;
+	int i;
+
+	batch->pages = 0;
+	size = read(fd, batch->buf, count);
+	if (size == -1 && errno == EFAULT)
+		/* memory hole within batch */
+		return read_pages_single(batch, fd, off, addr, count);
+	if (size != (ssize_t) count) {
+		if (size >= 0)
+			errno = EIO;
+		return -1;
+	}
+	for (i = 0; i < (int) (count / PIPE_PAGE_SIZE); i++)
+		batch->addr[i] = addr + i * PIPE_PAGE_SIZE;
+	batch->pages = count / PIPE_PAGE_SIZE;
+	return 0;
+}
+
+/*
+ * Pass all chunks of MAP to the pipeline. Memory address 0 is found at
+ * offset OFF of FD. There is one seek per chunk, the chunks are read in
+ * batches. PROGRESS is called after each batch, if it is set.
+ *
+ * Returns 0 on success, PIPE_ERR_READ if reading failed (errno is set)
+ * or PIPE_ERR_WRITE if the pipeline could not write the records.
+ */
+int dump_pipe_copy_map(struct dump_pipe *p, int fd, off_t off,
+		       const struct dump_map *map,
+		       pipe_progress_fn_t progress, void *data)
+{
+	uint64_t addr, end, count, copied = 0;
+	struct pipe_batch *batch;
+	int i;
+
+	for (i = 0; i < map->count; i++) {
+		addr = map->chunk[i].addr;
+		end = addr + map->chunk[i].size;
+		if (lseek(fd, off + addr, SEEK_SET) < 0)
+			return PIPE_ERR_READ;
+		for (; addr < end; addr += count) {
+			count = MIN(end - addr, PIPE_BATCH_SIZE);
+			batch = dump_pipe_get(p);
+			if (!batch)
+				return PIPE_ERR_WRITE;
+			if (dump_pipe_read(batch, fd, off, addr, count))
+				return PIPE_ERR_READ;
+			dump_pipe_put(p, batch);
+			copied += count;
+			if (progress)
+				progress(p, addr + count, copied, data);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Write all remaining batches and stop the pipeline
+ *
+ * Returns 0, if all batches have been written.
+ */
+int dump_pipe_close(struct dump_pipe *p)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->read_done = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	for (i = 0; i < p->threads; i++)
+		pthread_join(p->conv_thread[i], NULL);
+	pthread_join(p->write_thread, NULL);
+	return p->err ? -1 : 0;
+}
+
+/*
+ * Get current counters of the pipeline
+ */
+void dump_pipe_stats(struct dump_pipe *p, struct pipe_stats *stats)
+{
+	pthread_mutex_lock(&p->lock);
+	*stats = p->stats;
+	pthread_mutex_unlock(&p->lock);
+	stats->total_usecs = get_usecs() - p->start_usecs;
+}
+
+/*
+ * Fill trailer record with the counters of the pipeline
+ */
+void dump_pipe_trailer(struct dump_pipe *p, struct pipe_trailer *trailer)
+{
+	memset(trailer, 0, sizeof(*trailer));
+	trailer->magic = PIPE_TRAILER_MAGIC;
+	trailer->version = PIPE_TRAILER_VERSION;
+	trailer->size = sizeof(*trailer);
+	trailer->threads = p->threads;
+	trailer->compress = p->compress;
+	dump_pipe_stats(p, &trailer->stats);
+}
+
+/*
+ * Throughput in MB/s
+ */
+static double rate(uint64_t bytes, uint64_t usecs)
+{
+	if (usecs == 0)
+		return 0;
+	return (double) bytes / usecs * 1000000 / (1024 * 1024);
+}
+
+/*
+ * Format counters for the console: Throughput of the stages, the part of
+ * zero pages and the compression ratio.
+ */
+void dump_pipe_format_stats(const struct pipe_stats *stats, char *buf,
+			    size_t size)
+{
+	uint64_t done = stats->pages * PIPE_PAGE_SIZE;
+
+	snprintf(buf, size, "read %.1f MB/s (wait %.1f s), compress %.1f "
+		 "MB/s per thread, write %.1f MB/s, zero pages %.1f%%, "
+		 "ratio %.2f",
+		 rate(stats->read_bytes, stats->read_usecs),
+		 stats->read_wait_usecs / 1000000.0,
+		 rate(done, stats->conv_usecs),
+		 rate(stats->write_bytes, stats->write_usecs),
+		 stats->pages ? 100.0 * stats->zero_pages / stats->pages : 0,
+		 stats->write_bytes ? (double) done / stats->write_bytes : 0);
+}
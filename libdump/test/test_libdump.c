@@ -0,0 +1,278 @@
+/*
+ * test_libdump - Test program for the dump I/O library
+ *
+ * Checks the memory chunk map and copies a memory image with holes
+ * through the compression pipeline. With "-b <MB>" a memory image of
+ * the given size is dumped with each number of threads and the pipeline
+ * counters are printed, which can be used to compare the throughput of
+ * changes to the pipeline.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "libdump.h"
+
+
+/* Memory image behind a dump header, like zcore provides it */
+#define MEM_OFF		DUMP_HEADER_SZ_S390SA
+
+
+static char *memory;
+static uint64_t mem_size;
+
+
+static int tmp_file(void)
+{
+	char name[] = "/tmp/test_libdump.XXXXXX";
+	int fd;
+
+	fd = mkstemp(name);
+	assert(fd != -1);
+	unlink(name);
+	return fd;
+}
+
+static void test_page_is_zero(void)
+{
+	char page[DUMP_PAGE_SIZE];
+	int i;
+
+	memset(page, 0, sizeof(page));
+	assert(dump_page_is_zero(page));
+	for (i = 0; i < DUMP_PAGE_SIZE; i += 511) {
+		page[i] = 1;
+		assert(!dump_page_is_zero(page));
+		page[i] = 0;
+	}
+}
+
+static void test_map(void)
+{
+	struct dump_map map;
+
+	dump_map_init(&map);
+	assert(dump_map_add(&map, 0x10000, 0x1000) == 0);
+	assert(dump_map_add(&map, 0x0, 0x1000) == 0);
+	assert(dump_map_add(&map, 0x20000, 0x1000) == 0);
+	assert(map.count == 3);
+	assert(map.chunk[0].addr == 0 && map.chunk[1].addr == 0x10000);
+	/* touches the first chunk */
+	assert(dump_map_add(&map, 0x1000, 0x1000) == 0);
+	assert(map.count == 3 && map.chunk[0].size == 0x2000);
+	/* overlaps the second and the third chunk */
+	assert(dump_map_add(&map, 0x10800, 0x10000) == 0);
+	assert(map.count == 2);
+	assert(map.chunk[1].addr == 0x10000 && map.chunk[1].size == 0x11000);
+	assert(dump_map_size(&map) == 0x13000);
+	dump_map_clip(&map, 0x18000);
+	assert(map.count == 2 && map.chunk[1].size == 0x8000);
+	dump_map_clip(&map, 0x1000);
+	assert(map.count == 1 && map.chunk[0].size == 0x1000);
+	dump_map_free(&map);
+
+	/* many chunks */
+	for (mem_size = 0; mem_size < 100; mem_size++)
+		assert(dump_map_add(&map, mem_size * 0x2000, 0x1000) == 0);
+	assert(map.count == 100 && dump_map_size(&map) == 100 * 0x1000);
+	assert(dump_map_add(&map, 0, 200 * 0x1000) == 0);
+	assert(map.count == 1 && dump_map_size(&map) == 200 * 0x1000);
+	dump_map_free(&map);
+}
+
+static void test_map_zcore(void)
+{
+	const char *memmap = "0000000000000000 0000000000100000 "
+		"0000000000200000 0000000000080000 "
+		"0000000000000000 0000000000000000 ";
+	struct dump_map map;
+	int fd = tmp_file();
+
+	assert(write(fd, memmap, strlen(memmap)) == (ssize_t) strlen(memmap));
+	assert(lseek(fd, 0, SEEK_SET) == 0);
+	dump_map_init(&map);
+	assert(dump_map_read_zcore(&map, fd) == 0);
+	assert(map.count == 2);
+	assert(map.chunk[1].addr == 0x200000 && map.chunk[1].size == 0x80000);
+	dump_map_free(&map);
+
+	/* invalid entry */
+	assert(lseek(fd, 3, SEEK_SET) == 3);
+	assert(dump_map_read_zcore(&map, fd) == -1);
+	dump_map_free(&map);
+	close(fd);
+}
+
+static void init_memory(uint64_t size)
+{
+	uint64_t i;
+
+	mem_size = size;
+	memory = calloc(1, mem_size);
+	assert(memory);
+	srand(4711);
+	for (i = 0; i < mem_size; i += DUMP_PAGE_SIZE) {
+		switch (rand() % 3) {
+		case 0:
+			break;
+		case 1:
+			memory[i + rand() % DUMP_PAGE_SIZE] = rand();
+			break;
+		default:
+			memset(memory + i, rand(), DUMP_PAGE_SIZE / 2);
+		}
+	}
+}
+
+static int mem_file(void)
+{
+	int fd = tmp_file();
+
+	assert(pwrite(fd, memory, mem_size, MEM_OFF) == (ssize_t) mem_size);
+	return fd;
+}
+
+static ssize_t write_fn(int fd, const void *buf, size_t count)
+{
+	return write(fd, buf, count);
+}
+
+static void progress(struct dump_pipe *p, uint64_t addr, uint64_t copied,
+		     void *data)
+{
+	uint64_t *last = data;
+
+	(void) p;
+	assert(addr > *last);
+	*last = addr;
+	assert(copied <= mem_size);
+}
+
+/* Check records in FD, pages outside of MAP must not be there */
+static void check_records(int fd, const struct dump_map *map)
+{
+	char page[DUMP_PAGE_SIZE], *buf;
+	struct dump_page dp;
+	uint64_t pages = 0;
+	off_t size, off = 0;
+	uLongf len;
+	int i;
+
+	size = lseek(fd, 0, SEEK_END);
+	buf = malloc(size);
+	assert(buf && pread(fd, buf, size, 0) == size);
+	for (i = 0; i < map->count; i++) {
+		uint64_t addr = map->chunk[i].addr;
+
+		for (; addr < map->chunk[i].addr + map->chunk[i].size;
+		     addr += DUMP_PAGE_SIZE) {
+			memcpy(&dp, buf + off, sizeof(dp));
+			off += sizeof(dp);
+			assert(dp.address == addr);
+			if (dp.flags == DUMP_DH_COMPRESSED) {
+				len = sizeof(page);
+				assert(uncompress((Bytef *) page, &len,
+						  (Bytef *) buf + off,
+						  dp.size) == Z_OK);
+				assert(len == DUMP_PAGE_SIZE);
+			} else {
+				assert(dp.flags == DUMP_DH_RAW);
+				assert(dp.size == DUMP_PAGE_SIZE);
+				memcpy(page, buf + off, DUMP_PAGE_SIZE);
+				len = DUMP_PAGE_SIZE;
+			}
+			assert(memcmp(page, memory + addr, len) == 0);
+			off += dp.size;
+			pages++;
+		}
+	}
+	assert(off == size);
+	assert(pages == dump_map_size(map) / DUMP_PAGE_SIZE);
+	free(buf);
+}
+
+static void copy(int in_fd, const struct dump_map *map,
+		 enum pipe_compress compress, int threads, int check)
+{
+	struct pipe_trailer trailer;
+	struct dump_pipe *p;
+	uint64_t last = 0;
+	char str[256];
+	int out_fd;
+
+	out_fd = tmp_file();
+	p = dump_pipe_open(out_fd, write_fn, compress, threads);
+	assert(p);
+	assert(dump_pipe_copy_map(p, in_fd, MEM_OFF, map, progress,
+				  &last) == 0);
+	assert(dump_pipe_close(p) == 0);
+	dump_pipe_trailer(p, &trailer);
+	assert(trailer.stats.pages == dump_map_size(map) / DUMP_PAGE_SIZE);
+	assert(trailer.stats.read_bytes == dump_map_size(map));
+	if (check) {
+		check_records(out_fd, map);
+	} else {
+		dump_pipe_format_stats(&trailer.stats, str, sizeof(str));
+		printf("%s, %d thread(s): %.2f s, %s\n",
+		       compress == PIPE_COMPRESS_GZIP ? "gzip" : "none",
+		       p->threads, trailer.stats.total_usecs / 1000000.0,
+		       str);
+	}
+	dump_pipe_free(p);
+	close(out_fd);
+}
+
+static void test_pipe(void)
+{
+	struct dump_map map;
+	int fd, threads;
+
+	init_memory(3 * PIPE_BATCH_SIZE + 5 * DUMP_PAGE_SIZE);
+	fd = mem_file();
+	dump_map_init(&map);
+	/* a hole within the first batch and chunks not ending on batches */
+	assert(dump_map_add(&map, 0, 10 * DUMP_PAGE_SIZE) == 0);
+	assert(dump_map_add(&map, 20 * DUMP_PAGE_SIZE, mem_size -
+			    40 * DUMP_PAGE_SIZE) == 0);
+	for (threads = 1; threads <= 4; threads += 3) {
+		copy(fd, &map, PIPE_COMPRESS_GZIP, threads, 1);
+		copy(fd, &map, PIPE_COMPRESS_NONE, threads, 1);
+	}
+	dump_map_free(&map);
+	close(fd);
+	free(memory);
+}
+
+static void bench(uint64_t size)
+{
+	struct dump_map map;
+	int fd, threads;
+
+	init_memory(size);
+	fd = mem_file();
+	dump_map_init(&map);
+	assert(dump_map_add(&map, 0, mem_size) == 0);
+	copy(fd, &map, PIPE_COMPRESS_NONE, 1, 0);
+	for (threads = 1; threads <= dump_pipe_threads(); threads *= 2)
+		copy(fd, &map, PIPE_COMPRESS_GZIP, threads, 0);
+	dump_map_free(&map);
+	close(fd);
+	free(memory);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && strcmp(argv[1], "-b") == 0) {
+		bench(strtoull(argv[2], NULL, 10) << 20);
+		return 0;
+	}
+	test_page_is_zero();
+	test_map();
+	test_map_zcore();
+	test_pipe();
+	return 0;
+}
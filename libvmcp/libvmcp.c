@@ -0,0 +1,201 @@
+/*
+ * libvmcp - Client library for z/VM CP commands
+ *
+ * Copyright IBM Corp. 2009
+ *
+ * Client library for issuing z/VM CP commands through /dev/vmcp.
+ *
+ * The device is opened once per session. The kernel response buffer size
+ * is only set when it changes and grows adaptively: If a response does not
+ * fit, the buffer is enlarged and kept for all following commands.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "libvmcp.h"
+
+static int sys_open(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+static int sys_ioctl(int fd, unsigned long request, int *arg)
+{
+	return ioctl(fd, request, arg);
+}
+
+static const struct vmcp_dev_ops vmcp_sys_ops = {
+	sys_open,
+	close,
+	read,
+	write,
+	sys_ioctl,
+};
+
+/*
+ * Open session: Use default device node and system calls, if devnode and
+ * ops are NULL. Return 0 on success, -errno otherwise.
+ */
+int vmcp_open(struct vmcp_session *session, const char *devnode,
+	      const struct vmcp_dev_ops *ops)
+{
+	memset(session, 0, sizeof(*session));
+	session->ops = ops ? ops : &vmcp_sys_ops;
+	session->fd = session->ops->open(devnode ? devnode : VMCP_DEVICE_NODE,
+					 O_RDWR);
+	if (session->fd == -1) {
+		session->err_msg = "Could not open device " VMCP_DEVICE_NODE;
+		return -errno;
+	}
+	return 0;
+}
+
+void vmcp_close(struct vmcp_session *session)
+{
+	if (session->fd != -1)
+		session->ops->close(session->fd);
+	session->fd = -1;
+	free(session->resp);
+	session->resp = NULL;
+	session->resp_alloc = 0;
+}
+
+/*
+ * Set size of response buffer for the following commands
+ */
+int vmcp_set_bufsize(struct vmcp_session *session, int bufsize)
+{
+	if (bufsize < VMCP_MINBUFFER || bufsize > VMCP_MAXBUFFER) {
+		session->err_msg = "Invalid buffer size";
+		return -EINVAL;
+	}
+	if (session->ops->ioctl(session->fd, VMCP_SETBUF, &bufsize) == -1) {
+		session->err_msg = "Could not set buffer size";
+		return -errno;
+	}
+	session->bufsize = bufsize;
+	return 0;
+}
+
+/*
+ * Read at most COUNT bytes from session into BUF. Return number of bytes
+ * read on success, -1 on error.
+ */
+static ssize_t vmcp_read_buf(struct vmcp_session *session, char *buf,
+			     size_t count)
+{
+	ssize_t rc, len;
+
+	for (len = 0; len < (ssize_t) count; len += rc) {
+		rc = session->ops->read(session->fd, &buf[len], count - len);
+		if (rc == -1 && errno == EINTR) {
+			rc = 0;
+			continue;
+		}
+		if (rc == -1)
+			return -1;
+		if (rc == 0)
+			break;
+	}
+	return len;
+}
+
+/*
+ * Issue command and read response into session buffer
+ */
+static int vmcp_issue(struct vmcp_session *session, const char *cmd,
+		      int *cprc, int *len)
+{
+	session->cmd_count++;
+	if (session->ops->write(session->fd, cmd, strlen(cmd)) == -1) {
+		session->err_msg = "Could not issue CP command";
+		return -errno;
+	}
+	if (session->ops->ioctl(session->fd, VMCP_GETCODE, cprc) == -1) {
+		session->err_msg = "Could not query return code";
+		return -errno;
+	}
+	if (session->ops->ioctl(session->fd, VMCP_GETSIZE,
+				&session->resp_size) == -1) {
+		session->err_msg = "Could not query response size";
+		return -errno;
+	}
+	if (session->resp_alloc < session->bufsize + 1) {
+		char *resp = (char *) realloc(session->resp,
+					      session->bufsize + 1);
+		if (!resp) {
+			session->err_msg = "Out of memory for CP response";
+			return -ENOMEM;
+		}
+		session->resp = resp;
+		session->resp_alloc = session->bufsize + 1;
+	}
+	*len = vmcp_read_buf(session, session->resp, session->bufsize);
+	if (*len == -1) {
+		session->err_msg = "Could not read CP response";
+		return -errno;
+	}
+	session->resp[*len] = 0;
+	return 0;
+}
+
+/*
+ * Issue CP command:
+ * @cmd:      CP command (not converted to uppercase).
+ * @flags:    VMCP_RETRY: Command can be reissued, if the response buffer
+ *            is too small.
+ * @cprc:     CP return code.
+ * @resp:     Response, valid until the next command of the session.
+ * @resp_len: Length of response.
+ *
+ * Return 0 on success, -EMSGSIZE if the response has been truncated, or
+ * -errno on Linux errors.
+ */
+int vmcp_cmd(struct vmcp_session *session, const char *cmd, int flags,
+	     int *cprc, char **resp, int *resp_len)
+{
+	int rc, len = 0, bufsize;
+
+	if (strlen(cmd) > VMCP_MAXCMDLEN) {
+		session->err_msg = "CP command too long";
+		return -EINVAL;
+	}
+	if (session->bufsize == 0) {
+		rc = vmcp_set_bufsize(session, VMCP_MINBUFFER * 4);
+		if (rc)
+			return rc;
+	}
+	do {
+		rc = vmcp_issue(session, cmd, cprc, &len);
+		if (rc)
+			return rc;
+		if (session->resp_size <= session->bufsize)
+			break;
+		if (!(flags & VMCP_RETRY) ||
+		    session->bufsize == VMCP_MAXBUFFER) {
+			rc = -EMSGSIZE;
+			break;
+		}
+		/* Grow buffer: At least double it, round up to 4 KB */
+		bufsize = session->bufsize * 2;
+		if (bufsize < session->resp_size)
+			bufsize = (session->resp_size + VMCP_MINBUFFER - 1) &
+				~(VMCP_MINBUFFER - 1);
+		if (bufsize > VMCP_MAXBUFFER)
+			bufsize = VMCP_MAXBUFFER;
+		rc = vmcp_set_bufsize(session, bufsize);
+		if (rc)
+			return rc;
+	} while (1);
+
+	if (resp)
+		*resp = session->resp;
+	if (resp_len)
+		*resp_len = len;
+	return rc;
+}
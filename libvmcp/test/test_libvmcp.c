@@ -0,0 +1,207 @@
+/*
+ * test_libvmcp - Test program for the vmcp client library
+ *
+ * The CP commands are issued to a fake /dev/vmcp that emulates the
+ * write/ioctl/read protocol of the vmcp kernel module.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libvmcp.h"
+
+
+#define FAKE_FD		42
+#define BIG_SIZE	20000
+
+
+/* Fake /dev/vmcp state */
+static struct {
+	int open_count;
+	int setbuf_count;
+	int write_count;
+	int bufsize;
+	int cprc;
+	char *resp;
+	int resp_size;
+	int pos;
+} fake;
+
+static char big_resp[BIG_SIZE + 1];
+
+
+static int fake_open(const char *path, int flags)
+{
+	(void) path;
+	(void) flags;
+	fake.open_count++;
+	return FAKE_FD;
+}
+
+static int fake_close(int fd)
+{
+	assert(fd == FAKE_FD);
+	return 0;
+}
+
+/* CP emulation: "BIG" returns a large response, "FAIL" returns rc 1 */
+static ssize_t fake_write(int fd, const void *buf, size_t count)
+{
+	static char small_resp[256];
+
+	assert(fd == FAKE_FD);
+	fake.write_count++;
+	fake.pos = 0;
+	fake.cprc = 0;
+	if (count == 3 && memcmp(buf, "BIG", 3) == 0) {
+		fake.resp = big_resp;
+		fake.resp_size = BIG_SIZE;
+		return count;
+	}
+	if (count == 4 && memcmp(buf, "FAIL", 4) == 0)
+		fake.cprc = 1;
+	snprintf(small_resp, sizeof(small_resp), "RESPONSE %.*s\n",
+		 (int) count, (const char *) buf);
+	fake.resp = small_resp;
+	fake.resp_size = strlen(small_resp);
+	return count;
+}
+
+static ssize_t fake_read(int fd, void *buf, size_t count)
+{
+	int len;
+
+	assert(fd == FAKE_FD);
+	len = fake.resp_size < fake.bufsize ? fake.resp_size : fake.bufsize;
+	len -= fake.pos;
+	if ((size_t) len > count)
+		len = count;
+	memcpy(buf, fake.resp + fake.pos, len);
+	fake.pos += len;
+	return len;
+}
+
+static int fake_ioctl(int fd, unsigned long request, int *arg)
+{
+	assert(fd == FAKE_FD);
+	switch (request) {
+	case VMCP_SETBUF:
+		fake.setbuf_count++;
+		fake.bufsize = *arg;
+		return 0;
+	case VMCP_GETCODE:
+		*arg = fake.cprc;
+		return 0;
+	case VMCP_GETSIZE:
+		*arg = fake.resp_size;
+		return 0;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static const struct vmcp_dev_ops fake_ops = {
+	fake_open,
+	fake_close,
+	fake_read,
+	fake_write,
+	fake_ioctl,
+};
+
+
+/* All commands of a session use one open device and one SETBUF */
+static void test_session_reuse(void)
+{
+	struct vmcp_session session;
+	char *resp;
+	int i, cprc, len;
+
+	memset(&fake, 0, sizeof(fake));
+	assert(vmcp_open(&session, NULL, &fake_ops) == 0);
+	for (i = 0; i < 10; i++) {
+		assert(vmcp_cmd(&session, "QUERY USERID", 0, &cprc, &resp,
+				&len) == 0);
+		assert(cprc == 0);
+		assert(strcmp(resp, "RESPONSE QUERY USERID\n") == 0);
+		assert(len == (int) strlen(resp));
+	}
+	assert(fake.open_count == 1);
+	assert(fake.setbuf_count == 1);
+	assert(fake.write_count == 10);
+	vmcp_close(&session);
+}
+
+/* Truncated response without VMCP_RETRY */
+static void test_truncated(void)
+{
+	struct vmcp_session session;
+	char *resp;
+	int cprc, len;
+
+	memset(&fake, 0, sizeof(fake));
+	assert(vmcp_open(&session, NULL, &fake_ops) == 0);
+	assert(vmcp_set_bufsize(&session, 8192) == 0);
+	assert(vmcp_cmd(&session, "BIG", 0, &cprc, &resp, &len) ==
+	       -EMSGSIZE);
+	assert(len == 8192);
+	assert(session.resp_size == BIG_SIZE);
+	assert(memcmp(resp, big_resp, len) == 0);
+	assert(fake.write_count == 1);
+	vmcp_close(&session);
+}
+
+/* Buffer grows with VMCP_RETRY and is kept for following commands */
+static void test_adaptive_buffer(void)
+{
+	struct vmcp_session session;
+	char *resp;
+	int cprc, len;
+
+	memset(&fake, 0, sizeof(fake));
+	assert(vmcp_open(&session, NULL, &fake_ops) == 0);
+	assert(vmcp_cmd(&session, "BIG", VMCP_RETRY, &cprc, &resp, &len) == 0);
+	assert(len == BIG_SIZE);
+	assert(memcmp(resp, big_resp, len) == 0);
+	assert(session.bufsize >= BIG_SIZE);
+	assert(session.bufsize % VMCP_MINBUFFER == 0);
+	assert(fake.write_count == 2);
+	assert(fake.setbuf_count == 2);
+
+	assert(vmcp_cmd(&session, "BIG", VMCP_RETRY, &cprc, &resp, &len) == 0);
+	assert(fake.write_count == 3);
+	assert(fake.setbuf_count == 2);
+	vmcp_close(&session);
+}
+/* Argument errors are reported with an error message */
+static void test_invalid_args(void)
+{
+	struct vmcp_session session;
+	char cmd[VMCP_MAXCMDLEN + 2];
+	int cprc;
+
+	memset(&fake, 0, sizeof(fake));
+	assert(vmcp_open(&session, NULL, &fake_ops) == 0);
+	assert(vmcp_set_bufsize(&session, 1) == -EINVAL);
+	assert(session.err_msg != NULL);
+	session.err_msg = NULL;
+	memset(cmd, 'A', sizeof(cmd) - 1);
+	cmd[sizeof(cmd) - 1] = 0;
+	assert(vmcp_cmd(&session, cmd, 0, &cprc, NULL, NULL) == -EINVAL);
+	assert(session.err_msg != NULL);
+	assert(fake.write_count == 0);
+	vmcp_close(&session);
+}
+
+int main(void)
+{
+	memset(big_resp, 'X', BIG_SIZE);
+
+	test_session_reuse();
+	test_truncated();
+	test_adaptive_buffer();
+	test_invalid_args();
+	return 0;
+}
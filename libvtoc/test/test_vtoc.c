@@ -0,0 +1,125 @@
+/*
+ * test_vtoc - Test program for reading and writing a VTOC through a handle
+ *
+ * Uses a regular file as volume. Checks that the whole VTOC extent given
+ * by the format 4 DSCB is read, that only the DSCBs passed to
+ * vtoc_put_dscb are written and that the remainder of their blocks is
+ * kept.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <assert.h>
+
+#include "vtoc.h"
+
+#define HEADS		15
+#define SECTORS		12
+#define BLKSIZE		4096
+#define VTOC_TRACKS	3
+
+
+static char name[] = "/tmp/test_vtoc.XXXXXX";
+static struct hd_geometry geo = { HEADS, SECTORS, 100, 0 };
+
+
+/* Fill block BLK of file FD with the byte FILL */
+static void
+fill_block(int fd, unsigned int blk, int fill)
+{
+	char block[BLKSIZE];
+
+	memset(block, fill, sizeof(block));
+	assert(pwrite(fd, block, sizeof(block), (off_t) blk * BLKSIZE) ==
+	       sizeof(block));
+}
+
+
+/* Check that block BLK of file FD starts with SIZE bytes of HEAD and is
+ * filled with the byte FILL otherwise */
+static void
+check_block(int fd, unsigned int blk, int head, unsigned int size, int fill)
+{
+	char block[BLKSIZE];
+	unsigned int i;
+
+	assert(pread(fd, block, sizeof(block), (off_t) blk * BLKSIZE) ==
+	       sizeof(block));
+	for (i = 0; i < sizeof(block); i++)
+		assert(block[i] == (char) (i < size ? head : fill));
+}
+
+
+int
+main(void)
+{
+	format4_label_t f4, *p4;
+	format1_label_t f1, *p1;
+	cchh_t lower, upper;
+	vtoc_handle_t *vtoc;
+	unsigned int blk;
+	int fd;
+
+	fd = mkstemp(name);
+	assert(fd != -1);
+	for (blk = 0; blk < (VTOC_TRACKS + 2) * SECTORS; blk++)
+		fill_block(fd, blk, blk);
+
+	/* format 4 DSCB in the first block of track 1, the VTOC extent ends
+	 * with track VTOC_TRACKS */
+	memset(&f4, 0, sizeof(f4));
+	f4.DS4IDFMT = 0xf4;
+	vtoc_set_cchh(&lower, 0, 1);
+	vtoc_set_cchh(&upper, 0, VTOC_TRACKS);
+	vtoc_set_extent(&f4.DS4VTOCE, 0x01, 0x00, &lower, &upper);
+	assert(pwrite(fd, &f4, sizeof(f4), SECTORS * BLKSIZE) == sizeof(f4));
+
+	/* the whole extent is read */
+	vtoc = vtoc_open_vtoc(name, O_RDWR, SECTORS * BLKSIZE, BLKSIZE, &geo);
+	assert(vtoc->count == VTOC_TRACKS * SECTORS);
+	p4 = vtoc_get_dscb(vtoc, 0);
+	assert(p4->DS4IDFMT == 0xf4);
+	for (blk = 1; blk < vtoc->count; blk++) {
+		p1 = vtoc_get_dscb(vtoc, blk);
+		assert(p1->DS1DSNAM[0] == (char) (SECTORS + blk));
+	}
+	assert(vtoc_get_dscb(vtoc, vtoc->count) == NULL);
+
+	/* nothing is written without vtoc_put_dscb */
+	p1 = vtoc_get_dscb(vtoc, 1);
+	p1->DS1FMTID = 0xf1;
+	vtoc_flush(vtoc);
+	check_block(fd, SECTORS + 1, SECTORS + 1, 0, SECTORS + 1);
+
+	/* changed DSCBs across a track boundary and a separate one */
+	memset(&f1, 0xa1, sizeof(f1));
+	vtoc_put_dscb(vtoc, SECTORS - 1, &f1, sizeof(f1));
+	vtoc_put_dscb(vtoc, SECTORS, &f1, sizeof(f1));
+	vtoc_put_dscb(vtoc, 5, &f1, sizeof(f1));
+	vtoc_flush(vtoc);
+	vtoc_close(vtoc);
+	for (blk = SECTORS; blk < (VTOC_TRACKS + 2) * SECTORS; blk++) {
+		if ((blk == SECTORS + 5) || (blk == 2 * SECTORS - 1) ||
+		    (blk == 2 * SECTORS))
+			check_block(fd, blk, 0xa1, sizeof(f1), blk);
+		else if (blk != SECTORS)
+			check_block(fd, blk, blk, 0, blk);
+	}
+
+	/* without a format 4 DSCB only the rest of the track is read */
+	vtoc = vtoc_open_vtoc(name, O_RDONLY, (SECTORS + 4) * BLKSIZE,
+			      BLKSIZE, &geo);
+	assert(vtoc->count == SECTORS - 4);
+	vtoc_close(vtoc);
+
+	/* a fixed number of blocks */
+	vtoc = vtoc_open(name, O_RDONLY, 0, BLKSIZE, 2 * SECTORS);
+	assert(vtoc->count == 2 * SECTORS);
+	p1 = vtoc_get_dscb(vtoc, 2);
+	assert(p1->DS1DSNAM[0] == 2);
+	vtoc_close(vtoc);
+
+	close(fd);
+	unlink(name);
+	return 0;
+}
@@ -137,7 +137,8 @@ static unsigned char ASCtoEBC[256] =
 enum failure {unable_to_open,
 	      unable_to_seek,
 	      unable_to_write,
-	      unable_to_read};
+	      unable_to_read,
+	      out_of_memory};
 
 static char buffer[85];
 
@@ -163,6 +164,10 @@ static void vtoc_error(enum failure why, char *s1, char *s2)
 	        fprintf(stderr, "\n%s reading from device '%s' failed.\n%s\n",
 			VTOC_ERROR, s1, s2);
 		break;
+	case out_of_memory:
+	        fprintf(stderr, "\n%s allocating memory for device '%s' "
+			"failed.\n%s\n", VTOC_ERROR, s1, s2);
+		break;
 	default: fprintf(stderr, "\nFatal error\n");
 	}
 	exit(1);
@@ -615,6 +620,206 @@ vtoc_write_label (char *device,
         close(f);
 }
 
+/*
+ * reads COUNT blocks starting with block FIRST of the VTOC handle H
+ * into its buffer with one read
+ */
+static void vtoc_read_blocks (vtoc_handle_t *h, unsigned int first,
+			      unsigned int count)
+{
+	size_t size = (size_t) count * h->blksize;
+	ssize_t rc;
+
+	if (count == 0)
+		return;
+	rc = pread(h->fd, h->buffer + (size_t) first * h->blksize, size,
+		   h->start + (off_t) first * h->blksize);
+	if (rc != (ssize_t) size) {
+		close(h->fd);
+		vtoc_error(unable_to_read, h->device,
+			   "Could not read VTOC labels.");
+	}
+}
+
+
+/*
+ * sets the number of DSCB blocks of the VTOC handle H to COUNT
+ */
+static void vtoc_resize (vtoc_handle_t *h, unsigned int count)
+{
+	char *buffer, *changed;
+
+	/* aligned to allow for O_DIRECT I/O on the buffer */
+	if (posix_memalign((void **) &buffer, VTOC_BUFFER_ALIGN,
+			   (size_t) count * h->blksize + 1) != 0)
+		buffer = NULL;
+	changed = calloc(count + 1, 1);
+	if ((buffer == NULL) || (changed == NULL)) {
+		close(h->fd);
+		vtoc_error(out_of_memory, h->device,
+			   "Could not read VTOC labels.");
+	}
+	if (h->buffer != NULL) {
+		memcpy(buffer, h->buffer, (size_t) h->count * h->blksize);
+		memcpy(changed, h->changed, h->count);
+	}
+	free(h->buffer);
+	free(h->changed);
+	h->buffer = buffer;
+	h->changed = changed;
+	h->count = count;
+}
+
+
+/*
+ * opens DEVICE with FLAGS and reads COUNT DSCB blocks of size BLKSIZE
+ * starting at POSITION with one read; the blocks can be accessed with
+ * vtoc_get_dscb and vtoc_put_dscb until the handle is closed
+ */
+vtoc_handle_t *
+vtoc_open (char *device, int flags, unsigned long position,
+	   unsigned int blksize, unsigned int count)
+{
+	vtoc_handle_t *h;
+
+	h = calloc(1, sizeof(vtoc_handle_t));
+	if (h == NULL)
+		vtoc_error(out_of_memory, device,
+			   "Could not read VTOC labels.");
+	h->device = device;
+	h->start = position;
+	h->blksize = blksize;
+	if ((h->fd = open(device, flags)) == -1)
+		vtoc_error(unable_to_open, device,
+			   "Could not read VTOC labels.");
+	vtoc_resize(h, count);
+	vtoc_read_blocks(h, 0, count);
+
+	return h;
+}
+
+
+/*
+ * opens DEVICE with FLAGS and reads the complete VTOC starting with the
+ * format 4 DSCB at POSITION; the size of the VTOC is taken from the VTOC
+ * extent of the format 4 DSCB, if it is not valid only the rest of the
+ * track is read
+ */
+vtoc_handle_t *
+vtoc_open_vtoc (char *device, int flags, unsigned long position,
+		unsigned int blksize, struct hd_geometry *geo)
+{
+	format4_label_t *f4;
+	vtoc_handle_t *h;
+	unsigned long long first, last;
+	unsigned int count;
+
+	/* the VTOC of linux volumes fills one track */
+	first = position / blksize;
+	count = geo->sectors - first % geo->sectors;
+	h = vtoc_open(device, flags, position, blksize, count);
+
+	f4 = vtoc_get_dscb(h, 0);
+	if ((f4->DS4IDFMT != 0xf4) || (f4->DS4VTOCE.typeind == 0x00))
+		return h;
+	last = (unsigned long long)
+		(cchh2trk(&f4->DS4VTOCE.ulimit, geo) + 1) * geo->sectors;
+	if ((last <= first) || (last - first <= count))
+		return h;
+	/* read the remaining tracks of the VTOC extent at once */
+	vtoc_resize(h, last - first);
+	vtoc_read_blocks(h, count, h->count - count);
+
+	return h;
+}
+
+
+/*
+ * returns the DSCB with the given INDEX in the VTOC handle H, changes to
+ * the DSCB are written by vtoc_flush after calling vtoc_put_dscb
+ */
+void *
+vtoc_get_dscb (vtoc_handle_t *h, unsigned int index)
+{
+	if (index >= h->count)
+		return NULL;
+	return h->buffer + (size_t) index * h->blksize;
+}
+
+
+/*
+ * replaces the DSCB with the given INDEX in the VTOC handle H by SIZE
+ * bytes at DSCB and marks it to be written by vtoc_flush; DSCB may
+ * also point to the DSCB in the handle itself
+ */
+void
+vtoc_put_dscb (vtoc_handle_t *h, unsigned int index, void *dscb,
+	       unsigned int size)
+{
+	char *block;
+
+	if ((index >= h->count) || (size > h->blksize)) {
+		close(h->fd);
+		vtoc_error(unable_to_write, h->device,
+			   "Invalid VTOC DSCB.");
+	}
+	block = h->buffer + (size_t) index * h->blksize;
+	if (block != dscb)
+		memmove(block, dscb, size);
+	h->changed[index] = 1;
+}
+
+
+/*
+ * writes all DSCBs of the VTOC handle H passed to vtoc_put_dscb, each
+ * run of adjacent DSCBs is written with one pwritev
+ */
+void
+vtoc_flush (vtoc_handle_t *h)
+{
+	struct iovec iov[VTOC_MAX_IOV];
+	unsigned int first, i, n;
+	ssize_t size, rc;
+
+	for (first = 0; first < h->count; first = i) {
+		if (!h->changed[first]) {
+			i = first + 1;
+			continue;
+		}
+		size = 0;
+		for (i = first, n = 0;
+		     (i < h->count) && h->changed[i] && (n < VTOC_MAX_IOV);
+		     i++, n++) {
+			iov[n].iov_base = h->buffer + (size_t) i * h->blksize;
+			iov[n].iov_len = h->blksize;
+			size += h->blksize;
+		}
+		rc = pwritev(h->fd, iov, n, h->start +
+			     (off_t) first * h->blksize);
+		if (rc != size) {
+			close(h->fd);
+			vtoc_error(unable_to_write, h->device,
+				   "Could not write VTOC labels.");
+		}
+		memset(h->changed + first, 0, n);
+	}
+}
+
+
+/*
+ * closes the VTOC handle H, changed DSCBs have to be written with
+ * vtoc_flush before
+ */
+void
+vtoc_close (vtoc_handle_t *h)
+{
+	close(h->fd);
+	free(h->buffer);
+	free(h->changed);
+	free(h);
+}
+
+
 
 /*
  * initializes a format4 label
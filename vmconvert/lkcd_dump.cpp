@@ -20,7 +20,7 @@ LKCDDump::LKCDDump(Dump* dump, const char* arch){
 	referenceDump = dump;
 	dumpHeader.magic_number   = DUMP_MAGIC_NUMBER;
 	dumpHeader.version        = DUMP_VERSION_NUMBER;
-	dumpHeader.header_size    = sizeof(struct _lkcd_dump_header);
+	dumpHeader.header_size    = sizeof(struct dump_hdr_lkcd);
 	dumpHeader.time.tv_sec    = dump->getDumpTime().tv_sec;
 	dumpHeader.time.tv_usec   = dump->getDumpTime().tv_usec;
 	strcpy(dumpHeader.utsname_machine, arch);
@@ -71,7 +71,7 @@ LKCDDump::writeDump(const char* fileName)
 	uint32_t dp_size,dp_flags;
 	uint64_t mem_loc = 0;
 	ssize_t buf_loc = 0;
-	struct _dump_page dp;
+	struct dump_page dp;
 	int size, fd;
 
 	if (fileName == NULL)
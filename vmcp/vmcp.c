@@ -145,25 +145,6 @@ static inline void linux_error(const char *message)
 	fprintf(stderr, "Error: %s: %s\n", message, strerror(errno));
 }
 
-/* Read at most COUNT bytes from FD into memory at location BUF. Return
- * number of bytes read on success, -1 on error. */
-static ssize_t read_buffer(int fd, char *buf, size_t count)
-{
-	ssize_t ret;
-	ssize_t done;
-
-	for (done = 0; done < (ssize_t) count; done += ret) {
-		ret = read(fd, &buf[done], count - done);
-		if (ret == -1 && errno == EINTR)
-			continue;
-		if (ret == -1)
-			return -1;
-		if (ret == 0)
-			break;
-	}
-	return done;
-}
-
 /* Write COUNT bytes to FD from memory at location BUF. Return number of bytes
  * written on success, -1 otherwise. */
 static ssize_t write_buffer(int fd, const char *buf, size_t count)
@@ -185,10 +166,10 @@ static ssize_t write_buffer(int fd, const char *buf, size_t count)
 
 int main(int argc, char **argv)
 {
+	struct vmcp_session session;
 	int ret;
-	int fd;
 	int response_code;
-	int response_size;
+	int response_len;
 	char *buffer;
 
 	ret = parse_args(argc, argv);
@@ -198,64 +179,35 @@ int main(int argc, char **argv)
 	if (!keep_case)
 		uppercase(command);
 
-	buffer = malloc(buffersize);
-	if (!buffer) {
-		linux_error("Could not allocate return buffer");
-		return VMCP_LIN;
-	}
-	fd = open(DEVICE_NODE, O_RDWR);
-	if (fd == -1) {
-		linux_error("Could not open device " DEVICE_NODE);
-		free(buffer);
-		return VMCP_LIN;
-	}
-	if (ioctl(fd, VMCP_SETBUF, &buffersize) == -1) {
-		linux_error("Could not set buffer size");
-		free(buffer);
-		close(fd);
-		return VMCP_LIN;
-	}
-	if (write(fd, command, strlen(command)) == -1) {
-		linux_error("Could not issue CP command");
-		free(buffer);
-		close(fd);
-		return VMCP_LIN;
-	}
-	if (ioctl(fd, VMCP_GETCODE, &response_code) == -1) {
-		linux_error("Could not query return code");
-		free(buffer);
-		close(fd);
+	if (vmcp_open(&session, DEVICE_NODE, NULL)) {
+		linux_error(session.err_msg);
 		return VMCP_LIN;
 	}
-	if (ioctl(fd, VMCP_GETSIZE, &response_size) == -1) {
-		linux_error("Could not query response size");
-		free(buffer);
-		close(fd);
+	if (vmcp_set_bufsize(&session, buffersize)) {
+		linux_error(session.err_msg);
+		vmcp_close(&session);
 		return VMCP_LIN;
 	}
-	ret = read_buffer(fd, buffer, buffersize);
-	if (ret == -1) {
-		linux_error("Could not read CP response");
-		free(buffer);
-		close(fd);
+	ret = vmcp_cmd(&session, command, 0, &response_code, &buffer,
+		       &response_len);
+	if (ret && ret != -EMSGSIZE) {
+		linux_error(session.err_msg);
+		vmcp_close(&session);
 		return VMCP_LIN;
 	}
-	write_buffer(STDOUT_FILENO, buffer, ret);
-	if (response_size > buffersize) {
+	write_buffer(STDOUT_FILENO, buffer, response_len);
+	if (ret == -EMSGSIZE) {
 		fprintf(stderr, "Error: output (%d bytes) was truncated, try "
-			"--buffer to increase size\n", response_size);
-		free(buffer);
-		close(fd);
+			"--buffer to increase size\n", session.resp_size);
+		vmcp_close(&session);
 		return VMCP_BUF;
 	}
 	if (response_code > 0) {
 		fprintf(stderr, "Error: non-zero CP response for command '%s': "
 			"#%d\n", command, response_code);
-		free(buffer);
-		close(fd);
+		vmcp_close(&session);
 		return VMCP_CP;
 	}
-	free(buffer);
-	close(fd);
+	vmcp_close(&session);
 	return VMCP_OK;
 }
@@ -14,16 +14,13 @@
 #include <getopt.h>
 #include <sys/ioctl.h>
 #include "../include/zt_common.h"
+#include "../include/libvmcp.h"
 
-#define DEVICE_NODE "/dev/vmcp"
+#define DEVICE_NODE VMCP_DEVICE_NODE
 
-#define VMCP_GETCODE _IOR(0x10, 1, int)
-#define VMCP_SETBUF _IOW(0x10, 2, int)
-#define VMCP_GETSIZE _IOR(0x10, 3, int)
-
-#define MAXBUFFER 1048576
-#define MINBUFFER 4096
-#define MAXCMDLEN 240
+#define MAXBUFFER VMCP_MAXBUFFER
+#define MINBUFFER VMCP_MINBUFFER
+#define MAXCMDLEN VMCP_MAXCMDLEN
 
 #define VMCP_OK 0
 #define VMCP_CP 1
@@ -27,9 +27,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/time.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <search.h>
 #include <linux/types.h>
+#include <linux/falloc.h>
 #include "zt_common.h"
+#include "libvmcp.h"
 #include "vmur.h"
 #include "dump.h"
 
@@ -73,6 +78,16 @@ struct vmur {
 	int   stdout_specified;
 	int   hold_specified;
 	int   convert_specified;
+	int   all_specified;
+	char  rdr_class;
+	int   rdr_class_specified;
+	char  dir_name[PATH_MAX];
+	int   dir_name_specified;
+	int   blocks;
+	int   blocks_specified;
+	int   stats_specified;
+	struct rdr_stats stats;
+	long  spool_records;
 	enum  ur_action action;
 	int   devno;
 	int   ur_reclen;
@@ -140,6 +155,7 @@ static char *to_valid_linux_name(char *str)
 
 static char HELP_TEXT[] =
 "Usage: vmur receive [OPTIONS] [SPOOLID] [FILE]\n"
+"       vmur receive [OPTIONS] --all\n"
 "       vmur punch   [OPTIONS] [FILE]\n"
 "       vmur print   [OPTIONS] [FILE]\n"
 "       vmur purge   [OPTIONS] [SPOOLID]\n"
@@ -171,6 +187,15 @@ static char HELP_TEXT[] =
 "-O, --stdout             Write spool file to stdout.\n"
 "-f, --force              Overwrite files without prompt.\n"
 "-H, --hold               Hold spool file in reader after receive.\n"
+"-a, --all                Receive all files from the reader queue.\n"
+"-C, --class              Receive only files of this spool file class\n"
+"                         (requires --all).\n"
+"-D, --directory          Directory for the files received with --all.\n"
+"                         If omitted, the current directory is used.\n"
+"-B, --batch              Number of 4K blocks per read from the reader\n"
+"                         device (1-" STRINGIFY(RDR_MAX_BLOCKS) "). Default is "
+STRINGIFY(READ_BLOCKS) ".\n"
+"-S, --stats              Print throughput and stall time statistics.\n"
 "\n"
 "Options for 'punch' and 'print' command:\n"
 "\n"
@@ -225,24 +250,6 @@ fail:
 	ERR_EXIT("Could not initialize signal handler (errno = %i)\n", errno);
 }
 
-/*
- * Read at most COUNT bytes from FD into memory at location BUF.
- * Return number of bytes read on success, -1 on error.
- */
-static ssize_t read_buf(int fd, char *buf, ssize_t count)
-{
-	ssize_t rc, len;
-
-	for (len = 0; len < count; len += rc) {
-		rc = read(fd, &buf[len], count - len);
-		if (rc == -1)
-			return -1;
-		if (rc == 0)
-			break;
-	}
-	return len;
-}
-
 /*
  * Strip leading CP header from error message
  */
@@ -261,51 +268,44 @@ static void strip_cperr(char *buf)
 	}
 }
 
+/*
+ * Get vmcp session that is used for all CP commands
+ */
+static struct vmcp_session *get_vmcp_session(const char *cmd)
+{
+	static struct vmcp_session session;
+	static int session_open;
+
+	if (session_open)
+		return &session;
+	if (vmcp_open(&session, NULL, NULL))
+		ERR_EXIT("Could not issue cp command: \"%s\"\n"
+			 "Ensure that vmcp kernel module is loaded!\n", cmd);
+	session_open = 1;
+	return &session;
+}
+
 static void _cpcmd(char *cpcmd, char **resp, int *rc, int retry, int upper)
 {
-	int fd, len, cprc, bufsize = VMCP_BUFSIZE;
-	char *buf;
+	struct vmcp_session *session;
+	int vmcp_rc, cprc;
 	char cmd[MAXCMDLEN];
+	char *buf;
 
 	strcpy(cmd, cpcmd);
 	if (upper)
 		to_upper(cmd);
 
-	fd = open(VMCP_DEVICE_NODE, O_RDWR);
-	if (fd == -1)
-		ERR_EXIT("Could not issue cp command: \"%s\"\n"
-			 "Ensure that vmcp kernel module is loaded!\n", cmd);
-
-	do {
-		if (ioctl(fd, VMCP_SETBUF, &bufsize) == -1)
-			goto fail;
-
-		if (write(fd, cmd, strlen(cmd)) == -1)
-			goto fail;
-
-		if (ioctl(fd, VMCP_GETCODE, &cprc) == -1)
-			goto fail;
-
-		if (ioctl(fd, VMCP_GETSIZE, &len) == -1)
-			goto fail;
-
-		if (len <= bufsize)
-			break;
-		else if (retry)
-			bufsize = len;
-		else
-			ERR_EXIT("Not enough buffer space (%i/%i) for CP "
-				 "command '%s'.\nSorry, please issue command "
-				 "on your 3270 console!\n", len, bufsize, cmd);
-	} while (1);
-
-	buf = (char *) malloc(len + 1);
-	if (!buf)
-		ERR_EXIT("Out of memory for CP command '%s'\n", cmd);
-
-	memset(buf, 0, len + 1);
-	if (read_buf(fd, buf, len) == -1)
-		goto fail;
+	session = get_vmcp_session(cmd);
+	vmcp_rc = vmcp_cmd(session, cmd, retry ? VMCP_RETRY : 0, &cprc, &buf,
+			   NULL);
+	if (vmcp_rc == -EMSGSIZE)
+		ERR_EXIT("Not enough buffer space (%i/%i) for CP "
+			 "command '%s'.\nSorry, please issue command "
+			 "on your 3270 console!\n", session->resp_size,
+			 session->bufsize, cmd);
+	if (vmcp_rc)
+		ERR_EXIT("CP command '%s' failed.\n", cmd);
 
 	if (rc == NULL) {
 		if (cprc != 0) {
@@ -317,15 +317,11 @@ static void _cpcmd(char *cpcmd, char **resp, int *rc, int retry, int upper)
 		*rc = cprc;
 	}
 
-	if (resp)
-		*resp = buf;
-	else
-		free(buf);
-	close(fd);
-	return;
-
-fail:
-	ERR_EXIT("CP command '%s' failed.\n", cmd);
+	if (resp) {
+		*resp = strdup(buf);
+		if (!*resp)
+			ERR_EXIT("Out of memory for CP command '%s'\n", cmd);
+	}
 }
 
 /*
@@ -486,6 +482,7 @@ static void init_info(struct vmur *info)
 {
 	memset(info, 0, sizeof(struct vmur));
 	strcpy(info->queue, "rdr");
+	info->blocks = READ_BLOCKS;
 }
 
 /*
@@ -572,6 +569,31 @@ fail:
 		 "'0xSS,0xPP'.\n");
 }
 
+/*
+ * Set spool file class for receive --all
+ */
+static void set_rdr_class(struct vmur *info, char *rdr_class)
+{
+	if ((strlen(rdr_class) != 1) || !isalnum(rdr_class[0]))
+		ERR_EXIT("Invalid class: %s\n", rdr_class);
+	info->rdr_class = toupper(rdr_class[0]);
+	++info->rdr_class_specified;
+}
+
+/*
+ * Set number of blocks per read from the reader device
+ */
+static void set_blocks(struct vmur *info, char *blocks)
+{
+	char *endptr;
+
+	info->blocks = strtol(blocks, &endptr, 10);
+	if ((*endptr != 0) || (info->blocks < 1) ||
+	    (info->blocks > RDR_MAX_BLOCKS))
+		ERR_EXIT("Invalid batch size: %s\n", blocks);
+	++info->blocks_specified;
+}
+
 /*
  * Parse the command line: General options
  */
@@ -607,11 +629,16 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 		{ "force",       no_argument,       NULL, 'f'},
 		{ "hold",        no_argument,       NULL, 'H'},
 		{ "convert",     no_argument,       NULL, 'c'},
+		{ "all",         no_argument,       NULL, 'a'},
 		{ "device",      required_argument, NULL, 'd'},
 		{ "blocked",     required_argument, NULL, 'b'},
+		{ "class",       required_argument, NULL, 'C'},
+		{ "directory",   required_argument, NULL, 'D'},
+		{ "batch",       required_argument, NULL, 'B'},
+		{ "stats",       no_argument,       NULL, 'S'},
 		{ 0,             0,                 0,    0  }
 	};
-	static const char option_string[] = "vhtOfHcd:b:";
+	static const char option_string[] = "vhtOfHcaSd:b:C:D:B:";
 
 	strcpy(info->devnode, VMRDR_DEVICE_NODE);
 	while (1) {
@@ -644,13 +671,36 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 		case 'c':
 			++info->convert_specified;
 			break;
+		case 'a':
+			++info->all_specified;
+			break;
+		case 'C':
+			set_rdr_class(info, optarg);
+			break;
+		case 'D':
+			++info->dir_name_specified;
+			strncpy(info->dir_name, optarg,
+				sizeof(info->dir_name) - 1);
+			break;
+		case 'B':
+			set_blocks(info, optarg);
+			break;
+		case 'S':
+			++info->stats_specified;
+			break;
 		default:
 			std_usage_exit();
 		}
 	}
 
-	set_spoolid(info, argv, argc, optind + 1, 1);
-	set_file(info, argv, argc, optind + 2);
+	if (info->all_specified) {
+		if (argc > optind + 1)
+			ERR_EXIT("Spool id or file not allowed, when --all "
+				 "specified!\n");
+	} else {
+		set_spoolid(info, argv, argc, optind + 1, 1);
+		set_file(info, argv, argc, optind + 2);
+	}
 
 	CHECK_SPEC_MAX(info->text_specified, 1, "text");
 	CHECK_SPEC_MAX(info->devnode_specified, 1, "devnode");
@@ -660,9 +710,21 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 	CHECK_SPEC_MAX(info->hold_specified, 1, "hold");
 	CHECK_SPEC_MAX(info->stdout_specified, 1, "stdout");
 	CHECK_SPEC_MAX(info->convert_specified, 1, "convert");
+	CHECK_SPEC_MAX(info->all_specified, 1, "all");
+	CHECK_SPEC_MAX(info->rdr_class_specified, 1, "class");
+	CHECK_SPEC_MAX(info->dir_name_specified, 1, "directory");
+	CHECK_SPEC_MAX(info->blocks_specified, 1, "batch");
+	CHECK_SPEC_MAX(info->stats_specified, 1, "stats");
 
 	if (info->stdout_specified && info->file_name_specified)
 		ERR_EXIT("File name not allowed, when --stdout specifed!\n");
+	if (info->stdout_specified && info->all_specified)
+		ERR_EXIT("Conflicting options: --stdout together with --all "
+			 "specified\n");
+	if (info->rdr_class_specified && !info->all_specified)
+		ERR_EXIT("--class without --all specified\n");
+	if (info->dir_name_specified && !info->all_specified)
+		ERR_EXIT("--directory without --all specified\n");
 	if (info->blocked_specified + info->text_specified +
 	    info->convert_specified > 1)
 		ERR_EXIT("Conflicting options: -b, -t and -c are mutually "
@@ -1073,6 +1135,17 @@ static void parse_opts(struct vmur *info, int argc, char *argv[])
 	}
 }
 
+/*
+ * Check if spool file has hold state "NONE" in QUERY READER response
+ */
+static void check_hold_state_resp(char *spoolid, char *response)
+{
+	response[114] = 0;
+	if (strcmp(&response[110], "NONE") != 0)
+		ERR_EXIT("Could not receive spool file %s: hold state = %s\n",
+			 spoolid, &response[110]);
+}
+
 /*
  * Check if spool file has hold state "NONE"
  */
@@ -1083,10 +1156,7 @@ static void check_hold_state(char *spoolid)
 
 	sprintf(cmd, "QUERY READER * %s ALL SHORTDATE", spoolid);
 	cpcmd(cmd, &response, 0, 0);
-	response[114] = 0;
-	if (strcmp(&response[110], "NONE") != 0)
-		ERR_EXIT("Could not receive spool file %s: hold state = %s\n",
-			 spoolid, &response[110]);
+	check_hold_state_resp(spoolid, response);
 	free(response);
 }
 
@@ -1100,14 +1170,20 @@ static void check_hold_state(char *spoolid)
  */
 static void order_change_reader_file(struct vmur *info)
 {
-	char cmd[MAXCMDLEN];
+	char cmd[MAXCMDLEN], *resp;
 
 	sprintf(cmd, "ORDER * READER %s", info->spoolid);
 	cpcmd(cmd, NULL, NULL, 0);
 	sprintf(cmd, "CHANGE * READER %s NOHOLD", info->spoolid);
 	cpcmd(cmd, NULL, NULL, 0);
+	sprintf(cmd, "QUERY READER * %s ALL SHORTDATE", info->spoolid);
+	cpcmd(cmd, &resp, NULL, 0);
 
-	check_hold_state(info->spoolid);
+	if (strlen(resp) > QRDR_HEADER_LEN + QRDR_RECORDS_OFFS)
+		info->spool_records = strtol(resp + QRDR_HEADER_LEN +
+					     QRDR_RECORDS_OFFS, NULL, 10);
+	check_hold_state_resp(info->spoolid, resp);
+	free(resp);
 }
 
 /*
@@ -1481,14 +1557,352 @@ static void ur_receive_sig_handler(int UNUSED(sig), siginfo_t *UNUSED(sip),
 	ERR_EXIT("Operation terminated, spool file received incompletely.\n");
 }
 
+/*
+ * Receive pipeline: RDR_PIPE_BUFS buffers are filled by the reader thread
+ * and consumed in order by the converter/writer
+ */
+struct rdr_pipe {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct splink_page *sfdata[RDR_PIPE_BUFS];
+	ssize_t count[RDR_PIPE_BUFS];
+	int full[RDR_PIPE_BUFS];
+	int read_errno;
+	int stop;
+	int fhi;
+	struct vmur *info;
+};
+
+/*
+ * Get current time in seconds
+ */
+static double get_time(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Print receive statistics (--stats)
+ */
+static void print_stats(struct vmur *info)
+{
+	struct rdr_stats *stats = &info->stats;
+	double elapsed, mb;
+
+	if (!info->stats_specified)
+		return;
+	elapsed = get_time() - stats->start;
+	mb = stats->bytes_read / (1024.0 * 1024.0);
+	fprintf(stderr, "Receive statistics:\n");
+	fprintf(stderr, "  Data read        : %.2f MB in %.2f s "
+		"(%.2f MB/s)\n", mb, elapsed,
+		elapsed > 0 ? mb / elapsed : 0);
+	fprintf(stderr, "  Reader device    : %.2f s busy, %.2f s stalled\n",
+		stats->read_time, stats->read_stall);
+	fprintf(stderr, "  Convert and write: %.2f s busy, %.2f s stalled\n",
+		stats->write_time, stats->write_stall);
+}
+
+/*
+ * Receive pipeline: Reader thread, that fills the buffers from the
+ * reader device
+ */
+static void *rdr_pipe_reader(void *arg)
+{
+	struct rdr_pipe *rpipe = (struct rdr_pipe *) arg;
+	struct rdr_stats *stats = &rpipe->info->stats;
+	int i = 1, stop;
+	ssize_t count;
+	double t;
+
+	do {
+		t = get_time();
+		pthread_mutex_lock(&rpipe->lock);
+		while (rpipe->full[i] && !rpipe->stop)
+			pthread_cond_wait(&rpipe->cond, &rpipe->lock);
+		stop = rpipe->stop;
+		pthread_mutex_unlock(&rpipe->lock);
+		if (stop)
+			break;
+		stats->read_stall += get_time() - t;
+
+		t = get_time();
+		count = read(rpipe->fhi, rpipe->sfdata[i], rpipe->info->blocks *
+			     sizeof(struct splink_page));
+		stats->read_time += get_time() - t;
+
+		pthread_mutex_lock(&rpipe->lock);
+		if (count == -1)
+			rpipe->read_errno = errno;
+		else
+			stats->bytes_read += count;
+		rpipe->count[i] = count;
+		rpipe->full[i] = 1;
+		pthread_cond_broadcast(&rpipe->cond);
+		pthread_mutex_unlock(&rpipe->lock);
+		i = (i + 1) % RDR_PIPE_BUFS;
+	} while (count > 0);
+	return NULL;
+}
+
+/*
+ * Receive pipeline: Convert and write the buffers filled by the reader
+ * thread. The first buffer has already been filled by the caller.
+ */
+static int rdr_pipe_write(struct rdr_pipe *rpipe, enum spoolfile_fmt type,
+			  int fho)
+{
+	struct vmur *info = rpipe->info;
+	struct rdr_stats *stats = &info->stats;
+	ssize_t count;
+	int i = 0, rc;
+	double t;
+
+	while (1) {
+		t = get_time();
+		pthread_mutex_lock(&rpipe->lock);
+		while (!rpipe->full[i])
+			pthread_cond_wait(&rpipe->cond, &rpipe->lock);
+		count = rpipe->count[i];
+		pthread_mutex_unlock(&rpipe->lock);
+		stats->write_stall += get_time() - t;
+
+		if (count == -1) {
+			ERR("Could not read from device %s\n%s\n",
+			    info->devnode, strerror(rpipe->read_errno));
+			return -EIO;
+		}
+		if (count == 0)
+			return 0;
+
+		t = get_time();
+		if (type == TYPE_VMDUMP)
+			rc = write_vmdump(info, rpipe->sfdata[i],
+					  count / sizeof(struct splink_page),
+					  fho);
+		else
+			rc = write_normal(info, rpipe->sfdata[i],
+					  count / sizeof(struct splink_page),
+					  fho);
+		stats->write_time += get_time() - t;
+		if (rc)
+			return rc;
+
+		pthread_mutex_lock(&rpipe->lock);
+		rpipe->full[i] = 0;
+		pthread_cond_broadcast(&rpipe->cond);
+		pthread_mutex_unlock(&rpipe->lock);
+		i = (i + 1) % RDR_PIPE_BUFS;
+	}
+}
+
+/*
+ * Receive pipeline: Start reader thread, convert and write the data, and
+ * stop the reader thread again
+ */
+static int rdr_pipe_run(struct rdr_pipe *rpipe, enum spoolfile_fmt type,
+			int fho)
+{
+	pthread_t reader;
+	int rc;
+
+	rpipe->full[0] = 1;
+	if (pthread_create(&reader, NULL, rdr_pipe_reader, rpipe)) {
+		ERR("Could not create reader thread\n");
+		return -ENOMEM;
+	}
+	rc = rdr_pipe_write(rpipe, type, fho);
+
+	pthread_mutex_lock(&rpipe->lock);
+	rpipe->stop = 1;
+	pthread_cond_broadcast(&rpipe->cond);
+	pthread_mutex_unlock(&rpipe->lock);
+	pthread_join(reader, NULL);
+	return rc;
+}
+
+/*
+ * Receive pipeline: Allocate buffers
+ */
+static void rdr_pipe_init(struct rdr_pipe *rpipe, struct vmur *info, int fhi)
+{
+	int i;
+
+	memset(rpipe, 0, sizeof(*rpipe));
+	pthread_mutex_init(&rpipe->lock, NULL);
+	pthread_cond_init(&rpipe->cond, NULL);
+	rpipe->info = info;
+	rpipe->fhi = fhi;
+	for (i = 0; i < RDR_PIPE_BUFS; i++) {
+		rpipe->sfdata[i] = (struct splink_page *)
+			malloc(info->blocks * sizeof(struct splink_page));
+		if (!rpipe->sfdata[i])
+			ERR_EXIT("Out of memory\n");
+	}
+}
+
+static void rdr_pipe_free(struct rdr_pipe *rpipe)
+{
+	int i;
+
+	for (i = 0; i < RDR_PIPE_BUFS; i++)
+		free(rpipe->sfdata[i]);
+	pthread_mutex_destroy(&rpipe->lock);
+	pthread_cond_destroy(&rpipe->cond);
+}
+
+/*
+ * Preallocate disk space for VMDUMP output file from the number of spool
+ * file records reported by CP. The file size is not changed. Return the
+ * end of the preallocated space, which has to be passed to trim_vmdump()
+ * after the file is written, or 0 if nothing was preallocated.
+ */
+static off_t preallocate_vmdump(int fho, long records)
+{
+	struct stat stat_info;
+	off_t start, len;
+	int flags;
+
+	flags = fcntl(fho, F_GETFL);
+	if (records <= 0 || flags == -1 || fstat(fho, &stat_info) ||
+	    !S_ISREG(stat_info.st_mode))
+		return 0;
+	/* Data is written at the current offset or appended */
+	start = (flags & O_APPEND) ? stat_info.st_size :
+		lseek(fho, 0, SEEK_CUR);
+	if (start == -1)
+		return 0;
+	len = (off_t) records * sizeof(struct splink_page);
+	if (fallocate(fho, FALLOC_FL_KEEP_SIZE, start, len))
+		return 0;
+	return start + len;
+}
+
+/*
+ * Release preallocated space behind the end of the written VMDUMP file,
+ * if the number of spool file records was too large an estimate
+ */
+static int trim_vmdump(struct vmur *info, int fho, off_t end)
+{
+	struct stat stat_info;
+
+	if (end == 0)
+		return 0;
+	if (fstat(fho, &stat_info))
+		goto fail;
+	if (stat_info.st_size >= end)
+		return 0;
+	/* Truncating to the current size frees the blocks behind it */
+	if (ftruncate(fho, stat_info.st_size) == 0)
+		return 0;
+fail:
+	ERR("Could not release preallocated space of file %s: %s\n",
+	    info->file_name, strerror(errno));
+	return -errno;
+}
+
+/*
+ * Move data from pipe to output file
+ */
+static int rdr_splice_out(struct vmur *info, int pfd, int fho, ssize_t len)
+{
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = splice(pfd, NULL, fho, NULL, len,
+			    SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (rc <= 0) {
+			ERR("Write to file %s failed: %s\n", info->file_name,
+			    rc ? strerror(errno) : "Short write");
+			return -EIO;
+		}
+		len -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Receive VMDUMP data without passing it through user space: The data
+ * is spliced from the reader device via a pipe into the output file. The
+ * first blocks have already been read by the caller and are written first.
+ *
+ * Return -EOPNOTSUPP without having consumed or written any data, if the
+ * reader device or the output file does not support splice.
+ */
+static int rdr_splice_vmdump(struct vmur *info, struct rdr_stats *stats,
+			     int fhi, int fho, struct splink_page *sfdata,
+			     int blocks)
+{
+	size_t len = info->blocks * sizeof(struct splink_page);
+	int pfd[2], flags, rc = -EIO;
+	ssize_t count;
+	double t;
+
+	/* splice() to a file opened with O_APPEND fails with EINVAL */
+	flags = fcntl(fho, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND))
+		return -EOPNOTSUPP;
+	if (pipe(pfd) == -1)
+		return -EOPNOTSUPP;
+#ifdef F_SETPIPE_SZ
+	fcntl(pfd[1], F_SETPIPE_SZ, len);
+#endif
+
+	/* Trial splice from the empty pipe: If the output supports splice,
+	 * it fails with EAGAIN without writing anything */
+	count = splice(pfd[0], NULL, fho, NULL, len, SPLICE_F_NONBLOCK);
+	if (count != -1 || errno != EAGAIN) {
+		rc = -EOPNOTSUPP;
+		goto out;
+	}
+
+	t = get_time();
+	count = splice(fhi, NULL, pfd[1], NULL, len, SPLICE_F_MOVE);
+	if (count == -1 && (errno == EINVAL || errno == ENOSYS)) {
+		rc = -EOPNOTSUPP;
+		goto out;
+	}
+	t = get_time() - t;
+	if (write_vmdump(info, sfdata, blocks, fho))
+		goto out;
+	while (count != 0) {
+		if (count == -1) {
+			ERR("Could not read from device %s\n%s\n",
+			    info->devnode, strerror(errno));
+			goto out;
+		}
+		stats->read_time += t;
+		stats->bytes_read += count;
+		t = get_time();
+		if (rdr_splice_out(info, pfd[0], fho, count))
+			goto out;
+		stats->write_time += get_time() - t;
+		t = get_time();
+		count = splice(fhi, NULL, pfd[1], NULL, len, SPLICE_F_MOVE);
+		t = get_time() - t;
+	}
+	rc = 0;
+out:
+	close(pfd[0]);
+	close(pfd[1]);
+	return rc;
+}
+
 /*
  * Receive reader file.
  */
 static void ur_receive(struct vmur *info)
 {
-	struct splink_page sfdata[READ_BLOCKS];
+	struct rdr_pipe rpipe;
+	struct splink_page *sfdata;
 	enum spoolfile_fmt type;
-	int fhi, fho = STDOUT_FILENO, count;
+	int fhi, fho = STDOUT_FILENO;
+	off_t prealloc_end = 0;
+	ssize_t count;
+	double t;
 	int rc;
 
 	if (check_class(info))
@@ -1516,12 +1930,18 @@ static void ur_receive(struct vmur *info)
 
 	/* Read first block and check spoolfile format */
 
-	count = read(fhi, &sfdata, READ_BLOCKS * sizeof(sfdata[0]));
+	rdr_pipe_init(&rpipe, info, fhi);
+	sfdata = rpipe.sfdata[0];
+	info->stats.start = t = get_time();
+	count = read(fhi, sfdata, info->blocks * sizeof(sfdata[0]));
 	if (count == -1) {
 		ERR("Could not read from device %s\n%s\n", info->devnode,
 		    strerror(errno));
 		goto fail;
 	}
+	info->stats.read_time += get_time() - t;
+	info->stats.bytes_read += count;
+	rpipe.count[0] = count;
 
 	type = get_spoolfile_fmt(info, &sfdata[0]);
 	if (info->convert_specified) {
@@ -1570,34 +1990,29 @@ static void ur_receive(struct vmur *info)
 			goto fail;
 		}
 	}
-	while (count != 0) {
-		int blocks;
-
-		blocks = count / sizeof(sfdata[0]);
-		if (type == TYPE_VMDUMP)
-			rc = write_vmdump(info, &sfdata[0], blocks, fho);
-		else
-			rc = write_normal(info, &sfdata[0], blocks, fho);
-
-		if (rc)
-			goto fail;
-
-		/* read next records */
-		count = read(fhi, &sfdata, READ_BLOCKS * sizeof(sfdata[0]));
-		if (count == -1) {
-			ERR("Could not read from device %s\n%s\n",
-			    info->devnode, strerror(errno));
+	if (type == TYPE_VMDUMP) {
+		prealloc_end = preallocate_vmdump(fho, info->spool_records);
+		rc = rdr_splice_vmdump(info, &info->stats, fhi, fho, sfdata,
+				       count / sizeof(sfdata[0]));
+		if (rc == 0)
+			count = 0;
+		else if (rc != -EOPNOTSUPP)
 			goto fail;
-		}
 	}
+	if (count != 0 && rdr_pipe_run(&rpipe, type, fho))
+		goto fail;
+	if (trim_vmdump(info, fho, prealloc_end))
+		goto fail;
 	if (fho != STDOUT_FILENO)
 		close(fho);
 	close(fhi);
 vm_convert_done:
+	rdr_pipe_free(&rpipe);
 	if (info->hold_specified)
 		close_reader(info, "HOLD");
 	else
 		close_reader(info, "NOHOLD NOKEEP");
+	print_stats(info);
 	return;
 
 fail:
@@ -1605,6 +2020,759 @@ fail:
 	exit(1);
 }
 
+/*
+ * Receive all: Chunk of spool file data read from the reader device
+ */
+struct rdr_chunk {
+	struct rdr_chunk *next;
+	size_t size;
+	int blocks;
+	struct splink_page *sfdata;
+};
+
+/*
+ * Receive all: One received spool file, to be converted and written by
+ * a worker thread. The reader adds chunks while the worker writes them.
+ */
+struct rdr_job {
+	struct rdr_job *next;
+	const char *spoolid;
+	struct vmur info;
+	enum spoolfile_fmt type;
+	struct rdr_chunk *chunks;
+	struct rdr_chunk *last;
+	int complete;
+	int aborted;
+};
+
+/*
+ * Receive all: Worker pool shared by reader and workers
+ */
+struct rdr_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t job_cond;
+	pthread_cond_t done_cond;
+	struct rdr_job *head;
+	struct rdr_job *tail;
+	size_t inflight_bytes;
+	int shutdown;
+	int failed;
+	const char **done_ids;
+	int done_count;
+	struct rdr_stats *stats;
+};
+
+struct rdr_worker {
+	pthread_t thread;
+	struct rdr_pool *pool;
+	iconv_t iconv;
+};
+
+/*
+ * Copy column of "QUERY RDR" response line and strip trailing blanks
+ */
+static void get_rdr_field(char *dest, const char *line, unsigned int offs,
+			  unsigned int len)
+{
+	dest[0] = 0;
+	if (strlen(line) > offs) {
+		strncpy(dest, line + offs, len);
+		dest[len] = 0;
+	}
+	strstrip(dest);
+}
+
+/*
+ * List all reader files with one CP command
+ */
+static int get_rdr_files(struct rdr_file **files)
+{
+	char cmd[MAXCMDLEN];
+	char *buf, *line, *next;
+	int count = 0;
+
+	strcpy(cmd, "QUERY RDR * ALL SHORTDATE");
+	cpcmd(cmd, &buf, NULL, 1);
+	*files = NULL;
+
+	/* First line is the header, "NO RDR FILES" if reader is empty */
+	if (strncmp(buf, "ORIGINID", 8) != 0)
+		goto out;
+	line = strchr(buf, '\n');
+	while (line && *(++line)) {
+		struct rdr_file *file;
+
+		next = strchr(line, '\n');
+		if (next)
+			*next = 0;
+		if (strlen(line) <= QRDR_HOLD_OFFS)
+			goto next_line;
+		*files = (struct rdr_file *) realloc(*files, (count + 1) *
+						     sizeof(**files));
+		if (!*files)
+			ERR_EXIT("Out of memory\n");
+		file = &(*files)[count++];
+		get_rdr_field(file->spoolid, line, QRDR_SPOOLID_OFFS, 4);
+		file->file_class = line[QRDR_CLASS_OFFS];
+		get_rdr_field(file->hold, line, QRDR_HOLD_OFFS, 4);
+		file->records = strtol(line + QRDR_RECORDS_OFFS, NULL, 10);
+		get_rdr_field(file->name, line, QRDR_NAME_OFFS, 8);
+		get_rdr_field(file->type, line, QRDR_TYPE_OFFS, 8);
+next_line:
+		line = next;
+	}
+out:
+	free(buf);
+	return count;
+}
+
+/*
+ * Issue CP command "<prefix> <spoolid> <spoolid> ... [<suffix>]" for a list
+ * of spool ids using as few CP commands as possible
+ */
+static void cpcmd_spoolids(const char *prefix, const char *suffix,
+			   const char **ids, int count)
+{
+	char cmd[MAXCMDLEN];
+	size_t suffix_len;
+	int i = 0;
+
+	suffix_len = suffix ? strlen(suffix) + 1 : 0;
+	while (i < count) {
+		strcpy(cmd, prefix);
+		do {
+			strcat(cmd, " ");
+			strcat(cmd, ids[i++]);
+		} while ((i < count) && (strlen(cmd) + strlen(ids[i]) + 1 +
+					 suffix_len < MAXCMDLEN));
+		if (suffix) {
+			strcat(cmd, " ");
+			strcat(cmd, suffix);
+		}
+		cpcmd(cmd, NULL, NULL, 0);
+	}
+}
+
+/*
+ * Build output file name <directory>/<name>.<type> for reader file. If
+ * another reader file has the same name and type, .<spoolid> is appended.
+ */
+static void set_rdr_file_name(struct vmur *info, struct rdr_file *file)
+{
+	char *end;
+
+	if (strlen(file->type) == 0)
+		snprintf(info->file_name, sizeof(info->file_name), "%s/%s",
+			 info->dir_name, file->name);
+	else
+		snprintf(info->file_name, sizeof(info->file_name), "%s/%s.%s",
+			 info->dir_name, file->name, file->type);
+	if (file->add_spoolid) {
+		end = info->file_name + strlen(info->file_name);
+		snprintf(end, sizeof(info->file_name) -
+			 (end - info->file_name), ".%s", file->spoolid);
+	}
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp((const char *) a, (const char *) b);
+}
+
+/*
+ * Choose the output file name of a reader file. Each selected reader file
+ * must get its own output file, otherwise two workers would write the same
+ * file and both reader files would be purged. NAMES contains the output
+ * file names of the files selected so far. Return 0 if the file can be
+ * received, -1 if it has to be skipped.
+ */
+static int select_rdr_file_name(struct vmur *info, struct rdr_file *file,
+				void **names)
+{
+	struct stat stat_info;
+	char *name;
+
+	file->add_spoolid = 0;
+	set_rdr_file_name(info, file);
+	if (tfind(info->file_name, names, compare_names)) {
+		file->add_spoolid = 1;
+		set_rdr_file_name(info, file);
+		if (tfind(info->file_name, names, compare_names)) {
+			ERR("Skipping spool file %s: '%s' is already used "
+			    "for another spool file\n", file->spoolid,
+			    info->file_name);
+			return -1;
+		}
+		ERR("Spool file %s has the same name as another spool file, "
+		    "receiving it as '%s'\n", file->spoolid, info->file_name);
+	}
+	if (!info->force_specified && !stat(info->file_name, &stat_info)) {
+		ERR("Skipping spool file %s: '%s' already exists\n",
+		    file->spoolid, info->file_name);
+		return -1;
+	}
+	name = strdup(info->file_name);
+	if (!name || !tsearch(name, names, compare_names))
+		ERR_EXIT("Out of memory\n");
+	return 0;
+}
+
+/*
+ * Select reader files to be received: Check class, hold state, name, and
+ * output files. The user hold of the selected files is released. Return
+ * number of selected files.
+ */
+static int select_rdr_files(struct vmur *info, struct rdr_file *files,
+			    int count, int *skipped)
+{
+	char cmd[MAXCMDLEN];
+	char device_class, *buf;
+	const char **hold_ids;
+	void *names = NULL;
+	int i, selected = 0, held = 0;
+
+	sprintf(cmd, "QUERY VIRTUAL %X", info->devno);
+	cpcmd(cmd, &buf, NULL, 0);
+	device_class = buf[13];
+	free(buf);
+	if (info->rdr_class_specified && (device_class != '*') &&
+	    (device_class != info->rdr_class))
+		ERR_EXIT("Reader device class does not match spool file "
+			 "class.\nIssue CP command 'SPOOL %X CLASS *' to "
+			 "enable %X for any spool file class.\n",
+			 info->devno, info->devno);
+
+	for (i = 0; i < count; i++) {
+		struct rdr_file *file = &files[i];
+
+		if (info->rdr_class_specified) {
+			if (file->file_class != info->rdr_class)
+				continue;
+		} else if ((device_class != '*') &&
+			   (file->file_class != device_class)) {
+			continue;
+		}
+		if (strlen(file->name) == 0) {
+			ERR("Skipping unnamed spool file %s\n", file->spoolid);
+			goto skip;
+		}
+		if ((strcmp(file->hold, "USER") != 0) &&
+		    (strcmp(file->hold, "NONE") != 0)) {
+			ERR("Skipping spool file %s: hold state = %s\n",
+			    file->spoolid, file->hold);
+			goto skip;
+		}
+		to_valid_linux_name(file->name);
+		to_valid_linux_name(file->type);
+		if (select_rdr_file_name(info, file, &names))
+			goto skip;
+		files[selected++] = *file;
+		continue;
+skip:
+		(*skipped)++;
+	}
+	tdestroy(names, free);
+
+	/* Release user hold only of the files which are received */
+	hold_ids = (const char **) calloc(selected + 1, sizeof(char *));
+	if (!hold_ids)
+		ERR_EXIT("Out of memory\n");
+	for (i = 0; i < selected; i++)
+		if (strcmp(files[i].hold, "USER") == 0)
+			hold_ids[held++] = files[i].spoolid;
+	cpcmd_spoolids("CHANGE * READER", "NOHOLD", hold_ids, held);
+	free(hold_ids);
+	return selected;
+}
+
+/*
+ * Free chunk and wake up the reader if it waits for memory
+ */
+static void rdr_chunk_free(struct rdr_pool *pool, struct rdr_chunk *chunk)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->inflight_bytes -= chunk->size;
+	pthread_cond_broadcast(&pool->done_cond);
+	pthread_mutex_unlock(&pool->lock);
+	free(chunk);
+}
+
+/*
+ * Get next chunk of job, wait until the reader has added it. Return NULL
+ * when the reader has completed the job.
+ */
+static struct rdr_chunk *rdr_job_next_chunk(struct rdr_pool *pool,
+					    struct rdr_job *job)
+{
+	struct rdr_chunk *chunk;
+	double t = get_time();
+
+	pthread_mutex_lock(&pool->lock);
+	while (!job->chunks && !job->complete)
+		pthread_cond_wait(&pool->job_cond, &pool->lock);
+	chunk = job->chunks;
+	if (chunk) {
+		job->chunks = chunk->next;
+		if (!job->chunks)
+			job->last = NULL;
+	}
+	pool->stats->write_stall += get_time() - t;
+	pthread_mutex_unlock(&pool->lock);
+	return chunk;
+}
+
+/*
+ * Write received spool file to output file while it is read. After an
+ * error the remaining chunks are discarded to keep the reader going.
+ */
+static int rdr_job_write(struct rdr_pool *pool, struct rdr_job *job)
+{
+	struct rdr_chunk *chunk;
+	off_t prealloc_end = 0;
+	int fho, rc = 0;
+
+	fho = open(job->info.file_name, O_WRONLY | O_CREAT | O_TRUNC,
+		   S_IRUSR | S_IWUSR);
+	if (fho == -1) {
+		ERR("Could not open file %s\n%s\n", job->info.file_name,
+		    strerror(errno));
+		rc = -errno;
+	} else if (job->type == TYPE_VMDUMP) {
+		prealloc_end = preallocate_vmdump(fho,
+						  job->info.spool_records);
+	}
+	while ((chunk = rdr_job_next_chunk(pool, job))) {
+		if (rc == 0 && job->type == TYPE_VMDUMP)
+			rc = write_vmdump(&job->info, chunk->sfdata,
+					  chunk->blocks, fho);
+		else if (rc == 0)
+			rc = write_normal(&job->info, chunk->sfdata,
+					  chunk->blocks, fho);
+		rdr_chunk_free(pool, chunk);
+	}
+	if (fho == -1)
+		return rc;
+	if (!rc)
+		rc = trim_vmdump(&job->info, fho, prealloc_end);
+	if (close(fho) && !rc) {
+		ERR("Write to file %s failed: %s\n", job->info.file_name,
+		    strerror(errno));
+		rc = -errno;
+	}
+	/* Do not leave a partial output file behind */
+	if (job->aborted || rc)
+		unlink(job->info.file_name);
+	return job->aborted ? -EIO : rc;
+}
+
+static void rdr_job_free(struct rdr_pool *pool, struct rdr_job *job)
+{
+	struct rdr_chunk *chunk;
+
+	while (job->chunks) {
+		chunk = job->chunks;
+		job->chunks = chunk->next;
+		rdr_chunk_free(pool, chunk);
+	}
+	free(job);
+}
+
+/*
+ * Worker thread: Convert and write received spool files
+ */
+static void *rdr_worker_fn(void *arg)
+{
+	struct rdr_worker *worker = (struct rdr_worker *) arg;
+	struct rdr_pool *pool = worker->pool;
+	struct rdr_job *job;
+	double t;
+	int rc;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		t = get_time();
+		while (!pool->head && !pool->shutdown)
+			pthread_cond_wait(&pool->job_cond, &pool->lock);
+		job = pool->head;
+		if (!job)
+			break;
+		pool->head = job->next;
+		if (!pool->head)
+			pool->tail = NULL;
+		pool->stats->write_stall += get_time() - t;
+		pthread_mutex_unlock(&pool->lock);
+
+		t = get_time();
+		job->info.iconv = worker->iconv;
+		rc = rdr_job_write(pool, job);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->stats->write_time += get_time() - t;
+		if (rc)
+			pool->failed = 1;
+		else
+			pool->done_ids[pool->done_count++] = job->spoolid;
+		pthread_mutex_unlock(&pool->lock);
+		rdr_job_free(pool, job);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/*
+ * Allocate chunk for spool file data. Data of all chunks which are not
+ * yet written is in flight. If adding the chunk would exceed the limit,
+ * wait for the workers to catch up.
+ */
+static struct rdr_chunk *rdr_chunk_alloc(struct rdr_pool *pool, int blocks)
+{
+	struct rdr_chunk *chunk;
+	size_t size;
+	double t = get_time();
+
+	size = sizeof(*chunk) + blocks * sizeof(struct splink_page);
+	pthread_mutex_lock(&pool->lock);
+	while (pool->inflight_bytes + size > RDR_MAX_INFLIGHT)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pool->inflight_bytes += size;
+	pthread_mutex_unlock(&pool->lock);
+	pool->stats->read_stall += get_time() - t;
+
+	chunk = (struct rdr_chunk *) malloc(size);
+	if (!chunk) {
+		ERR("Out of memory\n");
+		pthread_mutex_lock(&pool->lock);
+		pool->inflight_bytes -= size;
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	chunk->size = size;
+	chunk->next = NULL;
+	chunk->sfdata = (struct splink_page *) (chunk + 1);
+	return chunk;
+}
+
+/*
+ * Add chunk to job and wake up its worker
+ */
+static void rdr_job_add_chunk(struct rdr_pool *pool, struct rdr_job *job,
+			      struct rdr_chunk *chunk)
+{
+	pthread_mutex_lock(&pool->lock);
+	if (job->last)
+		job->last->next = chunk;
+	else
+		job->chunks = chunk;
+	job->last = chunk;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Queue job for the workers, its chunks are added while they are read
+ */
+static void rdr_job_queue(struct rdr_pool *pool, struct rdr_job *job)
+{
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail)
+		pool->tail->next = job;
+	else
+		pool->head = job;
+	pool->tail = job;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Mark queued job as completely read. If ABORTED, the worker discards
+ * the output file.
+ */
+static void rdr_job_complete(struct rdr_pool *pool, struct rdr_job *job,
+			     int aborted)
+{
+	pthread_mutex_lock(&pool->lock);
+	job->complete = 1;
+	job->aborted = aborted;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Mark reader file as completely written
+ */
+static void rdr_pool_done(struct rdr_pool *pool, const char *spoolid)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->done_ids[pool->done_count++] = spoolid;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Receive VMDUMP file with splice, bypassing the workers
+ */
+static int rdr_receive_vmdump(struct vmur *info, struct rdr_job *job,
+			      int fhi, struct rdr_chunk *chunk)
+{
+	off_t prealloc_end;
+	int fho, rc;
+
+	fho = open(job->info.file_name, O_WRONLY | O_CREAT | O_TRUNC,
+		   S_IRUSR | S_IWUSR);
+	if (fho == -1) {
+		ERR("Could not open file %s\n%s\n", job->info.file_name,
+		    strerror(errno));
+		return -errno;
+	}
+	prealloc_end = preallocate_vmdump(fho, job->info.spool_records);
+	rc = rdr_splice_vmdump(&job->info, &info->stats, fhi, fho,
+			       chunk->sfdata, chunk->blocks);
+	if (rc == 0)
+		rc = trim_vmdump(&job->info, fho, prealloc_end);
+	if (close(fho) && !rc) {
+		ERR("Write to file %s failed: %s\n", job->info.file_name,
+		    strerror(errno));
+		rc = -EIO;
+	}
+	return rc;
+}
+
+/*
+ * Read one reader file and hand it to the workers chunk by chunk. The
+ * reader file is closed with HOLD, it is purged after the workers have
+ * written it.
+ */
+static int rdr_receive_file(struct vmur *info, struct rdr_pool *pool,
+			    struct rdr_file *file)
+{
+	struct rdr_chunk *chunk;
+	struct rdr_job *job;
+	int queued = 0;
+	ssize_t count;
+	double t;
+	int fhi, rc;
+
+	job = (struct rdr_job *) calloc(1, sizeof(*job));
+	if (!job) {
+		ERR("Out of memory\n");
+		return -ENOMEM;
+	}
+	job->spoolid = file->spoolid;
+	job->info = *info;
+	job->info.spool_records = file->records;
+	strcpy(job->info.spoolid, file->spoolid);
+	set_rdr_file_name(&job->info, file);
+
+	fhi = open(info->devnode, O_RDONLY | O_NONBLOCK);
+	if (fhi == -1) {
+		ERR("Could not open device %s\n%s\n", info->devnode,
+		    strerror(errno));
+		goto fail_job;
+	}
+	do {
+		chunk = rdr_chunk_alloc(pool, info->blocks);
+		if (!chunk)
+			goto fail;
+		t = get_time();
+		count = read(fhi, chunk->sfdata, info->blocks *
+			     sizeof(chunk->sfdata[0]));
+		info->stats.read_time += get_time() - t;
+		if (count == -1) {
+			ERR("Could not read from device %s\n%s\n",
+			    info->devnode, strerror(errno));
+			rdr_chunk_free(pool, chunk);
+			goto fail;
+		}
+		if (count == 0) {
+			rdr_chunk_free(pool, chunk);
+			break;
+		}
+		info->stats.bytes_read += count;
+		chunk->blocks = count / sizeof(chunk->sfdata[0]);
+		rdr_job_add_chunk(pool, job, chunk);
+		if (queued)
+			continue;
+
+		/* First block: check spoolfile format */
+		job->type = get_spoolfile_fmt(&job->info, &chunk->sfdata[0]);
+		if (info->convert_specified) {
+			if (job->type != TYPE_VMDUMP) {
+				ERR("Reader file %s does not have VMDUMP "
+				    "format, conversion not possible.\n",
+				    file->spoolid);
+				goto fail;
+			}
+			close(fhi);
+			if (vm_convert(info->devnode, job->info.file_name,
+				       prog_name))
+				goto fail_job;
+			close_reader(info, "HOLD");
+			rdr_pool_done(pool, file->spoolid);
+			rdr_job_free(pool, job);
+			return 0;
+		}
+		if (job->type == TYPE_VMDUMP) {
+			rc = rdr_receive_vmdump(info, job, fhi, chunk);
+			if (rc == 0) {
+				close(fhi);
+				close_reader(info, "HOLD");
+				rdr_pool_done(pool, file->spoolid);
+				rdr_job_free(pool, job);
+				return 0;
+			} else if (rc != -EOPNOTSUPP) {
+				goto fail;
+			}
+		}
+		if ((job->type != TYPE_VMDUMP) &&
+		    (atoi(file->spoolid) != chunk->sfdata[0].spoolid)) {
+			ERR("Could not receive spool file %s. Spoolid "
+			    "mismatch (%i)\n", file->spoolid,
+			    chunk->sfdata[0].spoolid);
+			goto fail;
+		}
+		/* Let a worker write the file while it is read */
+		rdr_job_queue(pool, job);
+		queued = 1;
+	} while (1);
+	close(fhi);
+	close_reader(info, "HOLD");
+	if (!queued) {
+		/* Empty reader file: create empty output file */
+		rdr_job_queue(pool, job);
+	}
+	rdr_job_complete(pool, job, 0);
+	return 0;
+
+fail:
+	close(fhi);
+fail_job:
+	if (queued)
+		rdr_job_complete(pool, job, 1);
+	else
+		rdr_job_free(pool, job);
+	return -EIO;
+}
+
+/*
+ * Purge reader files that have been written completely
+ */
+static void rdr_purge_done(struct rdr_pool *pool, int *purged, int force)
+{
+	int done_count;
+
+	pthread_mutex_lock(&pool->lock);
+	done_count = pool->done_count;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (!force && (done_count - *purged < RDR_BATCH_IDS))
+		return;
+	cpcmd_spoolids("PURGE * READER", NULL, &pool->done_ids[*purged],
+		       done_count - *purged);
+	*purged = done_count;
+}
+
+/*
+ * Receive all reader files: The reader device is read sequentially, data
+ * conversion and writing is done by a pool of worker threads. The reader
+ * files are ordered and purged in batches to save CP commands.
+ */
+static void ur_receive_all(struct vmur *info)
+{
+	struct rdr_worker workers[RDR_MAX_WORKERS];
+	struct rdr_file *files;
+	struct rdr_pool pool;
+	int i, j, count, nworkers, skipped = 0, purged = 0, rc = 0;
+	const char **order_ids;
+
+	if (!info->dir_name_specified)
+		strcpy(info->dir_name, ".");
+	info->stats.start = get_time();
+	count = get_rdr_files(&files);
+	count = select_rdr_files(info, files, count, &skipped);
+	if (count == 0) {
+		printf("No reader files received, %i skipped.\n", skipped);
+		free(files);
+		return;
+	}
+
+	memset(&pool, 0, sizeof(pool));
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.job_cond, NULL);
+	pthread_cond_init(&pool.done_cond, NULL);
+	pool.stats = &info->stats;
+	pool.done_ids = (const char **) calloc(count, sizeof(char *));
+	order_ids = (const char **) calloc(count, sizeof(char *));
+	if (!pool.done_ids || !order_ids)
+		ERR_EXIT("Out of memory\n");
+	for (i = 0; i < count; i++)
+		order_ids[i] = files[i].spoolid;
+
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nworkers < 1)
+		nworkers = 1;
+	if (nworkers > RDR_MAX_WORKERS)
+		nworkers = RDR_MAX_WORKERS;
+	for (i = 0; i < nworkers; i++) {
+		workers[i].pool = &pool;
+		workers[i].iconv = (iconv_t) -1;
+		if (info->text_specified) {
+			workers[i].iconv = iconv_open(ASCII_CODE_PAGE,
+						      EBCDIC_CODE_PAGE);
+			if (workers[i].iconv == ((iconv_t) -1))
+				ERR_EXIT("Could not initialize conversion "
+					 "table %s->%s.\n", EBCDIC_CODE_PAGE,
+					 ASCII_CODE_PAGE);
+		}
+		if (pthread_create(&workers[i].thread, NULL, rdr_worker_fn,
+				   &workers[i]))
+			ERR_EXIT("Could not create worker thread\n");
+	}
+
+	acquire_lock(info);
+	close_reader(info, "HOLD");
+	set_signal_handler(info, ur_receive_sig_handler);
+
+	for (i = 0; i < count; i += RDR_BATCH_IDS) {
+		int batch = (count - i < RDR_BATCH_IDS) ?
+			count - i : RDR_BATCH_IDS;
+
+		cpcmd_spoolids("ORDER * READER", NULL, &order_ids[i],
+			       batch);
+		for (j = i; j < i + batch; j++) {
+			rc = rdr_receive_file(info, &pool, &files[j]);
+			if (rc)
+				break;
+			if (!info->hold_specified)
+				rdr_purge_done(&pool, &purged, 0);
+		}
+		if (rc)
+			break;
+	}
+	if (rc)
+		close_reader(info, "HOLD");
+
+	pthread_mutex_lock(&pool.lock);
+	pool.shutdown = 1;
+	pthread_cond_broadcast(&pool.job_cond);
+	pthread_mutex_unlock(&pool.lock);
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].iconv != ((iconv_t) -1))
+			iconv_close(workers[i].iconv);
+	}
+	if (!info->hold_specified)
+		rdr_purge_done(&pool, &purged, 1);
+
+	printf("%i reader files received, %i skipped.\n", pool.done_count,
+	       skipped);
+	print_stats(info);
+	free(order_ids);
+	free(pool.done_ids);
+	free(files);
+	if (rc || pool.failed)
+		exit(1);
+}
+
 /*
  * Issue CP command CLOSE PUNCH
  */
@@ -1718,7 +2886,6 @@ static void rscs_punch_setup(struct vmur *info)
 	cpcmd(cmd, NULL, NULL, 0);
 	sprintf(cmd, "TAG DEV %X %s %s", info->devno, info->node, info->user);
 	cpcmd(cmd, NULL, NULL, 0);
-	return;
 }
 
 /*
@@ -2067,7 +3234,10 @@ int main(int argc, char **argv)
 		if (vmur_info.text_specified)
 			setup_iconv(&vmur_info, EBCDIC_CODE_PAGE,
 				    ASCII_CODE_PAGE);
-		ur_receive(&vmur_info);
+		if (vmur_info.all_specified)
+			ur_receive_all(&vmur_info);
+		else
+			ur_receive(&vmur_info);
 		break;
 	case PUNCH:
 	case PRINT:
@@ -0,0 +1,427 @@
+/*
+ *  zgetdump copy engine
+ *    Description: Copy dump data from the dump device to the output file
+ *		 descriptor. Data is moved with splice(), if the output is a
+ *		 pipe or a regular file that is not opened with O_APPEND.
+ *		 Otherwise a reader thread fills large
+ *		 buffers while the calling thread writes them, so that the
+ *		 dump device and the output device are busy at the same time.
+ *
+ *    Copyright IBM Corp. 2009
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "copy.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+struct copy_ctx {
+	struct copy_engine	*ce;
+	int			in_fd;
+	uint64_t		remaining;	/* Bytes still to be read */
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	ssize_t			count[COPY_BUFS]; /* -1: read error, 0: EOF */
+	int			full[COPY_BUFS];
+	int			read_errno;
+	int			stop;		/* Writer has given up */
+};
+
+/*
+ * Write COUNT bytes from BUF to FD. Return 0 on success, 1 on error.
+ */
+int write_all(int fd, const void *buf, size_t count)
+{
+	const char *ptr = (const char *) buf;
+	ssize_t rc;
+
+	while (count > 0) {
+		rc = write(fd, ptr, count);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1) {
+			perror("\nwrite failed");
+			return 1;
+		}
+		if (rc == 0) {
+			fprintf(stderr, "\nwrite failed: "
+				"No space left on device\n");
+			return 1;
+		}
+		ptr += rc;
+		count -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Write COUNT bytes from BUF to FD at offset OFF. Return 0 on success,
+ * 1 on error.
+ */
+int pwrite_all(int fd, const void *buf, size_t count, off_t off)
+{
+	const char *ptr = (const char *) buf;
+	ssize_t rc;
+
+	while (count > 0) {
+		rc = pwrite(fd, ptr, count, off);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1) {
+			perror("\nwrite failed");
+			return 1;
+		}
+		if (rc == 0) {
+			fprintf(stderr, "\nwrite failed: "
+				"No space left on device\n");
+			return 1;
+		}
+		ptr += rc;
+		off += rc;
+		count -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Initialize copy engine. The buffers are allocated when they are needed
+ * the first time, copies done with splice do not need them.
+ */
+void copy_engine_init(struct copy_engine *ce, size_t buf_size, int direct)
+{
+	memset(ce, 0, sizeof(*ce));
+	if (buf_size < COPY_BUF_SIZE_MIN)
+		buf_size = COPY_BUF_SIZE_MIN;
+	if (buf_size > COPY_BUF_SIZE_MAX)
+		buf_size = COPY_BUF_SIZE_MAX;
+	/* O_DIRECT needs aligned buffers and transfer sizes */
+	ce->buf_size = (buf_size + COPY_BUF_ALIGN - 1) & ~(COPY_BUF_ALIGN - 1);
+	ce->direct = direct;
+	ce->splice = !direct;
+}
+
+static int copy_alloc_bufs(struct copy_engine *ce)
+{
+	int i;
+
+	for (i = 0; i < COPY_BUFS; i++) {
+		if (ce->buf[i])
+			continue;
+		if (posix_memalign((void **) &ce->buf[i], COPY_BUF_ALIGN,
+				   ce->buf_size)) {
+			ce->buf[i] = NULL;
+			fprintf(stderr, "\nCould not allocate %zu bytes for "
+				"copy buffers\n", ce->buf_size);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void copy_engine_exit(struct copy_engine *ce)
+{
+	int i;
+
+	for (i = 0; i < COPY_BUFS; i++) {
+		free(ce->buf[i]);
+		ce->buf[i] = NULL;
+	}
+}
+
+static void copy_progress(struct copy_engine *ce, uint64_t copied)
+{
+	if (ce->progress)
+		ce->progress(copied, ce->progress_data);
+}
+
+/*
+ * Move COUNT bytes from pipe PFD to OUT_FD with splice. If OUT_OFF is not
+ * NULL, write at this offset and advance it.
+ */
+static int splice_drain(int pfd, int out_fd, off_t *out_off, size_t count)
+{
+	loff_t off;
+	ssize_t rc;
+
+	while (count > 0) {
+		off = out_off ? *out_off : 0;
+		rc = splice(pfd, NULL, out_fd, out_off ? &off : NULL, count,
+			    SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (rc > 0 && out_off)
+			*out_off += rc;
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1) {
+			perror("\nwrite failed");
+			return 1;
+		}
+		if (rc == 0) {
+			fprintf(stderr, "\nwrite failed: "
+				"No space left on device\n");
+			return 1;
+		}
+		count -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Enlarge pipe FD to SIZE bytes, so that each splice moves as much data as
+ * a buffer of the threaded copy. Unprivileged users are limited to
+ * /proc/sys/fs/pipe-max-size.
+ */
+static void copy_pipe_size(int fd, size_t size)
+{
+#ifdef F_SETPIPE_SZ
+	unsigned long max;
+	FILE *fh;
+
+	if (fcntl(fd, F_SETPIPE_SZ, size) != -1)
+		return;
+	fh = fopen("/proc/sys/fs/pipe-max-size", "r");
+	if (!fh)
+		return;
+	if (fscanf(fh, "%lu", &max) == 1 && max < size)
+		fcntl(fd, F_SETPIPE_SZ, max);
+	fclose(fh);
+#else
+	(void) fd;
+	(void) size;
+#endif
+}
+
+/*
+ * Copy with splice. If the output is a pipe, data is moved directly,
+ * otherwise through an intermediate pipe. Return -EOPNOTSUPP, if splice
+ * cannot be used and nothing has been copied.
+ */
+static int copy_splice(struct copy_engine *ce, int in_fd, int out_fd,
+		       off_t *out_off, uint64_t len, uint64_t *copied)
+{
+	int pfd[2] = { -1, -1 }, target, flags, rc = 0;
+	struct stat st;
+	ssize_t n;
+
+	/* splice() to a file opened with O_APPEND fails with EINVAL */
+	flags = fcntl(out_fd, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND))
+		return -EOPNOTSUPP;
+	if (fstat(out_fd, &st) == -1)
+		return -EOPNOTSUPP;
+	if (S_ISFIFO(st.st_mode) && !out_off) {
+		target = out_fd;
+	} else if (S_ISREG(st.st_mode)) {
+		if (pipe(pfd) == -1)
+			return -EOPNOTSUPP;
+		target = pfd[1];
+	} else {
+		return -EOPNOTSUPP;
+	}
+	copy_pipe_size(target, ce->buf_size);
+	while (*copied < len) {
+		n = splice(in_fd, NULL, target, NULL,
+			   MIN(len - *copied, ce->buf_size),
+			   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && *copied == 0 &&
+		    (errno == EINVAL || errno == ENOSYS)) {
+			rc = -EOPNOTSUPP;
+			break;
+		}
+		if (n == -1) {
+			perror(target == out_fd ? "\nsplice failed" :
+			       "\nread failed");
+			rc = 1;
+			break;
+		}
+		if (n == 0)
+			break;
+		if (target != out_fd &&
+		    splice_drain(pfd[0], out_fd, out_off, n)) {
+			rc = 1;
+			break;
+		}
+		*copied += n;
+		copy_progress(ce, *copied);
+	}
+	if (pfd[0] != -1) {
+		close(pfd[0]);
+		close(pfd[1]);
+	}
+	return rc;
+}
+
+/*
+ * Reader thread: Fill buffers in turn until LEN bytes are read, EOF is
+ * reached or the writer stops.
+ */
+static void *copy_reader(void *arg)
+{
+	struct copy_ctx *ctx = (struct copy_ctx *) arg;
+	struct copy_engine *ce = ctx->ce;
+	ssize_t n;
+	int i = 0;
+
+	do {
+		pthread_mutex_lock(&ctx->lock);
+		while (ctx->full[i] && !ctx->stop)
+			pthread_cond_wait(&ctx->cond, &ctx->lock);
+		pthread_mutex_unlock(&ctx->lock);
+		if (ctx->stop)
+			break;
+		do {
+			n = read(ctx->in_fd, ce->buf[i],
+				 MIN(ctx->remaining, ce->buf_size));
+		} while (n == -1 && errno == EINTR);
+		pthread_mutex_lock(&ctx->lock);
+		if (n == -1)
+			ctx->read_errno = errno;
+		else
+			ctx->remaining -= n;
+		ctx->count[i] = n;
+		ctx->full[i] = 1;
+		pthread_cond_broadcast(&ctx->cond);
+		pthread_mutex_unlock(&ctx->lock);
+		i = (i + 1) % COPY_BUFS;
+	} while (n > 0 && ctx->remaining > 0);
+	return NULL;
+}
+
+/*
+ * Copy with a reader thread and the calling thread as writer
+ */
+static int copy_threaded(struct copy_engine *ce, int in_fd, int out_fd,
+			 off_t *out_off, uint64_t len, uint64_t *copied)
+{
+	struct copy_ctx ctx;
+	pthread_t reader;
+	int i = 0, rc = 0;
+	ssize_t n;
+
+	if (copy_alloc_bufs(ce))
+		return 1;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.ce = ce;
+	ctx.in_fd = in_fd;
+	ctx.remaining = len - *copied;
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.cond, NULL);
+	if (pthread_create(&reader, NULL, copy_reader, &ctx)) {
+		fprintf(stderr, "\nCould not create reader thread\n");
+		rc = 1;
+		goto out_destroy;
+	}
+	while (*copied < len) {
+		pthread_mutex_lock(&ctx.lock);
+		while (!ctx.full[i])
+			pthread_cond_wait(&ctx.cond, &ctx.lock);
+		n = ctx.count[i];
+		pthread_mutex_unlock(&ctx.lock);
+		if (n == -1) {
+			errno = ctx.read_errno;
+			perror("\nread failed");
+			rc = 1;
+			break;
+		}
+		if (n == 0)
+			break;
+		if (ce->consume) {
+			if (ce->consume(ce->buf[i], n, ce->consume_data)) {
+				rc = 1;
+				break;
+			}
+		} else if (out_off) {
+			if (pwrite_all(out_fd, ce->buf[i], n, *out_off)) {
+				rc = 1;
+				break;
+			}
+			*out_off += n;
+		} else if (write_all(out_fd, ce->buf[i], n)) {
+			rc = 1;
+			break;
+		}
+		*copied += n;
+		copy_progress(ce, *copied);
+		pthread_mutex_lock(&ctx.lock);
+		ctx.full[i] = 0;
+		pthread_cond_broadcast(&ctx.cond);
+		pthread_mutex_unlock(&ctx.lock);
+		i = (i + 1) % COPY_BUFS;
+	}
+	pthread_mutex_lock(&ctx.lock);
+	ctx.stop = 1;
+	pthread_cond_broadcast(&ctx.cond);
+	pthread_mutex_unlock(&ctx.lock);
+	pthread_join(reader, NULL);
+out_destroy:
+	pthread_cond_destroy(&ctx.cond);
+	pthread_mutex_destroy(&ctx.lock);
+	return rc;
+}
+
+/*
+ * Copy LEN bytes from the current position of IN_FD to OUT_FD. If OUT_OFF
+ * is not NULL, the data is written at this offset, which is advanced, and
+ * the file position of OUT_FD is not changed. This allows several threads
+ * to write to the same output file. On return, COPIED contains the number
+ * of bytes written, which is less than LEN if the end of the input has
+ * been reached. The input file position is advanced by the number of
+ * copied bytes.
+ *
+ * Return 0 on success, 1 on error (a message has been printed).
+ */
+int copy_data_at(struct copy_engine *ce, int in_fd, int out_fd,
+		 off_t *out_off, uint64_t len, uint64_t *copied)
+{
+	int flags = 0, rc;
+
+	*copied = 0;
+	if (ce->splice && !ce->consume) {
+		rc = copy_splice(ce, in_fd, out_fd, out_off, len, copied);
+		if (rc != -EOPNOTSUPP)
+			return rc;
+		/* Do not try again for following copies */
+		ce->splice = 0;
+	}
+	if (ce->direct) {
+		flags = fcntl(in_fd, F_GETFL);
+		if (flags == -1 ||
+		    fcntl(in_fd, F_SETFL, flags | O_DIRECT) == -1) {
+			perror("Could not enable direct I/O");
+			return 1;
+		}
+	}
+	rc = copy_threaded(ce, in_fd, out_fd, out_off, len, copied);
+	/* Small reads like the end marker are not possible with O_DIRECT */
+	if (ce->direct && fcntl(in_fd, F_SETFL, flags) == -1) {
+		perror("Could not disable direct I/O");
+		rc = 1;
+	}
+	return rc;
+}
+
+int copy_data(struct copy_engine *ce, int in_fd, int out_fd, uint64_t len,
+	      uint64_t *copied)
+{
+	return copy_data_at(ce, in_fd, out_fd, NULL, len, copied);
+}
+
+/*
+ * Read LEN bytes from the current position of IN_FD and pass them to the
+ * consume function of the copy engine.
+ */
+int read_data(struct copy_engine *ce, int in_fd, uint64_t len,
+	      uint64_t *copied)
+{
+	return copy_data_at(ce, in_fd, -1, NULL, len, copied);
+}
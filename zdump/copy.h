@@ -0,0 +1,42 @@
+/*
+ *  zgetdump copy engine
+ *    Copyright IBM Corp. 2009
+ */
+
+#ifndef _COPY_H
+#define _COPY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define COPY_BUF_SIZE_DEFAULT	(4 * 1024 * 1024)
+#define COPY_BUF_SIZE_MIN	4096
+#define COPY_BUF_SIZE_MAX	(256 * 1024 * 1024)
+#define COPY_BUF_ALIGN		4096
+#define COPY_BUFS		2
+
+struct copy_engine {
+	size_t		buf_size;	/* Size of each I/O buffer */
+	int		direct;		/* Read input with O_DIRECT */
+	int		splice;		/* Try splice for pipe/file output */
+	char		*buf[COPY_BUFS];
+	/* Called after each written buffer with total bytes copied */
+	void		(*progress)(uint64_t copied, void *data);
+	void		*progress_data;
+	/* If set, read data is passed to this function instead of written */
+	int		(*consume)(const char *buf, size_t len, void *data);
+	void		*consume_data;
+};
+
+void copy_engine_init(struct copy_engine *ce, size_t buf_size, int direct);
+void copy_engine_exit(struct copy_engine *ce);
+int copy_data(struct copy_engine *ce, int in_fd, int out_fd, uint64_t len,
+	      uint64_t *copied);
+int copy_data_at(struct copy_engine *ce, int in_fd, int out_fd,
+		 off_t *out_off, uint64_t len, uint64_t *copied);
+int read_data(struct copy_engine *ce, int in_fd, uint64_t len,
+	      uint64_t *copied);
+int write_all(int fd, const void *buf, size_t count);
+int pwrite_all(int fd, const void *buf, size_t count, off_t off);
+
+#endif /* _COPY_H */
@@ -0,0 +1,851 @@
+/*
+ *  zgetdump output formats
+ *    Description: Convert dump memory to lkcd or ELF format while it is
+ *		 read from the dump device. The lkcd page records are
+ *		 created by the compression pipeline of libdump. For ELF,
+ *		 the memory is processed in blocks: The main thread reads
+ *		 blocks into a ring of slots, converter threads check for
+ *		 zero pages and a writer thread writes the blocks in memory
+ *		 order with holes for zero pages. The writer thread also
+ *		 collects the CPU save areas, which are written as notes
+ *		 after the memory.
+ *
+ *    Copyright IBM Corp. 2009
+ */
+
+#define _GNU_SOURCE
+#include <elf.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "format.h"
+#include "copy.h"
+
+#define SLOT_FREE	0
+#define SLOT_READ	1
+#define SLOT_DONE	2
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+#define ELF_DATA	ELFDATA2MSB
+#else
+#define ELF_DATA	ELFDATA2LSB
+#endif
+
+/*
+ * Store status save areas relative to the prefix page. The stand-alone
+ * dump tools and zfcpdump store the status of each CPU in its prefix page.
+ */
+#define SA64_OFFSET	0x1200
+#define SA64_PREFIX	0x1318
+#define SA64_ALIGN	0x2000
+#define SA32_OFFSET	0xd4
+#define SA32_PREFIX	0x108
+#define SA32_ALIGN	0x1000
+/* Prefix pages below this address are not used by Linux */
+#define SA_PREFIX_MIN	0x10000
+
+struct sa64 {
+	uint64_t	fprs[16];
+	uint64_t	gprs[16];
+	uint8_t		psw[16];
+	uint8_t		pad1[8];
+	uint32_t	prefix;
+	uint32_t	fpc;
+	uint8_t		pad2[4];
+	uint32_t	todpreg;
+	uint64_t	timer;
+	uint64_t	clk_cmp;
+	uint8_t		pad3[8];
+	uint32_t	acrs[16];
+	uint64_t	ctrs[16];
+} __attribute__((packed));
+
+struct sa32 {
+	uint32_t	ext_save;
+	uint64_t	timer;
+	uint64_t	clk_cmp;
+	uint8_t		pad1[24];
+	uint8_t		psw[8];
+	uint32_t	prefix;
+	uint8_t		pad2[20];
+	uint32_t	acrs[16];
+	uint64_t	fprs[4];
+	uint32_t	gprs[16];
+	uint32_t	ctrs[16];
+} __attribute__((packed));
+
+/* Note contents as defined by the Linux kernel for s390x and s390 */
+struct nt_prstatus64 {
+	int32_t		sig_info[3];
+	int16_t		cursig;
+	uint8_t		pad1[2];
+	uint64_t	sigpend;
+	uint64_t	sighold;
+	int32_t		pid;
+	int32_t		ppid;
+	int32_t		pgrp;
+	int32_t		sid;
+	uint64_t	times[8];
+	uint8_t		psw[16];
+	uint64_t	gprs[16];
+	uint32_t	acrs[16];
+	uint64_t	orig_gpr2;
+	int32_t		fpvalid;
+	uint8_t		pad2[4];
+} __attribute__((packed));
+
+struct nt_prstatus32 {
+	int32_t		sig_info[3];
+	int16_t		cursig;
+	uint8_t		pad1[2];
+	uint32_t	sigpend;
+	uint32_t	sighold;
+	int32_t		pid;
+	int32_t		ppid;
+	int32_t		pgrp;
+	int32_t		sid;
+	uint32_t	times[8];
+	uint8_t		psw[8];
+	uint32_t	gprs[16];
+	uint32_t	acrs[16];
+	uint32_t	orig_gpr2;
+	int32_t		fpvalid;
+} __attribute__((packed));
+
+struct nt_fpregset {
+	uint32_t	fpc;
+	uint8_t		pad[4];
+	uint64_t	fprs[16];
+} __attribute__((packed));
+
+struct nt_prpsinfo64 {
+	char		state;
+	char		sname;
+	char		zomb;
+	char		nice;
+	uint8_t		pad[4];
+	uint64_t	flag;
+	uint32_t	uid;
+	uint32_t	gid;
+	int32_t		pid;
+	int32_t		ppid;
+	int32_t		pgrp;
+	int32_t		sid;
+	char		fname[16];
+	char		psargs[80];
+} __attribute__((packed));
+
+struct nt_prpsinfo32 {
+	char		state;
+	char		sname;
+	char		zomb;
+	char		nice;
+	uint32_t	flag;
+	uint16_t	uid;
+	uint16_t	gid;
+	int32_t		pid;
+	int32_t		ppid;
+	int32_t		pgrp;
+	int32_t		sid;
+	char		fname[16];
+	char		psargs[80];
+} __attribute__((packed));
+
+#define NT_NAME		"CORE"
+#define NT_ALIGN(x)	(((x) + 3) & ~3UL)
+#define NT_SIZE(desc)	(sizeof(Elf64_Nhdr) + NT_ALIGN(sizeof(NT_NAME)) + \
+			 NT_ALIGN(desc))
+
+/*
+ * The note segment is written after the memory and its size must be known
+ * when the ELF header is written. Space is reserved for FMT_MAX_CPUS CPUs,
+ * the unused space is filled with a padding note without name.
+ */
+#define ELF_NOTES64	(FMT_MAX_CPUS * (NT_SIZE(sizeof(struct nt_prstatus64)) + \
+			 NT_SIZE(sizeof(struct nt_fpregset))) + \
+			 NT_SIZE(sizeof(struct nt_prpsinfo64)) + \
+			 sizeof(Elf64_Nhdr))
+#define ELF_NOTES32	(FMT_MAX_CPUS * (NT_SIZE(sizeof(struct nt_prstatus32)) + \
+			 NT_SIZE(sizeof(struct nt_fpregset))) + \
+			 NT_SIZE(sizeof(struct nt_prpsinfo32)) + \
+			 sizeof(Elf64_Nhdr))
+
+static const char zero_page[FMT_PAGE_SIZE];
+
+int fmt_parse(const char *name, enum dump_format *fmt)
+{
+	if (strcmp(name, "s390") == 0)
+		*fmt = DUMP_FMT_S390;
+	else if (strcmp(name, "lkcd") == 0)
+		*fmt = DUMP_FMT_LKCD;
+	else if (strcmp(name, "elf") == 0)
+		*fmt = DUMP_FMT_ELF;
+	else
+		return 1;
+	return 0;
+}
+
+const char *fmt_name(enum dump_format fmt)
+{
+	switch (fmt) {
+	case DUMP_FMT_LKCD:
+		return "lkcd";
+	case DUMP_FMT_ELF:
+		return "elf";
+	default:
+		return "s390";
+	}
+}
+
+static void fmt_convert(struct fmt_slot *slot)
+{
+	size_t off;
+	int i;
+
+	for (i = 0, off = 0; off < slot->in_len; i++, off += FMT_PAGE_SIZE)
+		slot->zero[i] = (slot->in_len - off >= FMT_PAGE_SIZE) &&
+			dump_page_is_zero(slot->in + off);
+}
+
+/*
+ * Remember the save areas of all prefix pages in SLOT: The prefix register
+ * in the save area of a CPU contains the address of its prefix page.
+ */
+static void elf_find_save_areas(struct fmt_writer *w, struct fmt_slot *slot)
+{
+	size_t off, align, sa_off, sa_size, prefix_off;
+	uint32_t prefix;
+	uint64_t addr;
+
+	if (w->arch == ARCH_S390) {
+		align = SA32_ALIGN;
+		sa_off = SA32_OFFSET;
+		sa_size = sizeof(struct sa32);
+		prefix_off = SA32_PREFIX;
+	} else {
+		align = SA64_ALIGN;
+		sa_off = SA64_OFFSET;
+		sa_size = sizeof(struct sa64);
+		prefix_off = SA64_PREFIX;
+	}
+	off = (align - slot->addr % align) % align;
+	for (; off + align <= slot->in_len; off += align) {
+		addr = slot->addr + off;
+		if (addr < SA_PREFIX_MIN ||
+		    slot->zero[(off + prefix_off) / FMT_PAGE_SIZE])
+			continue;
+		memcpy(&prefix, slot->in + off + prefix_off, sizeof(prefix));
+		if (prefix != addr)
+			continue;
+		if (w->cpus < FMT_MAX_CPUS)
+			memcpy(w->sa[w->cpus++], slot->in + off + sa_off,
+			       sa_size);
+		w->cpus_found++;
+	}
+}
+
+/*
+ * Write ELF memory: Zero pages become holes in seekable output files
+ */
+static int elf_write_slot(struct fmt_writer *w, struct fmt_slot *slot)
+{
+	size_t off, run;
+	int i;
+
+	elf_find_save_areas(w, slot);
+
+	for (i = 0, off = 0; off < slot->in_len; ) {
+		if (slot->zero[i]) {
+			if (w->seekable) {
+				if (lseek(w->out_fd, FMT_PAGE_SIZE,
+					  SEEK_CUR) == -1) {
+					perror("\nCannot seek on output file");
+					return 1;
+				}
+			} else if (write_all(w->out_fd, zero_page,
+					     FMT_PAGE_SIZE)) {
+				return 1;
+			}
+			i++;
+			off += FMT_PAGE_SIZE;
+			continue;
+		}
+		for (run = 0; off + run < slot->in_len && !slot->zero[i]; i++)
+			run += FMT_PAGE_SIZE;
+		if (off + run > slot->in_len)
+			run = slot->in_len - off;
+		if (write_all(w->out_fd, slot->in + off, run))
+			return 1;
+		w->out_bytes += run;
+		off += run;
+	}
+	return 0;
+}
+
+static void fmt_set_err(struct fmt_writer *w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->err = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+static void *fmt_converter(void *data)
+{
+	struct fmt_writer *w = (struct fmt_writer *) data;
+	struct fmt_slot *slot;
+
+	pthread_mutex_lock(&w->lock);
+	while (1) {
+		while (w->seq_conv == w->seq_read && !w->read_done && !w->err)
+			pthread_cond_wait(&w->cond, &w->lock);
+		if (w->err || w->seq_conv == w->seq_read)
+			break;
+		slot = &w->slot[w->seq_conv++ % w->nslots];
+		pthread_mutex_unlock(&w->lock);
+		fmt_convert(slot);
+		pthread_mutex_lock(&w->lock);
+		slot->state = SLOT_DONE;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+static void *fmt_writer_thread(void *data)
+{
+	struct fmt_writer *w = (struct fmt_writer *) data;
+	struct fmt_slot *slot;
+	uint64_t seq;
+	size_t i;
+	int rc;
+
+	for (seq = 0; ; seq++) {
+		slot = &w->slot[seq % w->nslots];
+		pthread_mutex_lock(&w->lock);
+		while (slot->state != SLOT_DONE && !w->err &&
+		       !(w->read_done && seq == w->seq_read))
+			pthread_cond_wait(&w->cond, &w->lock);
+		if (slot->state != SLOT_DONE) {
+			pthread_mutex_unlock(&w->lock);
+			break;
+		}
+		pthread_mutex_unlock(&w->lock);
+		rc = elf_write_slot(w, slot);
+		if (rc) {
+			fmt_set_err(w);
+			break;
+		}
+		for (i = 0; i * FMT_PAGE_SIZE < slot->in_len; i++)
+			w->zero_pages += slot->zero[i];
+		w->copied += slot->in_len;
+		if (w->progress)
+			w->progress(w->copied, w->progress_data);
+		pthread_mutex_lock(&w->lock);
+		slot->state = SLOT_FREE;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+	return NULL;
+}
+
+static ssize_t read_block(int fd, char *buf, size_t count)
+{
+	ssize_t rc, len;
+
+	for (len = 0; len < (ssize_t) count; len += rc) {
+		rc = read(fd, buf + len, count - len);
+		if (rc == -1 && errno == EINTR) {
+			rc = 0;
+			continue;
+		}
+		if (rc == -1)
+			return -1;
+		if (rc == 0)
+			break;
+	}
+	return len;
+}
+
+/*
+ * Pass the memory to the compression pipeline of libdump in batches. Only
+ * complete pages are converted, the dump memory consists of pages.
+ */
+static int lkcd_write_mem(struct fmt_writer *w, int in_fd, uint64_t len)
+{
+	struct pipe_batch *batch;
+	size_t count;
+	ssize_t n;
+	int i;
+
+	w->copied = 0;
+	while (len > 0) {
+		batch = dump_pipe_get(w->pipe);
+		if (!batch)
+			return 1;
+		count = MIN(len, PIPE_BATCH_SIZE);
+		n = read_block(in_fd, batch->buf, count);
+		if (n == -1) {
+			perror("\nread failed");
+			return 1;
+		}
+		batch->pages = n / FMT_PAGE_SIZE;
+		for (i = 0; i < batch->pages; i++)
+			batch->addr[i] = w->mem_addr + i * FMT_PAGE_SIZE;
+		if (batch->pages)
+			dump_pipe_put(w->pipe, batch);
+		n = batch->pages * FMT_PAGE_SIZE;
+		w->mem_addr += n;
+		w->copied += n;
+		len -= n;
+		if (w->progress)
+			w->progress(w->copied, w->progress_data);
+		if ((size_t) n < count)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * Pass the memory through the converter and writer threads in blocks
+ */
+static int elf_write_mem(struct fmt_writer *w, int in_fd, uint64_t len)
+{
+	pthread_t conv[FMT_MAX_THREADS], writer;
+	struct fmt_slot *slot;
+	int i, started;
+	uint64_t seq;
+	ssize_t n;
+
+	w->seq_read = w->seq_conv = w->copied = 0;
+	w->read_done = w->err = 0;
+	for (i = 0; i < w->nslots; i++)
+		w->slot[i].state = SLOT_FREE;
+	if (pthread_create(&writer, NULL, fmt_writer_thread, w)) {
+		fprintf(stderr, "\nCould not create writer thread\n");
+		return 1;
+	}
+	for (started = 0; started < w->threads; started++) {
+		if (pthread_create(&conv[started], NULL, fmt_converter, w)) {
+			fprintf(stderr, "\nCould not create converter "
+				"thread\n");
+			fmt_set_err(w);
+			break;
+		}
+	}
+	for (seq = 0; len > 0 && started > 0; seq++) {
+		slot = &w->slot[seq % w->nslots];
+		pthread_mutex_lock(&w->lock);
+		while (slot->state != SLOT_FREE && !w->err)
+			pthread_cond_wait(&w->cond, &w->lock);
+		pthread_mutex_unlock(&w->lock);
+		if (w->err)
+			break;
+		n = read_block(in_fd, slot->in, MIN(len, FMT_BLOCK_SIZE));
+		if (n == -1) {
+			perror("\nread failed");
+			fmt_set_err(w);
+			break;
+		}
+		if (n == 0)
+			break;
+		slot->in_len = n;
+		slot->addr = w->mem_addr;
+		w->mem_addr += n;
+		len -= n;
+		pthread_mutex_lock(&w->lock);
+		slot->state = SLOT_READ;
+		w->seq_read++;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+		if (n < (ssize_t) FMT_BLOCK_SIZE && len > 0)
+			break;
+	}
+	pthread_mutex_lock(&w->lock);
+	w->read_done = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	for (i = 0; i < started; i++)
+		pthread_join(conv[i], NULL);
+	pthread_join(writer, NULL);
+	return w->err;
+}
+
+/*
+ * Convert LEN bytes of dump memory from the current position of IN_FD.
+ * Can be called several times for consecutive parts of the memory, e.g.
+ * for the volumes of a multi-volume dump. On return, COPIED contains the
+ * number of converted bytes, which is less than LEN if the end of the input
+ * has been reached.
+ *
+ * Return 0 on success, 1 on error (a message has been printed).
+ */
+int fmt_write_mem(struct fmt_writer *w, int in_fd, uint64_t len,
+		  uint64_t *copied)
+{
+	int flags = 0, rc;
+
+	if (w->direct) {
+		flags = fcntl(in_fd, F_GETFL);
+		if (flags == -1 ||
+		    fcntl(in_fd, F_SETFL, flags | O_DIRECT) == -1) {
+			perror("Could not enable direct I/O");
+			return 1;
+		}
+	}
+	if (w->fmt == DUMP_FMT_LKCD)
+		rc = lkcd_write_mem(w, in_fd, len);
+	else
+		rc = elf_write_mem(w, in_fd, len);
+	*copied = w->copied;
+	if (w->direct && fcntl(in_fd, F_SETFL, flags) == -1) {
+		perror("Could not disable direct I/O");
+		rc = 1;
+	}
+	return rc;
+}
+
+static int lkcd_write_header(struct fmt_writer *w, s390_dump_header_t *hdr)
+{
+	struct dump_hdr_s390 s390_dh;
+	struct dump_hdr_lkcd *dh;
+	char *buf;
+	int rc;
+
+	buf = calloc(1, DUMP_HEADER_SIZE);
+	if (!buf) {
+		fprintf(stderr, "Could not allocate lkcd dump header\n");
+		return 1;
+	}
+	memset(&s390_dh, 0, sizeof(s390_dh));
+	s390_dh.dump_level = DUMP_LEVEL_ALL;
+	s390_dh.page_size = FMT_PAGE_SIZE;
+	s390_dh.memory_size = hdr->dh_memory_size;
+	s390_dh.memory_start = hdr->dh_memory_start;
+	s390_dh.memory_end = hdr->dh_memory_start + hdr->dh_memory_size;
+	s390_dh.num_pages = hdr->dh_memory_size / FMT_PAGE_SIZE;
+	s390_dh.tod = hdr->dh_tod;
+	s390_dh.cpu_id = hdr->dh_cpu_id;
+	s390_dh.arch_id = hdr->dh_arch;
+	dh = (struct dump_hdr_lkcd *) buf;
+	dump_s390_to_lkcd_hdr(&s390_dh, dh);
+	dh->dump_compress = DUMP_COMPRESS_GZIP;
+	rc = write_all(w->out_fd, buf, DUMP_HEADER_SIZE);
+	w->out_bytes += DUMP_HEADER_SIZE;
+	free(buf);
+	return rc;
+}
+
+/* Write function for the compression pipeline */
+static ssize_t lkcd_write(int fd, const void *buf, size_t count)
+{
+	return write_all(fd, buf, count) ? -1 : (ssize_t) count;
+}
+
+/*
+ * ELF header with a PT_LOAD segment for the complete memory, which starts
+ * at the first page boundary, followed by a PT_NOTE segment with the CPU
+ * registers from the save areas.
+ */
+static int elf_write_header(struct fmt_writer *w, s390_dump_header_t *hdr)
+{
+	uint64_t mem_off = FMT_PAGE_SIZE;
+	char buf[FMT_PAGE_SIZE];
+	unsigned char *ident;
+
+	memset(buf, 0, sizeof(buf));
+	ident = (unsigned char *) buf;
+	memcpy(ident, ELFMAG, SELFMAG);
+	ident[EI_DATA] = ELF_DATA;
+	ident[EI_VERSION] = EV_CURRENT;
+	ident[EI_OSABI] = ELFOSABI_SYSV;
+	if (hdr->dh_arch == ARCH_S390) {
+		Elf32_Ehdr *eh = (Elf32_Ehdr *) buf;
+		Elf32_Phdr *nt = (Elf32_Phdr *) (eh + 1);
+		Elf32_Phdr *ph = nt + 1;
+
+		ident[EI_CLASS] = ELFCLASS32;
+		eh->e_type = ET_CORE;
+		eh->e_machine = EM_S390;
+		eh->e_version = EV_CURRENT;
+		eh->e_phoff = sizeof(*eh);
+		eh->e_ehsize = sizeof(*eh);
+		eh->e_phentsize = sizeof(*ph);
+		eh->e_phnum = 2;
+		nt->p_type = PT_NOTE;
+		nt->p_offset = mem_off + hdr->dh_memory_size;
+		nt->p_filesz = ELF_NOTES32;
+		ph->p_type = PT_LOAD;
+		ph->p_offset = mem_off;
+		ph->p_vaddr = hdr->dh_memory_start;
+		ph->p_paddr = hdr->dh_memory_start;
+		ph->p_filesz = hdr->dh_memory_size;
+		ph->p_memsz = hdr->dh_memory_size;
+		ph->p_flags = PF_R | PF_W | PF_X;
+		ph->p_align = FMT_PAGE_SIZE;
+	} else {
+		Elf64_Ehdr *eh = (Elf64_Ehdr *) buf;
+		Elf64_Phdr *nt = (Elf64_Phdr *) (eh + 1);
+		Elf64_Phdr *ph = nt + 1;
+
+		ident[EI_CLASS] = ELFCLASS64;
+		eh->e_type = ET_CORE;
+		eh->e_machine = EM_S390;
+		eh->e_version = EV_CURRENT;
+		eh->e_phoff = sizeof(*eh);
+		eh->e_ehsize = sizeof(*eh);
+		eh->e_phentsize = sizeof(*ph);
+		eh->e_phnum = 2;
+		nt->p_type = PT_NOTE;
+		nt->p_offset = mem_off + hdr->dh_memory_size;
+		nt->p_filesz = ELF_NOTES64;
+		ph->p_type = PT_LOAD;
+		ph->p_offset = mem_off;
+		ph->p_vaddr = hdr->dh_memory_start;
+		ph->p_paddr = hdr->dh_memory_start;
+		ph->p_filesz = hdr->dh_memory_size;
+		ph->p_memsz = hdr->dh_memory_size;
+		ph->p_flags = PF_R | PF_W | PF_X;
+		ph->p_align = FMT_PAGE_SIZE;
+	}
+	w->out_bytes += sizeof(buf);
+	return write_all(w->out_fd, buf, sizeof(buf));
+}
+
+/*
+ * Add note with TYPE and contents DESC to BUF, return size of note
+ */
+static size_t nt_add(char *buf, uint32_t type, const char *name,
+		     const void *desc, size_t size)
+{
+	Elf64_Nhdr nh;
+	size_t len;
+
+	nh.n_namesz = name ? strlen(name) + 1 : 0;
+	nh.n_descsz = size;
+	nh.n_type = type;
+	memcpy(buf, &nh, sizeof(nh));
+	len = sizeof(nh);
+	if (name) {
+		memset(buf + len, 0, NT_ALIGN(nh.n_namesz));
+		memcpy(buf + len, name, nh.n_namesz);
+		len += NT_ALIGN(nh.n_namesz);
+	}
+	memset(buf + len, 0, NT_ALIGN(size));
+	if (desc)
+		memcpy(buf + len, desc, size);
+	return len + NT_ALIGN(size);
+}
+
+static size_t nt_cpu64(char *buf, const char *sa_buf, int cpu)
+{
+	const struct sa64 *sa = (const struct sa64 *) sa_buf;
+	struct nt_prstatus64 prs;
+	struct nt_fpregset fp;
+	size_t len;
+
+	memset(&prs, 0, sizeof(prs));
+	prs.pid = cpu + 1;
+	memcpy(prs.psw, sa->psw, sizeof(prs.psw));
+	memcpy(prs.gprs, sa->gprs, sizeof(prs.gprs));
+	memcpy(prs.acrs, sa->acrs, sizeof(prs.acrs));
+	prs.orig_gpr2 = sa->gprs[2];
+	prs.fpvalid = 1;
+	memset(&fp, 0, sizeof(fp));
+	fp.fpc = sa->fpc;
+	memcpy(fp.fprs, sa->fprs, sizeof(fp.fprs));
+	len = nt_add(buf, NT_PRSTATUS, NT_NAME, &prs, sizeof(prs));
+	return len + nt_add(buf + len, NT_FPREGSET, NT_NAME, &fp, sizeof(fp));
+}
+
+static size_t nt_cpu32(char *buf, const char *sa_buf, int cpu)
+{
+	const struct sa32 *sa = (const struct sa32 *) sa_buf;
+	struct nt_prstatus32 prs;
+	struct nt_fpregset fp;
+	size_t len;
+	int i;
+
+	memset(&prs, 0, sizeof(prs));
+	prs.pid = cpu + 1;
+	memcpy(prs.psw, sa->psw, sizeof(prs.psw));
+	memcpy(prs.gprs, sa->gprs, sizeof(prs.gprs));
+	memcpy(prs.acrs, sa->acrs, sizeof(prs.acrs));
+	prs.orig_gpr2 = sa->gprs[2];
+	prs.fpvalid = 1;
+	/* ESA/390 stores floating point registers 0, 2, 4 and 6 only */
+	memset(&fp, 0, sizeof(fp));
+	for (i = 0; i < 4; i++)
+		fp.fprs[2 * i] = sa->fprs[i];
+	len = nt_add(buf, NT_PRSTATUS, NT_NAME, &prs, sizeof(prs));
+	return len + nt_add(buf + len, NT_FPREGSET, NT_NAME, &fp, sizeof(fp));
+}
+
+static size_t nt_prpsinfo(char *buf, int arch)
+{
+	struct nt_prpsinfo64 psi64;
+	struct nt_prpsinfo32 psi32;
+
+	if (arch == ARCH_S390) {
+		memset(&psi32, 0, sizeof(psi32));
+		psi32.sname = 'R';
+		strcpy(psi32.fname, "vmlinux");
+		strcpy(psi32.psargs, "vmlinux");
+		return nt_add(buf, NT_PRPSINFO, NT_NAME, &psi32,
+			      sizeof(psi32));
+	}
+	memset(&psi64, 0, sizeof(psi64));
+	psi64.sname = 'R';
+	strcpy(psi64.fname, "vmlinux");
+	strcpy(psi64.psargs, "vmlinux");
+	return nt_add(buf, NT_PRPSINFO, NT_NAME, &psi64, sizeof(psi64));
+}
+
+/*
+ * Write the note segment: prstatus and fpregset of each CPU found in the
+ * dump memory, prpsinfo and a padding note up to the reserved size.
+ */
+static int elf_write_notes(struct fmt_writer *w)
+{
+	size_t len = 0, size;
+	char *buf;
+	int i, rc;
+
+	size = w->arch == ARCH_S390 ? ELF_NOTES32 : ELF_NOTES64;
+	buf = malloc(size);
+	if (!buf) {
+		fprintf(stderr, "Could not allocate ELF notes\n");
+		return 1;
+	}
+	if (w->cpus_found > w->cpus)
+		fprintf(stderr, "Warning: Found %i CPUs, only the registers "
+			"of %i CPUs are written\n", w->cpus_found, w->cpus);
+	for (i = 0; i < w->cpus; i++) {
+		if (w->arch == ARCH_S390)
+			len += nt_cpu32(buf + len, w->sa[i], i);
+		else
+			len += nt_cpu64(buf + len, w->sa[i], i);
+	}
+	len += nt_prpsinfo(buf + len, w->arch);
+	nt_add(buf + len, 0, NULL, NULL, size - len - sizeof(Elf64_Nhdr));
+	rc = write_all(w->out_fd, buf, size);
+	w->out_bytes += size;
+	free(buf);
+	return rc;
+}
+
+void fmt_free(struct fmt_writer *w)
+{
+	int i;
+
+	if (!w)
+		return;
+	if (w->pipe) {
+		dump_pipe_close(w->pipe);
+		dump_pipe_free(w->pipe);
+	}
+	for (i = 0; i < w->nslots; i++)
+		free(w->slot[i].in);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+}
+
+/*
+ * Prepare conversion of the dump with header HDR to format FMT and write
+ * the header of the new format to OUT_FD. Memory is converted with
+ * THREADS converter threads, lkcd uses at most PIPE_MAX_THREADS. Return
+ * NULL on error.
+ */
+struct fmt_writer *fmt_open(enum dump_format fmt, s390_dump_header_t *hdr,
+			    int out_fd, int threads, int direct)
+{
+	struct fmt_writer *w;
+	struct stat st;
+	int i, flags;
+
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		fprintf(stderr, "Could not allocate dump writer\n");
+		return NULL;
+	}
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->fmt = fmt;
+	w->out_fd = out_fd;
+	w->direct = direct;
+	w->arch = hdr->dh_arch == ARCH_S390 ? ARCH_S390 : ARCH_S390X;
+	w->mem_addr = hdr->dh_memory_start;
+	w->mem_end = hdr->dh_memory_start + hdr->dh_memory_size;
+	w->threads = threads < 1 ? 1 : MIN(threads, FMT_MAX_THREADS);
+	/* Holes need a regular file, O_APPEND ignores the file position */
+	flags = fcntl(out_fd, F_GETFL);
+	w->seekable = fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode) &&
+		flags != -1 && !(flags & O_APPEND);
+	if (fmt == DUMP_FMT_LKCD) {
+		if (lkcd_write_header(w, hdr))
+			goto fail;
+		w->pipe = dump_pipe_open(out_fd, lkcd_write,
+					 PIPE_COMPRESS_GZIP, w->threads);
+		if (!w->pipe) {
+			fprintf(stderr, "Could not start compression "
+				"threads\n");
+			goto fail;
+		}
+		return w;
+	}
+	w->nslots = 2 * w->threads;
+	for (i = 0; i < w->nslots; i++) {
+		if (posix_memalign((void **) &w->slot[i].in, FMT_PAGE_SIZE,
+				   FMT_BLOCK_SIZE)) {
+			w->slot[i].in = NULL;
+			fprintf(stderr, "Could not allocate conversion "
+				"buffers\n");
+			goto fail;
+		}
+	}
+	if (elf_write_header(w, hdr))
+		goto fail;
+	return w;
+fail:
+	fmt_free(w);
+	return NULL;
+}
+
+/*
+ * Complete the converted dump: lkcd dumps get an end record, ELF files
+ * get the note segment after the memory.
+ */
+int fmt_finish(struct fmt_writer *w)
+{
+	struct pipe_stats stats;
+	struct dump_page dp;
+	int rc;
+
+	if (w->fmt == DUMP_FMT_LKCD) {
+		rc = dump_pipe_close(w->pipe);
+		dump_pipe_stats(w->pipe, &stats);
+		dump_pipe_free(w->pipe);
+		w->pipe = NULL;
+		if (rc)
+			return 1;
+		w->zero_pages = stats.zero_pages;
+		w->out_bytes += stats.write_bytes;
+		memset(&dp, 0, sizeof(dp));
+		dp.flags = DUMP_DH_END;
+		w->out_bytes += sizeof(dp);
+		return write_all(w->out_fd, &dp, sizeof(dp));
+	}
+	if (w->mem_addr != w->mem_end) {
+		fprintf(stderr, "Cannot write ELF notes: Dump memory is "
+			"incomplete\n");
+		return 1;
+	}
+	return elf_write_notes(w);
+}
@@ -0,0 +1,76 @@
+/*
+ *  zgetdump output formats
+ *    Copyright IBM Corp. 2009
+ */
+
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <pthread.h>
+#include "libdump.h"
+#include "zgetdump.h"
+
+enum dump_format {
+	DUMP_FMT_S390,		/* s390 dump header and memory image */
+	DUMP_FMT_LKCD,		/* lkcd with gzip compressed pages */
+	DUMP_FMT_ELF,		/* ELF core with CPU notes and memory */
+};
+
+#define FMT_PAGE_SIZE		4096
+#define FMT_BLOCK_SIZE		(1024 * 1024)
+#define FMT_BLOCK_PAGES		(FMT_BLOCK_SIZE / FMT_PAGE_SIZE)
+#define FMT_MAX_THREADS		16
+#define FMT_SLOTS		(2 * FMT_MAX_THREADS)
+#define FMT_MAX_CPUS		64
+#define FMT_SA_SIZE		512	/* Maximum size of a CPU save area */
+
+struct fmt_slot {
+	char		*in;		/* Memory read from the dump device */
+	size_t		in_len;
+	uint64_t	addr;		/* Memory address of first page */
+	unsigned char	zero[FMT_BLOCK_PAGES];	/* Page contains zeros */
+	int		state;
+};
+
+struct fmt_writer {
+	enum dump_format	fmt;
+	int			out_fd;
+	int			seekable;	/* Zero pages become holes */
+	int			threads;
+	int			direct;
+	int			arch;		/* ARCH_S390 or ARCH_S390X */
+	uint64_t		mem_addr;	/* Next memory address */
+	uint64_t		mem_end;	/* End of dump memory */
+	uint64_t		zero_pages;
+	uint64_t		out_bytes;	/* Output size without holes */
+	/* Called after each written block with bytes of this copy */
+	void			(*progress)(uint64_t copied, void *data);
+	void			*progress_data;
+	/* lkcd: compression pipeline of libdump */
+	struct dump_pipe	*pipe;
+	/* ELF: CPU save areas found in the prefix pages */
+	char			sa[FMT_MAX_CPUS][FMT_SA_SIZE];
+	int			cpus;
+	int			cpus_found;
+	/* ELF: Pipeline state */
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct fmt_slot		slot[FMT_SLOTS];
+	int			nslots;
+	uint64_t		seq_read;	/* Blocks read */
+	uint64_t		seq_conv;	/* Blocks taken by converters */
+	uint64_t		copied;		/* Memory bytes written */
+	int			read_done;
+	int			err;
+};
+
+int fmt_parse(const char *name, enum dump_format *fmt);
+const char *fmt_name(enum dump_format fmt);
+struct fmt_writer *fmt_open(enum dump_format fmt, s390_dump_header_t *hdr,
+			    int out_fd, int threads, int direct);
+int fmt_write_mem(struct fmt_writer *w, int in_fd, uint64_t len,
+		  uint64_t *copied);
+int fmt_finish(struct fmt_writer *w);
+void fmt_free(struct fmt_writer *w);
+
+#endif /* _FORMAT_H */
@@ -0,0 +1,220 @@
+/*
+ *  zgetdump parallel multi-volume copy
+ *    Description: Copy the dump data of all volumes of a multi-volume DASD
+ *		 dump at the same time. Each volume is read by its own thread
+ *		 and written with pwrite() to its offset in the output file,
+ *		 so that the channel paths of all volumes are used.
+ *
+ *    Copyright IBM Corp. 2009
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "mvcopy.h"
+
+#define PROGRESS_INTERVAL	1	/* seconds */
+#define MB			(1024 * 1024)
+
+static pthread_mutex_t mvcopy_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mvcopy_cond = PTHREAD_COND_INITIALIZER;
+
+static int read_header(struct mvcopy_vol *vol)
+{
+	char *ptr = (char *) &vol->hdr;
+	size_t count = sizeof(vol->hdr);
+	ssize_t rc;
+
+	while (count > 0) {
+		rc = read(vol->fd, ptr, count);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			fprintf(stderr, "Cannot read dump header on %s\n",
+				vol->name);
+			return 1;
+		}
+		ptr += rc;
+		count -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Read and verify the dump headers of all volumes and compute which part
+ * of the dump memory is stored on which volume. On return, USED contains
+ * the number of volumes holding dump data. The file descriptors are
+ * positioned at the start of the dump data.
+ *
+ * Return 0 on success, 1 on error.
+ */
+int mvcopy_read_headers(struct mvcopy_vol vol[], int count, int *used)
+{
+	uint64_t total = 0, data_size;
+	s390_dump_header_t *first = &vol[0].hdr;
+	int i;
+
+	*used = 0;
+	for (i = 0; i < count; i++) {
+		if (read_header(&vol[i]))
+			return 1;
+		if (vol[i].hdr.dh_magic_number != DUMP_MAGIC_S390 ||
+		    vol[i].hdr.dh_mvdump_signature != DUMP_MAGIC_S390) {
+			fprintf(stderr, "ERROR: Invalid dump header on %s.\n",
+				vol[i].name);
+			return 1;
+		}
+		if (vol[i].hdr.dh_tod != first->dh_tod ||
+		    vol[i].hdr.dh_memory_size != first->dh_memory_size ||
+		    vol[i].hdr.dh_header_size != first->dh_header_size) {
+			fprintf(stderr, "ERROR: Dump header on %s does not "
+				"match dump header on %s.\n", vol[i].name,
+				vol[0].name);
+			return 1;
+		}
+		/* only complete 4K pages are part of the dump */
+		data_size = ((vol[i].part_size >> 12) << 12) -
+			S390_DUMP_HEADER_SIZE;
+		vol[i].mem_offset = total;
+		vol[i].size = MIN(first->dh_memory_size - total, data_size);
+		total += vol[i].size;
+		if (vol[i].size)
+			*used = i + 1;
+	}
+	return 0;
+}
+
+static void mvcopy_progress(uint64_t copied, void *data)
+{
+	struct mvcopy_vol *vol = (struct mvcopy_vol *) data;
+
+	pthread_mutex_lock(&mvcopy_lock);
+	vol->copied = copied;
+	pthread_mutex_unlock(&mvcopy_lock);
+}
+
+static void *mvcopy_thread(void *data)
+{
+	struct mvcopy_vol *vol = (struct mvcopy_vol *) data;
+	off_t off = vol->out_off + vol->hdr.dh_header_size + vol->mem_offset;
+	uint64_t copied;
+	int rc;
+
+	rc = copy_data_at(&vol->ce, vol->fd, vol->out_fd, &off, vol->size,
+			  &copied);
+	if (rc == 0 && copied < vol->size) {
+		fprintf(stderr, "\nUnexpected end of dump data on %s\n",
+			vol->name);
+		rc = 1;
+	}
+	pthread_mutex_lock(&mvcopy_lock);
+	vol->copied = copied;
+	vol->rc = rc;
+	vol->done = 1;
+	pthread_cond_broadcast(&mvcopy_cond);
+	pthread_mutex_unlock(&mvcopy_lock);
+	return NULL;
+}
+
+/* Print percentage of copied data per volume, return number of busy ones */
+static int mvcopy_print_progress(struct mvcopy_vol vol[], int count)
+{
+	int i, busy = 0;
+
+	fprintf(stderr, "\r");
+	for (i = 0; i < count; i++) {
+		fprintf(stderr, "%3d%% ", vol[i].size ?
+			(int) (vol[i].copied * 100 / vol[i].size) : 100);
+		if (!vol[i].done)
+			busy++;
+	}
+	return busy;
+}
+
+/*
+ * Check whether the volumes can be written to OUT_FD at their offsets:
+ * pwrite() needs a regular file, and with O_APPEND Linux ignores the
+ * offset and appends the data in the order it is written.
+ *
+ * Return 1 if OUT_FD can be used by mvcopy_copy(), 0 otherwise.
+ */
+int mvcopy_output_ok(int out_fd)
+{
+	struct stat st;
+	int flags;
+
+	if (fstat(out_fd, &st) == -1 || !S_ISREG(st.st_mode))
+		return 0;
+	flags = fcntl(out_fd, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND))
+		return 0;
+	return 1;
+}
+
+/*
+ * Copy the dump header of the first volume and the dump data of COUNT
+ * volumes to the seekable output file OUT_FD, starting at offset OUT_OFF.
+ * The file position of OUT_FD is not changed.
+ *
+ * Return 0 on success, 1 on error.
+ */
+int mvcopy_copy(struct mvcopy_vol vol[], int count, int out_fd,
+		off_t out_off, size_t buf_size, int direct)
+{
+	struct timespec timeout;
+	struct timeval now;
+	int i, started, rc = 0;
+
+	if (!mvcopy_output_ok(out_fd)) {
+		fprintf(stderr, "Parallel copy requires a regular output file "
+			"that is not opened for appending.\n");
+		return 1;
+	}
+	if (pwrite_all(out_fd, &vol[0].hdr, vol[0].hdr.dh_header_size,
+		       out_off))
+		return 1;
+	for (i = 0; i < count; i++)
+		fprintf(stderr, "%s ", vol[i].name);
+	fprintf(stderr, "\n");
+	for (started = 0; started < count; started++) {
+		struct mvcopy_vol *v = &vol[started];
+
+		copy_engine_init(&v->ce, buf_size, direct);
+		v->ce.progress = mvcopy_progress;
+		v->ce.progress_data = v;
+		v->out_fd = out_fd;
+		v->out_off = out_off;
+		v->copied = 0;
+		v->done = 0;
+		v->rc = 0;
+		if (pthread_create(&v->thread, NULL, mvcopy_thread, v)) {
+			fprintf(stderr, "Could not create thread for %s\n",
+				v->name);
+			rc = 1;
+			break;
+		}
+	}
+	pthread_mutex_lock(&mvcopy_lock);
+	while (mvcopy_print_progress(vol, started)) {
+		gettimeofday(&now, NULL);
+		timeout.tv_sec = now.tv_sec + PROGRESS_INTERVAL;
+		timeout.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&mvcopy_cond, &mvcopy_lock, &timeout);
+	}
+	pthread_mutex_unlock(&mvcopy_lock);
+	fprintf(stderr, "\n");
+	for (i = 0; i < started; i++) {
+		pthread_join(vol[i].thread, NULL);
+		copy_engine_exit(&vol[i].ce);
+		fprintf(stderr, "Volume %i (%s): %llu MB copied\n", i + 1,
+			vol[i].name, (unsigned long long) vol[i].copied / MB);
+		if (vol[i].rc)
+			rc = 1;
+	}
+	return rc;
+}
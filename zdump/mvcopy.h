@@ -0,0 +1,36 @@
+/*
+ *  zgetdump parallel multi-volume copy
+ *    Copyright IBM Corp. 2009
+ */
+
+#ifndef _MVCOPY_H
+#define _MVCOPY_H
+
+#include <pthread.h>
+#include "zgetdump.h"
+#include "copy.h"
+
+struct mvcopy_vol {
+	const char		*name;		/* Volume name for messages */
+	int			fd;		/* Positioned at dump header */
+	uint64_t		part_size;	/* Size of dump partition */
+	/* Set by mvcopy_read_headers() */
+	s390_dump_header_t	hdr;
+	uint64_t		mem_offset;	/* Offset of data in dump memory */
+	uint64_t		size;		/* Dump data on this volume */
+	/* Set by mvcopy_copy() */
+	int			out_fd;
+	off_t			out_off;	/* Start of dump in output */
+	uint64_t		copied;
+	int			done;
+	int			rc;
+	struct copy_engine	ce;
+	pthread_t		thread;
+};
+
+int mvcopy_read_headers(struct mvcopy_vol vol[], int count, int *used);
+int mvcopy_output_ok(int out_fd);
+int mvcopy_copy(struct mvcopy_vol vol[], int count, int out_fd,
+		off_t out_off, size_t buf_size, int direct);
+
+#endif /* _MVCOPY_H */
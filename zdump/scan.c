@@ -0,0 +1,106 @@
+/*
+ *  zgetdump dump scan
+ *    Description: Read the dump data without writing it: Count zero and
+ *		 non-zero pages, compute a CRC-32 of the data and estimate
+ *		 the size of the dump in lkcd format by compressing a sample
+ *		 of the non-zero pages.
+ *
+ *    Copyright IBM Corp. 2009
+ */
+
+#include <string.h>
+#include <zlib.h>
+
+#include "scan.h"
+
+void scan_init(struct dump_scan *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->crc = crc32(0L, Z_NULL, 0);
+}
+
+static void scan_page(struct dump_scan *s, const char *page)
+{
+	s->pages++;
+	if (dump_page_is_zero(page)) {
+		s->zero_pages++;
+		return;
+	}
+	if ((s->pages - s->zero_pages - 1) % SCAN_SAMPLE_STEP)
+		return;
+	s->sampled_size += dump_pipe_rec_size(PIPE_COMPRESS_GZIP, page);
+	s->sampled++;
+}
+
+/*
+ * Consume function for the copy engine
+ */
+static int scan_consume(const char *buf, size_t len, void *data)
+{
+	struct dump_scan *s = (struct dump_scan *) data;
+	size_t n;
+
+	s->crc = crc32(s->crc, (const Bytef *) buf, len);
+	/* Complete page of the last read */
+	if (s->fill) {
+		n = MIN(len, FMT_PAGE_SIZE - s->fill);
+		memcpy(s->page + s->fill, buf, n);
+		s->fill += n;
+		buf += n;
+		len -= n;
+		if (s->fill < FMT_PAGE_SIZE)
+			return 0;
+		scan_page(s, s->page);
+		s->fill = 0;
+	}
+	for (; len >= FMT_PAGE_SIZE; buf += FMT_PAGE_SIZE, len -= FMT_PAGE_SIZE)
+		scan_page(s, buf);
+	memcpy(s->page, buf, len);
+	s->fill = len;
+	return 0;
+}
+
+/*
+ * Scan LEN bytes from the current position of FD with the buffers of the
+ * copy engine. Return 0 on success, 1 on error (a message has been
+ * printed).
+ */
+int scan_data(struct dump_scan *s, struct copy_engine *ce, int fd,
+	      uint64_t len, uint64_t *scanned)
+{
+	int rc;
+
+	ce->consume = scan_consume;
+	ce->consume_data = s;
+	rc = read_data(ce, fd, len, scanned);
+	ce->consume = NULL;
+	ce->consume_data = NULL;
+	return rc;
+}
+
+/*
+ * Add page counters of S to TOTAL
+ */
+void scan_add(struct dump_scan *total, const struct dump_scan *s)
+{
+	total->pages += s->pages;
+	total->zero_pages += s->zero_pages;
+	total->sampled += s->sampled;
+	total->sampled_size += s->sampled_size;
+}
+
+/*
+ * Projected size of the dump converted with "zgetdump -f lkcd"
+ */
+uint64_t scan_lkcd_size(const struct dump_scan *s)
+{
+	static const char zero_page[FMT_PAGE_SIZE];
+	uint64_t size, data_pages = s->pages - s->zero_pages;
+
+	size = DUMP_HEADER_SIZE + sizeof(struct dump_page);
+	size += s->zero_pages * dump_pipe_rec_size(PIPE_COMPRESS_GZIP,
+						   zero_page);
+	if (s->sampled)
+		size += (double) data_pages * s->sampled_size / s->sampled;
+	return size;
+}
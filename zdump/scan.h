@@ -0,0 +1,33 @@
+/*
+ *  zgetdump dump scan
+ *    Copyright IBM Corp. 2009
+ */
+
+#ifndef _SCAN_H
+#define _SCAN_H
+
+#include <stdint.h>
+#include "copy.h"
+#include "format.h"
+
+/* Every SCAN_SAMPLE_STEP non-zero page is compressed for the lkcd size */
+#define SCAN_SAMPLE_STEP	16
+
+struct dump_scan {
+	uint64_t	pages;
+	uint64_t	zero_pages;
+	uint64_t	sampled;	/* Compressed non-zero pages */
+	uint64_t	sampled_size;	/* lkcd record size of sampled pages */
+	uint32_t	crc;		/* CRC-32 of the scanned data */
+	/* Incomplete page of the last read */
+	char		page[FMT_PAGE_SIZE];
+	size_t		fill;
+};
+
+void scan_init(struct dump_scan *s);
+int scan_data(struct dump_scan *s, struct copy_engine *ce, int fd,
+	      uint64_t len, uint64_t *scanned);
+void scan_add(struct dump_scan *total, const struct dump_scan *s);
+uint64_t scan_lkcd_size(const struct dump_scan *s);
+
+#endif /* _SCAN_H */
@@ -0,0 +1,248 @@
+/*
+ *  zgetdump tape reader
+ *    Description: Copy the dump data of a tape volume to the output file
+ *		 descriptor. The calling thread reads large requests from the
+ *		 tape into a ring of buffers while a writer thread writes them,
+ *		 so that the output is still written while the next volume is
+ *		 loaded.
+ *
+ *    Copyright IBM Corp. 2009
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
+#include <sys/time.h>
+
+#include "copy.h"
+#include "tape.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/*
+ * Number of bytes to request with each read(). With variable block size
+ * one read returns a single record of the tape dumper. With fixed block
+ * size one read returns as many blocks as fit into TAPE_READ_SIZE.
+ */
+size_t tape_read_size(int fd)
+{
+	struct mtget mtget;
+	size_t block_size;
+
+	if (ioctl(fd, MTIOCGET, &mtget) == -1)
+		return TAPE_READ_SIZE;
+	block_size = (mtget.mt_dsreg & MT_ST_BLKSIZE_MASK) >>
+		MT_ST_BLKSIZE_SHIFT;
+	if (block_size == 0)
+		return TAPE_READ_SIZE;
+	if (block_size >= TAPE_READ_SIZE)
+		return block_size;
+	return TAPE_READ_SIZE / block_size * block_size;
+}
+
+static void *tape_writer(void *data)
+{
+	struct tape_copy *tc = (struct tape_copy *) data;
+	int i, rc;
+
+	pthread_mutex_lock(&tc->lock);
+	while (1) {
+		while (!tc->queued && !tc->done && !tc->stop)
+			pthread_cond_wait(&tc->cond, &tc->lock);
+		if (!tc->queued || tc->stop)
+			break;
+		i = tc->tail;
+		pthread_mutex_unlock(&tc->lock);
+		rc = write_all(tc->out_fd, tc->buf[i], tc->len[i]);
+		pthread_mutex_lock(&tc->lock);
+		if (rc) {
+			tc->error = 1;
+			pthread_cond_broadcast(&tc->cond);
+			break;
+		}
+		tc->tail = (tc->tail + 1) % TAPE_BUFS;
+		tc->queued--;
+		pthread_cond_broadcast(&tc->cond);
+	}
+	pthread_mutex_unlock(&tc->lock);
+	return NULL;
+}
+
+/*
+ * Wait for a free buffer. Return NULL if the writer has failed.
+ */
+static char *tape_get_buf(struct tape_copy *tc)
+{
+	char *buf;
+
+	pthread_mutex_lock(&tc->lock);
+	while (tc->queued == TAPE_BUFS && !tc->error)
+		pthread_cond_wait(&tc->cond, &tc->lock);
+	buf = tc->error ? NULL : tc->buf[tc->head];
+	pthread_mutex_unlock(&tc->lock);
+	return buf;
+}
+
+static void tape_put_buf(struct tape_copy *tc, size_t len)
+{
+	if (len == 0)
+		return;
+	pthread_mutex_lock(&tc->lock);
+	tc->len[tc->head] = len;
+	tc->head = (tc->head + 1) % TAPE_BUFS;
+	tc->queued++;
+	pthread_cond_broadcast(&tc->cond);
+	pthread_mutex_unlock(&tc->lock);
+}
+
+static int tape_marker(const char *block, size_t len, const char *marker)
+{
+	return len >= 8 && strncmp(block, marker, 8) == 0;
+}
+
+/*
+ * Allocate buffers and start the writer thread. Return 0 on success,
+ * 1 on error.
+ */
+int tape_copy_init(struct tape_copy *tc, int in_fd, int out_fd)
+{
+	int i;
+
+	memset(tc, 0, sizeof(*tc));
+	tc->in_fd = in_fd;
+	tc->out_fd = out_fd;
+	tc->read_size = tape_read_size(in_fd);
+	tc->buf_size = tc->read_size > TAPE_BUF_SIZE ?
+		tc->read_size : TAPE_BUF_SIZE;
+	for (i = 0; i < TAPE_BUFS; i++) {
+		tc->buf[i] = malloc(tc->buf_size);
+		if (!tc->buf[i]) {
+			fprintf(stderr, "\nCould not allocate %zu bytes for "
+				"tape buffers\n", tc->buf_size);
+			goto out_free;
+		}
+	}
+	pthread_mutex_init(&tc->lock, NULL);
+	pthread_cond_init(&tc->cond, NULL);
+	if (pthread_create(&tc->writer, NULL, tape_writer, tc)) {
+		fprintf(stderr, "\nCould not create writer thread\n");
+		pthread_mutex_destroy(&tc->lock);
+		pthread_cond_destroy(&tc->cond);
+		goto out_free;
+	}
+	return 0;
+
+out_free:
+	for (i = 0; i < TAPE_BUFS; i++)
+		free(tc->buf[i]);
+	return 1;
+}
+
+/*
+ * Read the dump data of the current volume up to the end marker and queue
+ * it for the writer. TOTAL is the size of the dump data of all volumes.
+ * The block containing the end marker is stored in tc->marker. Return
+ * the found end marker or -1 on error (a message has been printed).
+ */
+int tape_copy_volume(struct tape_copy *tc, uint64_t total)
+{
+	enum tape_end result = TAPE_END_NONE;
+	struct timeval start, end;
+	size_t fill = 0, off, len;
+	int found = 0;
+	ssize_t n;
+	char *buf;
+
+	gettimeofday(&start, NULL);
+	tc->vol_bytes = 0;
+	memset(tc->marker, 0, sizeof(tc->marker));
+	buf = tape_get_buf(tc);
+	if (!buf)
+		return -1;
+	while (!found) {
+		if (fill + tc->read_size > tc->buf_size) {
+			tape_put_buf(tc, fill);
+			fill = 0;
+			buf = tape_get_buf(tc);
+			if (!buf)
+				return -1;
+		}
+		n = read(tc->in_fd, buf + fill, tc->read_size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1) {
+			perror("\nCannot read from tape");
+			return -1;
+		}
+		if (n == 0)	/* Tape mark before end marker */
+			break;
+		/* The dumper writes a marker into its own block */
+		for (off = 0; off < (size_t) n; off += TAPE_BLOCK_SIZE) {
+			len = MIN(TAPE_BLOCK_SIZE, n - off);
+			if (tape_marker(buf + fill + off, len, "ENDOFVOL"))
+				result = TAPE_END_VOL;
+			else if (tape_marker(buf + fill + off, len, "DUMP_END"))
+				result = TAPE_END_DUMP;
+			else if (tc->read_bytes >= total)
+				result = TAPE_END_NONE;
+			else {
+				tc->read_bytes += len;
+				tc->vol_bytes += len;
+				continue;
+			}
+			memcpy(tc->marker, buf + fill + off, len);
+			found = 1;
+			n = off;
+			break;
+		}
+		fill += n;
+		if (tc->progress)
+			tc->progress(tc->read_bytes, tc->progress_data);
+	}
+	tape_put_buf(tc, fill);
+	gettimeofday(&end, NULL);
+	tc->vol_usecs = (end.tv_sec - start.tv_sec) * 1000000ULL +
+		end.tv_usec - start.tv_usec;
+	return result;
+}
+
+static void tape_copy_end(struct tape_copy *tc, int stop)
+{
+	int i;
+
+	pthread_mutex_lock(&tc->lock);
+	tc->done = 1;
+	tc->stop = stop;
+	pthread_cond_broadcast(&tc->cond);
+	pthread_mutex_unlock(&tc->lock);
+	pthread_join(tc->writer, NULL);
+	pthread_mutex_destroy(&tc->lock);
+	pthread_cond_destroy(&tc->cond);
+	for (i = 0; i < TAPE_BUFS; i++) {
+		free(tc->buf[i]);
+		tc->buf[i] = NULL;
+	}
+}
+
+/*
+ * Wait until all queued data is written and free the buffers. Return 0
+ * on success, 1 if writing has failed.
+ */
+int tape_copy_finish(struct tape_copy *tc)
+{
+	tape_copy_end(tc, 0);
+	return tc->error;
+}
+
+/*
+ * Stop the writer thread after a read error without writing the queued
+ * data and free the buffers.
+ */
+void tape_copy_abort(struct tape_copy *tc)
+{
+	tape_copy_end(tc, 1);
+}
@@ -0,0 +1,57 @@
+/*
+ *  zgetdump tape reader
+ *    Copyright IBM Corp. 2009
+ */
+
+#ifndef _TAPE_H
+#define _TAPE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TAPE_BLOCK_SIZE		32768	/* Block size of the tape dumper */
+#define TAPE_READ_SIZE		(1024 * 1024)
+#define TAPE_BUF_SIZE		(4 * 1024 * 1024)
+#define TAPE_BUFS		4
+#define TAPE_MARKER_SIZE	TAPE_BLOCK_SIZE
+
+/* Result of tape_copy_volume() */
+enum tape_end {
+	TAPE_END_NONE,		/* No marker where one was expected */
+	TAPE_END_VOL,		/* "ENDOFVOL": dump continues on next volume */
+	TAPE_END_DUMP,		/* "DUMP_END": end of the dump */
+};
+
+struct tape_copy {
+	int		in_fd;
+	int		out_fd;
+	size_t		read_size;	/* Bytes requested by each read() */
+	size_t		buf_size;
+	char		*buf[TAPE_BUFS];
+	size_t		len[TAPE_BUFS];
+	int		head;		/* Next buffer to be filled */
+	int		tail;		/* Next buffer to be written */
+	int		queued;
+	int		done;		/* No more buffers will be queued */
+	int		stop;		/* Discard queued buffers */
+	int		error;		/* Writer has failed */
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	pthread_t	writer;
+	uint64_t	read_bytes;	/* Dump data read from all volumes */
+	uint64_t	vol_bytes;	/* Dump data read from current volume */
+	uint64_t	vol_usecs;	/* Time spent on current volume */
+	char		marker[TAPE_MARKER_SIZE]; /* Block with end marker */
+	/* Called after each read with total bytes read */
+	void		(*progress)(uint64_t copied, void *data);
+	void		*progress_data;
+};
+
+size_t tape_read_size(int fd);
+int tape_copy_init(struct tape_copy *tc, int in_fd, int out_fd);
+int tape_copy_volume(struct tape_copy *tc, uint64_t total);
+int tape_copy_finish(struct tape_copy *tc);
+void tape_copy_abort(struct tape_copy *tc);
+
+#endif /* _TAPE_H */
@@ -0,0 +1,219 @@
+/*
+ * fake_tape - File backed emulation of a tape device for the zgetdump tests
+ *
+ * Each volume is a temporary file with a sequence of records. A record is
+ * stored as 32 bit length followed by the data, a tape mark has length 0.
+ * read() and ioctl() are replaced for the file descriptor returned by
+ * fake_tape_open(), all other file descriptors are passed to the kernel.
+ * The supported tape operations are MTIOCGET and the MTIOCTOP operations
+ * MTBSR, MTFSFM, MTOFFL, MTLOAD and MTREW.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
+#include <sys/syscall.h>
+#include "fake_tape.h"
+
+
+#define MAX_VOLUMES	8
+
+
+static struct {
+	int	fd;		/* Returned by fake_tape_open(), -1 if closed */
+	int	vol_fds[MAX_VOLUMES];
+	int	vol_count;
+	int	vol;		/* Loaded volume, -1 if unloaded */
+	int	next_vol;	/* Volume loaded by MTLOAD */
+	off_t	pos;		/* Offset of the next record */
+	size_t	block_size;	/* 0: variable block size */
+} tape = { .fd = -1 };
+
+
+int fake_tape_create(void)
+{
+	char name[] = "/tmp/fake_tape.XXXXXX";
+	int fd;
+
+	fd = mkstemp(name);
+	assert(fd != -1);
+	unlink(name);
+	return fd;
+}
+
+void fake_tape_write_record(int vol_fd, const void *buf, uint32_t len)
+{
+	assert(write(vol_fd, &len, sizeof(len)) == sizeof(len));
+	assert(write(vol_fd, buf, len) == (ssize_t) len);
+}
+
+void fake_tape_write_mark(int vol_fd)
+{
+	uint32_t len = 0;
+
+	assert(write(vol_fd, &len, sizeof(len)) == sizeof(len));
+}
+
+int fake_tape_open(int vol_fds[], int vol_count, size_t block_size)
+{
+	assert(vol_count <= MAX_VOLUMES);
+	memcpy(tape.vol_fds, vol_fds, vol_count * sizeof(int));
+	tape.vol_count = vol_count;
+	tape.vol = 0;
+	tape.next_vol = 1;
+	tape.pos = 0;
+	tape.block_size = block_size;
+	tape.fd = dup(vol_fds[0]);
+	assert(tape.fd != -1);
+	return tape.fd;
+}
+
+void fake_tape_close(void)
+{
+	close(tape.fd);
+	tape.fd = -1;
+}
+
+/* Length of the record at POS, -1 at the end of the volume */
+static ssize_t record_len(off_t pos)
+{
+	uint32_t len;
+
+	if (pread(tape.vol_fds[tape.vol], &len, sizeof(len), pos) !=
+	    sizeof(len))
+		return -1;
+	return len;
+}
+
+/* Read one record, return 0 for a tape mark */
+static ssize_t read_record(char *buf, size_t count)
+{
+	ssize_t len = record_len(tape.pos);
+
+	if (len == -1) {
+		errno = EIO;
+		return -1;
+	}
+	if (len > (ssize_t) count) {
+		/* Variable block size: the rest of the record is lost */
+		if (tape.block_size) {
+			errno = EINVAL;
+			return -1;
+		}
+		len = count;
+	}
+	assert(pread(tape.vol_fds[tape.vol], buf, len,
+		     tape.pos + sizeof(uint32_t)) == len);
+	tape.pos += sizeof(uint32_t) + record_len(tape.pos);
+	return len;
+}
+
+static ssize_t fake_read(char *buf, size_t count)
+{
+	ssize_t rc, total = 0;
+
+	if (tape.vol == -1) {
+		errno = ENOMEDIUM;
+		return -1;
+	}
+	if (!tape.block_size)
+		return read_record(buf, count);
+	/* Fixed block size: read blocks up to COUNT or the next tape mark */
+	if (count % tape.block_size) {
+		errno = EINVAL;
+		return -1;
+	}
+	while ((size_t) total < count) {
+		if (record_len(tape.pos) == 0)
+			return total ? total : read_record(buf, 0);
+		rc = read_record(buf + total, tape.block_size);
+		if (rc == -1)
+			return total ? total : -1;
+		total += rc;
+	}
+	return total;
+}
+
+static int fake_op(struct mtop *op)
+{
+	off_t pos, prev;
+	ssize_t len;
+
+	if (tape.vol == -1 && op->mt_op != MTLOAD)
+		return -1;
+	assert(op->mt_count == 1);
+	switch (op->mt_op) {
+	case MTBSR:
+		for (pos = prev = 0; pos < tape.pos;
+		     pos += sizeof(uint32_t) + record_len(pos))
+			prev = pos;
+		if (tape.pos == 0 || record_len(prev) == 0)
+			return -1;
+		tape.pos = prev;
+		return 0;
+	case MTFSFM:
+		/* Behind the next tape mark, then back to its BOT side */
+		while ((len = record_len(tape.pos)) > 0)
+			tape.pos += sizeof(uint32_t) + len;
+		return len == 0 ? 0 : -1;
+	case MTOFFL:
+		tape.vol = -1;
+		return 0;
+	case MTLOAD:
+		if (tape.vol != -1)
+			return 0;
+		/* Volumes are loaded in sequence */
+		if (tape.next_vol == tape.vol_count)
+			return -1;
+		tape.vol = tape.next_vol++;
+		tape.pos = 0;
+		return 0;
+	case MTREW:
+		tape.pos = 0;
+		return 0;
+	}
+	return -1;
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	if (fd == tape.fd && fd != -1)
+		return fake_read(buf, count);
+	return syscall(SYS_read, fd, buf, count);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct mtget *get;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+	if (fd != tape.fd || fd == -1)
+		return syscall(SYS_ioctl, fd, request, arg);
+	switch (request) {
+	case MTIOCGET:
+		get = (struct mtget *) arg;
+		memset(get, 0, sizeof(*get));
+		get->mt_type = MT_ISSCSI2;
+		get->mt_dsreg = (tape.block_size << MT_ST_BLKSIZE_SHIFT) &
+			MT_ST_BLKSIZE_MASK;
+		return 0;
+	case MTIOCTOP:
+		if (fake_op((struct mtop *) arg) == 0)
+			return 0;
+		errno = EIO;
+		return -1;
+	}
+	errno = ENOTTY;
+	return -1;
+}
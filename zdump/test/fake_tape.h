@@ -0,0 +1,19 @@
+/*
+ * fake_tape - File backed emulation of a tape device for the zgetdump tests
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#ifndef _FAKE_TAPE_H
+#define _FAKE_TAPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+int fake_tape_create(void);
+void fake_tape_write_record(int vol_fd, const void *buf, uint32_t len);
+void fake_tape_write_mark(int vol_fd);
+int fake_tape_open(int vol_fds[], int vol_count, size_t block_size);
+void fake_tape_close(void);
+
+#endif /* _FAKE_TAPE_H */
@@ -0,0 +1,139 @@
+/*
+ * test_copy - Test program for the copy engine of zgetdump
+ *
+ * Copies a regular file to a new regular file, to a file opened with
+ * O_APPEND and through a pipe and checks the result. Splice cannot be
+ * used for O_APPEND output, which has to be detected before any data is
+ * consumed.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "copy.h"
+
+
+#define DATA_SIZE	(3 * 1024 * 1024 + 1000)
+#define HEADER		"HEADER"
+
+static char *data;
+static char in_name[] = "/tmp/test_copy_in.XXXXXX";
+static char out_name[] = "/tmp/test_copy_out.XXXXXX";
+
+
+/* Check that file NAME contains SKIP bytes followed by the test data */
+static void check_output(const char *name, size_t skip)
+{
+	char *buf;
+	int fd;
+
+	buf = malloc(skip + DATA_SIZE + 1);
+	assert(buf);
+	fd = open(name, O_RDONLY);
+	assert(fd != -1);
+	assert(read(fd, buf, skip + DATA_SIZE + 1) ==
+	       (ssize_t) (skip + DATA_SIZE));
+	assert(memcmp(buf + skip, data, DATA_SIZE) == 0);
+	close(fd);
+	free(buf);
+}
+
+/* Copy the input file to OUT_FD with a new copy engine */
+static void copy(int in_fd, int out_fd, int direct)
+{
+	struct copy_engine ce;
+	uint64_t copied;
+
+	assert(lseek(in_fd, 0, SEEK_SET) == 0);
+	copy_engine_init(&ce, 256 * 1024, direct);
+	assert(copy_data(&ce, in_fd, out_fd, DATA_SIZE, &copied) == 0);
+	assert(copied == DATA_SIZE);
+	copy_engine_exit(&ce);
+}
+
+static void test_regular(int in_fd)
+{
+	int fd;
+
+	fd = open(out_name, O_WRONLY | O_TRUNC);
+	assert(fd != -1);
+	copy(in_fd, fd, 0);
+	close(fd);
+	check_output(out_name, 0);
+}
+
+static void test_append(int in_fd)
+{
+	int fd;
+
+	fd = open(out_name, O_WRONLY | O_TRUNC);
+	assert(fd != -1);
+	assert(write(fd, HEADER, strlen(HEADER)) == strlen(HEADER));
+	close(fd);
+	fd = open(out_name, O_WRONLY | O_APPEND);
+	assert(fd != -1);
+	copy(in_fd, fd, 0);
+	close(fd);
+	check_output(out_name, strlen(HEADER));
+}
+
+static void test_pipe(int in_fd)
+{
+	int pfd[2], status, out_fd;
+	pid_t pid;
+	char *buf;
+	ssize_t n;
+
+	assert(pipe(pfd) == 0);
+	pid = fork();
+	assert(pid != -1);
+	if (pid == 0) {
+		close(pfd[0]);
+		copy(in_fd, pfd[1], 0);
+		exit(0);
+	}
+	close(pfd[1]);
+	out_fd = open(out_name, O_WRONLY | O_TRUNC);
+	assert(out_fd != -1);
+	buf = malloc(65536);
+	assert(buf);
+	while ((n = read(pfd[0], buf, 65536)) > 0)
+		assert(write(out_fd, buf, n) == n);
+	free(buf);
+	close(out_fd);
+	close(pfd[0]);
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	check_output(out_name, 0);
+}
+
+int main(void)
+{
+	int in_fd, fd, i;
+
+	data = malloc(DATA_SIZE);
+	assert(data);
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = i % 251;
+	in_fd = mkstemp(in_name);
+	assert(in_fd != -1);
+	assert(write(in_fd, data, DATA_SIZE) == DATA_SIZE);
+	fd = mkstemp(out_name);
+	assert(fd != -1);
+	close(fd);
+
+	test_regular(in_fd);
+	test_append(in_fd);
+	test_pipe(in_fd);
+
+	close(in_fd);
+	unlink(in_name);
+	unlink(out_name);
+	free(data);
+	return 0;
+}
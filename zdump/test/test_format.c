@@ -0,0 +1,280 @@
+/*
+ * test_format - Test program for the lkcd and ELF output formats of zgetdump
+ *
+ * A memory image with zero pages, random pages and compressible pages is
+ * converted and decoded again. Two prefix pages contain CPU save areas,
+ * which must show up as notes of the ELF format.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include "format.h"
+
+
+/* Not a multiple of the conversion block size */
+#define MEM_SIZE	(3 * FMT_BLOCK_SIZE + 5 * FMT_PAGE_SIZE)
+#define MEM_PAGES	(MEM_SIZE / FMT_PAGE_SIZE)
+#define CPU_COUNT	2
+
+/* Output file variants */
+#define OUT_FILE	0
+#define OUT_APPEND	1
+#define OUT_PIPE	2
+
+static const uint32_t prefix[CPU_COUNT] = { 0x20000, 0x104000 };
+
+
+static char *memory;
+static int zero_pages;
+
+
+static int tmp_file(char *name)
+{
+	int fd;
+
+	strcpy(name, "/tmp/test_format.XXXXXX");
+	fd = mkstemp(name);
+	assert(fd != -1);
+	return fd;
+}
+
+static void init_memory(void)
+{
+	int i, j;
+
+	memory = calloc(1, MEM_SIZE);
+	assert(memory);
+	srand(4711);
+	for (i = 0; i < MEM_PAGES; i++) {
+		char *page = memory + i * FMT_PAGE_SIZE;
+
+		switch (rand() % 3) {
+		case 0:
+			break;
+		case 1:
+			for (j = 0; j < FMT_PAGE_SIZE; j++)
+				page[j] = rand();
+			break;
+		default:
+			for (j = 0; j < FMT_PAGE_SIZE; j++)
+				page[j] = "zgetdump"[j % 8];
+			/* A single byte makes the page non-zero */
+			page[FMT_PAGE_SIZE - 1] = 1;
+		}
+	}
+	/* Save areas with the prefix register pointing to the prefix page */
+	for (i = 0; i < CPU_COUNT; i++) {
+		char *sa = memory + prefix[i] + 0x1200;
+
+		for (j = 0; j < 0x200; j++)
+			sa[j] = i + j;
+		memcpy(memory + prefix[i] + 0x1318, &prefix[i],
+		       sizeof(prefix[i]));
+	}
+	/* Memory ends with a zero page */
+	memset(memory + MEM_SIZE - FMT_PAGE_SIZE, 0, FMT_PAGE_SIZE);
+	zero_pages = 0;
+	for (i = 0; i < MEM_PAGES; i++)
+		zero_pages += dump_page_is_zero(memory + i * FMT_PAGE_SIZE);
+}
+
+/* Copy everything from the pipe PFD to OUT_FD in a child process */
+static pid_t start_reader(int pfd[2], int out_fd)
+{
+	char buf[65536];
+	pid_t pid;
+	ssize_t n;
+
+	assert(pipe(pfd) == 0);
+	pid = fork();
+	assert(pid != -1);
+	if (pid)
+		return pid;
+	close(pfd[1]);
+	while ((n = read(pfd[0], buf, sizeof(buf))) > 0)
+		assert(write(out_fd, buf, n) == n);
+	exit(0);
+}
+
+/* Convert memory in two parts, like a dump on two volumes */
+static char *convert(enum dump_format fmt, int threads, int out, size_t *size)
+{
+	char in_name[32], out_name[32], *buf;
+	int in_fd, out_fd, file_fd, pfd[2];
+	s390_dump_header_t hdr;
+	struct fmt_writer *w;
+	uint64_t copied;
+	struct stat st;
+	pid_t pid = 0;
+
+	in_fd = tmp_file(in_name);
+	assert(write(in_fd, memory, MEM_SIZE) == MEM_SIZE);
+	assert(lseek(in_fd, 0, SEEK_SET) == 0);
+	file_fd = out_fd = tmp_file(out_name);
+	if (out == OUT_APPEND) {
+		out_fd = open(out_name, O_WRONLY | O_APPEND);
+		assert(out_fd != -1);
+	} else if (out == OUT_PIPE) {
+		pid = start_reader(pfd, file_fd);
+		close(pfd[0]);
+		out_fd = pfd[1];
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.dh_magic_number = DUMP_MAGIC_S390;
+	hdr.dh_memory_size = MEM_SIZE;
+	hdr.dh_arch = ARCH_S390X;
+	w = fmt_open(fmt, &hdr, out_fd, threads, 0);
+	assert(w);
+	assert(fmt_write_mem(w, in_fd, FMT_BLOCK_SIZE + 3 * FMT_PAGE_SIZE,
+			     &copied) == 0);
+	assert(copied == FMT_BLOCK_SIZE + 3 * FMT_PAGE_SIZE);
+	assert(fmt_write_mem(w, in_fd, MEM_SIZE, &copied) == 0);
+	assert(copied == MEM_SIZE - FMT_BLOCK_SIZE - 3 * FMT_PAGE_SIZE);
+	assert(fmt_finish(w) == 0);
+	assert(w->zero_pages == (uint64_t) zero_pages);
+	assert(w->seekable == (out == OUT_FILE));
+	fmt_free(w);
+	if (out != OUT_FILE)
+		close(out_fd);
+	if (pid)
+		assert(waitpid(pid, NULL, 0) == pid);
+
+	assert(fstat(file_fd, &st) == 0);
+	*size = st.st_size;
+	buf = malloc(st.st_size);
+	assert(buf);
+	assert(pread(file_fd, buf, st.st_size, 0) == st.st_size);
+	close(in_fd);
+	close(file_fd);
+	unlink(in_name);
+	unlink(out_name);
+	return buf;
+}
+
+static void test_lkcd(int threads)
+{
+	struct dump_hdr_lkcd *dh;
+	struct dump_page dp;
+	char *buf, *mem, page[FMT_PAGE_SIZE];
+	size_t size, off = DUMP_HEADER_SIZE;
+	uLongf len;
+	int pages = 0;
+
+	buf = convert(DUMP_FMT_LKCD, threads, OUT_FILE, &size);
+	dh = (struct dump_hdr_lkcd *) buf;
+	assert(dh->magic_number == DUMP_MAGIC_LKCD);
+	assert(dh->memory_size == MEM_SIZE);
+	assert(strcmp(dh->utsname_machine, "s390x") == 0);
+	mem = calloc(1, MEM_SIZE);
+	assert(mem);
+	while (1) {
+		memcpy(&dp, buf + off, sizeof(dp));
+		off += sizeof(dp);
+		if (dp.flags == DUMP_DH_END)
+			break;
+		assert(dp.address == (uint64_t) pages * FMT_PAGE_SIZE);
+		if (dp.flags == DUMP_DH_COMPRESSED) {
+			len = sizeof(page);
+			assert(uncompress((Bytef *) page, &len,
+					  (Bytef *) buf + off, dp.size) == Z_OK);
+			assert(len == FMT_PAGE_SIZE);
+			memcpy(mem + dp.address, page, len);
+		} else {
+			assert(dp.flags == DUMP_DH_RAW);
+			assert(dp.size == FMT_PAGE_SIZE);
+			memcpy(mem + dp.address, buf + off, dp.size);
+		}
+		off += dp.size;
+		pages++;
+	}
+	assert(off == size);
+	assert(pages == MEM_PAGES);
+	assert(memcmp(mem, memory, MEM_SIZE) == 0);
+	free(mem);
+	free(buf);
+}
+
+/* Check the prstatus and fpregset notes of the CPU at PREFIX */
+static char *check_cpu_notes(char *nt, uint32_t prefix)
+{
+	const char *sa = memory + prefix + 0x1200;
+	Elf64_Nhdr *nh = (Elf64_Nhdr *) nt;
+	char *desc = nt + sizeof(*nh) + 8;
+
+	assert(nh->n_type == NT_PRSTATUS && nh->n_namesz == 5);
+	assert(strcmp(nt + sizeof(*nh), "CORE") == 0);
+	assert(nh->n_descsz == 336);
+	/* psw, gprs and acrs */
+	assert(memcmp(desc + 112, sa + 0x100, 16) == 0);
+	assert(memcmp(desc + 128, sa + 0x80, 128) == 0);
+	assert(memcmp(desc + 256, sa + 0x140, 64) == 0);
+	nt = desc + nh->n_descsz;
+	nh = (Elf64_Nhdr *) nt;
+	desc = nt + sizeof(*nh) + 8;
+	assert(nh->n_type == NT_FPREGSET && nh->n_descsz == 136);
+	/* fpc and fprs */
+	assert(memcmp(desc, sa + 0x11c, 4) == 0);
+	assert(memcmp(desc + 8, sa, 128) == 0);
+	return desc + nh->n_descsz;
+}
+
+static void test_elf(int threads, int out)
+{
+	Elf64_Phdr *ph, *nt_ph;
+	Elf64_Nhdr *nh;
+	Elf64_Ehdr *eh;
+	char *buf, *nt;
+	size_t size;
+	int i;
+
+	buf = convert(DUMP_FMT_ELF, threads, out, &size);
+	eh = (Elf64_Ehdr *) buf;
+	assert(memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0);
+	assert(eh->e_ident[EI_CLASS] == ELFCLASS64);
+	assert(eh->e_type == ET_CORE && eh->e_machine == EM_S390);
+	assert(eh->e_phnum == 2);
+	nt_ph = (Elf64_Phdr *) (buf + eh->e_phoff);
+	ph = nt_ph + 1;
+	assert(ph->p_type == PT_LOAD);
+	assert(ph->p_filesz == MEM_SIZE);
+	assert(memcmp(buf + ph->p_offset, memory, MEM_SIZE) == 0);
+
+	/* The notes follow the memory and fill the rest of the file */
+	assert(nt_ph->p_type == PT_NOTE);
+	assert(nt_ph->p_offset == ph->p_offset + MEM_SIZE);
+	assert(size == nt_ph->p_offset + nt_ph->p_filesz);
+	nt = buf + nt_ph->p_offset;
+	for (i = 0; i < CPU_COUNT; i++)
+		nt = check_cpu_notes(nt, prefix[i]);
+	nh = (Elf64_Nhdr *) nt;
+	assert(nh->n_type == NT_PRPSINFO && nh->n_descsz == 136);
+	nt += sizeof(*nh) + 8 + nh->n_descsz;
+	/* Padding note up to the end of the segment */
+	nh = (Elf64_Nhdr *) nt;
+	assert(nh->n_type == 0 && nh->n_namesz == 0);
+	assert(nt + sizeof(*nh) + nh->n_descsz == buf + size);
+	free(buf);
+}
+
+int main(void)
+{
+	init_memory();
+	test_lkcd(1);
+	test_lkcd(4);
+	test_elf(1, OUT_FILE);
+	test_elf(3, OUT_FILE);
+	test_elf(2, OUT_APPEND);
+	test_elf(2, OUT_PIPE);
+	free(memory);
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * test_mvcopy - Test program for the parallel multi-volume copy of zgetdump
+ *
+ * The dump partitions of a multi-volume DASD dump are emulated by regular
+ * files: Each file contains some unused space, followed by the dump header
+ * and the dump data of this volume. The last used volume is followed by
+ * the end marker.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mvcopy.h"
+
+
+#define VOL_COUNT	4
+#define START_OFFSET	8192
+#define MEM_SIZE	(10 * 1024 * 1024)
+#define TEST_TOD	0xc3a1b2c3d4e5f600ULL
+
+
+/* Partition sizes: Volume 2 is not a multiple of 4K, volume 4 is unused */
+static const uint64_t part_size[VOL_COUNT] = {
+	4096 + 3 * 1024 * 1024,
+	4096 + 5 * 1024 * 1024 + 1000,
+	4096 + 4 * 1024 * 1024,
+	4096 + 1024 * 1024,
+};
+
+static char *memory;
+static char vol_name[VOL_COUNT][32];
+
+
+static int tmp_file(char *name)
+{
+	int fd;
+
+	strcpy(name, "/tmp/test_mvcopy.XXXXXX");
+	fd = mkstemp(name);
+	assert(fd != -1);
+	return fd;
+}
+
+static void init_header(s390_dump_header_t *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->dh_magic_number = DUMP_MAGIC_S390;
+	hdr->dh_version = 3;
+	hdr->dh_header_size = S390_DUMP_HEADER_SIZE;
+	hdr->dh_page_size = 4096;
+	hdr->dh_memory_size = MEM_SIZE;
+	hdr->dh_memory_end = MEM_SIZE;
+	hdr->dh_num_pages = MEM_SIZE / 4096;
+	hdr->dh_tod = TEST_TOD;
+	hdr->dh_mvdump = 1;
+	hdr->dh_mvdump_signature = DUMP_MAGIC_S390;
+}
+
+/* Create fake volumes, the header of volume BAD_VOL gets a wrong time */
+static void create_volumes(struct mvcopy_vol vol[], int bad_vol)
+{
+	s390_dump_header_t hdr;
+	uint64_t offset = 0, size;
+	int i;
+
+	for (i = 0; i < VOL_COUNT; i++) {
+		vol[i].fd = tmp_file(vol_name[i]);
+		vol[i].name = vol_name[i];
+		vol[i].part_size = part_size[i];
+		init_header(&hdr);
+		if (i == bad_vol)
+			hdr.dh_tod++;
+		size = ((part_size[i] >> 12) << 12) - 4096;
+		if (size > MEM_SIZE - offset)
+			size = MEM_SIZE - offset;
+		assert(pwrite(vol[i].fd, &hdr, sizeof(hdr), START_OFFSET) ==
+		       sizeof(hdr));
+		assert(pwrite(vol[i].fd, memory + offset, size,
+			      START_OFFSET + sizeof(hdr)) == (ssize_t) size);
+		offset += size;
+		if (offset == MEM_SIZE && size)
+			assert(pwrite(vol[i].fd, "DUMP_END", 8, START_OFFSET +
+				      sizeof(hdr) + size) == 8);
+		assert(lseek(vol[i].fd, START_OFFSET, SEEK_SET) ==
+		       START_OFFSET);
+	}
+}
+
+static void remove_volumes(struct mvcopy_vol vol[])
+{
+	int i;
+
+	for (i = 0; i < VOL_COUNT; i++) {
+		close(vol[i].fd);
+		unlink(vol_name[i]);
+	}
+}
+
+static void test_copy(size_t buf_size, int direct)
+{
+	struct mvcopy_vol vol[VOL_COUNT];
+	s390_dump_header_t hdr;
+	char out_name[32], *out, marker[8];
+	int out_fd, used;
+
+	create_volumes(vol, -1);
+	assert(mvcopy_read_headers(vol, VOL_COUNT, &used) == 0);
+	assert(used == 3);
+	assert(vol[0].size == 3 * 1024 * 1024);
+	assert(vol[1].size == 5 * 1024 * 1024);
+	assert(vol[2].mem_offset == 8 * 1024 * 1024);
+	assert(vol[2].size == 2 * 1024 * 1024);
+	assert(vol[3].size == 0);
+
+	/* Output starts behind existing data, like "zgetdump >> file" */
+	out_fd = tmp_file(out_name);
+	assert(write(out_fd, "prefix", 6) == 6);
+	assert(mvcopy_copy(vol, used, out_fd, 6, buf_size, direct) == 0);
+	assert(lseek(out_fd, 0, SEEK_CUR) == 6);
+
+	out = malloc(MEM_SIZE);
+	assert(out);
+	assert(pread(out_fd, &hdr, sizeof(hdr), 6) == sizeof(hdr));
+	assert(hdr.dh_tod == TEST_TOD);
+	assert(pread(out_fd, out, MEM_SIZE, 6 + sizeof(hdr)) == MEM_SIZE);
+	assert(memcmp(out, memory, MEM_SIZE) == 0);
+
+	/* The last used volume is positioned at the end marker */
+	assert(read(vol[2].fd, marker, 8) == 8);
+	assert(memcmp(marker, "DUMP_END", 8) == 0);
+
+	free(out);
+	close(out_fd);
+	unlink(out_name);
+	remove_volumes(vol);
+}
+
+static void test_bad_header(void)
+{
+	struct mvcopy_vol vol[VOL_COUNT];
+	int used;
+
+	create_volumes(vol, 1);
+	assert(mvcopy_read_headers(vol, VOL_COUNT, &used) == 1);
+	remove_volumes(vol);
+}
+
+/* O_APPEND output and pipes would ignore the offsets and must be rejected */
+static void test_bad_output(void)
+{
+	struct mvcopy_vol vol[VOL_COUNT];
+	char out_name[32];
+	int out_fd, pfd[2], used;
+
+	create_volumes(vol, -1);
+	assert(mvcopy_read_headers(vol, VOL_COUNT, &used) == 0);
+
+	out_fd = tmp_file(out_name);
+	assert(mvcopy_output_ok(out_fd) == 1);
+	close(out_fd);
+	out_fd = open(out_name, O_WRONLY | O_APPEND);
+	assert(out_fd != -1);
+	assert(mvcopy_output_ok(out_fd) == 0);
+	assert(mvcopy_copy(vol, used, out_fd, 0, COPY_BUF_SIZE_DEFAULT,
+			   0) == 1);
+	assert(lseek(out_fd, 0, SEEK_END) == 0);
+	close(out_fd);
+	unlink(out_name);
+
+	assert(pipe(pfd) == 0);
+	assert(mvcopy_output_ok(pfd[1]) == 0);
+	close(pfd[0]);
+	close(pfd[1]);
+	remove_volumes(vol);
+}
+
+int main(void)
+{
+	int i;
+
+	memory = malloc(MEM_SIZE);
+	assert(memory);
+	srand(4711);
+	for (i = 0; i < MEM_SIZE; i++)
+		memory[i] = rand();
+
+	test_copy(COPY_BUF_SIZE_DEFAULT, 0);
+	test_copy(64 * 1024, 0);
+	test_copy(1024 * 1024, 1);
+	test_bad_header();
+	test_bad_output();
+
+	free(memory);
+	return 0;
+}
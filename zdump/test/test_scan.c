@@ -0,0 +1,108 @@
+/*
+ * test_scan - Test program for the dump summary of zgetdump (option -s)
+ *
+ * A memory image with zero and non-zero pages is scanned with different
+ * buffer sizes and the page counters and the CRC-32 are checked.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "scan.h"
+
+
+#define MEM_PAGES	100
+#define MEM_SIZE	(MEM_PAGES * FMT_PAGE_SIZE)
+/* Bytes in front of the dump data, as the dump header on a volume */
+#define DATA_OFF	512
+
+
+static char *memory;
+static int zero_pages;
+static char file_name[] = "/tmp/test_scan.XXXXXX";
+
+
+static void init_memory(void)
+{
+	int i, j;
+
+	memory = calloc(1, MEM_SIZE);
+	assert(memory);
+	srand(4711);
+	for (i = 0; i < MEM_PAGES; i++) {
+		char *page = memory + i * FMT_PAGE_SIZE;
+
+		if (i % 3 == 0) {
+			zero_pages++;
+			continue;
+		}
+		for (j = 0; j < FMT_PAGE_SIZE; j++)
+			page[j] = (i % 3 == 1) ? rand() : "zgetdump"[j % 8];
+	}
+}
+
+static int open_dump(void)
+{
+	char head[DATA_OFF];
+	int fd;
+
+	fd = mkstemp(file_name);
+	assert(fd != -1);
+	memset(head, 0xff, sizeof(head));
+	assert(write(fd, head, sizeof(head)) == sizeof(head));
+	assert(write(fd, memory, MEM_SIZE) == MEM_SIZE);
+	return fd;
+}
+
+static void test_scan(int fd, size_t buf_size)
+{
+	struct copy_engine ce;
+	struct dump_scan s, total;
+	uint64_t scanned, len = MEM_SIZE / 2 + 100;
+	uLong crc;
+
+	copy_engine_init(&ce, buf_size, 0);
+	scan_init(&total);
+	scan_init(&s);
+	assert(lseek(fd, DATA_OFF, SEEK_SET) == DATA_OFF);
+	/* Two parts, the first one ends within a page */
+	assert(scan_data(&s, &ce, fd, len, &scanned) == 0);
+	assert(scanned == len);
+	assert(scan_data(&s, &ce, fd, MEM_SIZE - len, &scanned) == 0);
+	assert(scanned == MEM_SIZE - len);
+	assert(s.pages == MEM_PAGES);
+	assert(s.zero_pages == (uint64_t) zero_pages);
+	assert(s.sampled > 0);
+	crc = crc32(crc32(0L, Z_NULL, 0), (Bytef *) memory, MEM_SIZE);
+	assert(s.crc == crc);
+	/* Not more than the rest of the file can be scanned */
+	assert(scan_data(&s, &ce, fd, FMT_PAGE_SIZE, &scanned) == 0);
+	assert(scanned == 0);
+
+	scan_add(&total, &s);
+	assert(total.pages == MEM_PAGES);
+	assert(scan_lkcd_size(&total) > DUMP_HEADER_SIZE);
+	assert(scan_lkcd_size(&total) <
+	       DUMP_HEADER_SIZE + MEM_SIZE - (uint64_t) zero_pages *
+	       FMT_PAGE_SIZE + MEM_PAGES * sizeof(struct dump_page) * 2);
+	copy_engine_exit(&ce);
+}
+
+int main(void)
+{
+	int fd;
+
+	init_memory();
+	fd = open_dump();
+	test_scan(fd, COPY_BUF_SIZE_MIN);
+	test_scan(fd, 3 * COPY_BUF_SIZE_MIN);
+	test_scan(fd, COPY_BUF_SIZE_DEFAULT);
+	close(fd);
+	unlink(file_name);
+	free(memory);
+	return 0;
+}
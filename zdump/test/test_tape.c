@@ -0,0 +1,191 @@
+/*
+ * test_tape - Test program for the tape reader of zgetdump
+ *
+ * A dump is written to two volumes of a fake tape device and read back
+ * with variable and fixed block size.
+ *
+ * Copyright IBM Corp. 2009
+ */
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
+#include "fake_tape.h"
+#include "tape.h"
+
+
+/* Not a multiple of the read size used with fixed block size */
+#define MEM_SIZE	(70 * TAPE_BLOCK_SIZE)
+/* Dump data on the first volume */
+#define VOL1_SIZE	(45 * TAPE_BLOCK_SIZE)
+#define HEADER_SIZE	4096
+
+
+static char *memory;
+static char block[TAPE_BLOCK_SIZE];
+
+
+static void init_memory(void)
+{
+	int i;
+
+	memory = malloc(MEM_SIZE);
+	assert(memory);
+	srand(4711);
+	for (i = 0; i < MEM_SIZE; i++)
+		memory[i] = rand();
+}
+
+/* Write dump data from OFF to END and a marker block */
+static int create_volume(int volnr, size_t off, size_t end, const char *marker)
+{
+	int fd = fake_tape_create();
+
+	memset(block, 0, sizeof(block));
+	block[0] = volnr;
+	fake_tape_write_record(fd, block, TAPE_BLOCK_SIZE);
+	for (; off < end; off += TAPE_BLOCK_SIZE)
+		fake_tape_write_record(fd, memory + off, TAPE_BLOCK_SIZE);
+	if (marker) {
+		memset(block, 0, sizeof(block));
+		strcpy(block, marker);
+		fake_tape_write_record(fd, block, TAPE_BLOCK_SIZE);
+	}
+	fake_tape_write_mark(fd);
+	return fd;
+}
+
+static void tape_op(int fd, short op)
+{
+	struct mtop mtop;
+
+	mtop.mt_op = op;
+	mtop.mt_count = 1;
+	assert(ioctl(fd, MTIOCTOP, &mtop) == 0);
+}
+
+static char *read_output(int fd, size_t size)
+{
+	char *buf = malloc(size + 1);
+
+	assert(buf);
+	assert(pread(fd, buf, size + 1, 0) == (ssize_t) size);
+	return buf;
+}
+
+static void test_copy(size_t block_size)
+{
+	char name[] = "/tmp/test_tape.XXXXXX";
+	size_t header_size = block_size ? block_size : HEADER_SIZE;
+	struct tape_copy tc;
+	int vol_fds[2], fd, out_fd;
+	char *buf;
+
+	vol_fds[0] = create_volume(0, 0, VOL1_SIZE, "ENDOFVOL");
+	vol_fds[1] = create_volume(1, VOL1_SIZE, MEM_SIZE, "DUMP_END");
+	fd = fake_tape_open(vol_fds, 2, block_size);
+	out_fd = mkstemp(name);
+	assert(out_fd != -1);
+	unlink(name);
+
+	if (block_size)
+		assert(tape_read_size(fd) ==
+		       TAPE_READ_SIZE / block_size * block_size);
+	else
+		assert(tape_read_size(fd) == TAPE_READ_SIZE);
+	/* The header is a block of its own */
+	assert(read(fd, block, header_size) == (ssize_t) header_size);
+	assert(block[0] == 0);
+	assert(tape_copy_init(&tc, fd, out_fd) == 0);
+	assert(tape_copy_volume(&tc, MEM_SIZE) == TAPE_END_VOL);
+	assert(tc.vol_bytes == VOL1_SIZE);
+	assert(strcmp(tc.marker, "ENDOFVOL") == 0);
+
+	/* The writer is still busy while the next volume is loaded */
+	tape_op(fd, MTOFFL);
+	tape_op(fd, MTLOAD);
+	tape_op(fd, MTREW);
+	assert(read(fd, block, header_size) == (ssize_t) header_size);
+	assert(block[0] == 1);
+	assert(tape_copy_volume(&tc, MEM_SIZE) == TAPE_END_DUMP);
+	assert(tc.vol_bytes == MEM_SIZE - VOL1_SIZE);
+	assert(tc.read_bytes == MEM_SIZE);
+	assert(strcmp(tc.marker, "DUMP_END") == 0);
+	assert(tape_copy_finish(&tc) == 0);
+
+	buf = read_output(out_fd, MEM_SIZE);
+	assert(memcmp(buf, memory, MEM_SIZE) == 0);
+	free(buf);
+	fake_tape_close();
+	close(out_fd);
+	close(vol_fds[0]);
+	close(vol_fds[1]);
+}
+
+/* A tape mark where the end marker is expected */
+static void test_no_marker(void)
+{
+	struct tape_copy tc;
+	int vol_fd, fd;
+
+	vol_fd = create_volume(0, 0, VOL1_SIZE, NULL);
+	fd = fake_tape_open(&vol_fd, 1, 0);
+	assert(read(fd, block, HEADER_SIZE) == HEADER_SIZE);
+	assert(tape_copy_init(&tc, fd, open("/dev/null", O_WRONLY)) == 0);
+	assert(tape_copy_volume(&tc, MEM_SIZE) == TAPE_END_NONE);
+	assert(tc.read_bytes == VOL1_SIZE);
+	assert(tape_copy_finish(&tc) == 0);
+	close(tc.out_fd);
+	fake_tape_close();
+	close(vol_fd);
+}
+
+/* Loading the next volume fails while the writer is busy */
+static void test_abort(void)
+{
+	struct tape_copy tc;
+	int vol_fd, fd, i;
+
+	vol_fd = create_volume(0, 0, VOL1_SIZE, "ENDOFVOL");
+	fd = fake_tape_open(&vol_fd, 1, 0);
+	assert(read(fd, block, HEADER_SIZE) == HEADER_SIZE);
+	assert(tape_copy_init(&tc, fd, open("/dev/null", O_WRONLY)) == 0);
+	assert(tape_copy_volume(&tc, MEM_SIZE) == TAPE_END_VOL);
+	tape_copy_abort(&tc);
+	for (i = 0; i < TAPE_BUFS; i++)
+		assert(tc.buf[i] == NULL);
+	close(tc.out_fd);
+	fake_tape_close();
+	close(vol_fd);
+}
+
+/* "zgetdump -i" on tape finds the end marker with FSFM and BSR */
+static void test_forward(void)
+{
+	int vol_fd, fd;
+
+	vol_fd = create_volume(0, 0, VOL1_SIZE, "DUMP_END");
+	fd = fake_tape_open(&vol_fd, 1, 0);
+	tape_op(fd, MTFSFM);
+	tape_op(fd, MTBSR);
+	assert(read(fd, block, 16) == 16);
+	assert(strncmp(block, "DUMP_END", 8) == 0);
+	fake_tape_close();
+	close(vol_fd);
+}
+
+int main(void)
+{
+	init_memory();
+	test_copy(0);
+	test_copy(TAPE_BLOCK_SIZE);
+	test_no_marker();
+	test_abort();
+	test_forward();
+	free(memory);
+	return 0;
+}
@@ -10,6 +10,11 @@
  */
 
 #include "zgetdump.h"
+#include "copy.h"
+#include "mvcopy.h"
+#include "format.h"
+#include "scan.h"
+#include "tape.h"
 #include "zt_common.h"
 #include <stdio.h>
 #include <unistd.h>
@@ -40,8 +45,6 @@
 #define MAGIC_BLOCK_OFFSET_ECKD 3
 #define MAGIC_OFFSET_FBA -0x1000
 #define HEXINSTR "\x0d\x10\x47\xf0"      /* BASR + 1st halfword of BC    */
-#define ARCH_S390  1
-#define ARCH_S390X 2
 #define VERSION_NO_DUMP_DEVICE -1
 
 #define SYSFS_BUSDIR "/sys/bus/ccw/devices"
@@ -60,9 +63,21 @@ char *help_text =
 "zgetdump can also check, whether a DASD device contains a valid dumper.\n\n"\
 "Usage:\n"\
 "Copy dump from <dumpdevice> to stdout:\n"\
-"       > zgetdump <dumpdevice>\n"\
+"       > zgetdump [-b <size>] [-D] [-P] [-f <fmt>] [-t <n>] <dumpdevice>\n"\
+"       -b <size> or --buffer=<size>: Size of the copy buffers, default 4M,\n"\
+"                 the k and M suffixes are supported\n"\
+"       -D or --direct: Read the dump device with direct I/O\n"\
+"       -P or --parallel: Read all volumes of a multi-volume DASD dump\n"\
+"                 at the same time, stdout must be a regular file\n"\
+"       -f <fmt> or --fmt=<fmt>: Output format of a DASD dump: s390\n"\
+"                 (default), lkcd (compressed pages) or elf\n"\
+"       -t <n> or --threads=<n>: Number of threads for lkcd compression\n"\
+"                 and elf zero page detection, default: number of CPUs\n"\
 "Print dump header and check if dump is valid - for single tape or DASD:\n"\
-"       > zgetdump [-i | --info] <dumpdevice>\n"\
+"       > zgetdump [-i | --info] [-s | --summary] <dumpdevice>\n"\
+"       -s or --summary: Read the dump data of a DASD dump, count zero\n"\
+"                 pages, print CRC-32 checksums of the volumes and the\n"\
+"                 size of the dump in lkcd format. Implies --info\n"\
 "Print dump header and check if dump is valid - for all volumes of a\n"
 "multi-volume tape dump:\n"\
 "       > zgetdump [-i | --info] [-a | --all] <dumpdevice>\n"\
@@ -75,6 +90,7 @@ char *help_text =
 "Examples for single-volume DASD:\n"\
 "> zgetdump -d /dev/dasdc\n"\
 "> zgetdump -i /dev/dasdc1\n"\
+"> zgetdump -i -s /dev/dasdc1\n"\
 "> zgetdump /dev/dasdc1 > dump_file\n";
 
 char *usage_note =
@@ -102,6 +118,16 @@ struct timeval h_time_begin, h_time_end;
 int  option_a_set;
 int  option_i_set;
 int  option_d_set;
+int  option_direct_set;
+int  option_parallel_set;
+int  option_summary_set;
+struct dump_scan scan_total;
+struct tape_copy tape_copy;
+enum dump_format dump_format = DUMP_FMT_S390;
+int  fmt_threads;
+struct fmt_writer *fmt_writer;
+size_t copy_buf_size = COPY_BUF_SIZE_DEFAULT;
+struct copy_engine copy_engine;
 char dump_device[PATH_MAX];
 
 /* end of definitions */
@@ -722,24 +748,32 @@ void print_s390_header(enum dump_type d_type)
 	}
 }
 
-/* print header information */
-void get_header(int fd)
+/* read the dump header, return 1 on error */
+int get_header(int fd)
 {
 	ssize_t n_read;
 
 	n_read = read(fd, &header, HEADER_SIZE);
 	if (n_read == -1) {
 		perror("Cannot read dump header");
-		close(fd);
-		exit(1);
+		return 1;
 	}
+	return 0;
 }
 
-/* copy header to stdout */
+/* copy header to stdout, or header of the selected output format */
 void write_header()
 {
 	ssize_t rc;
 
+	if (dump_format != DUMP_FMT_S390) {
+		fmt_writer = fmt_open(dump_format, &header, STDOUT_FILENO,
+				      fmt_threads, option_direct_set);
+		if (!fmt_writer)
+			exit(1);
+		return;
+	}
+
 	memcpy(read_buffer, &header, sizeof(header));
 	rc = write(STDOUT_FILENO, read_buffer, header.dh_header_size);
 	if (rc == -1) {
@@ -752,130 +786,136 @@ void write_header()
 	}
 }
 
+/* print a progress dot for each 1/32 of the data copied */
+struct copy_progress {
+	uint64_t step;
+	uint64_t next;
+};
+
+void print_copy_progress(uint64_t copied, void *data)
+{
+	struct copy_progress *progress = (struct copy_progress *) data;
+
+	while (progress->step && copied >= progress->next) {
+		fprintf(stderr, ".");
+		progress->next += progress->step;
+	}
+}
+
+/* copy LEN bytes of dump data from the current position of fd to stdout */
+int copy_dump_data(int fd, uint64_t len, uint64_t *copied)
+{
+	struct copy_progress progress;
+
+	progress.step = header.dh_memory_size / 32;
+	progress.next = progress.step;
+	if (fmt_writer) {
+		fmt_writer->progress = print_copy_progress;
+		fmt_writer->progress_data = &progress;
+		return fmt_write_mem(fmt_writer, fd, len, copied);
+	}
+	copy_engine.progress = print_copy_progress;
+	copy_engine.progress_data = &progress;
+	return copy_data(&copy_engine, fd, STDOUT_FILENO, len, copied);
+}
+
+/* read LEN bytes of dump data from the current position of fd without
+ * writing them and add them to the counters of S (option --summary) */
+int scan_dump_data(int fd, uint64_t len, struct dump_scan *s)
+{
+	struct copy_progress progress;
+	uint64_t scanned;
+
+	progress.step = header.dh_memory_size / 32;
+	progress.next = progress.step;
+	copy_engine.progress = print_copy_progress;
+	copy_engine.progress_data = &progress;
+	if (scan_data(s, &copy_engine, fd, len, &scanned))
+		return 1;
+	fprintf(stderr, "\n");
+	if (scanned < len) {
+		fprintf(stderr, "Dump data is incomplete: %"FMT64"u of "
+			"%"FMT64"u bytes found\n", scanned, len);
+		return 1;
+	}
+	scan_add(&scan_total, s);
+	return 0;
+}
+
+/* print page counters and projected sizes of all scanned dump data */
+void print_scan_summary(void)
+{
+	uint64_t data_pages = scan_total.pages - scan_total.zero_pages;
+
+	fprintf(stderr, "\nSummary of dump contents:\n");
+	fprintf(stderr, "  Pages             : %"FMT64"u (%"FMT64"u MB)\n",
+		scan_total.pages, (scan_total.pages * FMT_PAGE_SIZE) >> 20);
+	fprintf(stderr, "  Zero pages        : %"FMT64"u (%.1f%%)\n",
+		scan_total.zero_pages, scan_total.pages ?
+		100.0 * scan_total.zero_pages / scan_total.pages : 0);
+	fprintf(stderr, "  Non-zero data     : %"FMT64"u MB\n",
+		(data_pages * FMT_PAGE_SIZE) >> 20);
+	fprintf(stderr, "  Size in lkcd fmt  : %"FMT64"u MB (estimated)\n",
+		scan_lkcd_size(&scan_total) >> 20);
+}
+
 /* copy partition containing multi-volume dump data to stdout */
 int mvdump_copy(int fd, uint64_t partsize, uint64_t *totalsize)
 {
-	ssize_t n_read, n_written;
-	uint64_t part_offset;
-	int done = 0;
-	size_t count;
-
-	part_offset = HEADER_SIZE;
-	do {
-		count = MIN(header.dh_memory_size - *totalsize, BLOCK_SIZE);
-		if (count < BLOCK_SIZE)
-			done = 1;
-		if (partsize - part_offset < count) {
-			count = partsize - part_offset;
-			done = 1;
-		}
-		n_read = read(fd, read_buffer, count);
-		if (n_read == -1) {
-			perror("\nread failed");
-			return 1;
-		}
-		n_read = (n_read >> 12) << 12;
-		n_written = write(STDOUT_FILENO, read_buffer, n_read);
-		if (n_written == -1) {
-			perror("\nwrite failed");
-			return 1;
-		}
-		if (n_written < n_read) {
-			fprintf(stderr, "\nwrite failed: "
-				"No space left on device\n");
-			return 1;
-		}
-		part_offset += n_written;
-		*totalsize += n_written;
-		if (part_offset % (header.dh_memory_size / 32) == HEADER_SIZE)
-			fprintf(stderr, ".");
-	} while (!done);
+	uint64_t count, copied;
+
+	/* only complete 4K pages are part of the dump */
+	count = MIN(header.dh_memory_size - *totalsize,
+		    ((partsize - HEADER_SIZE) >> 12) << 12);
+	if (copy_dump_data(fd, count, &copied))
+		return 1;
+	*totalsize += copied;
 	fprintf(stderr, "\n");
 	return 0;
 }
 
-/* copy the dump to stdout */
+/* copy the dump to stdout, return -1 on error */
 int get_dump(int fd, int d_type)
 {
-	int ret, bsr;
-	ssize_t n_read, n_written;
-	struct mtop mymtop;
 	uint64_t i;
+	int ret;
 
 	ret = 0;
 	if (d_type == IS_DASD) {
-		i = 0;
-		do {
-			n_read = read(fd, read_buffer, BLOCK_SIZE);
-			n_written = write(STDOUT_FILENO, read_buffer, n_read);
-			if (n_written == -1) {
-				perror("\nwrite failed");
-				exit(1);
-			}
-			if (n_written < n_read) {
-				fprintf(stderr, "\nwrite failed: "
-					"No space left on device\n");
-				exit(1);
-			}
-			i += n_read;
-			if (i % (header.dh_memory_size / 32) == 0)
-				fprintf(stderr, ".");
-		} while (i < header.dh_memory_size && n_read != 0
-			 && n_written >= 0);
+		if (copy_dump_data(fd, header.dh_memory_size, &i))
+			return -1;
 	} else if (d_type == IS_TAPE) {
 	/* write to stdout while not ENDOFVOL or DUMP_END		*/
 		if (header.dh_volnr != 0)
 			fprintf(stderr, "Reading dump content ");
-		for (i = 0; i < (header.dh_memory_size/BLOCK_SIZE); i++) {
-			n_read = read(fd, read_buffer, BLOCK_SIZE);
-			if (i % ((header.dh_memory_size/BLOCK_SIZE) / 32) == 0)
-				fprintf(stderr, ".");
-			if (strncmp(read_buffer, "ENDOFVOL", 8) == 0) {
-				fprintf(stderr, "\nEnd of Volume reached.\n");
-				ret = 1;
-				break;
-			} else if (strncmp(read_buffer, "DUMP_END", 8) == 0) {
-				ret = 2;
-				break;
-			} else {
-				n_written = write(STDOUT_FILENO, read_buffer,
-						  n_read);
-				if (n_written == -1) {
-					perror("\nwrite failed");
-					exit(1);
-				}
-				if (n_written < n_read) {
-					fprintf(stderr, "\nwrite failed: "
-						"No space left on device\n");
-					exit(1);
-				}
-			}
-		}
-		if (ret == 2) {
-			/* we go back a record, so dump_end_times gets called */
-			mymtop.mt_count = 1;
-			mymtop.mt_op = MTBSR;
-			bsr = ioctl(fd, MTIOCTOP, &mymtop);
-			if (bsr != 0) {
-				fprintf(stderr,
-					"Tape operation MTBSR failed.\n");
-				exit(1);
-			}
+		ret = tape_copy_volume(&tape_copy, header.dh_memory_size);
+		if (ret == -1)
+			return -1;
+		fprintf(stderr, "\nVolume %i: %"FMT64"u MB read in %.1f s "
+			"(%.1f MB/s)\n", header.dh_volnr,
+			tape_copy.vol_bytes >> 20,
+			tape_copy.vol_usecs / 1000000.0,
+			tape_copy.vol_usecs ? (double) tape_copy.vol_bytes /
+			tape_copy.vol_usecs * 1000000 / (1 << 20) : 0);
+		if (ret == TAPE_END_VOL) {
+			fprintf(stderr, "End of Volume reached.\n");
+			ret = 1;
+		} else if (ret == TAPE_END_DUMP) {
+			/* the end marker has already been read */
+			memcpy(&end_marker, tape_copy.marker,
+			       sizeof(end_marker));
+			ret = 2;
 		}
 	}
 	return ret;
 }
 
-/*	check for DUMP_END and see		*/
-/*	if dump ended after it started (!!!)	*/
-int dump_end_times(int fd)
+/*	check for DUMP_END in the end marker read last	*/
+/*	and see if dump ended after it started (!!!)	*/
+int check_end_times(void)
 {
 	int ret;
 
-	if (read(fd, &end_marker, sizeof(end_marker)) == -1) {
-		perror("Could not read end marker.");
-		exit(1);
-	}
 	s390_tod_to_timeval(end_marker.end_time, &h_time_end);
 	if ((strncmp(end_marker.end_string, "DUMP_END", 8) == 0) &&
 	    ((h_time_end.tv_sec - h_time_begin.tv_sec) >= 0)) {
@@ -887,19 +927,54 @@ int dump_end_times(int fd)
 	return ret;
 }
 
-int check_and_write_end_marker(int fd)
+/*	read the end marker and check it	*/
+int dump_end_times(int fd)
 {
-	if (dump_end_times(fd) == 0) {
-		ssize_t rc;
-		rc = write(STDOUT_FILENO, &end_marker,
-			   sizeof(end_marker));
-		if (rc == -1) {
-			perror("\nwrite failed");
-			return 1;
-		}
-		if (rc < (ssize_t) sizeof(end_marker)) {
-			fprintf(stderr, "\nwrite failed: "
-				"No space left on device\n");
+	if (read(fd, &end_marker, sizeof(end_marker)) == -1) {
+		perror("Could not read end marker.");
+		exit(1);
+	}
+	return check_end_times();
+}
+
+/* complete dump in lkcd or elf format and print statistics */
+int finish_converted_dump(void)
+{
+	if (fmt_finish(fmt_writer))
+		return 1;
+	fprintf(stderr, "Converted dump to %s format: %"FMT64"u of %"FMT64"u "
+		"pages are zero, output size %"FMT64"u MB\n",
+		fmt_name(dump_format), fmt_writer->zero_pages,
+		header.dh_memory_size / FMT_PAGE_SIZE,
+		fmt_writer->out_bytes >> 20);
+	return 0;
+}
+
+int write_end_marker(void)
+{
+	ssize_t rc;
+
+	rc = write(STDOUT_FILENO, &end_marker, sizeof(end_marker));
+	if (rc == -1) {
+		perror("\nwrite failed");
+		return 1;
+	}
+	if (rc < (ssize_t) sizeof(end_marker)) {
+		fprintf(stderr, "\nwrite failed: "
+			"No space left on device\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* write the end marker, if VALID is set, and print the dump status */
+int write_valid_end_marker(int valid)
+{
+	if (valid) {
+		if (fmt_writer) {
+			if (finish_converted_dump())
+				return 1;
+		} else if (write_end_marker()) {
 			return 1;
 		}
 		fprintf(stderr, "\nDump End Marker found: "
@@ -911,6 +986,11 @@ int check_and_write_end_marker(int fd)
 	}
 }
 
+int check_and_write_end_marker(int fd)
+{
+	return write_valid_end_marker(dump_end_times(fd) == 0);
+}
+
 /*	if a tape is part of the dump (not the last)	*/
 /*	it should have and ENDOFVOL marker		*/
 int vol_end(void)
@@ -947,7 +1027,7 @@ void tape_forwards(int fd)
 
 /*	put current tape offline	*/
 /*	load & rewind next tape		*/
-void load_next(int fd)
+int load_next(int fd)
 {
 	int ret;
 	struct mtop mymtop;
@@ -957,7 +1037,7 @@ void load_next(int fd)
 	ret = ioctl(fd, MTIOCTOP, &mymtop);
 	if (ret != 0) {
 		fprintf(stderr, "Tape operation OFFL failed.\n");
-		exit(1);
+		return 1;
 	}
 
 	mymtop.mt_count = 1;
@@ -965,7 +1045,7 @@ void load_next(int fd)
 	ret = ioctl(fd, MTIOCTOP, &mymtop);
 	if (ret != 0) {
 		fprintf(stderr, "Tape operation LOAD failed.\n");
-		exit(1);
+		return 1;
 	} else
 		fprintf(stderr, "done\n");
 
@@ -974,8 +1054,38 @@ void load_next(int fd)
 	ret = ioctl(fd, MTIOCTOP, &mymtop);
 	if (ret != 0) {
 		fprintf(stderr, "Tape operation REW failed.\n");
-		exit(1);
+		return 1;
+	}
+	return 0;
+}
+
+/* parse buffer size with optional k or M suffix */
+int parse_buffer_size(char *string, size_t *size)
+{
+	unsigned long bytes;
+	char *suffix;
+
+	bytes = strtoul(string, &suffix, 10);
+	if (suffix == string || strlen(suffix) > 1)
+		return 1;
+	switch (*suffix) {
+	case 'k':
+	case 'K':
+		bytes *= 1024;
+		break;
+	case 'm':
+	case 'M':
+		bytes *= 1024 * 1024;
+		break;
+	case '\0':
+		break;
+	default:
+		return 1;
 	}
+	if (bytes < COPY_BUF_SIZE_MIN || bytes > COPY_BUF_SIZE_MAX)
+		return 1;
+	*size = bytes;
+	return 0;
 }
 
 /* parse the commandline options */
@@ -988,9 +1098,15 @@ void parse_opts(int argc, char *argv[])
 		{"version", no_argument, 0, 'v'},
 		{"all",     no_argument, 0, 'a'},
 		{"device",  no_argument, 0, 'd'},
+		{"buffer",  required_argument, 0, 'b'},
+		{"direct",  no_argument, 0, 'D'},
+		{"parallel", no_argument, 0, 'P'},
+		{"fmt",     required_argument, 0, 'f'},
+		{"threads", required_argument, 0, 't'},
+		{"summary", no_argument, 0, 's'},
 		{0,         0,           0, 0  }
 	};
-	static const char option_string[] = "iavhd";
+	static const char option_string[] = "iavhdb:DPf:t:s";
 
 	while ((opt = getopt_long(argc, argv, option_string, long_options,
 			       &index)) != -1) {
@@ -1004,6 +1120,38 @@ void parse_opts(int argc, char *argv[])
 		case 'i':
 			option_i_set = 1;
 			break;
+		case 's':
+			option_summary_set = 1;
+			option_i_set = 1;
+			break;
+		case 'b':
+			if (parse_buffer_size(optarg, &copy_buf_size)) {
+				fprintf(stderr, "Invalid buffer size '%s'\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case 'D':
+			option_direct_set = 1;
+			break;
+		case 'P':
+			option_parallel_set = 1;
+			break;
+		case 'f':
+			if (fmt_parse(optarg, &dump_format)) {
+				fprintf(stderr, "Invalid output format '%s'\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case 't':
+			fmt_threads = atoi(optarg);
+			if (fmt_threads < 1 || fmt_threads > FMT_MAX_THREADS) {
+				fprintf(stderr, "Number of threads must be "
+					"between 1 and %i\n", FMT_MAX_THREADS);
+				exit(1);
+			}
+			break;
 		case 'h':
 			printf(help_text);
 			exit(0);
@@ -1027,10 +1175,129 @@ void parse_opts(int argc, char *argv[])
 		exit(1);
 
 
+	}
+	if (option_parallel_set && dump_format != DUMP_FMT_S390) {
+		fprintf(stderr, "Option --parallel is only supported for "
+			"the s390 output format\n");
+		exit(1);
+	}
+	if (!fmt_threads) {
+		fmt_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (fmt_threads < 1)
+			fmt_threads = 1;
+		fmt_threads = MIN(fmt_threads, FMT_MAX_THREADS);
 	}
 	strcpy(dump_device, argv[optind]);
 }
 
+/* Check that a volume of a multi-volume dump is available and open it.
+ * Return file descriptor positioned at the dump partition or -1 on error */
+int mvdump_open_volume(struct disk_info *vol, char **temp_devnode)
+{
+	int fd;
+
+	if (vol->status != ONLINE) {
+		fprintf(stderr, "============================="
+			"=======================\n");
+		fprintf(stderr, "ERROR: Dump device %s is not "
+			"available.\n", vol->bus_id);
+		fprintf(stderr, "============================="
+			"=======================\n");
+		return -1;
+	}
+	if (vol->signature != ACTIVE) {
+		fprintf(stderr, "============================="
+			"=======================\n");
+		fprintf(stderr, "ERROR: Invalid dump data on "
+			"%s.\n", vol->bus_id);
+		fprintf(stderr, "============================="
+			"=======================\n");
+		return -1;
+	}
+	if (make_temp_devnode(vol->device, temp_devnode))
+		return -1;
+	fd = open_block_device(*temp_devnode);
+	if (fd == -1) {
+		free_temp_devnode(*temp_devnode);
+		return -1;
+	}
+	if (lseek(fd, vol->start_offset, SEEK_SET) != vol->start_offset) {
+		perror("Cannot seek on device");
+		close(fd);
+		free_temp_devnode(*temp_devnode);
+		return -1;
+	}
+	return fd;
+}
+
+/* Copy all volumes of a multi-volume dump at the same time: Each volume is
+ * written at its offset of the output file, which therefore must be a
+ * regular file that is not opened with O_APPEND                          */
+int mvdump_parallel_copy(int vol_count, struct disk_info vol[])
+{
+	struct mvcopy_vol mv[MAX_DUMP_VOLUMES];
+	char *temp_devnode[MAX_DUMP_VOLUMES];
+	int i, used, opened, rc = 1;
+	off_t out_off, end_off;
+
+	out_off = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+	if (out_off == -1) {
+		perror("Cannot seek on output file");
+		return 1;
+	}
+	for (opened = 0; opened < vol_count; opened++) {
+		mv[opened].fd = mvdump_open_volume(&vol[opened],
+						   &temp_devnode[opened]);
+		if (mv[opened].fd == -1)
+			goto out;
+		mv[opened].name = vol[opened].bus_id;
+		mv[opened].part_size = vol[opened].part_size;
+	}
+	if (mvcopy_read_headers(mv, vol_count, &used))
+		goto out;
+	memcpy(&header, &mv[0].hdr, sizeof(header));
+	print_s390_header(IS_MULT_DASD);
+	if (used == 0) {
+		fprintf(stderr, "Dump contains no memory: "
+			"this dump is NOT valid.\n");
+		goto out;
+	}
+	fprintf(stderr, "Reading dump contents from %i volumes in "
+		"parallel:\n", used);
+	if (mvcopy_copy(mv, used, STDOUT_FILENO, out_off, copy_buf_size,
+			option_direct_set))
+		goto out;
+	/* the end marker follows the data on the last used volume */
+	end_off = out_off + header.dh_header_size + mv[used - 1].mem_offset +
+		mv[used - 1].size;
+	if (lseek(STDOUT_FILENO, end_off, SEEK_SET) != end_off) {
+		perror("Cannot seek on output file");
+		goto out;
+	}
+	rc = check_and_write_end_marker(mv[used - 1].fd);
+out:
+	for (i = 0; i < opened; i++) {
+		close(mv[i].fd);
+		free_temp_devnode(temp_devnode[i]);
+	}
+	return rc;
+}
+
+/* read the dump data of one volume for option --summary */
+int mvdump_scan_volume(int fd, struct disk_info *vol, uint64_t len)
+{
+	struct dump_scan scan;
+
+	scan_init(&scan);
+	fprintf(stderr, "Scanning dump contents on %s ", vol->bus_id);
+	if (scan_dump_data(fd, len, &scan))
+		return 1;
+	fprintf(stderr, "%s: %"FMT64"u pages, %"FMT64"u zero pages, "
+		"CRC-32 0x%08x\n", vol->bus_id, scan.pages, scan.zero_pages,
+		scan.crc);
+	return 0;
+}
+
 /* Loop along all involved volumes (dump partitions) and either check (for
  * option --info) or pick up dump data                                     */
 int mvdump_check_or_copy(int vol_count, struct disk_info vol[])
@@ -1040,51 +1307,32 @@ int mvdump_check_or_copy(int vol_count, struct disk_info vol[])
 	char* temp_devnode;
 
 	for (i = 0; i < vol_count; i++) {
-		if (vol[i].status != ONLINE) {
-			fprintf(stderr, "============================="
-				"=======================\n");
-			fprintf(stderr, "ERROR: Dump device %s is not "
-				"available.\n", vol[i].bus_id);
-			fprintf(stderr, "============================="
-				"=======================\n");
-			return 1;
-		}
-		if (vol[i].signature != ACTIVE) {
-			fprintf(stderr, "============================="
-				"=======================\n");
-			fprintf(stderr, "ERROR: Invalid dump data on "
-				"%s.\n", vol[i].bus_id);
-			fprintf(stderr, "============================="
-				"=======================\n");
-			return 1;
-		}
-		if (make_temp_devnode(vol[i].device, &temp_devnode))
-			return 1;
-		fd = open_block_device(temp_devnode);
-		if (fd == -1) {
-			free_temp_devnode(temp_devnode);
+		fd = mvdump_open_volume(&vol[i], &temp_devnode);
+		if (fd == -1)
 			return 1;
-		}
-		if (lseek(fd, vol[i].start_offset, SEEK_SET) !=
-		    vol[i].start_offset) {
-			perror("Cannot seek on device");
+		if (get_header(fd))
 			goto out;
-		}
-		get_header(fd);
 		print_s390_header(IS_MULT_DASD);
 		fprintf(stderr, "\nMulti-volume dump: Disk %i (of %i)\n",
 				i + 1, vol_count);
 		if (option_i_set) {
 			data_size = ((vol[i].part_size >> 12) << 12) -
 				HEADER_SIZE;
+			if (option_summary_set &&
+			    mvdump_scan_volume(fd, &vol[i], MIN(data_size,
+				header.dh_memory_size - total_size)))
+				goto out;
 			if (total_size + data_size > header.dh_memory_size) {
-				if (lseek(fd, header.dh_memory_size -
+				if (!option_summary_set &&
+				    lseek(fd, header.dh_memory_size -
 					  total_size, SEEK_CUR) == -1) {
 					perror("Cannot seek on device");
 					goto out;
 				}
 				fprintf(stderr, "Checking dump contents on "
 					"%s\n", vol[i].bus_id);
+				if (option_summary_set)
+					print_scan_summary();
 				if (dump_end_times(fd) == 0) {
 					fprintf(stderr, "Dump End Marker "
 						"found: "
@@ -1103,8 +1351,9 @@ int mvdump_check_or_copy(int vol_count, struct disk_info vol[])
 				goto out;
 			}
 			total_size += data_size;
-			fprintf(stderr, "Skipping dump contents on %s\n",
-				vol[i].bus_id);
+			if (!option_summary_set)
+				fprintf(stderr, "Skipping dump contents on "
+					"%s\n", vol[i].bus_id);
 		} else {
 			if (i == 0)
 				write_header();
@@ -1132,7 +1381,8 @@ int main(int argc, char *argv[])
 {
 	uint64_t cur_time, size_limit;
 	int vol_count, fd = -1;
-	int version, dumper_arch, dasd_mv_flag = 0, block_size, rc;
+	int version, dumper_arch, dasd_mv_flag = 0, block_size, rc, ret;
+	struct copy_progress tape_progress;
 	int force_specified = 0;
 	enum dump_type d_type;
 	enum devnode_type type;
@@ -1141,6 +1391,7 @@ int main(int argc, char *argv[])
 
 	rc = 0;
 	parse_opts(argc, argv);
+	copy_engine_init(&copy_engine, copy_buf_size, option_direct_set);
 
 	if (option_d_set) {
 		fd = open_block_device(dump_device);
@@ -1181,8 +1432,24 @@ is_dump_device:
 	}
 
 	fd = open_dump(dump_device);
-	get_header(fd);
+	if (get_header(fd)) {
+		rc = 1;
+		goto out;
+	}
 	d_type = dev_type(fd);
+	if (d_type == IS_TAPE && dump_format != DUMP_FMT_S390 &&
+	    !option_i_set) {
+		fprintf(stderr, "Output format %s is only supported for "
+			"DASD dumps\n", fmt_name(dump_format));
+		rc = 1;
+		goto out;
+	}
+	if (d_type == IS_TAPE && option_summary_set) {
+		fprintf(stderr, "Option --summary is only supported for DASD "
+			"dumps\n");
+		rc = 1;
+		goto out;
+	}
 	if ((d_type == IS_DASD) &&
 	    ((header.dh_magic_number == DUMP_MAGIC_LKCD)
 	     || (header.dh_magic_number == DUMP_MAGIC_LIVE))) {
@@ -1220,7 +1487,17 @@ is_dump_device:
 		rc = get_mvdump_info(fd, block_size, &vol_count, vol);
 		if (rc)
 			goto out;
-		rc = mvdump_check_or_copy(vol_count, vol);
+		if (option_parallel_set && !option_i_set &&
+		    !mvcopy_output_ok(STDOUT_FILENO)) {
+			fprintf(stderr, "Standard output is not a regular file "
+				"or is opened for appending: Copying volumes "
+				"one after another.\n");
+			option_parallel_set = 0;
+		}
+		if (option_parallel_set && !option_i_set)
+			rc = mvdump_parallel_copy(vol_count, vol);
+		else
+			rc = mvdump_check_or_copy(vol_count, vol);
 		goto out;
 	}
 
@@ -1229,25 +1506,50 @@ is_dump_device:
 		write_header();
 		fprintf(stderr, "Reading dump content ");
 
+		/*	the writer keeps writing the data read	*/
+		/*	while the next volume is loaded		*/
+
+		if (d_type == IS_TAPE) {
+			if (tape_copy_init(&tape_copy, fd, STDOUT_FILENO)) {
+				rc = 1;
+				goto out;
+			}
+			tape_progress.step = header.dh_memory_size / 32;
+			tape_progress.next = tape_progress.step;
+			tape_copy.progress = print_copy_progress;
+			tape_copy.progress_data = &tape_progress;
+		}
+
 		/*	now get_dump returns 1 for all	*/
 		/*	except the last tape of a multi-volume dump */
 
-		while (get_dump(fd, d_type) == 1) {
+		while ((ret = get_dump(fd, d_type)) == 1) {
 			fprintf(stderr, "\nWaiting for next volume to be "
 				"loaded... ");
-			load_next(fd);
-			get_header(fd);
+			if (load_next(fd) || get_header(fd)) {
+				ret = -1;
+				break;
+			}
 			print_s390_header(d_type);
 		}
+		if (ret == -1) {
+			if (d_type == IS_TAPE)
+				tape_copy_abort(&tape_copy);
+			rc = 1;
+			goto out;
+		}
 
 		/*	if dev is DASD and dump is copied	*/
 		/*	check if the dump is valid		*/
 
-		if (d_type == IS_DASD)
+		if (d_type == IS_DASD) {
 			lseek(fd, header.dh_header_size + header.dh_memory_size,
 			      SEEK_SET);
-
-		if (!check_and_write_end_marker(fd))
+			if (!check_and_write_end_marker(fd))
+				goto out;
+		} else if (!tape_copy_finish(&tape_copy) &&
+			   !write_valid_end_marker(ret == 2 &&
+						   check_end_times() == 0))
 			goto out;
 	} else if (!option_a_set) {		/* "-i" option */
 		fprintf(stderr, "\n> \"zgetdump -i\" checks if a dump on "
@@ -1258,7 +1560,20 @@ is_dump_device:
 		fprintf(stderr, "> it checks if it is a valid portion of "
 			"the dump.\n");
 		print_s390_header(d_type);
-		if (d_type == IS_DASD)
+		if (d_type == IS_DASD && option_summary_set) {
+			struct dump_scan scan;
+
+			scan_init(&scan);
+			lseek(fd, header.dh_header_size, SEEK_SET);
+			fprintf(stderr, "Scanning dump content ");
+			if (scan_dump_data(fd, header.dh_memory_size, &scan)) {
+				rc = 1;
+				goto out;
+			}
+			fprintf(stderr, "CRC-32 of dump content: 0x%08x\n",
+				scan.crc);
+			print_scan_summary();
+		} else if (d_type == IS_DASD)
 			lseek(fd,
 			      header.dh_header_size + header.dh_memory_size,
 			      SEEK_SET);
@@ -1298,7 +1613,7 @@ is_dump_device:
 			"multi-volume tape dump is valid.\n");
 		fprintf(stderr, "> Please make sure that all volumes are "
 			"loaded in sequence.\n");
-		if (d_type == IS_DASD) {
+		if (d_type == IS_DASD || option_summary_set) {
 			fprintf(stderr, "\"-i -a\" is used for validation of "
 				"multi-volume tape dumps.\n\n");
 			rc = 1;
@@ -1326,8 +1641,10 @@ is_dump_device:
 				header.dh_volnr);
 			fprintf(stderr, "Waiting for Volume %i to be "
 				"loaded... ", cur_volnr);
-			load_next(fd);
-			get_header(fd);
+			if (load_next(fd) || get_header(fd)) {
+				rc = 1;
+				goto out;
+			}
 			print_s390_header(d_type);
 			if (header.dh_volnr != cur_volnr) {
 				fprintf(stderr, "This is not Volume %i\n",
@@ -1356,5 +1673,7 @@ is_dump_device:
 out:
 	if (fd != -1)
 		close(fd);
+	copy_engine_exit(&copy_engine);
+	fmt_free(fmt_writer);
 	return(rc);
 }
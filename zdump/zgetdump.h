@@ -24,6 +24,9 @@
 
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
+#define ARCH_S390  1
+#define ARCH_S390X 2
+
 /*
  * Structure: s390_dump_header_t
  *  Function: This is the header dumped at the top of every valid s390 crash
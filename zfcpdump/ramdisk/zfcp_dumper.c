@@ -17,7 +17,6 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
-#include <zlib.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -30,6 +29,7 @@
 
 #include "zfcp_dumper.h"
 #include "../kernel/dump.h"
+#include "libdump.h"
 #include "zt_common.h"
 
 #ifdef __s390x__
@@ -99,135 +99,6 @@
 #define SLEEP_TIME_ERASE 5 /* seconds */
 #define SLEEP_TIME_END   3 /* seconds */
 
-/******************************************************************************/
-/* defines dump format                                                        */
-/* datastructures and defines are from the lkcd (linux kernel crash dumps)    */
-/* project                                                                    */
-/******************************************************************************/
-
-#define UTS_LEN 65     /* do not change ... */
- 
-/*
- * Size of the buffer that's used to hold:
- *
- *      1. the dump header (paded to fill the complete buffer)
- *      2. the possibly compressed page headers and data
- */
-#define DUMP_BUFFER_SIZE     (64 * 1024)  /* size of dump buffer (0x10000) */
- 
-/* header definitions for dumps from s390 standalone dump tools */
-#define DUMP_MAGIC_S390SA     0xa8190173618f23fdULL /* s390sa magic number */
-#define DUMP_HEADER_SZ_S390SA 4096
- 
-/* standard header definitions */
-#define DUMP_MAGIC_NUMBER  0xa8190173618f23edULL  /* dump magic number  */
-#define DUMP_VERSION_NUMBER 0x8      /* dump version number             */
-#define DUMP_PANIC_LEN      0x100    /* dump panic string length        */
- 
-/* dump compression options -- add as necessary */
-#define DUMP_COMPRESS_NONE     0x0   /* don't compress this dump      */
-#define DUMP_COMPRESS_RLE      0x1   /* use RLE compression           */
-#define DUMP_COMPRESS_GZIP     0x2   /* use GZIP compression          */
- 
-/* dump flags - any dump-type specific flags -- add as necessary */
-#define DUMP_FLAGS_NONE        0x0   /* no flags are set for this dump   */
-#define DUMP_FLAGS_NONDISRUPT  0x1   /* try to keep running after dump   */
- 
-/* dump header flags -- add as necessary */
-#define DUMP_DH_FLAGS_NONE     0x0   /* no flags set (error condition!)  */
-#define DUMP_DH_RAW            0x1   /* raw page (no compression)        */
-#define DUMP_DH_COMPRESSED     0x2   /* page is compressed               */
-#define DUMP_DH_END            0x4   /* end marker on a full dump        */
-#define DUMP_DH_TRUNCATED      0x8   /* dump is incomplete               */
-#define DUMP_DH_TEST_PATTERN   0x10  /* dump page is a test pattern      */
-#define DUMP_DH_NOT_USED       0x20  /* 1st bit not used in flags        */
-
-#define PAGE_SIZE           4096
-/* macros for page size, mask etc. used in dump format
- * (this is not the system page size stored in the dump header)
- */
-#define DUMP_PAGE_SHIFT     12ULL
-#define DUMP_PAGE_SIZE      (1ULL << DUMP_PAGE_SHIFT)
-#define DUMP_PAGE_MASK      (~(DUMP_PAGE_SIZE-1))
-#define DUMP_HEADER_OFFSET  DUMP_PAGE_SIZE
-
-
-/******************************************************************************/
-/* Data structures                                                            */
-/******************************************************************************/
-
-/* This is the header dumped at the top of every valid crash dump.
- */
-typedef struct dump_header_s {
-        uint64_t magic_number; /* dump magic number, unique to verify dump */
-        uint32_t version;      /* version number of this dump */
-        uint32_t header_size;  /* size of this header */
-        uint32_t dump_level;   /* level of this dump */
-        uint32_t page_size;    /* page size (e.g. 4K, 8K, 16K, etc.) */
-        uint64_t memory_size;  /* size of entire physical memory */
-        uint64_t memory_start; /* start of physical memory */
-        uint64_t memory_end;   /* end of physical memory */
-        /* the number of dump pages in this dump specifically */
-        uint32_t num_dump_pages;
-        char panic_string[DUMP_PANIC_LEN]; /* panic string, if available*/
- 
-        /* timeval depends on machine, two long values */
-        struct {uint64_t tv_sec;
-                uint64_t tv_usec;
-        } time; /* the time of the system crash */
-
-        /* the NEW utsname (uname) information -- in character form */
-        /* we do this so we don't have to include utsname.h         */
-        /* plus it helps us be more architecture independent        */
-        char utsname_sysname[UTS_LEN];
-        char utsname_nodename[UTS_LEN];
-        char utsname_release[UTS_LEN];
-        char utsname_version[UTS_LEN];
-        char utsname_machine[UTS_LEN];
-        char utsname_domainname[UTS_LEN];
-
-        uint64_t current_task;  
-        uint32_t dump_compress; /* compression type used in this dump */
-        uint32_t dump_flags;    /* any additional flags */
-        uint32_t dump_device;   /* any additional flags */
-} __attribute__((packed)) dump_header_t;
-
-/* This is the header used by zcore
- */
-typedef struct dump_header_s390sa_s {
-        uint64_t magic_number; /* magic number for this dump (unique)*/
-        uint32_t version;      /* version number of this dump */
-        uint32_t header_size;  /* size of this header */
-        uint32_t dump_level;   /* the level of this dump (just a header?) */
-        uint32_t page_size;    /* page size of dumped Linux (4K,8K,16K etc.) */
-        uint64_t memory_size;  /* the size of all physical memory */
-        uint64_t memory_start; /* the start of physical memory */
-        uint64_t memory_end;   /* the end of physical memory */
-        uint32_t num_pages;    /* number of pages in this dump */
-        uint32_t pad;          /* ensure 8 byte alignment for tod and cpu_id */
-        uint64_t tod;          /* the time of the dump generation */
-        uint64_t cpu_id;       /* cpu id */
-        uint32_t arch_id;
-        uint32_t build_arch_id;
-#define DH_ARCH_ID_S390X 2
-#define DH_ARCH_ID_S390  1
-} __attribute__((packed))  dump_header_s390sa_t;
- 
-/* Header associated to each physical page of memory saved in the system
- * crash dump.
- */
-typedef struct dump_page_s {
-        uint64_t address; /* the address of this dump page */
-        uint32_t size;  /* the size of this dump page */
-        uint32_t flags; /* flags (DUMP_COMPRESSED, DUMP_RAW or DUMP_END) */
-} __attribute__((packed)) dump_page_t;
-
-
-/* Compression function */
-typedef int (*compress_fn_t)(const unsigned char *old, uint32_t old_size,
-		unsigned char *new, uint32_t size);
-
-
 /******************************************************************************/
 /* Prototypes                                                                 */
 /******************************************************************************/
@@ -238,7 +109,8 @@ static int dump_init_sig(void);
 static int dump_tune_vm(void);
 static void dump_terminate(void);
 static int dump_create_s390sa(char* sourcedev, char* dumpdir);
-static void dump_display_progress(uint64_t mb_written, uint64_t mb_max);
+static void dump_display_progress(struct dump_pipe *pipe,
+	uint64_t mb_written, uint64_t mb_max);
   
 /******************************************************************************/
 /* Globals                                                                    */
@@ -1061,118 +933,22 @@ out:
 	return written;
 }
 
-/*
- * compress_gzip()
- *
- * Wrapper to gzip compress routine
- * Parameter: old      - buffer to compress (in)
- *            old_size - size of old buffer in bytes (in)
- *            new      - buffer for compressed data (out)
- *            new_size - size of 'new' buffer in bytes (in)
- * Return:    >=0 - Size of compressed buffer
- *            < 0 - error
- */
- 
-int
-compress_gzip(const unsigned char *old, uint32_t old_size, unsigned char *new,
-		uint32_t new_size)
-{
-	int rc;
-	unsigned long len = old_size;
-	rc = compress(new, &len, old, new_size);
-	switch(rc){
-	case Z_OK:
-		rc = len;
-		break;
-	case Z_MEM_ERROR:
-		PRINT_ERR("Z_MEM_ERROR (not enough memory)!\n");
-		rc = -1;
-		break;
-	case Z_BUF_ERROR:
-		/* In this case the compressed output is bigger than
-		   the uncompressed */
-		rc = -1;
-		break;
-	case Z_DATA_ERROR:
-		PRINT_ERR("Z_DATA_ERROR (input data corrupted)!\n");
-		rc = -1;
-		break;
-	default:
-		PRINT_ERR("Z_UNKNOWN_ERROR (rc 0x%x unknown)!\n",rc);
-		rc = -1;
-		break;
-	}
-	return rc;
-}
-
-/*
- * compress_none()
- *
- * Do nothing! - No compression
- */
-int
-compress_none(const unsigned char *old, uint32_t old_size, unsigned char *new,
-	uint32_t new_size)
-{
-	return -1;
-}
-
-/*
- * s390sa_to_reg_header()
- *
- * Copy info from s390sa header to reg lkcd header
- * Parameter: dh_s390sa - s390 dump header (in)
- *            dh        - lkcd dump header (out)
- */
-void
-s390sa_to_reg_header(dump_header_s390sa_t* dh_s390sa, dump_header_t* dh)
-{
-	struct timeval     h_time;
-
-	/* adjust todclock to 1970 */
-	uint64_t tod = dh_s390sa->tod;
-	tod -= 0x8126d60e46000000LL - (0x3c26700LL * 1000000 * 4096);
-	tod >>= 12;
-	h_time.tv_sec  = tod / 1000000;
-	h_time.tv_usec = tod % 1000000;
-
-	dh->memory_size    = dh_s390sa->memory_size;
-	dh->memory_start   = dh_s390sa->memory_start;
-	dh->memory_end     = dh_s390sa->memory_end;
-	dh->num_dump_pages = dh_s390sa->num_pages;
-	dh->page_size      = dh_s390sa->page_size;
-	dh->dump_level     = dh_s390sa->dump_level;
-
-	sprintf(dh->panic_string,"zSeries-dump (CPUID = %16"FMT64"x)",
-		dh_s390sa->cpu_id);
-
-	if(dh_s390sa->arch_id == DH_ARCH_ID_S390){
-		strcpy(dh->utsname_machine,"s390");
-	} else if(dh_s390sa->arch_id == DH_ARCH_ID_S390X) {
-		strcpy(dh->utsname_machine,"s390x");
-	} else {
-		strcpy(dh->utsname_machine,"unknown");
-	}
-
-	dh->magic_number   = DUMP_MAGIC_NUMBER;
-	dh->version        = DUMP_VERSION_NUMBER;
-	dh->header_size    = sizeof(dump_header_t);
-	dh->time.tv_sec    = h_time.tv_sec;
-	dh->time.tv_usec   = h_time.tv_usec;
-}
-
 /*
  * dump_display_progress()
  *
- * Write progress information to screen
- * Parameter: bytes_written - So many bytes have been written to the dump
+ * Write progress information and pipeline counters to screen
+ * Parameter: pipe          - Compression pipeline of the dump
+ *            bytes_written - So many bytes have been written to the dump
  *            bytes_max     - This is the whole memory to be written
  */
 static void
-dump_display_progress(uint64_t bytes_written, uint64_t bytes_max)
+dump_display_progress(struct dump_pipe *pipe, uint64_t bytes_written,
+	uint64_t bytes_max)
 {
 	int    time;
 	struct timeval t;
+	struct pipe_stats stats;
+	char stats_str[256];
 	double percent_written;
 
 	gettimeofday(&t, NULL);
@@ -1184,9 +960,33 @@ dump_display_progress(uint64_t bytes_written, uint64_t bytes_max)
 	percent_written = ((double) bytes_written / (double) bytes_max) * 100.0;
 	PRINT(" %4i MB of %4i MB (%5.1f%% )\n", (int)(bytes_written/ONE_MB),
 		(int)(bytes_max/ONE_MB), percent_written);
+	dump_pipe_stats(pipe, &stats);
+	dump_pipe_format_stats(&stats, stats_str, sizeof(stats_str));
+	PRINT("   %s\n", stats_str);
 	fflush(stdout);
 }
 
+/*
+ * dump_copy_progress()
+ *
+ * Called by the pipeline after each batch of memory pages
+ * Parameter: pipe   - Compression pipeline of the dump
+ *            addr   - Memory address that is read next
+ *            copied - So many bytes have been copied to the pipeline
+ *            data   - lkcd dump header
+ */
+static void
+dump_copy_progress(struct dump_pipe *pipe, uint64_t addr, uint64_t copied,
+	void *data)
+{
+	struct dump_hdr_lkcd *dh = data;
+
+	if((!g.hsa_released) && (addr > g.hsa_size)){
+		release_hsa();
+	}
+	dump_display_progress(pipe, copied, dh->memory_size);
+}
+
 /*
  * dump_create_s390sa()
  * retrieve a s390 (standalone) dump
@@ -1198,18 +998,17 @@ static int
 dump_create_s390sa(char* sourcedev, char* dumpdir)
 {
 	struct stat stat_buf;
-	dump_header_t dh;
-	dump_header_s390sa_t s390_dh;
-	compress_fn_t compress_fn;
-	dump_page_t dp;
-	char dump_page_buf[DUMP_BUFFER_SIZE];
-	char buf[DUMP_PAGE_SIZE];
-	char dpcpage[DUMP_PAGE_SIZE];
+	struct dump_hdr_lkcd dh;
+	struct dump_hdr_s390 s390_dh;
+	enum pipe_compress compress;
+	struct dump_pipe *pipe;
+	struct pipe_trailer trailer;
+	struct dump_map map;
+	char stats_str[256];
+	struct dump_page dp;
+	char dump_page_buf[DUMP_HEADER_SIZE];
 	char dump_file_name[1024];
-	uint64_t mem_loc;
-	uint32_t buf_loc = 0;
-	int size, fp_src = 0, fp_dump = 0;
-	uint32_t dp_size,dp_flags;
+	int fp_src = 0, fp_dump = 0;
 	int rc = 0;
 
 	if(stat(dumpdir, &stat_buf) < 0){
@@ -1261,15 +1060,15 @@ dump_create_s390sa(char* sourcedev, char* dumpdir)
 		rc = -1; goto out;
 	}
 
-	s390sa_to_reg_header(&s390_dh,&dh);
+	dump_s390_to_lkcd_hdr(&s390_dh,&dh);
 
 	if(strcmp(g.parm_dump_compress,PARM_DUMP_COMPRESS_GZIP) == 0){
 		dh.dump_compress = DUMP_COMPRESS_GZIP;
-		compress_fn = compress_gzip;
+		compress = PIPE_COMPRESS_GZIP;
 	}
 	else{
 		dh.dump_compress = DUMP_COMPRESS_NONE;
-		compress_fn = compress_none;
+		compress = PIPE_COMPRESS_NONE;
 	}
 
 	if(g.parm_dump_mem < dh.memory_size){
@@ -1279,82 +1078,66 @@ dump_create_s390sa(char* sourcedev, char* dumpdir)
 		dh.num_dump_pages = g.parm_dump_mem / dh.page_size;
 	}
 
-	memset(dump_page_buf, 0, DUMP_BUFFER_SIZE);
-	memcpy((void *)dump_page_buf, (const void *)&dh, sizeof(dump_header_t));
+	memset(dump_page_buf, 0, DUMP_HEADER_SIZE);
+	memcpy((void *)dump_page_buf, (const void *)&dh, sizeof(dh));
 	if(lseek(fp_dump, 0L, SEEK_SET) < 0) {
 		PRINT_ERR("lseek() failed\n");
 		rc = -1; goto out;
 	}
-	if (dump_write(fp_dump, (char *)dump_page_buf, DUMP_BUFFER_SIZE)
-		!= DUMP_BUFFER_SIZE) {
+	if (dump_write(fp_dump, (char *)dump_page_buf, DUMP_HEADER_SIZE)
+		!= DUMP_HEADER_SIZE) {
 		PRINT_ERR("Error: Write dump header failed\n");
 		rc = -1; goto out;
 	}
 
-	/* write dump */
+	/* write dump: zcore provides the memory without holes */
 
-	mem_loc = 0;
-	if(lseek(fp_src, DUMP_HEADER_SZ_S390SA, SEEK_SET) < 0){
-		PRINT_ERR("lseek() failed\n");
+	dump_map_init(&map);
+	if(dump_map_add(&map, 0, dh.memory_size) != 0){
+		PRINT_ERR("Could not allocate memory for the memory map\n");
 		rc = -1; goto out;
 	}
-	while (mem_loc < dh.memory_size) {
-		if((!g.hsa_released) && (mem_loc > g.hsa_size)){
-			release_hsa();
-		}
-		if(read(fp_src, buf, DUMP_PAGE_SIZE) != DUMP_PAGE_SIZE){
-			PRINT_ERR("read error\n");
-			rc = -1; goto out;
-		}
-		memset(dpcpage, 0, DUMP_PAGE_SIZE);
-		/* get the new compressed page size
-                 */
-
-		size = compress_fn((unsigned char *)buf, DUMP_PAGE_SIZE,
-			(unsigned char *)dpcpage, DUMP_PAGE_SIZE);
-
-		/* if compression failed or compressed was ineffective,
-		 * we write an uncompressed page
-		 */
-		if (size < 0) {
-			dp_flags = DUMP_DH_RAW;
-			dp_size  = DUMP_PAGE_SIZE;
-		} else {
-			dp_flags = DUMP_DH_COMPRESSED;
-			dp_size  = size;
-		}
-		dp.address = mem_loc;
-		dp.size    = dp_size;
-		dp.flags   = dp_flags;
-		memcpy((void *)(dump_page_buf + buf_loc), (const void *)&dp,
-			sizeof(dump_page_t));
-		buf_loc += sizeof(dump_page_t);
-		/* copy the page of memory */
-		if (dp_flags & DUMP_DH_COMPRESSED) {
-			/* copy the compressed page */
-			memcpy((void *)(dump_page_buf + buf_loc),
-				(const void *)dpcpage, dp_size);
-		} else {
-			/* copy directly from memory */
-			memcpy((void *)(dump_page_buf + buf_loc),
-				(const void *)buf, dp_size);
-		}
-		buf_loc += dp_size;
-		if(dump_write(fp_dump, dump_page_buf, buf_loc) != buf_loc){
-			PRINT_ERR("write error\n");
-			rc = -1; goto out;
-		}
-		buf_loc = 0;
-		mem_loc += DUMP_PAGE_SIZE;
-		dump_display_progress(mem_loc, dh.memory_size);
-	}
-
-	/* write end marker */
+	/* the main thread reads, compression and writing is done by
+	 * the pipeline threads */
+	pipe = dump_pipe_open(fp_dump, dump_write, compress,
+		dump_pipe_threads());
+	if(!pipe){
+		PRINT_ERR("Could not start compression threads\n");
+		rc = -1; goto out_map;
+	}
+	PRINT_TRACE("compression threads: %d\n",pipe->threads);
+	rc = dump_pipe_copy_map(pipe, fp_src, DUMP_HEADER_SZ_S390SA, &map,
+		dump_copy_progress, &dh);
+	if(rc == PIPE_ERR_READ){
+		PRINT_ERR("read error\n");
+		rc = -1; goto out_pipe;
+	} else if(rc == PIPE_ERR_WRITE){
+		PRINT_ERR("write error\n");
+		rc = -1; goto out_pipe;
+	}
+	if(dump_pipe_close(pipe) != 0){
+		PRINT_ERR("write error\n");
+		rc = -1; goto out_free;
+	}
+	dump_pipe_trailer(pipe, &trailer);
+	dump_pipe_format_stats(&trailer.stats, stats_str, sizeof(stats_str));
+	PRINT("dump time: %i s, %s\n",
+		(int)(trailer.stats.total_usecs / 1000000), stats_str);
+
+	/* write end marker, followed by the statistics */
 
 	dp.address = 0x0;
-	dp.size    = DUMP_DH_END;
-	dp.flags   = 0x0;
-	dump_write(fp_dump, dump_page_buf, sizeof(dump_page_t)); 
+	dp.size    = 0x0;
+	dp.flags   = DUMP_DH_END;
+	dump_write(fp_dump, &dp, sizeof(dp));
+	dump_write(fp_dump, &trailer, sizeof(trailer));
+	goto out_free;
+out_pipe:
+	dump_pipe_close(pipe);
+out_free:
+	dump_pipe_free(pipe);
+out_map:
+	dump_map_free(&map);
 out:
 	if(fp_src != -1)
 		close(fp_src);
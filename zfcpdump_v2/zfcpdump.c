@@ -11,6 +11,7 @@
  * Author(s): Michael Holzheu
  */
 
+#define _GNU_SOURCE	/* for fallocate() */
 #include <errno.h>
 #include <string.h>
 #include <dirent.h>
@@ -25,12 +26,10 @@
 #include <sys/stat.h>
 #include <sys/mount.h>
 #include <sys/time.h>
+#include <sys/statvfs.h>
 #include <linux/reboot.h>
 #include <asm/types.h>
 #include "zfcpdump.h"
-#ifdef GZIP_SUPPORT
-#include <zlib.h>
-#endif
 
 static struct globals g;
 static char *module_list[] = {"zfcp", "sd_mod", "ext2", "ext3", "zcore_mod",
@@ -549,120 +548,129 @@ static ssize_t dump_write(int fd, const void *buf, size_t count)
 	return written;
 }
 
-#ifdef GZIP_SUPPORT
 /*
- * Wrapper to gzip compress routine
- * Parameter: old      - buffer to compress (in)
- *            old_size - size of old buffer in bytes (in)
- *            new      - buffer for compressed data (out)
- *            new_size - size of 'new' buffer in bytes (in)
- * Return:    >=0 - Size of compressed buffer
- *            < 0 - error
+ * Write progress information and pipeline counters to screen
+ * Parameter: pipe    - Compression pipeline of the dump
+ *            written - So many bytes have been written to the dump
+ *            max     - This is the whole memory to be written
  */
-static int compress_gzip(const unsigned char *old, __u32 old_size,
-			 unsigned char *new, __u32 new_size)
+static void show_progress(struct dump_pipe *pipe, unsigned long long written,
+			  unsigned long long max)
 {
-	int rc;
-	unsigned long len;
-
-	len = old_size;
-	rc = compress(new, &len, old, new_size);
-	switch (rc) {
-	case Z_OK:
-		return len;
-	case Z_MEM_ERROR:
-		PRINT_ERR("Z_MEM_ERROR (not enough memory)!\n");
-		return -1;
-	case Z_BUF_ERROR:
-		/* In this case the compressed output is bigger than
-		   the uncompressed */
-		return -1;
-	case Z_DATA_ERROR:
-		PRINT_ERR("Z_DATA_ERROR (input data corrupted)!\n");
-		return -1;
-	default:
-		PRINT_ERR("Z_UNKNOWN_ERROR (rc 0x%x unknown)!\n", rc);
-		return -1;
-	}
+	int    time;
+	struct timeval t;
+	struct pipe_stats stats;
+	char stats_str[256];
+	double percent;
+
+	gettimeofday(&t, NULL);
+	time = t.tv_sec;
+	if ((time < g.last_progress) && (written != max) && (written != 0))
+		return;
+	g.last_progress = time + 10;
+	percent = ((double) written / (double) max) * 100.0;
+	PRINT(" %4lli MB of %4lli MB (%5.1f%% )\n", written >> 20, max >> 20,
+		percent);
+	dump_pipe_stats(pipe, &stats);
+	dump_pipe_format_stats(&stats, stats_str, sizeof(stats_str));
+	PRINT("   %s\n", stats_str);
+	fflush(stdout);
 }
-#endif
 
 /*
- * Do nothing! - No compression
+ * Progress function for the pipeline, DATA is the lkcd dump header
  */
-static int compress_none(const unsigned char *old, __u32 old_size,
-			 unsigned char *new, __u32 new_size)
+static void copy_progress(struct dump_pipe *pipe, uint64_t addr,
+			  uint64_t copied, void *data)
 {
-	return -1; /* "-1" indicates, that compression was not done */
+	struct dump_hdr_lkcd *dh = data;
+
+	show_progress(pipe, copied, dh->memory_size);
 }
 
 /*
- * Convert s390 standalone dump header to lkcd dump header
- * Parameter: s390_dh - s390 dump header (in)
- *            dh      - lkcd dump header (out)
+ * Estimate size of the dump file: The size of the page records is
+ * computed from pages sampled over all memory chunks of MAP.
  */
-static void s390_to_lkcd_hdr(struct dump_hdr_s390 *s390_dh,
-			     struct dump_hdr_lkcd *dh)
+static __u64 estimate_dump_size(int fin, const struct dump_map *map,
+				enum pipe_compress compress)
 {
-	struct timeval h_time;
-
-	/* adjust todclock to 1970 */
-	__u64 tod = s390_dh->tod;
-	tod -= 0x8126d60e46000000LL - (0x3c26700LL * 1000000 * 4096);
-	tod >>= 12;
-	h_time.tv_sec  = tod / 1000000;
-	h_time.tv_usec = tod % 1000000;
-
-	dh->memory_size    = s390_dh->memory_size;
-	dh->memory_start   = s390_dh->memory_start;
-	dh->memory_end     = s390_dh->memory_end;
-	dh->num_dump_pages = s390_dh->num_pages;
-	dh->page_size      = s390_dh->page_size;
-	dh->dump_level     = s390_dh->dump_level;
-
-	sprintf(dh->panic_string, "zSeries-dump (CPUID = %16llx)",
-		(unsigned long long) s390_dh->cpu_id);
-
-	if (s390_dh->arch_id == DH_ARCH_ID_S390)
-		strcpy(dh->utsname_machine, "s390");
-	else if (s390_dh->arch_id == DH_ARCH_ID_S390X)
-		strcpy(dh->utsname_machine, "s390x");
-	else
-		strcpy(dh->utsname_machine, "<unknown>");
-
-	strcpy(dh->utsname_sysname, "<unknown>");
-	strcpy(dh->utsname_nodename, "<unknown>");
-	strcpy(dh->utsname_release, "<unknown>");
-	strcpy(dh->utsname_version, "<unknown>");
-	strcpy(dh->utsname_domainname, "<unknown>");
-
-	dh->magic_number   = DUMP_MAGIC_NUMBER;
-	dh->version        = DUMP_VERSION_NUMBER;
-	dh->header_size    = sizeof(struct dump_hdr_lkcd);
-	dh->time.tv_sec    = h_time.tv_sec;
-	dh->time.tv_usec   = h_time.tv_usec;
+	__u64 pages, step, page_nr = 0, rec_size = 0, sampled = 0, size;
+	char buf[DUMP_PAGE_SIZE];
+	int i;
+
+	pages = dump_map_size(map) / DUMP_PAGE_SIZE;
+	/* header, page records, end marker and trailer */
+	size = DUMP_HEADER_SIZE + sizeof(struct dump_page) +
+		sizeof(struct pipe_trailer);
+	if (compress == PIPE_COMPRESS_NONE || pages == 0)
+		return size + pages * (sizeof(struct dump_page) +
+				       DUMP_PAGE_SIZE);
+
+	step = MAX(pages / DUMP_SAMPLE_PAGES, 1);
+	for (i = 0; i < map->count; i++) {
+		__u64 addr, end = map->chunk[i].addr + map->chunk[i].size;
+
+		/* page_nr is the number of the first page of this chunk */
+		addr = map->chunk[i].addr +
+			(step - page_nr % step) % step * DUMP_PAGE_SIZE;
+		page_nr += map->chunk[i].size / DUMP_PAGE_SIZE;
+		for (; addr < end; addr += step * DUMP_PAGE_SIZE) {
+			if (lseek(fin, DUMP_HEADER_SZ_S390SA + addr,
+				  SEEK_SET) < 0 ||
+			    read(fin, buf, DUMP_PAGE_SIZE) != DUMP_PAGE_SIZE)
+				continue;
+			rec_size += dump_pipe_rec_size(compress, buf);
+			sampled++;
+		}
+	}
+	if (sampled == 0)
+		return size + pages * (sizeof(struct dump_page) +
+				       DUMP_PAGE_SIZE);
+	/* Add some space, because the samples may compress too well */
+	rec_size = rec_size * (100 + DUMP_SIZE_MARGIN) / 100 / sampled;
+	rec_size = MIN(rec_size, sizeof(struct dump_page) + DUMP_PAGE_SIZE);
+	return size + pages * rec_size;
 }
 
 /*
- * Write progress information to screen
- * Parameter: written - So many bytes have been written to the dump
- *            max     - This is the whole memory to be written
+ * Reserve SIZE bytes for the dump file FD: If the file system has not
+ * enough free space, old dumps are removed before the dump is written.
+ * Then the space is allocated, so that the dump can be written without
+ * interruption. The dump is also written, if not enough space is
+ * available, because the size is only an estimate.
  */
-static void show_progress(unsigned long long written, unsigned long long max)
+static void reserve_dump_space(int fd, __u64 size)
 {
-	int    time;
-	struct timeval t;
-	double percent;
-
-	gettimeofday(&t, NULL);
-	time = t.tv_sec;
-	if ((time < g.last_progress) && (written != max) && (written != 0))
-		return;
-	g.last_progress = time + 10;
-	percent = ((double) written / (double) max) * 100.0;
-	PRINT(" %4lli MB of %4lli MB (%5.1f%% )\n", written >> 20, max >> 20,
-		percent);
-	fflush(stdout);
+	struct statvfs sfs;
+	__u64 avail;
+
+	PRINT_TRACE("estimated dump size: %llu MB\n",
+		    (unsigned long long) size >> 20);
+	while (1) {
+		if (fstatvfs(fd, &sfs) == -1) {
+			PRINT_PERR("Cannot get free space of dump device\n");
+			return;
+		}
+		avail = (__u64) sfs.f_bavail * sfs.f_frsize;
+		if (avail >= size)
+			break;
+		PRINT("Dump needs about %llu MB, %llu MB are free\n",
+		      (unsigned long long) size >> 20,
+		      (unsigned long long) avail >> 20);
+		if (erase_oldest_dump()) {
+			PRINT_WARN("Dump may not fit on the dump device!\n");
+			return;
+		}
+	}
+	/*
+	 * The file size is not changed, so the dump file does not contain
+	 * garbage if the dumper is interrupted. Not all file systems
+	 * support fallocate(), the free space has been checked anyway.
+	 */
+	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) == -1 &&
+	    errno != EOPNOTSUPP && errno != ENOSYS)
+		PRINT_TRACE("fallocate() failed: %s\n", strerror(errno));
 }
 
 /*
@@ -676,16 +684,16 @@ static int create_dump(void)
 	struct stat stat_buf;
 	struct dump_hdr_lkcd dh;
 	struct dump_hdr_s390 s390_dh;
-	compress_fn_t compress_fn;
+	enum pipe_compress compress;
 	struct dump_page dp;
-	char page_buf[DUMP_BUF_SIZE], buf[PAGE_SIZE], dpcpage[PAGE_SIZE];
+	struct dump_pipe *pipe;
+	char page_buf[DUMP_HEADER_SIZE];
 	char dump_name[1024];
-	__u64 mem_loc, mem_count;
-	__u32 buf_loc = 0, dp_size, dp_flags;
-	int size, fin, fout, fmap, rc = 0;
-	char c_info[CHUNK_INFO_SIZE];
-	struct mem_chunk *chunk, *chunk_first = NULL, *chunk_prev = NULL;
-	char *end_ptr;
+	int fin, fout, fmap, rc = 0;
+	off_t dump_size;
+	struct pipe_trailer trailer;
+	char stats_str[256];
+	struct dump_map map;
 
 	if (stat(g.dump_dir, &stat_buf) < 0) {
 		PRINT_ERR("Specified dump dir '%s' not found!\n", g.dump_dir);
@@ -711,54 +719,25 @@ static int create_dump(void)
 	/* Open the memory map file - only available with kernel 2.6.25 or
 	* higher. If open fails, memory holes cannot be detected and only
 	* one single memory chunk is assumed */
+	dump_map_init(&map);
 	fmap = open(DEV_ZCORE_MAP, O_RDONLY, 0);
 	if (fmap == -1) {
-		chunk_first = calloc(1, sizeof(struct mem_chunk));
-		if (chunk_first == NULL) {
-			PRINT_ERR("Could not allocate %d bytes of memory\n",
-				  (int) sizeof(struct mem_chunk));
+		if (dump_map_add(&map, 0, PARM_MEM_DFLT)) {
+			PRINT_ERR("Could not allocate memory for the memory "
+				  "map\n");
 			return -1;
 		}
-		chunk_first->size = PARM_MEM_DFLT;
-	} else {
-	/* read information about memory chunks (start address and size) */
-		do {
-			if (read(fmap, c_info, sizeof(c_info)) != sizeof(c_info)) {
-				PRINT_ERR("read() memory map file '%s' "
-					  "failed!\n", DEV_ZCORE_MAP);
-				rc = -1;
-				goto failed_close_fmap;
-			}
-			chunk = calloc(1, sizeof(struct mem_chunk));
-			if (chunk == NULL) {
-				PRINT_ERR("Could not allocate %d bytes of "
-					  "memory\n",
-					  (int) sizeof(struct mem_chunk));
-				rc = -1;
-				goto failed_free_chunks;
-			}
-			chunk->size = strtoul(c_info + 17, &end_ptr, 16);
-			if (end_ptr != c_info + 33 || *end_ptr != ' ') {
-				PRINT_ERR("Invalid contents of memory map "
-					  "file '%s'!\n", DEV_ZCORE_MAP);
-				rc = -1;
-				goto failed_free_chunks;
-			}
-			if (chunk->size == 0)
-				break;
-			chunk->addr = strtoul(c_info, &end_ptr, 16);
-			if (end_ptr != c_info + 16 || *end_ptr != ' ') {
-				PRINT_ERR("Invalid contents of memory map "
-					  "file '%s'!\n", DEV_ZCORE_MAP);
-				rc = -1;
-				goto failed_free_chunks;
-			}
-			if (!chunk_first)
-				chunk_first = chunk;
-			else
-				chunk_prev->next = chunk;
-			chunk_prev = chunk;
-		} while (1);
+	} else if (dump_map_read_zcore(&map, fmap)) {
+		/* read information about memory chunks (start address and
+		 * size) */
+		if (errno == EINVAL)
+			PRINT_ERR("Invalid contents of memory map file "
+				  "'%s'!\n", DEV_ZCORE_MAP);
+		else
+			PRINT_ERR("read() memory map file '%s' failed!\n",
+				  DEV_ZCORE_MAP);
+		rc = -1;
+		goto failed_free_map;
 	}
 
 	/* try to open the source device */
@@ -766,7 +745,7 @@ static int create_dump(void)
 	if (fin == -1) {
 		PRINT_ERR("open() source device '%s' failed!\n", DEV_ZCORE);
 		rc = -1;
-		goto failed_free_chunks;
+		goto failed_free_map;
 	}
 
 	/* make the new filename */
@@ -794,20 +773,20 @@ static int create_dump(void)
 		goto failed_close_fout;
 	}
 
-	s390_to_lkcd_hdr(&s390_dh, &dh);
+	dump_s390_to_lkcd_hdr(&s390_dh, &dh);
 
 	if (strcmp(g.parm_compress, PARM_COMP_GZIP) == 0) {
 #ifdef GZIP_SUPPORT
 		dh.dump_compress = DUMP_COMPRESS_GZIP;
-		compress_fn = compress_gzip;
+		compress = PIPE_COMPRESS_GZIP;
 #else
 		PRINT_WARN("No gzip support. Compression disabled!\n");
 		dh.dump_compress = DUMP_COMPRESS_NONE;
-		compress_fn = compress_none;
+		compress = PIPE_COMPRESS_NONE;
 #endif
 	} else {
 		dh.dump_compress = DUMP_COMPRESS_NONE;
-		compress_fn = compress_none;
+		compress = PIPE_COMPRESS_NONE;
 	}
 
 	if (g.parm_mem < dh.memory_size) {
@@ -817,14 +796,17 @@ static int create_dump(void)
 		dh.num_dump_pages = g.parm_mem / dh.page_size;
 	}
 
-	memset(page_buf, 0, DUMP_BUF_SIZE);
+	dump_map_clip(&map, dh.memory_end);
+	reserve_dump_space(fout, estimate_dump_size(fin, &map, compress));
+
+	memset(page_buf, 0, DUMP_HEADER_SIZE);
 	memcpy(page_buf, &dh, sizeof(dh));
 	if (lseek(fout, 0L, SEEK_SET) < 0) {
 		PRINT_ERR("lseek() failed\n");
 		rc = -1;
 		goto failed_close_fout;
 	}
-	if (dump_write(fout, page_buf, DUMP_BUF_SIZE) != DUMP_BUF_SIZE) {
+	if (dump_write(fout, page_buf, DUMP_HEADER_SIZE) != DUMP_HEADER_SIZE) {
 		PRINT_ERR("Error: Write dump header failed\n");
 		rc = -1;
 		goto failed_close_fout;
@@ -832,93 +814,61 @@ static int create_dump(void)
 
 	/* write dump */
 
-	chunk = chunk_first;
-	mem_loc = 0;
-	mem_count = 0;
-	if (lseek(fin, DUMP_HEADER_SZ_S390SA, SEEK_SET) < 0) {
-		PRINT_ERR("lseek() failed\n");
+	pipe = dump_pipe_open(fout, dump_write, compress, dump_pipe_threads());
+	if (!pipe) {
+		PRINT_ERR("Could not start compression threads\n");
 		rc = -1;
 		goto failed_close_fout;
 	}
-	while (mem_loc < dh.memory_end) {
-		if (mem_loc >= chunk->addr + chunk->size) {
-			chunk = chunk->next;
-			mem_loc = chunk->addr;
-			if (lseek(fin, DUMP_HEADER_SZ_S390SA + mem_loc,
-				  SEEK_SET) < 0) {
-				PRINT_ERR("lseek() failed\n");
-				rc = -1;
-				goto failed_close_fout;
-			}
-		}
-		if (read(fin, buf, PAGE_SIZE) != PAGE_SIZE) {
-			if (errno == EFAULT) {
-				/* probably memory hole. Skip page */
-				mem_loc += PAGE_SIZE;
-				continue;
-			}
-			PRINT_PERR("read error\n");
-			rc = -1;
-			goto failed_close_fout;
-		}
-		memset(dpcpage, 0, PAGE_SIZE);
-		/* get the new compressed page size */
-
-		size = compress_fn((unsigned char *)buf, PAGE_SIZE,
-			(unsigned char *)dpcpage, PAGE_SIZE);
-
-		/* if compression failed or compressed was ineffective,
-		 * we write an uncompressed page */
-		if (size < 0) {
-			dp_flags = DUMP_DH_RAW;
-			dp_size = PAGE_SIZE;
-		} else {
-			dp_flags = DUMP_DH_COMPRESSED;
-			dp_size = size;
-		}
-		dp.address = mem_loc;
-		dp.size    = dp_size;
-		dp.flags   = dp_flags;
-		memcpy(page_buf + buf_loc, &dp, sizeof(dp));
-		buf_loc += sizeof(struct dump_page);
-		/* copy the page of memory */
-		if (dp_flags & DUMP_DH_COMPRESSED)
-			/* copy the compressed page */
-			memcpy(page_buf + buf_loc, dpcpage, dp_size);
-		else
-			/* copy directly from memory */
-			memcpy(page_buf + buf_loc, buf, dp_size);
-		buf_loc += dp_size;
-		if (dump_write(fout, page_buf, buf_loc) != buf_loc) {
-			PRINT_ERR("write error\n");
-			rc = -1;
-			goto failed_close_fout;
-		}
-		buf_loc = 0;
-		mem_loc += PAGE_SIZE;
-		mem_count += PAGE_SIZE;
-		show_progress(mem_count, dh.memory_size);
+	PRINT_TRACE("compression threads: %d\n", pipe->threads);
+	rc = dump_pipe_copy_map(pipe, fin, DUMP_HEADER_SZ_S390SA, &map,
+				copy_progress, &dh);
+	if (rc == PIPE_ERR_READ) {
+		PRINT_PERR("read error\n");
+		rc = -1;
+		goto failed_close_pipe;
+	} else if (rc == PIPE_ERR_WRITE) {
+		PRINT_ERR("write error\n");
+		rc = -1;
+		goto failed_close_pipe;
+	}
+	if (dump_pipe_close(pipe)) {
+		PRINT_ERR("write error\n");
+		rc = -1;
+		goto failed_free_pipe;
 	}
+	dump_pipe_trailer(pipe, &trailer);
+	dump_pipe_format_stats(&trailer.stats, stats_str, sizeof(stats_str));
+	PRINT("dump time: %llu s, %s\n",
+	      (unsigned long long) trailer.stats.total_usecs / 1000000,
+	      stats_str);
 
-	/* write end marker */
+	/* write end marker, followed by the statistics */
 
 	dp.address = 0x0;
 	dp.size    = 0x0;
 	dp.flags   = DUMP_DH_END;
 	dump_write(fout, &dp, sizeof(dp));
+	dump_write(fout, &trailer, sizeof(trailer));
 
+	/* free space that has been reserved but not used */
+	dump_size = lseek(fout, 0, SEEK_CUR);
+	if (dump_size == -1 || ftruncate(fout, dump_size) == -1) {
+		PRINT_PERR("Could not free unused dump space\n");
+		rc = -1;
+	}
+	goto failed_free_pipe;
+
+failed_close_pipe:
+	dump_pipe_close(pipe);
+failed_free_pipe:
+	dump_pipe_free(pipe);
 failed_close_fout:
 	close(fout);
 failed_close_fin:
 	close(fin);
-failed_free_chunks:
-	chunk = chunk_first;
-	while (chunk) {
-		chunk_prev = chunk;
-		chunk = chunk->next;
-		free(chunk_prev);
-	}
-failed_close_fmap:
+failed_free_map:
+	dump_map_free(&map);
 	close(fmap);
 	return rc;
 }
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <signal.h>
 #include <stdint.h>
+#include "libdump.h"
 
 #define ZFCPDUMP_VERSION "2.1"
 
@@ -125,102 +126,7 @@ struct globals {
 #define WAIT_TIME_END		3 /* seconds */
 #define WAIT_TIME_ONLINE	2 /* seconds */
 
-#define UTS_LEN		65
-
-#define DUMP_BUF_SIZE	(64 * 1024)
-
-/* header definitions for dumps from s390 standalone dump tools */
-#define DUMP_MAGIC_S390SA	0xa8190173618f23fdULL /* s390sa magic number */
-#define DUMP_HEADER_SZ_S390SA	4096
-
-/* standard header definitions */
-#define DUMP_MAGIC_NUMBER	0xa8190173618f23edULL  /* dump magic number  */
-#define DUMP_VERSION_NUMBER	0x8      /* dump version number             */
-#define DUMP_PANIC_LEN		0x100    /* dump panic string length        */
-
-/* dump compression options -- add as necessary */
-#define DUMP_COMPRESS_NONE	0x0   /* don't compress this dump      */
-#define DUMP_COMPRESS_GZIP	0x2   /* use GZIP compression          */
-
-/* dump header flags -- add as necessary */
-#define DUMP_DH_RAW		0x1   /* raw page (no compression)        */
-#define DUMP_DH_COMPRESSED	0x2   /* page is compressed               */
-#define DUMP_DH_END		0x4   /* end marker on a full dump        */
-
-#define PAGE_SIZE		4096
-#define CHUNK_INFO_SIZE		34  /* 2 16-byte char, each followed by blank */
-
-/*
- * This is the header dumped at the top of every valid crash dump.
- */
-struct dump_hdr_lkcd {
-	__u64 magic_number;
-	__u32 version;
-	__u32 header_size;
-	__u32 dump_level;
-	__u32 page_size;
-	__u64 memory_size;
-	__u64 memory_start;
-	__u64 memory_end;
-	__u32 num_dump_pages;
-	char panic_string[DUMP_PANIC_LEN];
-	struct {
-		__u64 tv_sec;
-		__u64 tv_usec;
-	} time;
-	char utsname_sysname[UTS_LEN];
-	char utsname_nodename[UTS_LEN];
-	char utsname_release[UTS_LEN];
-	char utsname_version[UTS_LEN];
-	char utsname_machine[UTS_LEN];
-	char utsname_domainname[UTS_LEN];
-	__u64 current_task;
-	__u32 dump_compress;
-	__u32 dump_flags;
-	__u32 dump_device;
-} __attribute__((packed));
-
-#define DH_ARCH_ID_S390X 2
-#define DH_ARCH_ID_S390  1
-
-/*
- * This is the header used by zcore
- */
-struct dump_hdr_s390 {
-	__u64 magic_number;
-	__u32 version;
-	__u32 header_size;
-	__u32 dump_level;
-	__u32 page_size;
-	__u64 memory_size;
-	__u64 memory_start;
-	__u64 memory_end;
-	__u32 num_pages;
-	__u32 pad;
-	__u64 tod;
-	__u64 cpu_id;
-	__u32 arch_id;
-	__u32 build_arch_id;
-} __attribute__((packed));
-
-/*
- * Header associated to each physical page of memory saved in the system
- * crash dump.
- */
-struct dump_page {
-	__u64 address; /* the address of this dump page */
-	__u32 size;    /* the size of this dump page */
-	__u32 flags;   /* flags (DUMP_COMPRESSED, DUMP_RAW or DUMP_END) */
-} __attribute__((packed));
-
-struct mem_chunk {
-	__u64 addr;    /* the start address of this memory chunk */
-	__u64 size;    /* the length of this memory chunk */
-	struct mem_chunk *next; /* pointer to next memory chunk */
-};
-
-/* Compression function */
-typedef int (*compress_fn_t)(const unsigned char *old, __u32 old_size,
-			     unsigned char *new, __u32 size);
+#define DUMP_SAMPLE_PAGES	256	/* Pages for dump size estimate */
+#define DUMP_SIZE_MARGIN	25	/* Percent added to estimate */
 
 #endif /* _ZFCPDUMP_H */
@@ -42,6 +42,14 @@ typedef union {
 	struct disk_blockptr_linear linear;
 } disk_blockptr_t;
 
+/* Extent of a file: COUNT blocks starting at block LOGICAL of the file are
+ * stored at block PHYSICAL on disk. PHYSICAL is zero for a hole. */
+struct disk_extent {
+	blocknum_t logical;
+	blocknum_t physical;
+	blocknum_t count;
+};
+
 /* Disk type identifier */
 typedef enum {
 	disk_type_scsi,
@@ -102,6 +110,8 @@ int disk_is_large_volume(struct disk_info* info);
 int disk_cyl_from_blocknum(blocknum_t blocknum, struct disk_info* info);
 int disk_head_from_blocknum(blocknum_t blocknum, struct disk_info* info);
 int disk_sec_from_blocknum(blocknum_t blocknum, struct disk_info* info);
+int disk_get_blocknum(int fd, blocknum_t logical, blocknum_t* physical,
+		      struct disk_info* info);
 void disk_blockptr_from_blocknum(disk_blockptr_t* ptr, blocknum_t blocknum,
 				 struct disk_info* info);
 int disk_write_block_aligned(int fd, const void* data, size_t bytecount,
@@ -118,6 +128,16 @@ blocknum_t disk_compact_blocklist(disk_blockptr_t* list, blocknum_t count,
 blocknum_t disk_get_blocklist_from_file(const char* filename,
 					disk_blockptr_t** blocklist,
 					struct disk_info* pinfo);
+int disk_get_extents(int fd, blocknum_t first, blocknum_t end,
+		     struct disk_extent** extents, int* num,
+		     struct disk_info* info);
+int disk_get_extents_from_file(const char* filename,
+			       struct disk_extent** extents,
+			       blocknum_t* blocks, struct disk_info* info);
+blocknum_t disk_blocklist_from_extents(struct disk_extent* extents, int count,
+				       blocknum_t first,
+				       disk_blockptr_t** blocklist,
+				       struct disk_info* info);
 int disk_check_subchannel_set(int devno, dev_t device, char* dev_name);
 
 #endif /* not DISK_H */
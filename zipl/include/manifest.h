@@ -0,0 +1,67 @@
+/*
+ * s390-tools/zipl/include/manifest.h
+ *   Functions to handle the manifest of the bootmap file.
+ *
+ * Copyright IBM Corp. 2009.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "zipl.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "disk.h"
+
+
+/* Component file which was added to the bootmap file */
+struct manifest_entry {
+	char* path;
+	off_t offset;		/* Offset of component in file */
+	int add_files;		/* File contents were copied to bootmap */
+	uint64_t size;		/* Size, modification time, inode and */
+	uint64_t mtime;		/* contents hash of the file */
+	uint64_t ino;
+	uint64_t hash;
+	blocknum_t first;	/* Blocks of bootmap file used for data */
+	blocknum_t count;	/* and segment tables of the component */
+	blocknum_t segment;	/* Disk block of first segment table */
+	uint64_t loc_size;	/* Size of component in memory */
+	int bootmap_num;	/* Disk location of bootmap blocks */
+	struct disk_extent* bootmap_ext;
+	int file_num;		/* Disk location of file (if not copied) */
+	struct disk_extent* file_ext;
+};
+
+/* Manifest of the bootmap file */
+struct manifest {
+	dev_t device;		/* Target device of the bootmap */
+	int type;
+	int phy_block_size;
+	uint64_t start;
+	uint64_t ino;		/* Inode and size of the bootmap file */
+	uint64_t size;
+	blocknum_t live;	/* Blocks referenced by the program table */
+	blocknum_t empty_first;	/* Bootmap and disk block of empty block */
+	blocknum_t empty_block;
+	int num;
+	struct manifest_entry* entry;
+};
+
+
+struct manifest* manifest_new(struct disk_info* info);
+int manifest_read(const char* filename, struct manifest** manifest);
+int manifest_write(const char* filename, struct manifest* manifest);
+void manifest_free(struct manifest* manifest);
+struct manifest_entry* manifest_find(struct manifest* manifest,
+				     const char* path, off_t offset,
+				     int add_files);
+int manifest_add(struct manifest* manifest, struct manifest_entry* entry);
+int manifest_check_target(struct manifest* manifest, struct disk_info* info);
+int manifest_equal_extents(struct disk_extent* a, int a_num,
+			   struct disk_extent* b, int b_num);
+uint64_t manifest_hash(const void* data, size_t size);
+
+#endif /* not MANIFEST_H */
@@ -17,6 +17,7 @@
 #include <sys/types.h>
 
 
+/* Read-only mapping of a file, see misc_get_file_buffer() */
 struct misc_file_buffer {
 	char* buffer;
 	off_t pos;
@@ -0,0 +1,46 @@
+/*
+ * s390-tools/zipl/include/mvdump.h
+ *   Functions to write the dump records of a multi-volume dump.
+ *
+ * Copyright IBM Corp. 2009.
+ */
+
+#ifndef MVDUMP_H
+#define MVDUMP_H
+
+#include "zipl.h"
+
+#include <sys/types.h>
+
+
+#define MVDUMP_MAX_WRITES	4
+
+/* Data to be written to a dump volume at a given offset */
+struct mvdump_write {
+	off_t offset;
+	const void* data;
+	size_t size;
+};
+
+/* Dump volume and the data to be written to it. The COMMIT record is
+ * written to all volumes only after the WRITE records of all volumes
+ * were written and verified. The previous contents of all records are
+ * saved in BACKUP and restored if writing fails on any volume. */
+struct mvdump_volume {
+	const char* device;
+	const char* name;
+	struct mvdump_write write[MVDUMP_MAX_WRITES];
+	int write_count;
+	struct mvdump_write commit;
+	/* Result of preparing the volume */
+	int error;
+	const char* text;
+	/* Previous contents of the records */
+	char* backup;
+	int changed;
+};
+
+
+int mvdump_write_volumes(struct mvdump_volume* volume, int count);
+
+#endif /* not MVDUMP_H */
@@ -0,0 +1,33 @@
+/*
+ * s390-tools/zipl/include/tape.h
+ *   Functions to write the boot loader and its components to tape.
+ *
+ * Copyright IBM Corp. 2004, 2009.
+ */
+
+#ifndef TAPE_H
+#define TAPE_H
+
+#include "zipl.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* Statistics of writing a file to tape */
+struct tape_stats {
+	uint64_t bytes;
+	uint64_t records;
+	uint64_t usecs;
+};
+
+
+int tape_rewind(int fd);
+int tape_write_mark(int fd, int count);
+int tape_write_buffer(int fd, const void* data, size_t size,
+		      size_t blocksize);
+int tape_write_file(int fd, const char* filename, size_t blocksize,
+		    struct tape_stats* stats);
+void tape_print_stats(struct tape_stats* stats);
+
+#endif /* not TAPE_H */
@@ -37,6 +37,7 @@
 #define KERNEL_HEADER_SIZE		65536
 #define BOOTMAP_FILENAME		"bootmap"
 #define BOOTMAP_TEMPLATE_FILENAME	"bootmap_temp.XXXXXX"
+#define BOOTMAP_MANIFEST_FILENAME	"bootmap.manifest"
 
 #define ZIPL_CONF_VAR			"ZIPLCONF"
 #define ZIPL_DEFAULT_CONF		"/etc/zipl.conf"
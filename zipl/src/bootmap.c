@@ -22,6 +22,7 @@
 #include "boot.h"
 #include "disk.h"
 #include "error.h"
+#include "manifest.h"
 #include "misc.h"
 
 
@@ -56,6 +57,11 @@ struct eckd_blockptr {
 /* Pointer to dedicated empty block in bootmap. */
 disk_blockptr_t empty_block;
 
+/* Manifest of the existing bootmap file when it is updated in place and
+ * manifest of the bootmap file which is being built. */
+static struct manifest* old_manifest;
+static struct manifest* new_manifest;
+
 
 /* Get size of a bootmap block pointer for disk with given INFO. */
 static int
@@ -294,24 +300,230 @@ struct component_loc {
 	size_t size;
 };
 
+/* Return the number of the first bootmap block at or after the current
+ * position of the bootmap file FD. */
+static blocknum_t
+get_bootmap_block(int fd, struct disk_info* info)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos == -1)
+		return 0;
+	return (pos + info->phy_block_size - 1) / info->phy_block_size;
+}
+
+
+/* Return the disk block which holds file block BLOCK according to the NUM
+ * extents in EXTENTS or 0 if there is no such block. */
+static blocknum_t
+get_extent_blocknum(struct disk_extent* extents, int num, blocknum_t block)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if ((block >= extents[i].logical) &&
+		    (block < extents[i].logical + extents[i].count)) {
+			if (extents[i].physical == 0)
+				return 0;
+			return extents[i].physical + block - extents[i].logical;
+		}
+	}
+	return 0;
+}
+
+
+/* Check whether the component file with status STATS is unchanged since
+ * ENTRY was recorded. A file with the same size, modification time and
+ * inode is considered unchanged. If one of them differs, a copied file is
+ * still unchanged if HASH is given and matches the hash of its contents.
+ * Return non-zero if the file is unchanged. */
+static int
+component_unchanged(struct manifest_entry* entry, int add_files,
+		    struct stat* stats, uint64_t* hash)
+{
+	if (entry->size != (uint64_t) stats->st_size)
+		return 0;
+	if ((entry->mtime == (uint64_t) stats->st_mtime) &&
+	    (entry->ino == (uint64_t) stats->st_ino))
+		return 1;
+	return add_files && (hash != NULL) && (entry->hash == *hash);
+}
+
+
+/* Return the manifest entry of component file FILENAME at OFFSET if the
+ * same component was already added to the bootmap file for another section
+ * during this run. STATS and HASH are checked as described for
+ * component_unchanged. Return NULL otherwise. */
+static struct manifest_entry*
+find_shared_component(const char* filename, off_t offset, int add_files,
+		      struct stat* stats, uint64_t* hash)
+{
+	struct manifest_entry* entry;
+
+	entry = manifest_find(new_manifest, filename, offset, add_files);
+	if ((entry == NULL) ||
+	    !component_unchanged(entry, add_files, stats, hash))
+		return NULL;
+	return entry;
+}
+
+
+/* Return the manifest entry of component file FILENAME at OFFSET if the
+ * component can be reused from the bootmap file FD which is updated in
+ * place. This is the case if the bootmap blocks of the component are still
+ * in place and the file is unchanged. STATS contains the current status of
+ * the file and HASH, if not NULL, the hash of its contents if it is copied.
+ * Return NULL otherwise. */
+static struct manifest_entry*
+find_unchanged_component(int fd, const char* filename, off_t offset,
+			 int add_files, struct stat* stats, uint64_t* hash,
+			 struct disk_info* info,
+			 struct job_target_data* target)
+{
+	struct manifest_entry* entry;
+	struct disk_info* file_info;
+	struct disk_extent* extents;
+	blocknum_t blocks;
+	int equal;
+	int num;
+
+	entry = manifest_find(old_manifest, filename, offset, add_files);
+	if ((entry == NULL) ||
+	    !component_unchanged(entry, add_files, stats, hash))
+		return NULL;
+	/* Check bootmap blocks of data and segment tables */
+	if (disk_get_extents(fd, entry->first, entry->first + entry->count,
+			     &extents, &num, info))
+		return NULL;
+	equal = manifest_equal_extents(extents, num, entry->bootmap_ext,
+				       entry->bootmap_num);
+	free(extents);
+	if (!equal || add_files)
+		return equal ? entry : NULL;
+	/* Check disk blocks of file referenced by the bootmap */
+	if (disk_get_info_from_file(filename, target, &file_info))
+		return NULL;
+	num = disk_get_extents_from_file(filename, &extents, &blocks,
+					 file_info);
+	disk_free_info(file_info);
+	if (num == 0)
+		return NULL;
+	equal = manifest_equal_extents(extents, num, entry->file_ext,
+				       entry->file_num);
+	free(extents);
+	return equal ? entry : NULL;
+}
+
+
+/* Return the manifest entry of a component file which can be shared with
+ * another section or reused from the existing bootmap file. A reused entry
+ * is added to the manifest of the new bootmap file with the current
+ * modification time and inode of the file. Return NULL if the component
+ * has to be written. */
+static struct manifest_entry*
+find_component(int fd, const char* filename, off_t offset, int add_files,
+	       struct stat* stats, uint64_t* hash, struct disk_info* info,
+	       struct job_target_data* target)
+{
+	struct manifest_entry* entry;
+
+	entry = find_shared_component(filename, offset, add_files, stats,
+				      hash);
+	if (entry != NULL)
+		return entry;
+	entry = find_unchanged_component(fd, filename, offset, add_files,
+					 stats, hash, info, target);
+	if (entry != NULL) {
+		entry->mtime = stats->st_mtime;
+		entry->ino = stats->st_ino;
+		manifest_add(new_manifest, entry);
+	}
+	return entry;
+}
+
+
+/* Add an entry for the component file FILENAME at OFFSET which was written
+ * to bootmap blocks starting at FIRST to the manifest of the new bootmap
+ * file. Failures are not fatal, the component is only not shared with
+ * other sections or reused by later runs. */
+static void
+record_component(int fd, const char* filename, off_t offset, int add_files,
+		 struct stat* stats, uint64_t hash, blocknum_t first,
+		 uint64_t loc_size, struct disk_extent* file_ext, int file_num,
+		 struct disk_info* info)
+{
+	struct manifest_entry entry;
+	blocknum_t end;
+
+	if ((new_manifest == NULL) ||
+	    (manifest_find(new_manifest, filename, offset, add_files) != NULL))
+		return;
+	memset(&entry, 0, sizeof(entry));
+	entry.path = (char *) filename;
+	entry.offset = offset;
+	entry.add_files = add_files;
+	entry.size = stats->st_size;
+	entry.mtime = stats->st_mtime;
+	entry.ino = stats->st_ino;
+	entry.hash = hash;
+	end = get_bootmap_block(fd, info);
+	if (end <= first)
+		return;
+	entry.first = first;
+	entry.count = end - first;
+	entry.loc_size = loc_size;
+	entry.file_num = file_num;
+	entry.file_ext = file_ext;
+	if (disk_get_extents(fd, first, end, &entry.bootmap_ext,
+			     &entry.bootmap_num, info))
+		return;
+	/* The first segment table is written last */
+	entry.segment = get_extent_blocknum(entry.bootmap_ext,
+					    entry.bootmap_num, end - 1);
+	if (entry.segment != 0)
+		manifest_add(new_manifest, &entry);
+	free(entry.bootmap_ext);
+}
+
+
 static int
 add_component_file(int fd, const char* filename, address_t load_address,
 		   off_t offset, void* component, int add_files,
 		   struct disk_info* info, struct job_target_data* target,
 		   struct component_loc *location)
 {
+	struct manifest_entry* entry;
 	struct disk_info* file_info;
+	struct disk_extent* extents;
 	struct component_loc loc;
+	struct stat stats;
 	disk_blockptr_t segment;
 	disk_blockptr_t* list;
 	char* buffer;
 	size_t size;
+	uint64_t hash;
+	blocknum_t blocks;
 	blocknum_t count;
+	blocknum_t first;
+	int num;
 	int rc;
-	int from;
-	unsigned int to;
 
-	if (add_files) {
+	if (stat(filename, &stats)) {
+		error_reason(strerror(errno));
+		error_text("Could not get information for file '%s'",
+			   filename);
+		return -1;
+	}
+	hash = 0;
+	buffer = NULL;
+	size = 0;
+	/* Share component added for another section or reuse unchanged
+	 * component of existing bootmap file. The file is only read and
+	 * hashed if its size, modification time or inode have changed. */
+	entry = find_component(fd, filename, offset, add_files, &stats, NULL,
+			       info, target);
+	if ((entry == NULL) && add_files) {
 		/* Read file to buffer */
 		rc = misc_read_file(filename, &buffer, &size, 0);
 		if (rc) {
@@ -326,6 +538,26 @@ add_component_file(int fd, const char* filename, address_t load_address,
 			free(buffer);
 			return -1;
 		}
+		hash = manifest_hash(buffer, size);
+		entry = find_component(fd, filename, offset, add_files,
+				       &stats, &hash, info, target);
+	}
+	if (entry != NULL) {
+		free(buffer);
+		memset(&segment, 0, sizeof(disk_blockptr_t));
+		disk_blockptr_from_blocknum(&segment, entry->segment, info);
+		create_component_entry(component, &segment, component_load,
+				       load_address, info);
+		if (location != NULL) {
+			location->addr = load_address;
+			location->size = entry->loc_size;
+		}
+		return 0;
+	}
+	first = get_bootmap_block(fd, info);
+	extents = NULL;
+	num = 0;
+	if (add_files) {
 		/* Write buffer */
 		count = disk_write_block_buffer(fd, buffer + offset,
 					size - offset, &list, info);
@@ -334,6 +566,9 @@ add_component_file(int fd, const char* filename, address_t load_address,
 			error_text("Could not write to bootmap file");
 			return -1;
 		}
+		blocks = count;
+		/* Try to compact list */
+		count = disk_compact_blocklist(list, count, info);
 	} else {
 		/* Make sure file is on correct device */
 		rc = disk_get_info_from_file(filename, target, &file_info);
@@ -344,42 +579,49 @@ add_component_file(int fd, const char* filename, address_t load_address,
 			error_reason("File is not on target device");
 			return -1;
 		}
-		/* Get block list from existing file */
-		count = disk_get_blocklist_from_file(filename, &list,
-						     file_info);
-		disk_free_info(file_info);
-		if (count == 0)
+		/* Get extents of existing file */
+		num = disk_get_extents_from_file(filename, &extents, &blocks,
+						 file_info);
+		if (num == 0) {
+			disk_free_info(file_info);
 			return -1;
-		if (count * info->phy_block_size <= (size_t) offset) {
+		}
+		if (blocks * info->phy_block_size <= (size_t) offset) {
 			error_reason("File '%s' is too small (has to be "
 				     "greater than %ld bytes)", filename,
 				     (long) offset);
-			free(list);
+			free(extents);
+			disk_free_info(file_info);
 			return -1;
 		}
-		if (offset > 0) {
-			/* Shorten list by offset */
-			from = offset / info->phy_block_size;
-			count -= from;
-			for (to=0; to < count; to++, from++)
-				list[to] = list[from];
+		/* Build compacted block list, skipping the blocks before
+		 * offset */
+		count = disk_blocklist_from_extents(extents, num,
+					offset / info->phy_block_size,
+					&list, file_info);
+		disk_free_info(file_info);
+		if (count == 0) {
+			free(extents);
+			return -1;
 		}
+		blocks -= offset / info->phy_block_size;
 	}
 	/* Fill in component location */
 	loc.addr = load_address;
-	loc.size = count * info->phy_block_size;
-	/* Try to compact list */
-	count = disk_compact_blocklist(list, count, info);
+	loc.size = blocks * info->phy_block_size;
 	/* Write segment table */
 	rc = add_segment_table(fd, list, count, &segment, info);
 	free(list);
 	if (rc == 0) {
 		create_component_entry(component, &segment, component_load,
 				       load_address, info);
+		record_component(fd, filename, offset, add_files, &stats, hash,
+				 first, loc.size, extents, num, info);
 		/* Return location if requested */
 		if (location != NULL)
 			*location = loc;
 	}
+	free(extents);
 	return rc;
 }
 
@@ -830,6 +1072,150 @@ write_empty_block(int fd, disk_blockptr_t* block, struct disk_info* info)
 }
 
 
+/* Open the existing bootmap file MAPNAME for appending new components if
+ * its manifest MANIFESTNAME matches the target device INFO and no more than
+ * half of the bootmap blocks are unused. Upon success, return the file
+ * descriptor and set old_manifest and empty_block. Return -1 otherwise. */
+static int
+open_bootmap_update(const char* mapname, const char* manifestname,
+		    struct disk_info* info)
+{
+	struct disk_extent* extents;
+	struct manifest* manifest;
+	struct stat stats;
+	int valid;
+	int num;
+	int fd;
+
+	if (manifest_read(manifestname, &manifest))
+		return -1;
+	if (!manifest_check_target(manifest, info)) {
+		manifest_free(manifest);
+		return -1;
+	}
+	fd = open(mapname, O_RDWR);
+	if (fd == -1) {
+		manifest_free(manifest);
+		return -1;
+	}
+	/* Bootmap file must not have been changed since the last run */
+	valid = (fstat(fd, &stats) == 0) &&
+		(manifest->ino == (uint64_t) stats.st_ino) &&
+		(manifest->size == (uint64_t) stats.st_size) &&
+		((blocknum_t) stats.st_size / info->phy_block_size <=
+		 2 * manifest->live);
+	/* Empty block must still be in place */
+	if (valid && (disk_get_extents(fd, manifest->empty_first,
+				       manifest->empty_first + 1, &extents,
+				       &num, info) == 0)) {
+		valid = (num == 1) &&
+			(extents[0].physical == manifest->empty_block);
+		free(extents);
+	} else
+		valid = 0;
+	if (!valid || (lseek(fd, 0, SEEK_END) == -1)) {
+		close(fd);
+		manifest_free(manifest);
+		return -1;
+	}
+	memset(&empty_block, 0, sizeof(disk_blockptr_t));
+	disk_blockptr_from_blocknum(&empty_block, manifest->empty_block, info);
+	old_manifest = manifest;
+	return fd;
+}
+
+
+/* Check whether the existing bootmap file in directory DIR can be updated
+ * in place. In that case, it replaces the temporary bootmap file FD and
+ * FILENAME. Failures are not fatal, the bootmap file is then built from
+ * scratch. */
+static void
+prepare_update(char* dir, int* fd, char** filename,
+	       struct disk_info* info)
+{
+	char* manifestname;
+	char* mapname;
+	int map_fd;
+
+	mapname = misc_make_path(dir, BOOTMAP_FILENAME);
+	manifestname = misc_make_path(dir, BOOTMAP_MANIFEST_FILENAME);
+	map_fd = -1;
+	if ((mapname != NULL) && (manifestname != NULL))
+		map_fd = open_bootmap_update(mapname, manifestname, info);
+	free(manifestname);
+	if (map_fd == -1) {
+		free(mapname);
+		return;
+	}
+	new_manifest->empty_first = old_manifest->empty_first;
+	close(*fd);
+	remove(*filename);
+	free(*filename);
+	*fd = map_fd;
+	*filename = mapname;
+}
+
+
+/* Complete the manifest of the bootmap file in directory DIR to which
+ * blocks were written starting at bootmap block START and write it next
+ * to the bootmap file. */
+static void
+write_manifest(char* dir, blocknum_t start, struct disk_info* info)
+{
+	struct disk_extent* extents;
+	struct stat stats;
+	char* manifestname;
+	char* mapname;
+	blocknum_t live;
+	int num;
+	int fd;
+	int rc;
+	int i;
+
+	mapname = misc_make_path(dir, BOOTMAP_FILENAME);
+	manifestname = misc_make_path(dir, BOOTMAP_MANIFEST_FILENAME);
+	if ((mapname == NULL) || (manifestname == NULL))
+		goto out;
+	rc = -1;
+	fd = open(mapname, O_RDONLY);
+	if (fd != -1) {
+		rc = fstat(fd, &stats);
+		if (rc == 0)
+			rc = disk_get_extents(fd, new_manifest->empty_first,
+					      new_manifest->empty_first + 1,
+					      &extents, &num, info);
+		close(fd);
+	}
+	if (rc == 0) {
+		new_manifest->empty_block = get_extent_blocknum(extents, num,
+						new_manifest->empty_first);
+		free(extents);
+		/* Blocks written by this run and reused components */
+		new_manifest->ino = stats.st_ino;
+		new_manifest->size = stats.st_size;
+		live = (stats.st_size + info->phy_block_size - 1) /
+		       info->phy_block_size - start +
+		       new_manifest->empty_first + 1;
+		for (i = 0; i < new_manifest->num; i++)
+			if (new_manifest->entry[i].first < start)
+				live += new_manifest->entry[i].count;
+		new_manifest->live = live;
+		if (new_manifest->empty_block != 0)
+			rc = manifest_write(manifestname, new_manifest);
+		else
+			rc = -1;
+	}
+	if (rc) {
+		fprintf(stderr, "Warning: could not write manifest file %s!\n",
+			manifestname);
+		remove(manifestname);
+	}
+out:
+	free(manifestname);
+	free(mapname);
+}
+
+
 int
 bootmap_create(struct job_data* job, disk_blockptr_t* program_table,
 	       disk_blockptr_t** stage2_list, blocknum_t* stage2_count,
@@ -841,6 +1227,7 @@ bootmap_create(struct job_data* job, disk_blockptr_t* program_table,
 	char *mapname;
 	void* stage2_data;
 	size_t stage2_size;
+	blocknum_t start;
 	int fd;
 	int rc;
 
@@ -897,29 +1284,41 @@ bootmap_create(struct job_data* job, disk_blockptr_t* program_table,
 			return rc;
 		}
 	}
-	printf("Building bootmap in '%s'%s\n", job->target.bootmap_dir,
+	/* Keep track of components to share them between sections and to
+	 * reuse unchanged components of the existing bootmap file */
+	new_manifest = manifest_new(info);
+	if (!dry_run && (new_manifest != NULL))
+		prepare_update(job->target.bootmap_dir, &fd, &filename, info);
+	printf("%s bootmap in '%s'%s\n",
+	       old_manifest != NULL ? "Updating" : "Building",
+	       job->target.bootmap_dir,
 	       job->add_files ? " (files will be added to bootmap file)" :
 	       "");
-	/* Write bootmap header */
-	rc = misc_write(fd, header_text, sizeof(header_text));
-	if (rc) {
-		error_text("Could not write to file '%s'", filename);
-		misc_free_temp_dev(device);
-		disk_free_info(info);
-		close(fd);
-		free(filename);
-		return rc;
-	}
-	/* Write empty block to be read in place of holes in files */
-	rc = write_empty_block(fd, &empty_block, info);
-	if (rc) {
-		error_text("Could not write to file '%s'", filename);
-		misc_free_temp_dev(device);
-		disk_free_info(info);
-		close(fd);
-		free(filename);
-		return rc;
+	if (old_manifest == NULL) {
+		/* Write bootmap header */
+		rc = misc_write(fd, header_text, sizeof(header_text));
+		if (rc) {
+			error_text("Could not write to file '%s'", filename);
+			misc_free_temp_dev(device);
+			disk_free_info(info);
+			close(fd);
+			free(filename);
+			return rc;
+		}
+		/* Write empty block to be read in place of holes in files */
+		if (new_manifest != NULL)
+			new_manifest->empty_first = get_bootmap_block(fd, info);
+		rc = write_empty_block(fd, &empty_block, info);
+		if (rc) {
+			error_text("Could not write to file '%s'", filename);
+			misc_free_temp_dev(device);
+			disk_free_info(info);
+			close(fd);
+			free(filename);
+			return rc;
+		}
 	}
+	start = get_bootmap_block(fd, info);
 	/* Build program table */
 	rc = build_program_table(fd, job, program_table, info);
 	if (rc)
@@ -982,7 +1381,7 @@ bootmap_create(struct job_data* job, disk_blockptr_t* program_table,
 		if (remove(filename) == -1)
 			fprintf(stderr, "Warning: could not remove temporary "
 				"file %s!\n", filename);
-	} else {
+	} else if (old_manifest == NULL) {
 		/* Rename to final bootmap name */
 		mapname = misc_make_path(job->target.bootmap_dir,
 				BOOTMAP_FILENAME);
@@ -1004,6 +1403,12 @@ bootmap_create(struct job_data* job, disk_blockptr_t* program_table,
 		}
 		free(mapname);
 	}
+	if (!dry_run && (new_manifest != NULL))
+		write_manifest(job->target.bootmap_dir, start, info);
+	manifest_free(old_manifest);
+	manifest_free(new_manifest);
+	old_manifest = NULL;
+	new_manifest = NULL;
 	*new_device = device;
 	*new_info = info;
 	free(filename);
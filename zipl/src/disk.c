@@ -33,6 +33,52 @@
 #define FIGETBSZ		_IO(0x00,2)
 #define BLKGETSIZE		_IO(0x12,96)
 #define BLKSSZGET		_IO(0x12,104)
+#define FS_IOC_FIEMAP		_IOWR('f', 11, struct fiemap)
+
+/* from linux/fiemap.h */
+struct fiemap_extent {
+	uint64_t fe_logical;	/* logical offset in bytes of the extent */
+	uint64_t fe_physical;	/* physical offset in bytes of the extent */
+	uint64_t fe_length;	/* length in bytes of the extent */
+	uint64_t fe_reserved64[2];
+	uint32_t fe_flags;	/* FIEMAP_EXTENT_* flags for this extent */
+	uint32_t fe_reserved[3];
+};
+
+struct fiemap {
+	uint64_t fm_start;	/* logical offset (inclusive) at which to
+				 * start mapping (in) */
+	uint64_t fm_length;	/* logical length of mapping (in) */
+	uint32_t fm_flags;	/* FIEMAP_FLAG_* flags for request (in/out) */
+	uint32_t fm_mapped_extents; /* number of extents that were mapped
+				     * (out) */
+	uint32_t fm_extent_count; /* size of fm_extents array (in) */
+	uint32_t fm_reserved;
+	struct fiemap_extent fm_extents[0]; /* array of mapped extents (out) */
+};
+
+#define FIEMAP_FLAG_SYNC		0x00000001
+#define FIEMAP_EXTENT_LAST		0x00000001
+#define FIEMAP_EXTENT_UNKNOWN		0x00000002
+#define FIEMAP_EXTENT_DELALLOC		0x00000004
+#define FIEMAP_EXTENT_ENCODED		0x00000008
+#define FIEMAP_EXTENT_DATA_ENCRYPTED	0x00000080
+#define FIEMAP_EXTENT_NOT_ALIGNED	0x00000100
+#define FIEMAP_EXTENT_DATA_INLINE	0x00000200
+#define FIEMAP_EXTENT_DATA_TAIL		0x00000400
+#define FIEMAP_EXTENT_UNWRITTEN		0x00000800
+
+/* Extents with these flags have no usable disk location */
+#define FIEMAP_EXTENT_NO_BLOCKS	(FIEMAP_EXTENT_UNKNOWN | \
+				 FIEMAP_EXTENT_DELALLOC | \
+				 FIEMAP_EXTENT_ENCODED | \
+				 FIEMAP_EXTENT_DATA_ENCRYPTED | \
+				 FIEMAP_EXTENT_NOT_ALIGNED | \
+				 FIEMAP_EXTENT_DATA_INLINE | \
+				 FIEMAP_EXTENT_DATA_TAIL)
+
+/* Number of extents requested with one FS_IOC_FIEMAP call */
+#define FIEMAP_EXTENT_COUNT	64
 
 /* from linux/hdregs.h */
 #define HDIO_GETGEO		0x0301
@@ -458,6 +504,232 @@ disk_get_blocknum(int fd, blocknum_t logical, blocknum_t* physical,
 }
 
 
+/* Add COUNT blocks starting at block LOGICAL of the file which are stored
+ * at block PHYSICAL (zero for a hole) to the list of NUM extents in
+ * EXTENTS. Extend the last extent if the blocks are adjacent to it. Return
+ * 0 on success, non-zero otherwise. */
+static int
+add_extent(struct disk_extent** extents, int* num, blocknum_t logical,
+	   blocknum_t physical, blocknum_t count)
+{
+	struct disk_extent* last;
+	struct disk_extent* list;
+
+	if (*num > 0) {
+		last = &(*extents)[*num - 1];
+		if ((last->logical + last->count == logical) &&
+		    (((last->physical == 0) && (physical == 0)) ||
+		     ((last->physical != 0) && (physical != 0) &&
+		      (last->physical + last->count == physical)))) {
+			last->count += count;
+			return 0;
+		}
+	}
+	/* Grow list in steps of FIEMAP_EXTENT_COUNT elements */
+	if (*num % FIEMAP_EXTENT_COUNT == 0) {
+		list = (struct disk_extent *) realloc(*extents,
+				sizeof(struct disk_extent) *
+				(*num + FIEMAP_EXTENT_COUNT));
+		if (list == NULL) {
+			error_reason(strerror(errno));
+			return -1;
+		}
+		*extents = list;
+	}
+	last = &(*extents)[(*num)++];
+	last->logical = logical;
+	last->physical = physical;
+	last->count = count;
+	return 0;
+}
+
+
+/* Get the extents of blocks FIRST to END - 1 of the file identified by FD
+ * with the FS_IOC_FIEMAP ioctl. Return 0 on success. Return non-zero if the
+ * file system does not provide a usable mapping, in which case the caller
+ * has to fall back to FIBMAP. */
+static int
+get_extents_fiemap(int fd, blocknum_t first, blocknum_t end,
+		   struct disk_extent** extents, int* num,
+		   struct disk_info* info)
+{
+	struct fiemap* map;
+	struct fiemap_extent* fe;
+	uint64_t start, size;
+	blocknum_t logical, physical, count, next;
+	unsigned int i;
+	int done;
+
+	map = (struct fiemap *) misc_malloc(sizeof(struct fiemap) +
+			sizeof(struct fiemap_extent) * FIEMAP_EXTENT_COUNT);
+	if (map == NULL)
+		return -1;
+	size = end * info->phy_block_size;
+	next = first;
+	for (start = first * info->phy_block_size, done = 0;
+	     (start < size) && !done;) {
+		memset(map, 0, sizeof(struct fiemap));
+		map->fm_start = start;
+		map->fm_length = size - start;
+		map->fm_flags = FIEMAP_FLAG_SYNC;
+		map->fm_extent_count = FIEMAP_EXTENT_COUNT;
+		if (ioctl(fd, FS_IOC_FIEMAP, map))
+			goto out_fallback;
+		/* No more extents, the rest of the file is a hole */
+		if (map->fm_mapped_extents == 0)
+			break;
+		for (i = 0; (i < map->fm_mapped_extents) && !done; i++) {
+			fe = &map->fm_extents[i];
+			if ((fe->fe_flags & FIEMAP_EXTENT_NO_BLOCKS) ||
+			    (fe->fe_logical % info->phy_block_size) ||
+			    (fe->fe_physical % info->phy_block_size))
+				goto out_fallback;
+			logical = fe->fe_logical / info->phy_block_size;
+			if (logical >= end)
+				break;
+			count = (fe->fe_length + info->phy_block_size - 1) /
+				info->phy_block_size;
+			/* Unwritten extents read as zeroes, like holes */
+			if (fe->fe_flags & FIEMAP_EXTENT_UNWRITTEN)
+				physical = 0;
+			else
+				physical = fe->fe_physical /
+					   info->phy_block_size +
+					   info->geo.start;
+			/* The first extent may start before the range */
+			if ((logical < first) && (logical + count > first)) {
+				if (physical != 0)
+					physical += first - logical;
+				count -= first - logical;
+				logical = first;
+			}
+			if (logical < next)
+				goto out_fallback;
+			if (count > end - logical)
+				count = end - logical;
+			if ((logical > next) &&
+			    add_extent(extents, num, next, 0, logical - next))
+				goto out_error;
+			if (add_extent(extents, num, logical, physical, count))
+				goto out_error;
+			next = logical + count;
+			start = fe->fe_logical + fe->fe_length;
+			done = fe->fe_flags & FIEMAP_EXTENT_LAST;
+		}
+		if (i < map->fm_mapped_extents)
+			break;
+	}
+	/* Data behind the last extent is a hole */
+	if ((next < end) && add_extent(extents, num, next, 0, end - next))
+		goto out_error;
+	free(map);
+	return 0;
+
+out_fallback:
+	free(*extents);
+	*extents = NULL;
+	*num = 0;
+	free(map);
+	return 1;
+out_error:
+	free(map);
+	return -1;
+}
+
+
+/* Get the extents of blocks FIRST to END - 1 of the file identified by FD
+ * with one FIBMAP ioctl per file system block. Return 0 on success, non-zero
+ * otherwise. */
+static int
+get_extents_fibmap(int fd, blocknum_t first, blocknum_t end,
+		   struct disk_extent** extents, int* num,
+		   struct disk_info* info)
+{
+	blocknum_t phy_per_fs;
+	blocknum_t logical;
+	blocknum_t count;
+	int subblock;
+	int mapped;
+
+	phy_per_fs = info->fs_block_size / info->phy_block_size;
+	for (logical = first; logical < end; logical += count) {
+		mapped = logical / phy_per_fs;
+		subblock = logical % phy_per_fs;
+		if (ioctl(fd, FIBMAP, &mapped)) {
+			error_reason("Could not get file mapping");
+			return -1;
+		}
+		count = phy_per_fs - subblock;
+		if (count > end - logical)
+			count = end - logical;
+		/* Convert file system block to physical and add partition
+		 * start */
+		if (add_extent(extents, num, logical, mapped == 0 ? 0 :
+			       mapped * phy_per_fs + subblock + info->geo.start,
+			       count))
+			return -1;
+	}
+	return 0;
+}
+
+
+/* Get the extents of blocks FIRST to END - 1 of the file identified by FD.
+ * Upon success, return 0, set EXTENTS to point to the list of extents and
+ * NUM to the number of extents. Return non-zero otherwise. */
+int
+disk_get_extents(int fd, blocknum_t first, blocknum_t end,
+		 struct disk_extent** extents, int* num,
+		 struct disk_info* info)
+{
+	struct statfs buf;
+	int rc;
+
+	/* Get file system type */
+	if (fstatfs(fd, &buf)) {
+		error_reason(strerror(errno));
+		return -1;
+	}
+	/* Files on ReiserFS need unpacking */
+	if (buf.f_type == REISERFS_SUPER_MAGIC) {
+		if (ioctl(fd, REISERFS_IOC_UNPACK, 1)) {
+			error_reason("Could not unpack ReiserFS file");
+			return -1;
+		}
+	}
+	/* Get extents in one go if possible, block by block otherwise */
+	*extents = NULL;
+	*num = 0;
+	rc = get_extents_fiemap(fd, first, end, extents, num, info);
+	if (rc > 0)
+		rc = get_extents_fibmap(fd, first, end, extents, num, info);
+	if (rc) {
+		free(*extents);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Store a pointer for each block of the NUM extents in EXTENTS to LIST.
+ * INFO provides information about the disk layout. */
+static void
+fill_blocklist(disk_blockptr_t* list, struct disk_extent* extents, int num,
+	       struct disk_info* info)
+{
+	blocknum_t block;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		for (block = 0; block < extents[i].count; block++, list++) {
+			memset(list, 0, sizeof(disk_blockptr_t));
+			disk_blockptr_from_blocknum(list,
+				extents[i].physical == 0 ? 0 :
+				extents[i].physical + block, info);
+		}
+	}
+}
+
+
 /* Return the cylinder on which the block number BLOCKNUM is stored on the
  * CHS device identified by INFO. */
 int
@@ -579,34 +851,49 @@ disk_write_block_buffer(int fd, const void* buffer, size_t bytecount,
 			disk_blockptr_t** blocklist,
 			struct disk_info* info)
 {
+	struct disk_extent* extents;
 	disk_blockptr_t* list;
+	blocknum_t first;
 	blocknum_t count;
-	blocknum_t i;
-	size_t written;
-	size_t chunk_size;
-	int rc;
+	off_t current_pos;
+	int align;
+	int num;
 
-	count = (bytecount + info->phy_block_size - 1) / info->phy_block_size;
+	current_pos = lseek(fd, 0, SEEK_CUR);
+	if (current_pos == -1) {
+		error_text(strerror(errno));
+		return 0;
+	}
+	/* Ensure block alignment of current file pos */
+	align = info->phy_block_size;
+	if (current_pos % align != 0) {
+		current_pos = lseek(fd, align - current_pos % align, SEEK_CUR);
+		if (current_pos == -1) {
+			error_text(strerror(errno));
+			return 0;
+		}
+	}
+	first = current_pos / align;
+	count = (bytecount + align - 1) / align;
+	/* Write all blocks at once and make sure that they are allocated
+	 * before getting the mapping */
+	if (misc_write(fd, buffer, bytecount))
+		return 0;
+	if (fdatasync(fd)) {
+		error_reason(strerror(errno));
+		return 0;
+	}
+	if (disk_get_extents(fd, first, first + count, &extents, &num, info))
+		return 0;
 	list = (disk_blockptr_t *) misc_malloc(sizeof(disk_blockptr_t) *
 					       count);
 	if (list == NULL) {
-		close(fd);
+		free(extents);
 		return 0;
 	}
-	memset((void *) list, 0, sizeof(disk_blockptr_t) * count);
 	/* Build list */
-	for (i=0, written=0; i < count; i++, written += chunk_size) {
-		chunk_size = bytecount - written;
-		if (chunk_size > (size_t) info->phy_block_size)
-			chunk_size = info->phy_block_size;
-		rc = disk_write_block_aligned(fd, VOID_ADD(buffer, written),
-				chunk_size,
-				&list[i], info);
-		if (rc) {
-			free(list);
-			return 0;
-		}
-	}
+	fill_blocklist(list, extents, num, info);
+	free(extents);
 	*blocklist = list;
 	return count;
 }
@@ -838,20 +1125,22 @@ disk_compact_blocklist(disk_blockptr_t* list, blocknum_t count,
 }
 
 
-/* Retrieve a list of pointers to the disk blocks that make up the file
- * specified by FILENAME. Upon success, return the number of blocks and set
- * BLOCKLIST to point to the uncompacted list. INFO provides information
+/* Retrieve the extents of the file specified by FILENAME. Upon success,
+ * return the number of extents, set EXTENTS to point to the list of
+ * extents and BLOCKS to the number of blocks of the file. The extents cover
+ * all blocks of the file in ascending order, holes are represented by
+ * extents with a physical block number of zero. INFO provides information
  * about the device which contains the file. Return zero otherwise. */
-blocknum_t
-disk_get_blocklist_from_file(const char* filename, disk_blockptr_t** blocklist,
-			     struct disk_info* info)
+int
+disk_get_extents_from_file(const char* filename,
+			   struct disk_extent** extents, blocknum_t* blocks,
+			   struct disk_info* info)
 {
-	disk_blockptr_t* list;
 	struct stat stats;
+	struct disk_extent* list;
+	int num;
 	int fd;
-	blocknum_t count;
-	blocknum_t i;
-	blocknum_t blocknum;
+	int rc;
 
 	fd = open(filename, O_RDONLY);
 	if (fd == -1) {
@@ -867,30 +1156,95 @@ disk_get_blocklist_from_file(const char* filename, disk_blockptr_t** blocklist,
 		return 0;
 	}
 	/* Get number of blocks */
-	count = ((blocknum_t) stats.st_size +
+	*blocks = ((blocknum_t) stats.st_size +
 			info->phy_block_size - 1) / info->phy_block_size;
-	if (count == 0) {
+	if (*blocks == 0) {
 		error_reason("Could not read empty file '%s'", filename);
 		close(fd);
 		return 0;
 	}
+	rc = disk_get_extents(fd, 0, *blocks, &list, &num, info);
+	close(fd);
+	if (rc)
+		return 0;
+	*extents = list;
+	return num;
+}
+
+
+/* Create a list of pointers to the disk blocks described by the COUNT
+ * elements in EXTENTS, starting at block FIRST of the file. Adjacent blocks
+ * are merged while the list is built. Upon success, return the number of
+ * elements and set BLOCKLIST to point to the compacted list. INFO provides
+ * information about the disk layout. Return zero otherwise. */
+blocknum_t
+disk_blocklist_from_extents(struct disk_extent* extents, int count,
+			    blocknum_t first, disk_blockptr_t** blocklist,
+			    struct disk_info* info)
+{
+	disk_blockptr_t* list;
+	disk_blockptr_t ptr;
+	blocknum_t block;
+	blocknum_t num;
+	blocknum_t max;
+	int i;
+
+	max = extents[count - 1].logical + extents[count - 1].count;
+	if (first >= max)
+		return 0;
+	list = (disk_blockptr_t *) misc_malloc(sizeof(disk_blockptr_t) *
+					       (max - first));
+	if (list == NULL)
+		return 0;
+	memset(&ptr, 0, sizeof(ptr));
+	num = 0;
+	for (i = 0; i < count; i++) {
+		block = extents[i].logical;
+		if (block < first)
+			block = first;
+		for (; block < extents[i].logical + extents[i].count;
+		     block++) {
+			disk_blockptr_from_blocknum(&ptr,
+				extents[i].physical == 0 ? 0 :
+				extents[i].physical + block -
+				extents[i].logical, info);
+			if ((num > 0) && can_merge_blocks(&list[num - 1], &ptr,
+							  info))
+				merge_blocks(&list[num - 1], &ptr, info);
+			else
+				list[num++] = ptr;
+		}
+	}
+	*blocklist = list;
+	return num;
+}
+
+
+/* Retrieve a list of pointers to the disk blocks that make up the file
+ * specified by FILENAME. Upon success, return the number of blocks and set
+ * BLOCKLIST to point to the uncompacted list. INFO provides information
+ * about the device which contains the file. Return zero otherwise. */
+blocknum_t
+disk_get_blocklist_from_file(const char* filename, disk_blockptr_t** blocklist,
+			     struct disk_info* info)
+{
+	disk_blockptr_t* list;
+	struct disk_extent* extents;
+	blocknum_t count;
+	int num;
+
+	num = disk_get_extents_from_file(filename, &extents, &count, info);
+	if (num == 0)
+		return 0;
 	list = (disk_blockptr_t *) misc_malloc(sizeof(disk_blockptr_t) *
 					       count);
 	if (list == NULL) {
-		close(fd);
+		free(extents);
 		return 0;
 	}
-	memset((void *) list, 0, sizeof(disk_blockptr_t) * count);
 	/* Build list */
-	for (i=0; i < count; i++) {
-		if (disk_get_blocknum(fd, i, &blocknum, info)) {
-			free(list);
-			close(fd);
-			return 0;
-		}
-		disk_blockptr_from_blocknum(&list[i], blocknum, info);
-	}
-	close(fd);
+	fill_blocklist(list, extents, num, info);
+	free(extents);
 	*blocklist = list;
 	return count;
 }
@@ -29,6 +29,8 @@
 #include "disk.h"
 #include "error.h"
 #include "misc.h"
+#include "mvdump.h"
+#include "tape.h"
 
 
 /* Types of SCSI disk layouts */
@@ -388,115 +390,6 @@ ask_for_confirmation(const char* fmt, ...)
 }
 
 
-/* Write data from file FILENAME to file descriptor FD. Data will be written
- * in blocks of BLOCKSIZE bytes. Return 0 on success, non-zero otherwise. */
-static int
-write_tapefile(int fd, const char* filename, size_t blocksize)
-{
-	struct stat stats;
-	ssize_t written;
-	off_t offset;
-	size_t chunk;
-	void* buffer;
-	int read_fd;
-
-	if (stat(filename, &stats)) {
-		error_reason(strerror(errno));
-		return -1;
-	}
-	if (!S_ISREG(stats.st_mode)) {
-		error_reason("Not a regular file");
-		return -1;
-	}
-	buffer = misc_malloc(blocksize);
-	if (buffer == NULL)
-		return -1;
-	read_fd = open(filename, O_RDONLY);
-	if (fd == -1) {
-		error_reason(strerror(errno));
-		free(buffer);
-		return -1;
-	}
-	for (offset = 0; offset < stats.st_size; offset += chunk) {
-		chunk = stats.st_size - offset;
-		if (chunk > blocksize)
-			chunk = blocksize;
-		else
-			memset(buffer, 0, blocksize);
-		if (misc_read(read_fd, buffer, chunk)) {
-			close(read_fd);
-			free(buffer);
-			return -1;
-		}
-		written = write(fd, buffer, chunk);
-		if (written != (ssize_t) chunk) {
-			if (written == -1)
-				error_reason(strerror(errno));
-			else
-				error_reason("Write error");
-			close(read_fd);
-			free(buffer);
-			return -1;
-		}
-	}
-	close(read_fd);
-	free(buffer);
-	return 0;
-}
-
-
-/* Write SIZE bytes of data from memory location DATA to file descriptor FD.
- * Data will be written in blocks of BLOCKSIZE bytes. Return 0 on success,
- * non-zero otherwise. */
-static int
-write_tapebuffer(int fd, const char* data, size_t size, size_t blocksize)
-{
-	ssize_t written;
-	size_t offset;
-	size_t chunk;
-	void* buffer;
-
-	buffer = misc_malloc(blocksize);
-	if (buffer == NULL)
-		return -1;
-	for (offset = 0; offset < size; offset += chunk) {
-		chunk = size - offset;
-		if (chunk > blocksize)
-			chunk = blocksize;
-		else
-			memset(buffer, 0, blocksize);
-		memcpy(buffer, VOID_ADD(data, offset), chunk);
-		written = write(fd, buffer, chunk);
-		if (written != (ssize_t) chunk) {
-			if (written == -1)
-				error_reason(strerror(errno));
-			else
-				error_reason("Write error");
-			free(buffer);
-			return -1;
-		}
-	}
-	free(buffer);
-	return 0;
-}
-
-
-/* Write COUNT tapemarks to file handle FD. */
-static int
-write_tapemark(int fd, int count)
-{
-	struct mtop op;
-
-	op.mt_count = count;
-	op.mt_op = MTWEOF;
-	if (ioctl(fd, MTIOCTOP, &op) == -1) {
-		error_reason("Could not write tapemark");
-		return -1;
-	}
-	return 0;
-}
-
-
 #define IPL_TAPE_BLOCKSIZE	1024
 
 /* Install IPL record on tape device. */
@@ -505,6 +398,7 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 		   const char* ramdisk, address_t image_addr,
 		   address_t parm_addr, address_t initrd_addr)
 {
+	struct tape_stats stats;
 	void* buffer;
 	size_t size;
 	int rc;
@@ -524,14 +418,14 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 		free(buffer);
 		return -1;
 	}
-	if (rewind_tape(fd) != 0) {
+	if (tape_rewind(fd) != 0) {
 		error_text("Could not rewind tape device '%s'", device);
 		free(buffer);
 		close(fd);
 		return -1;
 	}
 	/* Write boot loader */
-	rc = DRY_RUN_FUNC(write_tapebuffer(fd, buffer, size,
+	rc = DRY_RUN_FUNC(tape_write_buffer(fd, buffer, size,
 		IPL_TAPE_BLOCKSIZE));
 	free(buffer);
 	if (rc) {
@@ -539,7 +433,7 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 		close(fd);
 		return rc;
 	}
-	rc = DRY_RUN_FUNC(write_tapemark(fd, 1));
+	rc = DRY_RUN_FUNC(tape_write_mark(fd, 1));
 	if (rc) {
 		error_text("Could not write boot loader to tape");
 		close(fd);
@@ -550,13 +444,16 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 		printf("  kernel image......: %s at 0x%llx\n", image,
 		       (unsigned long long) image_addr);
 	}
-	rc = DRY_RUN_FUNC(write_tapefile(fd, image, IPL_TAPE_BLOCKSIZE));
+	rc = DRY_RUN_FUNC(tape_write_file(fd, image, IPL_TAPE_BLOCKSIZE,
+					  &stats));
 	if (rc) {
 		error_text("Could not write image file '%s' to tape", image);
 		close(fd);
 		return rc;
 	}
-	rc = DRY_RUN_FUNC(write_tapemark(fd, 1));
+	if (verbose && !dry_run)
+		tape_print_stats(&stats);
+	rc = DRY_RUN_FUNC(tape_write_mark(fd, 1));
 	if (rc) {
 		error_text("Could not write boot loader to tape");
 		close(fd);
@@ -568,7 +465,7 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 			       parmline, (unsigned long long) parm_addr);
 		}
 		/* Write parameter line */
-		rc = DRY_RUN_FUNC(write_tapebuffer(fd, parmline,
+		rc = DRY_RUN_FUNC(tape_write_buffer(fd, parmline,
 			strlen(parmline), IPL_TAPE_BLOCKSIZE));
 		if (rc) {
 			error_text("Could not write parameter string to tape");
@@ -576,7 +473,7 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 			return rc;
 		}
 	}
-	rc = DRY_RUN_FUNC(write_tapemark(fd, 1));
+	rc = DRY_RUN_FUNC(tape_write_mark(fd, 1));
 	if (rc) {
 		error_text("Could not write boot loader to tape");
 		close(fd);
@@ -588,22 +485,24 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 			printf("  initial ramdisk...: %s at 0x%llx\n",
 			       ramdisk, (unsigned long long) initrd_addr);
 		}
-		rc = DRY_RUN_FUNC(write_tapefile(fd, ramdisk,
-			IPL_TAPE_BLOCKSIZE));
+		rc = DRY_RUN_FUNC(tape_write_file(fd, ramdisk,
+			IPL_TAPE_BLOCKSIZE, &stats));
 		if (rc) {
 			error_text("Could not write ramdisk file '%s' to tape",
 				   ramdisk);
 			close(fd);
 			return rc;
 		}
+		if (verbose && !dry_run)
+			tape_print_stats(&stats);
 	}
-	rc = DRY_RUN_FUNC(write_tapemark(fd, 1));
+	rc = DRY_RUN_FUNC(tape_write_mark(fd, 1));
 	if (rc) {
 		error_text("Could not write boot loader to tape");
 		close(fd);
 		return rc;
 	}
-	if (rewind_tape(fd) != 0) {
+	if (tape_rewind(fd) != 0) {
 		error_text("Could not rewind tape device '%s' to tape", device);
 		rc = -1;
 	}
@@ -611,32 +510,57 @@ install_tapeloader(const char* device, const char* image, const char* parmline,
 	return rc;
 }
 
+/* Return the number of bytes at the start of the dump partition described
+ * by INFO which are overwritten by the dump signature. */
+static unsigned int
+get_partition_start_size(struct disk_info* info)
+{
+	unsigned int bytes = 65536;
+
+	if (info->phy_block_size * info->phy_blocks < bytes)
+		bytes = info->phy_block_size * info->phy_blocks;
+	return bytes;
+}
+
+
+/* Return a buffer of 64k null bytes with dump signature at offset 512 if
+ * MV_DUMP_MAGIC is set, NULL if no buffer could be allocated. */
+static char*
+get_partition_start(int mv_dump_magic)
+{
+	char* buffer;
+	const char dump_magic[] = {0xa8, 0x19, 0x01, 0x73,
+		0x61, 0x8f, 0x23, 0xfd};
+
+	buffer = calloc(1, 65536);
+	if (buffer == NULL) {
+		error_text("Could not allocate buffer");
+		return NULL;
+	}
+	if (mv_dump_magic)
+		memcpy(VOID_ADD(buffer, 512), dump_magic, sizeof(dump_magic));
+	return buffer;
+}
+
+
 /* Write 64k null bytes with dump signature at offset 512 to
  * start of dump partition */
 static int
 overwrite_partition_start(int fd, struct disk_info* info, int mv_dump_magic)
 {
 	int rc;
-	unsigned int bytes = 65536;
 	char* buffer;
-	const char dump_magic[] = {0xa8, 0x19, 0x01, 0x73,
-		0x61, 0x8f, 0x23, 0xfd};
 
 	if (lseek(fd, info->geo.start * info->phy_block_size, SEEK_SET) !=
 	    (off_t) info->geo.start * info->phy_block_size) {
 		error_text("Could not seek on device");
 		return -1;
 	}
-	if (info->phy_block_size * info->phy_blocks < bytes)
-		bytes = info->phy_block_size * info->phy_blocks;
-	buffer = calloc(1, bytes);
-	if (buffer == NULL) {
-		error_text("Could not allocate buffer");
+	buffer = get_partition_start(mv_dump_magic);
+	if (buffer == NULL)
 		return -1;
-	}
-	if (mv_dump_magic)
-		memcpy(VOID_ADD(buffer, 512), dump_magic, sizeof(dump_magic));
-	rc = DRY_RUN_FUNC(misc_write(fd, buffer, bytes));
+	rc = DRY_RUN_FUNC(misc_write(fd, buffer,
+				     get_partition_start_size(info)));
 	free(buffer);
 	if (rc) {
 		error_text("Could not write dump signature");
@@ -799,66 +723,6 @@ install_dump_eckd_compatible(int fd, struct disk_info* info, uint64_t mem)
 }
 
 
-static int
-install_mvdump_eckd_compatible(int fd, struct disk_info* info, uint64_t mem,
-			       uint8_t force, struct mvdump_parm_table parm)
-{
-	struct boot_eckd_stage0 stage0;
-	struct boot_eckd_compatible_stage1 stage1;
-	void* buffer;
-	size_t size;
-	int rc;
-
-	/* Prepare stage 0 */
-	boot_init_eckd_compatible_stage0(&stage0);
-	/* Install stage 0 */
-	if (lseek(fd, 4, SEEK_SET) != 4) {
-		error_reason(strerror(errno));
-		error_text("Could not seek on device");
-		return -1;
-	}
-	rc = DRY_RUN_FUNC(misc_write(fd, &stage0,
-		sizeof(struct boot_eckd_stage0)));
-	if (rc) {
-		error_text("Could not write boot loader");
-		return rc;
-	}
-	/* Prepare stage 1 */
-	rc = boot_init_eckd_compatible_dump_stage1(&stage1, info, 1);
-	if (rc)
-		return rc;
-	/* Install stage 1 */
-	if (lseek(fd, info->phy_block_size + 4, SEEK_SET) !=
-	    info->phy_block_size + 4) {
-		error_reason(strerror(errno));
-		error_text("Could not seek on device");
-		return -1;
-	}
-	rc = DRY_RUN_FUNC(misc_write(fd, &stage1,
-			sizeof(struct boot_eckd_compatible_stage1)));
-	if (rc) {
-		error_text("Could not write dump record");
-		return rc;
-	}
-	/* Install stage 2 dump record */
-	if (lseek(fd, 3 * info->phy_block_size, SEEK_SET) !=
-	    3 * info->phy_block_size) {
-		error_text("Could not seek on device");
-		return -1;
-	}
-	rc = boot_get_eckd_mvdump_stage2(&buffer, &size, mem, force, parm);
-	if (rc)
-		return rc;
-	rc = DRY_RUN_FUNC(misc_write(fd, buffer, size));
-	free(buffer);
-	if (rc) {
-		error_text("Could not write dump record");
-		return rc;
-	}
-	return overwrite_partition_start(fd, info, 1);
-}
-
-
 static int
 install_dump_fba(int fd, struct disk_info* info, uint64_t mem)
 {
@@ -1062,13 +926,48 @@ install_dump(const char* device, struct job_target_data* target, uint64_t mem)
 }
 
 
+/* Describe the dump records to be written to multi-volume dump partition
+ * NAME described by INFO, which is accessed through device node DEVICE. */
+static void
+init_mvdump_volume(struct mvdump_volume* volume, const char* name,
+		   const char* device, struct disk_info* info,
+		   struct boot_eckd_stage0* stage0,
+		   struct boot_eckd_compatible_stage1* stage1,
+		   void* stage2, size_t stage2_size, char* start)
+{
+	memset(volume, 0, sizeof(struct mvdump_volume));
+	volume->device = device;
+	volume->name = name;
+	volume->write[0].offset = 4;
+	volume->write[0].data = stage0;
+	volume->write[0].size = sizeof(struct boot_eckd_stage0);
+	volume->write[1].offset = info->phy_block_size + 4;
+	volume->write[1].data = stage1;
+	volume->write[1].size = sizeof(struct boot_eckd_compatible_stage1);
+	volume->write[2].offset = (off_t) info->geo.start *
+				  info->phy_block_size;
+	volume->write[2].data = start;
+	volume->write[2].size = get_partition_start_size(info);
+	volume->write_count = 3;
+	volume->commit.offset = 3 * info->phy_block_size;
+	volume->commit.data = stage2;
+	volume->commit.size = stage2_size;
+}
+
+
 int
 install_mvdump(char* const device[], struct job_target_data* target, int count,
 	       uint64_t mem, uint8_t force)
 {
 	struct disk_info* info[MAX_DUMP_VOLUMES] = {0};
+	char* tempdev[MAX_DUMP_VOLUMES] = {0};
+	struct boot_eckd_compatible_stage1 stage1[MAX_DUMP_VOLUMES];
+	struct mvdump_volume volume[MAX_DUMP_VOLUMES];
+	struct boot_eckd_stage0 stage0;
 	struct mvdump_parm_table parm;
-	char* tempdev;
+	void* stage2 = NULL;
+	size_t stage2_size;
+	char* start = NULL;
 	uint64_t total_size = 0;
 	int rc = 0, i, j, fd;
 	struct timeval time;
@@ -1122,6 +1021,14 @@ install_mvdump(char* const device[], struct job_target_data* target, int count,
 				rc = -1;
 				goto out;
 			}
+			/* Volumes are prepared concurrently */
+			if (info[j]->device == info[i]->device) {
+				error_text("Dump targets '%s' and '%s' are "
+					   "on the same device.",
+					   device[i], device[j]);
+				rc = -1;
+				goto out;
+			}
 		}
 		/* Make sure target device belongs to subchannel set 0 */
 		rc = disk_check_subchannel_set(info[i]->devno,
@@ -1166,33 +1073,45 @@ install_mvdump(char* const device[], struct job_target_data* target, int count,
 		if (rc)
 			goto out;
 	}
+	/* Prepare dump records of all volumes. Stage 2 contains the volume
+	 * parameter table and is written last to commit the dump volumes. */
+	boot_init_eckd_compatible_stage0(&stage0);
+	rc = boot_get_eckd_mvdump_stage2(&stage2, &stage2_size, mem, force,
+					 parm);
+	if (rc)
+		goto out;
+	start = get_partition_start(1);
+	if (start == NULL) {
+		rc = -1;
+		goto out;
+	}
 	for (i = 0; i < count; i++) {
-		rc = misc_temp_dev(info[i]->device, 1, &tempdev);
-		if (rc) {
-			rc = -1;
+		rc = boot_init_eckd_compatible_dump_stage1(&stage1[i], info[i],
+							   1);
+		if (rc)
 			goto out;
-		}
-		fd = open(tempdev, O_RDWR);
-		if (fd == -1) {
-			error_text("Could not open temporary device node '%s'",
-				   tempdev);
-			misc_free_temp_dev(tempdev);
+		rc = misc_temp_dev(info[i]->device, 1, &tempdev[i]);
+		if (rc) {
 			rc = -1;
 			goto out;
 		}
+		init_mvdump_volume(&volume[i], device[i], tempdev[i], info[i],
+				   &stage0, &stage1[i], stage2, stage2_size,
+				   start);
 		if (verbose)
 			printf("Installing dump record on target partition "
 			       "'%s'\n", device[i]);
-		rc = install_mvdump_eckd_compatible(fd, info[i], mem, force,
-						    parm);
-		misc_free_temp_dev(tempdev);
-		close(fd);
-		if (rc)
-			goto out;
 	}
+	if (!dry_run)
+		rc = mvdump_write_volumes(volume, count);
 out:
-	for (i = 0; i < count; i++)
+	for (i = 0; i < count; i++) {
+		if (tempdev[i] != NULL)
+			misc_free_temp_dev(tempdev[i]);
 		if (info[i] != NULL)
 			disk_free_info(info[i]);
+	}
+	free(stage2);
+	free(start);
 	return rc;
 }
@@ -0,0 +1,433 @@
+/*
+ * s390-tools/zipl/src/manifest.c
+ *   Functions to handle the manifest of the bootmap file.
+ *
+ * The manifest records which component files were added to the bootmap
+ * file and where their data and segment tables are located. A later zipl
+ * run uses it to reuse unchanged components instead of adding them again.
+ *
+ * Copyright IBM Corp. 2009.
+ */
+
+#include "manifest.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "misc.h"
+
+
+#define MANIFEST_MAGIC		"zipl-manifest"
+#define MANIFEST_VERSION	1
+#define MANIFEST_TEMPLATE	".XXXXXX"
+
+
+/* Create an empty manifest for a bootmap on the disk specified by INFO.
+ * Return a pointer to the manifest on success, NULL otherwise. */
+struct manifest*
+manifest_new(struct disk_info* info)
+{
+	struct manifest* manifest;
+
+	manifest = (struct manifest *) misc_malloc(sizeof(struct manifest));
+	if (manifest == NULL)
+		return NULL;
+	memset(manifest, 0, sizeof(struct manifest));
+	manifest->device = info->device;
+	manifest->type = info->type;
+	manifest->phy_block_size = info->phy_block_size;
+	manifest->start = info->geo.start;
+	return manifest;
+}
+
+
+static void
+free_entry(struct manifest_entry* entry)
+{
+	free(entry->path);
+	free(entry->bootmap_ext);
+	free(entry->file_ext);
+}
+
+
+void
+manifest_free(struct manifest* manifest)
+{
+	int i;
+
+	if (manifest == NULL)
+		return;
+	for (i = 0; i < manifest->num; i++)
+		free_entry(&manifest->entry[i]);
+	free(manifest->entry);
+	free(manifest);
+}
+
+
+/* Return a copy of the NUM extents in EXTENTS or NULL if there are no
+ * extents or no memory is available. */
+static struct disk_extent*
+copy_extents(struct disk_extent* extents, int num)
+{
+	struct disk_extent* copy;
+
+	if (num == 0)
+		return NULL;
+	copy = (struct disk_extent *) misc_malloc(sizeof(struct disk_extent) *
+						  num);
+	if (copy != NULL)
+		memcpy(copy, extents, sizeof(struct disk_extent) * num);
+	return copy;
+}
+
+
+/* Add a copy of ENTRY to MANIFEST. Return 0 on success, non-zero
+ * otherwise. */
+int
+manifest_add(struct manifest* manifest, struct manifest_entry* entry)
+{
+	struct manifest_entry* list;
+	struct manifest_entry* new;
+
+	list = (struct manifest_entry *) realloc(manifest->entry,
+			sizeof(struct manifest_entry) * (manifest->num + 1));
+	if (list == NULL) {
+		error_reason(strerror(errno));
+		return -1;
+	}
+	manifest->entry = list;
+	new = &list[manifest->num];
+	*new = *entry;
+	new->path = misc_strdup(entry->path);
+	new->bootmap_ext = copy_extents(entry->bootmap_ext, entry->bootmap_num);
+	new->file_ext = copy_extents(entry->file_ext, entry->file_num);
+	if ((new->path == NULL) ||
+	    (entry->bootmap_num && (new->bootmap_ext == NULL)) ||
+	    (entry->file_num && (new->file_ext == NULL))) {
+		free_entry(new);
+		return -1;
+	}
+	manifest->num++;
+	return 0;
+}
+
+
+/* Return the entry for component file PATH at OFFSET which was added with
+ * ADD_FILES set as specified or NULL if there is no such entry. */
+struct manifest_entry*
+manifest_find(struct manifest* manifest, const char* path, off_t offset,
+	      int add_files)
+{
+	int i;
+
+	if (manifest == NULL)
+		return NULL;
+	for (i = 0; i < manifest->num; i++) {
+		if ((manifest->entry[i].offset == offset) &&
+		    (manifest->entry[i].add_files == add_files) &&
+		    (strcmp(manifest->entry[i].path, path) == 0))
+			return &manifest->entry[i];
+	}
+	return NULL;
+}
+
+
+/* Return non-zero if MANIFEST was created for a bootmap on the disk
+ * specified by INFO, 0 otherwise. */
+int
+manifest_check_target(struct manifest* manifest, struct disk_info* info)
+{
+	return (manifest->device == info->device) &&
+	       (manifest->type == (int) info->type) &&
+	       (manifest->phy_block_size == info->phy_block_size) &&
+	       (manifest->start == (uint64_t) info->geo.start);
+}
+
+
+/* Return non-zero if the A_NUM extents in A describe the same disk blocks
+ * as the B_NUM extents in B, 0 otherwise. */
+int
+manifest_equal_extents(struct disk_extent* a, int a_num,
+		       struct disk_extent* b, int b_num)
+{
+	int i;
+
+	if (a_num != b_num)
+		return 0;
+	for (i = 0; i < a_num; i++) {
+		if ((a[i].logical != b[i].logical) ||
+		    (a[i].physical != b[i].physical) ||
+		    (a[i].count != b[i].count))
+			return 0;
+	}
+	return 1;
+}
+
+
+/* Return the 64 bit FNV-1a hash of SIZE bytes at DATA. */
+uint64_t
+manifest_hash(const void* data, size_t size)
+{
+	const unsigned char* p = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+/* Return the next line of the buffer at *POS and advance *POS to the
+ * following line. Return NULL if there are no more lines. */
+static char*
+next_line(char** pos)
+{
+	char* line;
+	char* end;
+
+	line = *pos;
+	if (*line == 0)
+		return NULL;
+	end = strchr(line, '\n');
+	if (end != NULL) {
+		*end = 0;
+		*pos = end + 1;
+	} else {
+		*pos = line + strlen(line);
+	}
+	return line;
+}
+
+
+/* Read NUM extent lines from the buffer at *POS into a newly allocated
+ * list. Return 0 on success, non-zero otherwise. */
+static int
+read_extents(char** pos, int num, struct disk_extent** extents)
+{
+	unsigned long long logical, physical, count;
+	struct disk_extent* list;
+	char* line;
+	int i;
+
+	*extents = NULL;
+	if (num == 0)
+		return 0;
+	list = (struct disk_extent *) misc_malloc(sizeof(struct disk_extent) *
+						  num);
+	if (list == NULL)
+		return -1;
+	for (i = 0; i < num; i++) {
+		line = next_line(pos);
+		if ((line == NULL) ||
+		    (sscanf(line, "extent %llu %llu %llu", &logical, &physical,
+			    &count) != 3)) {
+			free(list);
+			return -1;
+		}
+		list[i].logical = logical;
+		list[i].physical = physical;
+		list[i].count = count;
+	}
+	*extents = list;
+	return 0;
+}
+
+
+/* Read the manifest from file FILENAME. Upon success, return 0 and set
+ * MANIFEST to point to the manifest. Return non-zero if the file does not
+ * exist or is not a valid manifest. */
+int
+manifest_read(const char* filename, struct manifest** manifest)
+{
+	unsigned long long v[12];
+	struct manifest_entry entry;
+	struct manifest* new;
+	char* buffer;
+	char* pos;
+	char* line;
+	int version;
+	int path_pos;
+	int rc;
+
+	if (misc_read_file(filename, &buffer, NULL, 1))
+		return -1;
+	new = (struct manifest *) misc_malloc(sizeof(struct manifest));
+	if (new == NULL) {
+		free(buffer);
+		return -1;
+	}
+	memset(new, 0, sizeof(struct manifest));
+	pos = buffer;
+	rc = -1;
+	/* Header */
+	line = next_line(&pos);
+	if ((line == NULL) ||
+	    (sscanf(line, MANIFEST_MAGIC " %d", &version) != 1) ||
+	    (version != MANIFEST_VERSION))
+		goto out;
+	line = next_line(&pos);
+	if ((line == NULL) ||
+	    (sscanf(line, "target %llu %llu %llu %llu", &v[0], &v[1], &v[2],
+		    &v[3]) != 4))
+		goto out;
+	new->device = v[0];
+	new->type = v[1];
+	new->phy_block_size = v[2];
+	new->start = v[3];
+	line = next_line(&pos);
+	if ((line == NULL) ||
+	    (sscanf(line, "bootmap %llu %llu %llu %llu %llu", &v[0], &v[1],
+		    &v[2], &v[3], &v[4]) != 5))
+		goto out;
+	new->ino = v[0];
+	new->size = v[1];
+	new->live = v[2];
+	new->empty_first = v[3];
+	new->empty_block = v[4];
+	/* Components */
+	while ((line = next_line(&pos)) != NULL) {
+		path_pos = 0;
+		if ((sscanf(line, "component %llu %llu %llu %llu %llu %llu "
+			    "%llu %llu %llu %llu %llu %llu %n", &v[0], &v[1],
+			    &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8],
+			    &v[9], &v[10], &v[11], &path_pos) != 12) ||
+		    (path_pos == 0) || (line[path_pos] == 0))
+			goto out;
+		memset(&entry, 0, sizeof(entry));
+		entry.add_files = v[0];
+		entry.offset = v[1];
+		entry.size = v[2];
+		entry.mtime = v[3];
+		entry.ino = v[4];
+		entry.hash = v[5];
+		entry.first = v[6];
+		entry.count = v[7];
+		entry.segment = v[8];
+		entry.loc_size = v[9];
+		entry.bootmap_num = v[10];
+		entry.file_num = v[11];
+		entry.path = &line[path_pos];
+		if (read_extents(&pos, entry.bootmap_num, &entry.bootmap_ext))
+			goto out;
+		if (read_extents(&pos, entry.file_num, &entry.file_ext)) {
+			free(entry.bootmap_ext);
+			goto out;
+		}
+		rc = manifest_add(new, &entry);
+		free(entry.bootmap_ext);
+		free(entry.file_ext);
+		if (rc)
+			goto out;
+		rc = -1;
+	}
+	rc = 0;
+out:
+	free(buffer);
+	if (rc) {
+		error_reason("Invalid manifest file '%s'", filename);
+		manifest_free(new);
+		return rc;
+	}
+	*manifest = new;
+	return 0;
+}
+
+
+static void
+write_extents(FILE* file, struct disk_extent* extents, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		fprintf(file, "extent %llu %llu %llu\n",
+			(unsigned long long) extents[i].logical,
+			(unsigned long long) extents[i].physical,
+			(unsigned long long) extents[i].count);
+}
+
+
+/* Write MANIFEST to file FILENAME. The file is replaced atomically.
+ * Return 0 on success, non-zero otherwise. */
+int
+manifest_write(const char* filename, struct manifest* manifest)
+{
+	struct manifest_entry* entry;
+	FILE* file;
+	char* tempname;
+	int fd;
+	int rc;
+	int i;
+
+	tempname = misc_malloc(strlen(filename) + sizeof(MANIFEST_TEMPLATE));
+	if (tempname == NULL)
+		return -1;
+	sprintf(tempname, "%s" MANIFEST_TEMPLATE, filename);
+	fd = mkstemp(tempname);
+	if (fd == -1) {
+		error_reason(strerror(errno));
+		free(tempname);
+		return -1;
+	}
+	file = fdopen(fd, "w");
+	if (file == NULL) {
+		error_reason(strerror(errno));
+		close(fd);
+		goto out_remove;
+	}
+	fprintf(file, MANIFEST_MAGIC " %d\n", MANIFEST_VERSION);
+	fprintf(file, "target %llu %d %d %llu\n",
+		(unsigned long long) manifest->device, manifest->type,
+		manifest->phy_block_size,
+		(unsigned long long) manifest->start);
+	fprintf(file, "bootmap %llu %llu %llu %llu %llu\n",
+		(unsigned long long) manifest->ino,
+		(unsigned long long) manifest->size,
+		(unsigned long long) manifest->live,
+		(unsigned long long) manifest->empty_first,
+		(unsigned long long) manifest->empty_block);
+	for (i = 0; i < manifest->num; i++) {
+		entry = &manifest->entry[i];
+		fprintf(file, "component %d %llu %llu %llu %llu %llu %llu "
+			"%llu %llu %llu %d %d %s\n", entry->add_files,
+			(unsigned long long) entry->offset,
+			(unsigned long long) entry->size,
+			(unsigned long long) entry->mtime,
+			(unsigned long long) entry->ino,
+			(unsigned long long) entry->hash,
+			(unsigned long long) entry->first,
+			(unsigned long long) entry->count,
+			(unsigned long long) entry->segment,
+			(unsigned long long) entry->loc_size,
+			entry->bootmap_num, entry->file_num, entry->path);
+		write_extents(file, entry->bootmap_ext, entry->bootmap_num);
+		write_extents(file, entry->file_ext, entry->file_num);
+	}
+	if ((fflush(file) != 0) || (fsync(fd) != 0)) {
+		error_reason(strerror(errno));
+		fclose(file);
+		goto out_remove;
+	}
+	if (fclose(file) != 0) {
+		error_reason(strerror(errno));
+		goto out_remove;
+	}
+	rc = rename(tempname, filename);
+	if (rc) {
+		error_reason(strerror(errno));
+		goto out_remove;
+	}
+	free(tempname);
+	return 0;
+
+out_remove:
+	remove(tempname);
+	free(tempname);
+	return -1;
+}
@@ -12,6 +12,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -202,16 +203,47 @@ misc_read_special_file(const char* filename, char** buffer, size_t* size,
 }
 
 
-/* Get contents of file identified by FILENAME and fill in the respective
- * fields of FILE. Return 0 on success, non-zero otherwise. */
+/* Map contents of file identified by FILENAME to memory and fill in the
+ * respective fields of FILE. Return 0 on success, non-zero otherwise. */
 int
 misc_get_file_buffer(const char* filename, struct misc_file_buffer* file)
 {
-	int rc;
+	struct stat stats;
+	void* data;
+	int fd;
 
-	rc = misc_read_file(filename, &file->buffer, &file->length, 0);
+	file->buffer = NULL;
 	file->pos = 0;
-	return rc;
+	file->length = 0;
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		error_reason(strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &stats)) {
+		error_reason(strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(stats.st_mode)) {
+		error_reason("Not a regular file");
+		close(fd);
+		return -1;
+	}
+	/* Empty files cannot be mapped */
+	if (stats.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+	data = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		error_reason(strerror(errno));
+		return -1;
+	}
+	file->buffer = (char *) data;
+	file->length = stats.st_size;
+	return 0;
 }
 
 
@@ -220,7 +252,7 @@ void
 misc_free_file_buffer(struct misc_file_buffer* file)
 {
 	if (file->buffer != NULL) {
-		free(file->buffer);
+		munmap(file->buffer, file->length);
 		file->buffer = NULL;
 		file->pos = 0;
 		file->length = 0;
@@ -0,0 +1,383 @@
+/*
+ * s390-tools/zipl/src/mvdump.c
+ *   Functions to write the dump records of a multi-volume dump.
+ *
+ * All volumes are prepared concurrently with one thread per volume. The
+ * record which contains the volume parameter table is written to the
+ * volumes only after all other records were written and verified on all
+ * volumes. The previous contents of all records are saved first and
+ * restored on all volumes if any step fails. Any file can be used as a
+ * volume, which allows testing with regular files in place of DASD
+ * partitions.
+ *
+ * Copyright IBM Corp. 2009.
+ */
+
+#define _GNU_SOURCE	/* for O_DIRECT */
+
+#include "mvdump.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+
+
+/* Alignment of buffers, offsets and sizes for direct I/O */
+#define MVDUMP_ALIGN	4096
+
+
+/* Set the result of preparing VOLUME to ERROR and TEXT. Return -1. Only
+ * the first error is kept. error_reason() and error_text() are not used
+ * in threads since they store their messages in static buffers. */
+static int
+set_error(struct mvdump_volume* volume, int error, const char* text)
+{
+	if (volume->text == NULL) {
+		volume->error = error;
+		volume->text = text;
+	}
+	return -1;
+}
+
+
+/* Read SIZE bytes at OFFSET from file descriptor FD to BUFFER. Return 0 on
+ * success, an error number otherwise. */
+static int
+read_data(int fd, char* buffer, size_t size, off_t offset)
+{
+	size_t done;
+	ssize_t rc;
+
+	for (done = 0; done < size; done += rc) {
+		rc = pread(fd, buffer + done, size - done, offset + done);
+		if (rc == -1) {
+			if (errno == EINTR) {
+				rc = 0;
+				continue;
+			}
+			return errno;
+		}
+		if (rc == 0)
+			return EIO;
+	}
+	return 0;
+}
+
+
+/* Write SIZE bytes of DATA to file descriptor FD at OFFSET. Return 0 on
+ * success, an error number otherwise. */
+static int
+write_data(int fd, const char* data, size_t size, off_t offset)
+{
+	size_t done;
+	ssize_t rc;
+
+	for (done = 0; done < size; done += rc) {
+		rc = pwrite(fd, data + done, size - done, offset + done);
+		if (rc == -1) {
+			if (errno == EINTR) {
+				rc = 0;
+				continue;
+			}
+			return errno;
+		}
+		if (rc == 0)
+			return EIO;
+	}
+	return 0;
+}
+
+
+/* Open DEVICE for reading with direct I/O so that data is read from the
+ * device and not from the page cache. Files on file systems without
+ * direct I/O support are opened without it. */
+static int
+open_direct(const char* device)
+{
+	int fd;
+
+	fd = open(device, O_RDONLY | O_DIRECT);
+	if (fd == -1 && errno == EINVAL)
+		fd = open(device, O_RDONLY);
+	return fd;
+}
+
+
+/* Check that record WRITE was written to file descriptor FD which was
+ * opened with open_direct(). Direct I/O requires aligned buffers, offsets
+ * and sizes, so the aligned area containing the record is read. Return 0
+ * on success, an error number otherwise. */
+static int
+verify_record(int fd, struct mvdump_write* write)
+{
+	void* buffer;
+	off_t start;
+	size_t size;
+	size_t need;
+	size_t done;
+	ssize_t rc;
+	int error;
+
+	start = write->offset & ~((off_t) MVDUMP_ALIGN - 1);
+	need = write->offset - start + write->size;
+	size = (need + MVDUMP_ALIGN - 1) & ~((size_t) MVDUMP_ALIGN - 1);
+	if (posix_memalign(&buffer, MVDUMP_ALIGN, size))
+		return ENOMEM;
+	error = 0;
+	/* The aligned area may extend beyond the end of a regular file */
+	for (done = 0; done < need; done += rc) {
+		rc = pread(fd, (char *) buffer + done, size - done,
+			   start + done);
+		if (rc == -1) {
+			if (errno == EINTR) {
+				rc = 0;
+				continue;
+			}
+			error = errno;
+			break;
+		}
+		if (rc == 0) {
+			error = EIO;
+			break;
+		}
+	}
+	if (error == 0 && memcmp((char *) buffer + (write->offset - start),
+				 write->data, write->size) != 0)
+		error = EIO;
+	free(buffer);
+	return error;
+}
+
+
+/* Return the number of bytes needed to save the records of VOLUME. */
+static size_t
+backup_size(struct mvdump_volume* volume)
+{
+	size_t size;
+	int i;
+
+	size = volume->commit.size;
+	for (i = 0; i < volume->write_count; i++)
+		size += volume->write[i].size;
+	return size;
+}
+
+
+/* Save the previous contents of all records of VOLUME. Return 0 on success,
+ * non-zero otherwise. */
+static int
+backup_volume(struct mvdump_volume* volume)
+{
+	char* data;
+	int error;
+	int fd;
+	int i;
+
+	volume->backup = malloc(backup_size(volume));
+	if (volume->backup == NULL)
+		return set_error(volume, ENOMEM, "Could not save dump target");
+	fd = open(volume->device, O_RDONLY);
+	if (fd == -1)
+		return set_error(volume, errno, "Could not open dump target");
+	data = volume->backup;
+	error = 0;
+	for (i = 0; i < volume->write_count; i++) {
+		error = read_data(fd, data, volume->write[i].size,
+				  volume->write[i].offset);
+		if (error)
+			break;
+		data += volume->write[i].size;
+	}
+	if (!error)
+		error = read_data(fd, data, volume->commit.size,
+				  volume->commit.offset);
+	close(fd);
+	if (error)
+		return set_error(volume, error, "Could not save dump target");
+	return 0;
+}
+
+
+/* Restore the previous contents of all records of VOLUME if it was
+ * changed. Return 0 on success, non-zero otherwise. */
+static int
+restore_volume(struct mvdump_volume* volume)
+{
+	const char* data;
+	int error;
+	int fd;
+	int i;
+
+	if (!volume->changed)
+		return 0;
+	fd = open(volume->device, O_RDWR);
+	if (fd == -1)
+		return -1;
+	data = volume->backup;
+	error = 0;
+	for (i = 0; i < volume->write_count && !error; i++) {
+		error = write_data(fd, data, volume->write[i].size,
+				   volume->write[i].offset);
+		data += volume->write[i].size;
+	}
+	if (!error)
+		error = write_data(fd, data, volume->commit.size,
+				   volume->commit.offset);
+	if (!error && fsync(fd))
+		error = errno;
+	if (close(fd) && !error)
+		error = errno;
+	if (error)
+		return -1;
+	volume->changed = 0;
+	return 0;
+}
+
+
+/* Write the NUM records in WRITE to VOLUME and verify them. Return 0 on
+ * success, non-zero otherwise. */
+static int
+write_volume(struct mvdump_volume* volume, struct mvdump_write* write,
+	     int num)
+{
+	int error;
+	int fd;
+	int i;
+
+	fd = open(volume->device, O_RDWR);
+	if (fd == -1)
+		return set_error(volume, errno, "Could not open dump target");
+	volume->changed = 1;
+	for (i = 0; i < num; i++) {
+		error = write_data(fd, write[i].data, write[i].size,
+				   write[i].offset);
+		if (error) {
+			close(fd);
+			return set_error(volume, error,
+					 "Could not write dump record to");
+		}
+	}
+	if (fsync(fd)) {
+		close(fd);
+		return set_error(volume, errno, "Could not sync dump target");
+	}
+	if (close(fd))
+		return set_error(volume, errno, "Could not close dump target");
+	fd = open_direct(volume->device);
+	if (fd == -1)
+		return set_error(volume, errno, "Could not open dump target");
+	for (i = 0; i < num; i++) {
+		error = verify_record(fd, &write[i]);
+		if (error) {
+			close(fd);
+			return set_error(volume, error,
+					 "Could not verify dump record on");
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+
+static void*
+prepare_volume(void* data)
+{
+	struct mvdump_volume* volume = data;
+
+	if (backup_volume(volume) == 0)
+		write_volume(volume, volume->write, volume->write_count);
+	return NULL;
+}
+
+
+/* Restore the previous contents of the records of all COUNT volumes in
+ * VOLUME which were changed. */
+static void
+rollback_volumes(struct mvdump_volume* volume, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (restore_volume(&volume[i]))
+			fprintf(stderr, "Warning: Could not restore previous "
+				"dump records on '%s'\n", volume[i].name);
+}
+
+
+/* Report the error of VOLUME. Return -1. */
+static int
+report_error(struct mvdump_volume* volume)
+{
+	error_reason(strerror(volume->error));
+	error_text("%s '%s'", volume->text, volume->name);
+	return -1;
+}
+
+
+/* Write the records of COUNT dump volumes in VOLUME. The WRITE records of
+ * all volumes are written and verified concurrently. Only if this worked
+ * for all volumes, the COMMIT record is written to each volume. If any
+ * step fails, the previous contents of the records are restored on all
+ * volumes. The volumes must not share a device. Return 0 on success,
+ * non-zero otherwise. */
+int
+mvdump_write_volumes(struct mvdump_volume* volume, int count)
+{
+	struct mvdump_volume* failed;
+	pthread_t* thread;
+	int* started;
+	int rc;
+	int i;
+
+	thread = calloc(count, sizeof(pthread_t));
+	started = calloc(count, sizeof(int));
+	if (thread == NULL || started == NULL) {
+		free(thread);
+		free(started);
+		error_reason(strerror(ENOMEM));
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		volume[i].error = 0;
+		volume[i].text = NULL;
+		volume[i].backup = NULL;
+		volume[i].changed = 0;
+	}
+	for (i = 0; i < count; i++) {
+		/* Prepare volume in this thread if no thread is available */
+		if (pthread_create(&thread[i], NULL, prepare_volume,
+				   &volume[i]) == 0)
+			started[i] = 1;
+		else
+			prepare_volume(&volume[i]);
+	}
+	for (i = 0; i < count; i++)
+		if (started[i])
+			pthread_join(thread[i], NULL);
+	free(thread);
+	free(started);
+	failed = NULL;
+	for (i = 0; i < count && failed == NULL; i++)
+		if (volume[i].text != NULL)
+			failed = &volume[i];
+	/* Commit parameter table */
+	for (i = 0; i < count && failed == NULL; i++)
+		if (write_volume(&volume[i], &volume[i].commit, 1))
+			failed = &volume[i];
+	rc = 0;
+	if (failed != NULL) {
+		rollback_volumes(volume, count);
+		rc = report_error(failed);
+	}
+	for (i = 0; i < count; i++) {
+		free(volume[i].backup);
+		volume[i].backup = NULL;
+	}
+	return rc;
+}
@@ -86,6 +86,24 @@ static const struct {
 	{ "tape", scan_keyword_tape}
 };
 
+/* Perfect hash of the keyword names in keyword_list. Keywords are
+ * identified by their length and last two characters. */
+#define KEYWORD_HASH_SIZE	32
+#define KEYWORD_MIN_LENGTH	4
+#define KEYWORD_MAX_LENGTH	15
+
+static const signed char keyword_hash_table[KEYWORD_HASH_SIZE] = {
+	-1, -1, -1, 18, 13,  8, -1, 12, -1, 11, -1,  7, -1, 15, -1, -1,
+	-1,  6, 16, 14, -1,  9, 10,  1, -1,  5, -1,  2,  0,  4, 17,  3
+};
+
+static int
+keyword_hash(const char* name, int length)
+{
+	return (length + 3 * (unsigned char) name[length - 1] +
+		15 * (unsigned char) name[length - 2]) % KEYWORD_HASH_SIZE;
+}
+
 /* Retrieve name of keyword identified by ID. */
 char *
 scan_keyword_name(enum scan_keyword_id id)
@@ -99,332 +117,300 @@ scan_keyword_name(enum scan_keyword_id id)
 }
 
 
-/* Advance the current file pointer of file buffer FILE until the current
- * character is no longer a blank. Return 0 if at least one blank
- * character was encountered, non-zero otherwise. */
-static int
-skip_blanks(struct misc_file_buffer* file)
-{
-	int rc;
-
-	rc = -1;
-	for (; isblank(misc_get_char(file, 0)); file->pos++)
-		rc = 0;
-	return rc;
-}
+/* Current line of the configuration file. Lines are scanned within the
+ * mapped file, END points to the newline character or end of file. */
+struct scan_line {
+	const char* pos;
+	const char* end;
+	int number;
+};
 
 
-/* Advance the current file position to beginning of next line in file buffer
- * FILE or to end of file. */
+/* Advance the current position of LINE until the current character is no
+ * longer a blank. */
 static void
-skip_line(struct misc_file_buffer* file)
+skip_blanks(struct scan_line* line)
 {
-	for (;; file->pos++) {
-		switch (misc_get_char(file, 0)) {
-		case '\n':
-			file->pos++;
-			return;
-		case EOF:
-			return;
-		}
-	}
+	while ((line->pos < line->end) && isblank(*line->pos))
+		line->pos++;
 }
 
 
-/* Skip trailing blanks of line. On success, return zero and set the file
- * buffer position to beginning of next line or EOF. Return non-zero if
- * non-blank characters were found before end of line. */
+/* Skip trailing blanks of LINE. Return non-zero if non-blank characters
+ * were found before end of line, zero otherwise. */
 static int
-skip_trailing_blanks(struct misc_file_buffer* file)
+skip_trailing_blanks(struct scan_line* line)
 {
-	int current;
+	skip_blanks(line);
+	return (line->pos < line->end) ? -1 : 0;
+}
 
-	for (;; file->pos++) {
-		current = misc_get_char(file, 0);
-		if (current == '\n') {
-			file->pos++;
-			return 0;
-		} else if (current == EOF)
-			return 0;
-		else if (!isblank(current))
-			return -1;
-	}
+
+/* Return a newly allocated copy of the LENGTH characters at START or NULL
+ * if no memory is available. */
+static char*
+copy_string(const char* start, size_t length)
+{
+	char* string;
+
+	string = (char *) misc_malloc(length + 1);
+	if (string == NULL)
+		return NULL;
+	memcpy(string, start, length);
+	string[length] = 0;
+	return string;
 }
 
 
 static int
-scan_section_heading(struct misc_file_buffer* file, struct scan_token* token,
-		     int line)
+scan_section_heading(struct scan_line* line, struct scan_token* token)
 {
-	int start_pos;
-	int end_pos;
-	int current;
+	const char* start;
+	const char* end;
 	char* name;
 
-	for (start_pos=file->pos; misc_get_char(file, 0) != ']'; file->pos++) {
-		current = misc_get_char(file, 0);
-		switch (current) {
-		case EOF:
-		case '\n':
-			error_reason("Line %d: unterminated section heading",
-				     line);
+	for (start = line->pos; (line->pos < line->end) &&
+	     (*line->pos != ']'); line->pos++) {
+		if (!(isalnum(*line->pos) || ispunct(*line->pos))) {
+			error_reason("Line %d: invalid character in "
+				     "section name", line->number);
 			return -1;
-		default:
-			if (!(isalnum(current) || ispunct(current))) {
-				error_reason("Line %d: invalid character in "
-					     "section name", line);
-				return -1;
-			}
 		}
 	}
-	end_pos = file->pos;
-	if (end_pos == start_pos) {
-		error_reason("Line %d: empty section name", line);
+	if (line->pos == line->end) {
+		error_reason("Line %d: unterminated section heading",
+			     line->number);
 		return -1;
 	}
-	file->pos++;
-	if (skip_trailing_blanks(file)) {
+	end = line->pos;
+	if (end == start) {
+		error_reason("Line %d: empty section name", line->number);
+		return -1;
+	}
+	line->pos++;
+	if (skip_trailing_blanks(line)) {
 		error_reason("Line %d: unexpected characters after section "
-			     "name", line);
+			     "name", line->number);
 		return -1;
 	}
-	name = (char *) misc_malloc(end_pos - start_pos + 1);
+	name = copy_string(start, end - start);
 	if (name == NULL)
 		return -1;
-	memcpy(name, &file->buffer[start_pos], end_pos - start_pos);
-	name[end_pos - start_pos] = 0;
 	token->id = scan_id_section_heading;
-	token->line = line;
+	token->line = line->number;
 	token->content.section.name = name;
 	return 0;
 }
 
 
 static int
-scan_menu_heading(struct misc_file_buffer* file, struct scan_token* token,
-		  int line)
+scan_menu_heading(struct scan_line* line, struct scan_token* token)
 {
-	int start_pos;
-	int end_pos;
-	int current;
+	const char* start;
+	const char* end;
 	char* name;
 
-	for (start_pos=file->pos; ; file->pos++) {
-		current = misc_get_char(file, 0);
-		if ((current == EOF) || (current == '\n'))
-			break;
-		else if (isblank(current))
-			break;
-		else if (!isalnum(current)) {
+	for (start = line->pos; (line->pos < line->end) &&
+	     !isblank(*line->pos); line->pos++) {
+		if (!isalnum(*line->pos)) {
 			error_reason("Line %d: invalid character in menu name ",
-				     line);
+				     line->number);
 			return -1;
 		}
 	}
-	end_pos = file->pos;
-	if (skip_trailing_blanks(file)) {
+	end = line->pos;
+	if (skip_trailing_blanks(line)) {
 		error_reason("Line %d: blanks not allowed in menu name",
-			     line);
+			     line->number);
 		return -1;
 	}
-	if (end_pos == start_pos) {
-		error_reason("Line %d: empty menu name", line);
+	if (end == start) {
+		error_reason("Line %d: empty menu name", line->number);
 		return -1;
 	}
-	name = (char *) misc_malloc(end_pos - start_pos + 1);
+	name = copy_string(start, end - start);
 	if (name == NULL)
 		return -1;
-	memcpy(name, &file->buffer[start_pos], end_pos - start_pos);
-	name[end_pos - start_pos] = 0;
 	token->id = scan_id_menu_heading;
-	token->line = line;
+	token->line = line->number;
 	token->content.menu.name = name;
 	return 0;
 }
 
 
 static int
-scan_number(struct misc_file_buffer* file, int* number, int line)
+scan_number(struct scan_line* line, int* number)
 {
-	int start_pos;
-	int old_number;
-	int new_number;
-
-	old_number = 0;
-	new_number = 0;
-	start_pos = file->pos;
-	for (; isdigit(misc_get_char(file, 0)); file->pos++) {
-		new_number = old_number*10 + misc_get_char(file, 0) - '0';
-		if (new_number < old_number) {
-			error_reason("Line %d: number too large", line);
+	const char* start;
+	int digit;
+	int value;
+
+	value = 0;
+	for (start = line->pos; (line->pos < line->end) &&
+	     isdigit(*line->pos); line->pos++) {
+		digit = *line->pos - '0';
+		if (value > (INT_MAX - digit) / 10) {
+			error_reason("Line %d: number too large",
+				     line->number);
 			return -1;
 		}
-		old_number = new_number;
+		value = value * 10 + digit;
 	}
-	if (file->pos == start_pos) {
-		error_reason("Line %d: number expected", line);
+	if (line->pos == start) {
+		error_reason("Line %d: number expected", line->number);
 		return -1;
 	}
-	*number = new_number;
+	*number = value;
 	return 0;
 }
 
 
+/* Scan the value of an assignment, which is either enclosed in quotes or
+ * extends to the end of the line without trailing blanks. */
 static int
-scan_value_string(struct misc_file_buffer* file, char** value, int line)
+scan_value_string(struct scan_line* line, char** value)
 {
-	int quote;
-	int start_pos;
-	int end_pos;
-	int last_nonspace;
-	int current;
+	const char* start;
+	const char* end;
 	char* string;
 
-	current = misc_get_char(file, 0);
-	if (current == '\"') {
-		quote = '\"';
-		file->pos++;
-	} else if (current == '\'') {
-		quote = '\'';
-		file->pos++;
-	} else quote = 0;
-	last_nonspace = -1;
-	for (start_pos=file->pos;; file->pos++) {
-		current = misc_get_char(file, 0);
-		if ((current == EOF) || (current == '\n')) {
-			break;
-		} else if (quote) {
-			if (current == quote)
-				break;
-		} else if (!isblank(current))
-			last_nonspace = file->pos;
-	}
-	end_pos = file->pos;
-	if (quote) {
-		if (current != quote) {
-			error_reason("Line %d: unterminated quotes", line);
+	if ((line->pos < line->end) &&
+	    ((*line->pos == '\"') || (*line->pos == '\''))) {
+		start = line->pos + 1;
+		end = memchr(start, *line->pos, line->end - start);
+		if (end == NULL) {
+			error_reason("Line %d: unterminated quotes",
+				     line->number);
 			return -1;
 		}
-	} else if (last_nonspace >= 0)
-		end_pos = last_nonspace + 1;
-	string = (char *) misc_malloc(end_pos - start_pos + 1);
+		line->pos = end + 1;
+	} else {
+		start = line->pos;
+		for (end = line->end; (end > start) && isblank(end[-1]); end--)
+			;
+		line->pos = line->end;
+	}
+	string = copy_string(start, end - start);
 	if (string == NULL)
 		return -1;
-	if (end_pos > start_pos)
-		memcpy(string, &file->buffer[start_pos], end_pos - start_pos);
-	string[end_pos - start_pos] = 0;
 	*value = string;
-	if (quote)
-		file->pos++;
 	return 0;
 }
 
 
+/* Scan the value of an assignment, starting at the equal sign. */
 static int
-scan_number_assignment(struct misc_file_buffer* file, struct scan_token* token,
-		      int line)
+scan_assignment_value(struct scan_line* line, char** value)
 {
-	int rc;
+	char* string;
 
-	rc = scan_number(file, &token->content.number.number, line);
-	if (rc)
-		return rc;
-	skip_blanks(file);
-	if (misc_get_char(file, 0) != '=') {
-		error_reason("Line %d: number expected as keyword", line);
+	line->pos++;
+	skip_blanks(line);
+	if (scan_value_string(line, &string))
 		return -1;
-	}
-	file->pos++;
-	skip_blanks(file);
-	rc = scan_value_string(file, &token->content.number.value, line);
-	if (rc)
-		return rc;
-	if (skip_trailing_blanks(file)) {
+	if (skip_trailing_blanks(line)) {
 		error_reason("Line %d: unexpected characters at end of line",
-			     line);
+			     line->number);
+		free(string);
 		return -1;
 	}
-	token->id = scan_id_number_assignment;
-	token->line = line;
+	*value = string;
 	return 0;
 }
 
+
 static int
-match_keyword(struct misc_file_buffer* file, const char* keyword)
+scan_number_assignment(struct scan_line* line, struct scan_token* token)
 {
-	unsigned int i;
-
-	for (i=0; i<strlen(keyword); i++)
-		if (misc_get_char(file, i) != keyword[i])
-			return -1;
+	if (scan_number(line, &token->content.number.number))
+		return -1;
+	skip_blanks(line);
+	if ((line->pos == line->end) || (*line->pos != '=')) {
+		error_reason("Line %d: number expected as keyword",
+			     line->number);
+		return -1;
+	}
+	if (scan_assignment_value(line, &token->content.number.value))
+		return -1;
+	token->id = scan_id_number_assignment;
+	token->line = line->number;
 	return 0;
 }
 
 
+/* Find the longest keyword at the current position of LINE. Keywords
+ * consist of lower case letters only. */
 static int
-scan_keyword(struct misc_file_buffer* file, enum scan_keyword_id* id, int line)
+scan_keyword(struct scan_line* line, enum scan_keyword_id* id)
 {
-	unsigned int i;
-
-	for (i=0; i < sizeof(keyword_list) / sizeof(keyword_list[0]); i++)
-		if (match_keyword(file, keyword_list[i].keyword) == 0) {
-			file->pos += strlen(keyword_list[i].keyword);
-			*id = keyword_list[i].id;
+	int length;
+	int index;
+
+	for (length = 0; (line->pos + length < line->end) &&
+	     (length < KEYWORD_MAX_LENGTH) &&
+	     islower(line->pos[length]); length++)
+		;
+	for (; length >= KEYWORD_MIN_LENGTH; length--) {
+		index = keyword_hash_table[keyword_hash(line->pos, length)];
+		if ((index >= 0) &&
+		    (strlen(keyword_list[index].keyword) == (size_t) length) &&
+		    (memcmp(keyword_list[index].keyword, line->pos,
+			    length) == 0)) {
+			line->pos += length;
+			*id = keyword_list[index].id;
 			return 0;
 		}
-	error_reason("Line %d: unknown keyword", line);
+	}
+	error_reason("Line %d: unknown keyword", line->number);
 	return -1;
 }
 
 
 static int
-scan_keyword_assignment(struct misc_file_buffer* file, struct scan_token* token,
-		       int line)
+scan_keyword_assignment(struct scan_line* line, struct scan_token* token)
 {
-	int rc;
-
-	rc = scan_keyword(file, &token->content.keyword.keyword, line);
-	if (rc)
-		return rc;
-	skip_blanks(file);
-	if (misc_get_char(file, 0) != '=') {
+	if (scan_keyword(line, &token->content.keyword.keyword))
+		return -1;
+	skip_blanks(line);
+	if ((line->pos == line->end) || (*line->pos != '=')) {
 		error_reason("Line %d: unexpected characters after keyword",
-			     line);
+			     line->number);
 		return -1;
 	}
-	file->pos++;
-	skip_blanks(file);
-	rc = scan_value_string(file, &token->content.keyword.value, line);
-	if (rc)
-		return rc;
-	if (skip_trailing_blanks(file)) {
-		error_reason("Line %d: unexpected characters at end of line",
-			     line);
+	if (scan_assignment_value(line, &token->content.keyword.value))
 		return -1;
-	}
 	token->id = scan_id_keyword_assignment;
-	token->line = line;
+	token->line = line->number;
 	return 0;
 }
 
 
-
+/* Scan LINE for a directive. Set TOKEN if the line contains one. Return
+ * zero on success, non-zero otherwise. */
 static int
-search_line_for(struct misc_file_buffer* file, int search)
+scan_line(struct scan_line* line, struct scan_token* token)
 {
-	int i;
-	int current;
-
-	for (i=0; ; i++) {
-		current = misc_get_char(file, i);
-		switch (current) {
-		case EOF:
-		case '\n':
-			return 0;
-		default:
-			if (current == search)
-				return 1;
+	skip_blanks(line);
+	if (line->pos == line->end)
+		return 0;
+	switch (*line->pos) {
+	case '[':
+		line->pos++;
+		return scan_section_heading(line, token);
+	case ':':
+		line->pos++;
+		return scan_menu_heading(line, token);
+	case '#':
+		return 0;
+	default:
+		if (memchr(line->pos, '=', line->end - line->pos) == NULL) {
+			error_reason("Line %d: unrecognized directive",
+				     line->number);
+			return -1;
 		}
+		if (isdigit(*line->pos))
+			return scan_number_assignment(line, token);
+		return scan_keyword_assignment(line, token);
 	}
 }
 
@@ -472,86 +458,59 @@ scan_free(struct scan_token* array)
 
 /* Scan file FILENAME for tokens. Upon success, return zero and set TOKEN
  * to point to a NULL-terminated array of scan_tokens, i.e. the token id
- * of the last token is 0. Return non-zero otherwise. */
+ * of the last token is 0. Return non-zero otherwise. The file is mapped
+ * to memory and scanned line by line in a single pass. */
 int
 scan_file(const char* filename, struct scan_token** token)
 {
 	struct misc_file_buffer file;
 	struct scan_token* array;
 	struct scan_token* buffer;
+	struct scan_line line;
+	const char* end;
 	int pos;
 	int size;
-	int current;
 	int rc;
-	int line;
 
 	rc = misc_get_file_buffer(filename, &file);
 	if (rc)
 		return rc;
 	size = INITIAL_ARRAY_LENGTH;
 	pos = 0;
-	array = (struct scan_token*) misc_malloc(size *
+	array = (struct scan_token*) misc_calloc(size,
 						 sizeof(struct scan_token));
 	if (array == NULL) {
 		misc_free_file_buffer(&file);
 		return -1;
 	}
-	line = 1;
-	while ((size_t) file.pos < file.length) {
-		skip_blanks(&file);
-		current = misc_get_char(&file, 0);
-		switch (current) {
-		case '[':
-			file.pos++;
-			rc = scan_section_heading(&file, &array[pos++], line);
-			break;
-		case ':':
-			file.pos++;
-			rc = scan_menu_heading(&file, &array[pos++], line);
-			break;
-		case '#':
-			file.pos++;
-			skip_line(&file);
-			rc = 0;
-			break;
-		case '\n':
-			file.pos++;
-			rc = 0;
-			break;
-		case EOF:
-			rc = 0;
-			break;
-		default:
-			if (search_line_for(&file, '=')) {
-				if (isdigit(current))
-					rc = scan_number_assignment(
-						&file, &array[pos++], line);
-				else
-					rc = scan_keyword_assignment(
-						&file, &array[pos++], line);
-			} else {
-				error_reason("Line %d: unrecognized directive",
-					     line);
-				rc = -1;
-			}
-		}
+	end = file.buffer + file.length;
+	line.pos = file.buffer;
+	line.number = 1;
+	while (line.pos < end) {
+		line.end = memchr(line.pos, '\n', end - line.pos);
+		if (line.end == NULL)
+			line.end = end;
+		rc = scan_line(&line, &array[pos]);
 		if (rc)
 			break;
-		line++;
+		if (array[pos].id != 0)
+			pos++;
+		line.pos = (line.end < end) ? line.end + 1 : end;
+		line.number++;
 		/* Enlarge array if there is only one position left */
 		if (pos + 1 >= size) {
-			size *= 2;
 			buffer = (struct scan_token *)
-					misc_malloc(size *
-						    sizeof(struct scan_token));
+				realloc(array, 2 * size *
+					       sizeof(struct scan_token));
 			if (buffer == NULL) {
+				error_reason(strerror(errno));
 				rc = -1;
 				break;
 			}
-			memset(buffer, 0, size);
-			memcpy(buffer, array, pos*sizeof(struct scan_token));
-			free(array);
+			memset(&buffer[size], 0,
+			       size * sizeof(struct scan_token));
 			array = buffer;
+			size *= 2;
 		}
 	}
 	misc_free_file_buffer(&file);
@@ -0,0 +1,280 @@
+/*
+ * s390-tools/zipl/src/tape.c
+ *   Functions to write the boot loader and its components to tape.
+ *
+ * A regular file can be used in place of a tape device for testing. Each
+ * record is then stored in the file preceded by its length as 32 bit big
+ * endian number, a tape mark is stored as a record of length zero.
+ *
+ * Copyright IBM Corp. 2004, 2009.
+ */
+
+#include "tape.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mtio.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "misc.h"
+
+
+/* Amount of file data which is read ahead while records are written */
+#define TAPE_READAHEAD_SIZE	(1024 * 1024)
+
+
+/* Return non-zero if FD refers to a regular file which emulates a tape,
+ * zero otherwise. */
+static int
+is_tape_file(int fd)
+{
+	struct stat stats;
+
+	if (fstat(fd, &stats))
+		return 0;
+	return S_ISREG(stats.st_mode);
+}
+
+
+/* Rewind the tape device identified by FD. Return 0 on success, non-zero
+ * otherwise. */
+int
+tape_rewind(int fd)
+{
+	struct mtop op;
+
+	if (is_tape_file(fd))
+		return (lseek(fd, 0, SEEK_SET) == -1) ? -1 : 0;
+	/* Magnetic tape rewind operation */
+	op.mt_count = 1;
+	op.mt_op = MTREW;
+	if (ioctl(fd, MTIOCTOP, &op) == -1)
+		return -1;
+	return 0;
+}
+
+
+/* Write one record of SIZE bytes at DATA to the tape identified by FD.
+ * FILE specifies whether FD is a file which emulates a tape. Return 0 on
+ * success, non-zero otherwise. */
+static int
+write_record(int fd, const void* data, size_t size, int file)
+{
+	uint32_t length;
+	ssize_t written;
+
+	if (file) {
+		length = htonl(size);
+		if (misc_write(fd, &length, sizeof(length)))
+			return -1;
+		return (size > 0) ? misc_write(fd, data, size) : 0;
+	}
+	written = write(fd, data, size);
+	if (written != (ssize_t) size) {
+		if (written == -1)
+			error_reason(strerror(errno));
+		else
+			error_reason("Write error");
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Write COUNT tapemarks to file handle FD. */
+int
+tape_write_mark(int fd, int count)
+{
+	struct mtop op;
+	off_t pos;
+
+	if (is_tape_file(fd)) {
+		for (; count > 0; count--)
+			if (write_record(fd, NULL, 0, 1))
+				return -1;
+		/* Data behind a tape mark is no longer accessible */
+		pos = lseek(fd, 0, SEEK_CUR);
+		if ((pos == -1) || ftruncate(fd, pos)) {
+			error_reason(strerror(errno));
+			return -1;
+		}
+		return 0;
+	}
+	op.mt_count = count;
+	op.mt_op = MTWEOF;
+	if (ioctl(fd, MTIOCTOP, &op) == -1) {
+		error_reason("Could not write tapemark");
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Write SIZE bytes of data from memory location DATA to file descriptor FD.
+ * Data will be written in records of BLOCKSIZE bytes, the last record may
+ * be shorter. Return 0 on success, non-zero otherwise. */
+int
+tape_write_buffer(int fd, const void* data, size_t size, size_t blocksize)
+{
+	size_t offset;
+	size_t chunk;
+	int file;
+
+	file = is_tape_file(fd);
+	for (offset = 0; offset < size; offset += chunk) {
+		chunk = size - offset;
+		if (chunk > blocksize)
+			chunk = blocksize;
+		if (write_record(fd, VOID_ADD(data, offset), chunk, file))
+			return -1;
+	}
+	return 0;
+}
+
+
+/* Write SIZE bytes of file READ_FD to file descriptor FD through a buffer
+ * of BLOCKSIZE bytes. Used if the file cannot be mapped. */
+static int
+write_file_buffered(int fd, int read_fd, off_t size, size_t blocksize)
+{
+	off_t offset;
+	size_t chunk;
+	void* buffer;
+	int file;
+
+	buffer = misc_malloc(blocksize);
+	if (buffer == NULL)
+		return -1;
+	file = is_tape_file(fd);
+	posix_fadvise(read_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	for (offset = 0; offset < size; offset += chunk) {
+		chunk = size - offset;
+		if (chunk > blocksize)
+			chunk = blocksize;
+		if (offset % TAPE_READAHEAD_SIZE == 0)
+			posix_fadvise(read_fd, offset + TAPE_READAHEAD_SIZE,
+				      TAPE_READAHEAD_SIZE, POSIX_FADV_WILLNEED);
+		if (misc_read(read_fd, buffer, chunk) ||
+		    write_record(fd, buffer, chunk, file)) {
+			free(buffer);
+			return -1;
+		}
+	}
+	free(buffer);
+	return 0;
+}
+
+
+/* Write SIZE bytes of DATA, which is a mapping of a file, to file
+ * descriptor FD in records of BLOCKSIZE bytes. The next part of the file
+ * is read ahead while the current part is written. */
+static int
+write_file_mapped(int fd, const char* data, size_t size, size_t blocksize)
+{
+	size_t offset;
+	size_t next;
+	size_t chunk;
+
+	madvise((void *) data, size, MADV_SEQUENTIAL);
+	for (offset = 0; offset < size; offset = next) {
+		next = offset + TAPE_READAHEAD_SIZE;
+		if (next > size)
+			next = size;
+		if (next < size) {
+			chunk = size - next;
+			if (chunk > TAPE_READAHEAD_SIZE)
+				chunk = TAPE_READAHEAD_SIZE;
+			madvise((void *) (data + next), chunk,
+				MADV_WILLNEED);
+		}
+		chunk = next - offset;
+		if (tape_write_buffer(fd, data + offset, chunk, blocksize))
+			return -1;
+	}
+	return 0;
+}
+
+
+/* Write data from file FILENAME to file descriptor FD. Data will be written
+ * in records of BLOCKSIZE bytes. If STATS is not NULL, store the number of
+ * bytes and records written and the time needed. Return 0 on success,
+ * non-zero otherwise. */
+int
+tape_write_file(int fd, const char* filename, size_t blocksize,
+		struct tape_stats* stats)
+{
+	struct timeval start;
+	struct timeval end;
+	struct stat info;
+	void* data;
+	int read_fd;
+	int rc;
+
+	/* The read ahead window has to consist of whole records */
+	if (TAPE_READAHEAD_SIZE % blocksize != 0) {
+		error_reason("Unsupported block size %lu",
+			     (unsigned long) blocksize);
+		return -1;
+	}
+	gettimeofday(&start, NULL);
+	read_fd = open(filename, O_RDONLY);
+	if (read_fd == -1) {
+		error_reason(strerror(errno));
+		return -1;
+	}
+	if (fstat(read_fd, &info)) {
+		error_reason(strerror(errno));
+		close(read_fd);
+		return -1;
+	}
+	if (!S_ISREG(info.st_mode)) {
+		error_reason("Not a regular file");
+		close(read_fd);
+		return -1;
+	}
+	data = MAP_FAILED;
+	if (info.st_size > 0)
+		data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+			    read_fd, 0);
+	if (data != MAP_FAILED) {
+		rc = write_file_mapped(fd, data, info.st_size, blocksize);
+		munmap(data, info.st_size);
+	} else
+		rc = write_file_buffered(fd, read_fd, info.st_size,
+					 blocksize);
+	close(read_fd);
+	if (rc == 0 && stats != NULL) {
+		gettimeofday(&end, NULL);
+		stats->bytes = info.st_size;
+		stats->records = (info.st_size + blocksize - 1) / blocksize;
+		stats->usecs = (end.tv_sec - start.tv_sec) * 1000000ULL +
+			       end.tv_usec - start.tv_usec;
+	}
+	return rc;
+}
+
+
+/* Print the throughput of writing a file to tape as given by STATS. */
+void
+tape_print_stats(struct tape_stats* stats)
+{
+	double secs;
+
+	secs = stats->usecs / 1000000.0;
+	printf("    %llu bytes in %llu records, %.2f s",
+	       (unsigned long long) stats->bytes,
+	       (unsigned long long) stats->records, secs);
+	if (stats->usecs > 0)
+		printf(" (%.2f MB/s)", stats->bytes / secs / (1024 * 1024));
+	printf("\n");
+}
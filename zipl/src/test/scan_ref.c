@@ -0,0 +1,479 @@
+/*
+ * scan_ref - Reference scanner for zipl.conf configuration files
+ *
+ * Copy of the character based scanner which was used by zipl before the
+ * configuration file was tokenized in a single pass. test_scan compares
+ * the results of both scanners. Do not change, except for fixing bugs
+ * in both scanners. Fixed so far: the token array is zeroed and numbers
+ * which do not fit into an int are rejected.
+ *
+ * Copyright IBM Corp. 2001, 2009
+ */
+
+#include "scan.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "misc.h"
+#include "error.h"
+
+int scan_file_ref(const char* filename, struct scan_token** token);
+
+
+/* Mapping of keyword IDs to strings */
+static const struct {
+	char* keyword;
+	enum scan_keyword_id id;
+} keyword_list[] = {
+	{ "defaultmenu", scan_keyword_defaultmenu},
+	{ "default", scan_keyword_default },
+	{ "dumptofs", scan_keyword_dumptofs },
+	{ "dumpto", scan_keyword_dumpto },
+	{ "image", scan_keyword_image },
+	{ "mvdump", scan_keyword_mvdump },
+	{ "parameters", scan_keyword_parameters },
+	{ "parmfile", scan_keyword_parmfile },
+	{ "ramdisk", scan_keyword_ramdisk },
+	{ "segment", scan_keyword_segment },
+	{ "targetbase", scan_keyword_targetbase},
+	{ "targettype", scan_keyword_targettype},
+	{ "targetgeometry", scan_keyword_targetgeometry},
+	{ "targetblocksize", scan_keyword_targetblocksize},
+	{ "targetoffset", scan_keyword_targetoffset},
+	{ "target", scan_keyword_target},
+	{ "prompt", scan_keyword_prompt},
+	{ "timeout", scan_keyword_timeout},
+	{ "tape", scan_keyword_tape}
+};
+
+/* Advance the current file pointer of file buffer FILE until the current
+ * character is no longer a blank. Return 0 if at least one blank
+ * character was encountered, non-zero otherwise. */
+static int
+skip_blanks(struct misc_file_buffer* file)
+{
+	int rc;
+
+	rc = -1;
+	for (; isblank(misc_get_char(file, 0)); file->pos++)
+		rc = 0;
+	return rc;
+}
+
+
+/* Advance the current file position to beginning of next line in file buffer
+ * FILE or to end of file. */
+static void
+skip_line(struct misc_file_buffer* file)
+{
+	for (;; file->pos++) {
+		switch (misc_get_char(file, 0)) {
+		case '\n':
+			file->pos++;
+			return;
+		case EOF:
+			return;
+		}
+	}
+}
+
+
+/* Skip trailing blanks of line. On success, return zero and set the file
+ * buffer position to beginning of next line or EOF. Return non-zero if
+ * non-blank characters were found before end of line. */
+static int
+skip_trailing_blanks(struct misc_file_buffer* file)
+{
+	int current;
+
+	for (;; file->pos++) {
+		current = misc_get_char(file, 0);
+		if (current == '\n') {
+			file->pos++;
+			return 0;
+		} else if (current == EOF)
+			return 0;
+		else if (!isblank(current))
+			return -1;
+	}
+}
+
+
+static int
+scan_section_heading(struct misc_file_buffer* file, struct scan_token* token,
+		     int line)
+{
+	int start_pos;
+	int end_pos;
+	int current;
+	char* name;
+
+	for (start_pos=file->pos; misc_get_char(file, 0) != ']'; file->pos++) {
+		current = misc_get_char(file, 0);
+		switch (current) {
+		case EOF:
+		case '\n':
+			error_reason("Line %d: unterminated section heading",
+				     line);
+			return -1;
+		default:
+			if (!(isalnum(current) || ispunct(current))) {
+				error_reason("Line %d: invalid character in "
+					     "section name", line);
+				return -1;
+			}
+		}
+	}
+	end_pos = file->pos;
+	if (end_pos == start_pos) {
+		error_reason("Line %d: empty section name", line);
+		return -1;
+	}
+	file->pos++;
+	if (skip_trailing_blanks(file)) {
+		error_reason("Line %d: unexpected characters after section "
+			     "name", line);
+		return -1;
+	}
+	name = (char *) misc_malloc(end_pos - start_pos + 1);
+	if (name == NULL)
+		return -1;
+	memcpy(name, &file->buffer[start_pos], end_pos - start_pos);
+	name[end_pos - start_pos] = 0;
+	token->id = scan_id_section_heading;
+	token->line = line;
+	token->content.section.name = name;
+	return 0;
+}
+
+
+static int
+scan_menu_heading(struct misc_file_buffer* file, struct scan_token* token,
+		  int line)
+{
+	int start_pos;
+	int end_pos;
+	int current;
+	char* name;
+
+	for (start_pos=file->pos; ; file->pos++) {
+		current = misc_get_char(file, 0);
+		if ((current == EOF) || (current == '\n'))
+			break;
+		else if (isblank(current))
+			break;
+		else if (!isalnum(current)) {
+			error_reason("Line %d: invalid character in menu name ",
+				     line);
+			return -1;
+		}
+	}
+	end_pos = file->pos;
+	if (skip_trailing_blanks(file)) {
+		error_reason("Line %d: blanks not allowed in menu name",
+			     line);
+		return -1;
+	}
+	if (end_pos == start_pos) {
+		error_reason("Line %d: empty menu name", line);
+		return -1;
+	}
+	name = (char *) misc_malloc(end_pos - start_pos + 1);
+	if (name == NULL)
+		return -1;
+	memcpy(name, &file->buffer[start_pos], end_pos - start_pos);
+	name[end_pos - start_pos] = 0;
+	token->id = scan_id_menu_heading;
+	token->line = line;
+	token->content.menu.name = name;
+	return 0;
+}
+
+
+static int
+scan_number(struct misc_file_buffer* file, int* number, int line)
+{
+	int start_pos;
+	int old_number;
+	int new_number;
+
+	old_number = 0;
+	new_number = 0;
+	start_pos = file->pos;
+	for (; isdigit(misc_get_char(file, 0)); file->pos++) {
+		if (old_number > (INT_MAX - (misc_get_char(file, 0) - '0')) /
+				 10) {
+			error_reason("Line %d: number too large", line);
+			return -1;
+		}
+		new_number = old_number*10 + misc_get_char(file, 0) - '0';
+		old_number = new_number;
+	}
+	if (file->pos == start_pos) {
+		error_reason("Line %d: number expected", line);
+		return -1;
+	}
+	*number = new_number;
+	return 0;
+}
+
+
+static int
+scan_value_string(struct misc_file_buffer* file, char** value, int line)
+{
+	int quote;
+	int start_pos;
+	int end_pos;
+	int last_nonspace;
+	int current;
+	char* string;
+
+	current = misc_get_char(file, 0);
+	if (current == '\"') {
+		quote = '\"';
+		file->pos++;
+	} else if (current == '\'') {
+		quote = '\'';
+		file->pos++;
+	} else quote = 0;
+	last_nonspace = -1;
+	for (start_pos=file->pos;; file->pos++) {
+		current = misc_get_char(file, 0);
+		if ((current == EOF) || (current == '\n')) {
+			break;
+		} else if (quote) {
+			if (current == quote)
+				break;
+		} else if (!isblank(current))
+			last_nonspace = file->pos;
+	}
+	end_pos = file->pos;
+	if (quote) {
+		if (current != quote) {
+			error_reason("Line %d: unterminated quotes", line);
+			return -1;
+		}
+	} else if (last_nonspace >= 0)
+		end_pos = last_nonspace + 1;
+	string = (char *) misc_malloc(end_pos - start_pos + 1);
+	if (string == NULL)
+		return -1;
+	if (end_pos > start_pos)
+		memcpy(string, &file->buffer[start_pos], end_pos - start_pos);
+	string[end_pos - start_pos] = 0;
+	*value = string;
+	if (quote)
+		file->pos++;
+	return 0;
+}
+
+
+static int
+scan_number_assignment(struct misc_file_buffer* file, struct scan_token* token,
+		      int line)
+{
+	int rc;
+
+	rc = scan_number(file, &token->content.number.number, line);
+	if (rc)
+		return rc;
+	skip_blanks(file);
+	if (misc_get_char(file, 0) != '=') {
+		error_reason("Line %d: number expected as keyword", line);
+		return -1;
+	}
+	file->pos++;
+	skip_blanks(file);
+	rc = scan_value_string(file, &token->content.number.value, line);
+	if (rc)
+		return rc;
+	if (skip_trailing_blanks(file)) {
+		error_reason("Line %d: unexpected characters at end of line",
+			     line);
+		return -1;
+	}
+	token->id = scan_id_number_assignment;
+	token->line = line;
+	return 0;
+}
+
+static int
+match_keyword(struct misc_file_buffer* file, const char* keyword)
+{
+	unsigned int i;
+
+	for (i=0; i<strlen(keyword); i++)
+		if (misc_get_char(file, i) != keyword[i])
+			return -1;
+	return 0;
+}
+
+
+static int
+scan_keyword(struct misc_file_buffer* file, enum scan_keyword_id* id, int line)
+{
+	unsigned int i;
+
+	for (i=0; i < sizeof(keyword_list) / sizeof(keyword_list[0]); i++)
+		if (match_keyword(file, keyword_list[i].keyword) == 0) {
+			file->pos += strlen(keyword_list[i].keyword);
+			*id = keyword_list[i].id;
+			return 0;
+		}
+	error_reason("Line %d: unknown keyword", line);
+	return -1;
+}
+
+
+static int
+scan_keyword_assignment(struct misc_file_buffer* file, struct scan_token* token,
+		       int line)
+{
+	int rc;
+
+	rc = scan_keyword(file, &token->content.keyword.keyword, line);
+	if (rc)
+		return rc;
+	skip_blanks(file);
+	if (misc_get_char(file, 0) != '=') {
+		error_reason("Line %d: unexpected characters after keyword",
+			     line);
+		return -1;
+	}
+	file->pos++;
+	skip_blanks(file);
+	rc = scan_value_string(file, &token->content.keyword.value, line);
+	if (rc)
+		return rc;
+	if (skip_trailing_blanks(file)) {
+		error_reason("Line %d: unexpected characters at end of line",
+			     line);
+		return -1;
+	}
+	token->id = scan_id_keyword_assignment;
+	token->line = line;
+	return 0;
+}
+
+
+
+static int
+search_line_for(struct misc_file_buffer* file, int search)
+{
+	int i;
+	int current;
+
+	for (i=0; ; i++) {
+		current = misc_get_char(file, i);
+		switch (current) {
+		case EOF:
+		case '\n':
+			return 0;
+		default:
+			if (current == search)
+				return 1;
+		}
+	}
+}
+
+
+#define INITIAL_ARRAY_LENGTH 40
+
+/* Scan file FILENAME for tokens. Upon success, return zero and set TOKEN
+ * to point to a NULL-terminated array of scan_tokens, i.e. the token id
+ * of the last token is 0. Return non-zero otherwise. */
+int
+scan_file_ref(const char* filename, struct scan_token** token)
+{
+	struct misc_file_buffer file;
+	struct scan_token* array;
+	struct scan_token* buffer;
+	int pos;
+	int size;
+	int current;
+	int rc;
+	int line;
+
+	rc = misc_get_file_buffer(filename, &file);
+	if (rc)
+		return rc;
+	size = INITIAL_ARRAY_LENGTH;
+	pos = 0;
+	array = (struct scan_token*) misc_malloc(size *
+						 sizeof(struct scan_token));
+	if (array == NULL) {
+		misc_free_file_buffer(&file);
+		return -1;
+	}
+	memset(array, 0, size * sizeof(struct scan_token));
+	line = 1;
+	while ((size_t) file.pos < file.length) {
+		skip_blanks(&file);
+		current = misc_get_char(&file, 0);
+		switch (current) {
+		case '[':
+			file.pos++;
+			rc = scan_section_heading(&file, &array[pos++], line);
+			break;
+		case ':':
+			file.pos++;
+			rc = scan_menu_heading(&file, &array[pos++], line);
+			break;
+		case '#':
+			file.pos++;
+			skip_line(&file);
+			rc = 0;
+			break;
+		case '\n':
+			file.pos++;
+			rc = 0;
+			break;
+		case EOF:
+			rc = 0;
+			break;
+		default:
+			if (search_line_for(&file, '=')) {
+				if (isdigit(current))
+					rc = scan_number_assignment(
+						&file, &array[pos++], line);
+				else
+					rc = scan_keyword_assignment(
+						&file, &array[pos++], line);
+			} else {
+				error_reason("Line %d: unrecognized directive",
+					     line);
+				rc = -1;
+			}
+		}
+		if (rc)
+			break;
+		line++;
+		/* Enlarge array if there is only one position left */
+		if (pos + 1 >= size) {
+			size *= 2;
+			buffer = (struct scan_token *)
+					misc_malloc(size *
+						    sizeof(struct scan_token));
+			if (buffer == NULL) {
+				rc = -1;
+				break;
+			}
+			memset(buffer, 0, size * sizeof(struct scan_token));
+			memcpy(buffer, array, pos*sizeof(struct scan_token));
+			free(array);
+			array = buffer;
+		}
+	}
+	misc_free_file_buffer(&file);
+	if (rc)
+		scan_free(array);
+	else
+		*token = array;
+	return rc;
+}
+
+
@@ -0,0 +1,261 @@
+/*
+ * test_disk - Test program for the zipl block list functions
+ *
+ * Creates contiguous, sparse and fragmented files and checks that the block
+ * lists built from the file extents match the lists built with one FIBMAP
+ * call per block. The same is checked for buffers written to a file like
+ * the components of the bootmap. The files are created in the directory given as first
+ * argument (default: current directory), which has to be on a block device
+ * based file system, for example a file system on a loop device.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "disk.h"
+
+#define FIBMAP			_IO(0x00,1)
+#define FIGETBSZ		_IO(0x00,2)
+
+#define FILE_BLOCKS		512	/* File size in file system blocks */
+
+
+static char file_name[2][PATH_MAX];
+
+
+static void
+init_info(struct disk_info* info, disk_type_t type, int phy_block_size,
+	  int fs_block_size)
+{
+	memset(info, 0, sizeof(*info));
+	info->type = type;
+	info->phy_block_size = phy_block_size;
+	info->fs_block_size = fs_block_size;
+	info->geo.heads = 15;
+	info->geo.sectors = 12;
+	info->geo.start = 24;
+}
+
+
+static void
+create_file(char* name, const char* dir)
+{
+	int fd;
+
+	snprintf(name, PATH_MAX, "%s/test_disk.XXXXXX", dir);
+	fd = mkstemp(name);
+	assert(fd != -1);
+	close(fd);
+}
+
+
+/* Write LEN bytes to block BLOCK of size SIZE of file NAME */
+static void
+write_block(const char* name, int block, int size, int len)
+{
+	char buf[size];
+	int fd;
+
+	memset(buf, block + 1, len);
+	fd = open(name, O_WRONLY);
+	assert(fd != -1);
+	assert(pwrite(fd, buf, len, (off_t) block * size) == len);
+	assert(fsync(fd) == 0);
+	close(fd);
+}
+
+
+/* Return the block list of file NAME built with one FIBMAP call per
+ * block */
+static blocknum_t
+get_blocklist_fibmap(const char* name, disk_blockptr_t** blocklist,
+		     struct disk_info* info)
+{
+	disk_blockptr_t* list;
+	blocknum_t blocknum;
+	blocknum_t count;
+	blocknum_t i;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	assert(fd != -1);
+	count = (lseek(fd, 0, SEEK_END) + info->phy_block_size - 1) /
+		info->phy_block_size;
+	list = calloc(count, sizeof(disk_blockptr_t));
+	assert(list);
+	for (i = 0; i < count; i++) {
+		assert(disk_get_blocknum(fd, i, &blocknum, info) == 0);
+		disk_blockptr_from_blocknum(&list[i], blocknum, info);
+	}
+	close(fd);
+	*blocklist = list;
+	return count;
+}
+
+
+static void
+check_file(const char* name, struct disk_info* info)
+{
+	disk_blockptr_t* ref;
+	disk_blockptr_t* list;
+	disk_blockptr_t* compact;
+	struct disk_extent* extents;
+	blocknum_t ref_count;
+	blocknum_t count;
+	blocknum_t blocks;
+	blocknum_t first;
+	int num;
+
+	ref_count = get_blocklist_fibmap(name, &ref, info);
+	/* Uncompacted list */
+	count = disk_get_blocklist_from_file(name, &list, info);
+	assert(count == ref_count);
+	assert(memcmp(list, ref, count * sizeof(disk_blockptr_t)) == 0);
+	free(list);
+	/* Compacted list, starting at different blocks */
+	num = disk_get_extents_from_file(name, &extents, &blocks, info);
+	assert(num > 0 && blocks == ref_count);
+	compact = malloc(blocks * sizeof(disk_blockptr_t));
+	assert(compact);
+	for (first = 0; first < blocks; first += blocks / 3 + 1) {
+		count = disk_blocklist_from_extents(extents, num, first,
+						    &list, info);
+		memcpy(compact, ref + first,
+		       (blocks - first) * sizeof(disk_blockptr_t));
+		assert(count == disk_compact_blocklist(compact, blocks - first,
+						       info));
+		assert(memcmp(list, compact,
+			      count * sizeof(disk_blockptr_t)) == 0);
+		free(list);
+	}
+	free(compact);
+	free(extents);
+	free(ref);
+}
+
+
+/* Write buffers of different sizes to file NAME like bootmap components
+ * and compare the returned block lists with the FIBMAP block lists */
+static void
+check_write(const char* name, struct disk_info* info)
+{
+	disk_blockptr_t* ref;
+	disk_blockptr_t* list;
+	blocknum_t first;
+	blocknum_t count;
+	size_t size;
+	char* buf;
+	int fd;
+	int i;
+
+	fd = open(name, O_RDWR | O_TRUNC);
+	assert(fd != -1);
+	assert(write(fd, "header", 6) == 6);
+	for (i = 0, size = 1; i < 4; i++, size = size * 37 + 1000) {
+		buf = malloc(size);
+		assert(buf);
+		memset(buf, i + 1, size);
+		first = (lseek(fd, 0, SEEK_CUR) + info->phy_block_size - 1) /
+			info->phy_block_size;
+		count = disk_write_block_buffer(fd, buf, size, &list, info);
+		assert(count == (size + info->phy_block_size - 1) /
+				info->phy_block_size);
+		free(buf);
+		assert(get_blocklist_fibmap(name, &ref, info) >= first + count);
+		assert(memcmp(list, ref + first,
+			      count * sizeof(disk_blockptr_t)) == 0);
+		free(ref);
+		free(list);
+	}
+	close(fd);
+}
+
+
+/* Check file NAME as file on a SCSI disk and on an ECKD DASD */
+static void
+check_disks(const char* name, int fs_block_size)
+{
+	struct disk_info info;
+
+	init_info(&info, disk_type_scsi, 512, fs_block_size);
+	check_file(name, &info);
+	init_info(&info, disk_type_eckd_compatible, fs_block_size,
+		  fs_block_size);
+	check_file(name, &info);
+}
+
+
+/* Check writing to file NAME on a SCSI disk and on an ECKD DASD */
+static void
+check_write_disks(const char* name, int fs_block_size)
+{
+	struct disk_info info;
+
+	init_info(&info, disk_type_scsi, 512, fs_block_size);
+	check_write(name, &info);
+	init_info(&info, disk_type_eckd_compatible, fs_block_size,
+		  fs_block_size);
+	check_write(name, &info);
+}
+
+
+int
+main(int argc, char* argv[])
+{
+	const char* dir = argc > 1 ? argv[1] : ".";
+	int fs_block_size;
+	int mapped;
+	int fd;
+	int i;
+
+	create_file(file_name[0], dir);
+	create_file(file_name[1], dir);
+	fd = open(file_name[0], O_RDONLY);
+	assert(fd != -1);
+	assert(ioctl(fd, FIGETBSZ, &fs_block_size) == 0);
+	mapped = 0;
+	if (ioctl(fd, FIBMAP, &mapped)) {
+		printf("FIBMAP not supported in '%s' (%s), test skipped\n",
+		       dir, strerror(errno));
+		close(fd);
+		unlink(file_name[0]);
+		unlink(file_name[1]);
+		return 0;
+	}
+	close(fd);
+
+	/* Contiguous file */
+	for (i = 0; i < FILE_BLOCKS; i++)
+		write_block(file_name[0], i, fs_block_size, fs_block_size);
+	check_disks(file_name[0], fs_block_size);
+
+	/* Sparse files with interleaved blocks and a partial last block */
+	for (i = 0; i < FILE_BLOCKS; i++) {
+		if (i % 7 == 3 || i % 31 == 0)
+			continue;
+		write_block(file_name[1], 2 * FILE_BLOCKS + i, fs_block_size,
+			    fs_block_size);
+		write_block(file_name[0], FILE_BLOCKS + i * 3, fs_block_size,
+			    fs_block_size);
+	}
+	write_block(file_name[1], 4 * FILE_BLOCKS, fs_block_size,
+		    fs_block_size / 2 + 1);
+	check_disks(file_name[0], fs_block_size);
+	check_disks(file_name[1], fs_block_size);
+
+	/* Bootmap components */
+	check_write_disks(file_name[0], fs_block_size);
+
+	unlink(file_name[0]);
+	unlink(file_name[1]);
+	return 0;
+}
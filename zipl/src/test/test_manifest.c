@@ -0,0 +1,154 @@
+/*
+ * test_manifest - Test program for the bootmap manifest functions
+ *
+ * Writes a manifest with copied and referenced components, reads it back
+ * and checks that all entries are unchanged. Also checks that invalid
+ * manifest files are rejected.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "manifest.h"
+
+
+static char file_name[] = "/tmp/test_manifest.XXXXXX";
+
+
+static void
+init_info(struct disk_info* info)
+{
+	memset(info, 0, sizeof(*info));
+	info->type = disk_type_eckd_compatible;
+	info->device = 0x5e01;
+	info->phy_block_size = 4096;
+	info->geo.start = 24;
+}
+
+
+static void
+check_entry(struct manifest_entry* a, struct manifest_entry* b)
+{
+	assert(strcmp(a->path, b->path) == 0);
+	assert(a->offset == b->offset && a->add_files == b->add_files);
+	assert(a->size == b->size && a->mtime == b->mtime);
+	assert(a->ino == b->ino && a->hash == b->hash);
+	assert(a->first == b->first && a->count == b->count);
+	assert(a->segment == b->segment && a->loc_size == b->loc_size);
+	assert(manifest_equal_extents(a->bootmap_ext, a->bootmap_num,
+				      b->bootmap_ext, b->bootmap_num));
+	assert(manifest_equal_extents(a->file_ext, a->file_num,
+				      b->file_ext, b->file_num));
+}
+
+
+static void
+write_file(const char* data)
+{
+	FILE* file;
+
+	file = fopen(file_name, "w");
+	assert(file);
+	assert(fputs(data, file) >= 0);
+	assert(fclose(file) == 0);
+}
+
+
+int
+main(void)
+{
+	struct disk_extent bootmap_ext[2] = {
+		{ 10, 3000, 200 }, { 210, 5000, 3 } };
+	struct disk_extent file_ext[3] = {
+		{ 0, 700, 16 }, { 16, 0, 4 }, { 20, 900, 1000 } };
+	struct manifest_entry entry[2];
+	struct manifest* manifest;
+	struct manifest* copy;
+	struct disk_info info;
+	int fd;
+	int i;
+
+	fd = mkstemp(file_name);
+	assert(fd != -1);
+	close(fd);
+	init_info(&info);
+	manifest = manifest_new(&info);
+	assert(manifest && manifest_check_target(manifest, &info));
+	manifest->ino = 4711;
+	manifest->size = 1 << 20;
+	manifest->live = 220;
+	manifest->empty_first = 1;
+	manifest->empty_block = 2999;
+	/* Kernel image copied to the bootmap file */
+	memset(entry, 0, sizeof(entry));
+	entry[0].path = "/boot/image with blanks";
+	entry[0].offset = 65536;
+	entry[0].add_files = 1;
+	entry[0].size = 822000;
+	entry[0].mtime = 1234567890;
+	entry[0].ino = 12;
+	entry[0].hash = manifest_hash("image", 5);
+	entry[0].first = 10;
+	entry[0].count = 203;
+	entry[0].segment = 5002;
+	entry[0].loc_size = 184 * 4096;
+	entry[0].bootmap_num = 2;
+	entry[0].bootmap_ext = bootmap_ext;
+	/* Ramdisk referenced by the bootmap file */
+	entry[1].path = "/boot/initrd";
+	entry[1].size = 1020 * 4096;
+	entry[1].first = 213;
+	entry[1].count = 1;
+	entry[1].segment = 5003;
+	entry[1].loc_size = entry[1].size;
+	entry[1].bootmap_num = 1;
+	entry[1].bootmap_ext = &bootmap_ext[1];
+	entry[1].file_num = 3;
+	entry[1].file_ext = file_ext;
+	for (i = 0; i < 2; i++)
+		assert(manifest_add(manifest, &entry[i]) == 0);
+	assert(manifest_find(manifest, "/boot/initrd", 0, 0) != NULL);
+	assert(manifest_find(manifest, "/boot/initrd", 0, 1) == NULL);
+	assert(manifest_find(manifest, "/boot/image with blanks", 0, 1) ==
+	       NULL);
+	assert(!manifest_equal_extents(file_ext, 3, file_ext, 2));
+	assert(!manifest_equal_extents(bootmap_ext, 1, &bootmap_ext[1], 1));
+	assert(manifest_hash("a", 1) == 0xaf63dc4c8601ec8cULL);
+
+	/* Read back */
+	assert(manifest_write(file_name, manifest) == 0);
+	assert(manifest_read(file_name, &copy) == 0);
+	assert(manifest_check_target(copy, &info));
+	assert(copy->ino == manifest->ino && copy->size == manifest->size);
+	assert(copy->live == manifest->live);
+	assert(copy->empty_first == manifest->empty_first);
+	assert(copy->empty_block == manifest->empty_block);
+	assert(copy->num == 2);
+	for (i = 0; i < 2; i++)
+		check_entry(&copy->entry[i], &entry[i]);
+	manifest_free(copy);
+	info.geo.start = 2;
+	assert(!manifest_check_target(manifest, &info));
+	manifest_free(manifest);
+
+	/* Invalid manifests */
+	write_file("zipl-manifest 2\ntarget 1 2 4096 24\n"
+		   "bootmap 1 2 3 4 5\n");
+	assert(manifest_read(file_name, &copy) != 0);
+	write_file("zipl-manifest 1\ntarget 1 2 4096 24\n"
+		   "bootmap 1 2 3 4 5\n"
+		   "component 0 0 1 2 3 4 5 6 7 8 1 0 /boot/image\n");
+	assert(manifest_read(file_name, &copy) != 0);
+	write_file("zipl-manifest 1\ntarget 1 2 4096 24\n"
+		   "bootmap 1 2 3 4 5\n"
+		   "component 0 0 1 2 3 4 5 6 7 8 0 0\n");
+	assert(manifest_read(file_name, &copy) != 0);
+	unlink(file_name);
+	assert(manifest_read(file_name, &copy) != 0);
+	return 0;
+}
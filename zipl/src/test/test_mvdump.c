@@ -0,0 +1,189 @@
+/*
+ * test_mvdump - Test program for writing multi-volume dump records
+ *
+ * Uses regular files as dump volumes. Checks that all records are written
+ * to all volumes and that the previous contents of all volumes are
+ * restored if preparing or committing one of the volumes fails.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <sys/stat.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mvdump.h"
+
+#define VOLUMES		8
+#define VOLUME_SIZE	(256 * 1024)
+#define BLOCK_SIZE	4096
+#define OLD_DATA	0x5a
+
+
+static char name[VOLUMES][32];
+static char start[65536];
+static char stage0[24];
+static char stage1[128];
+static char stage2[2 * BLOCK_SIZE];
+
+
+static void
+init_volume(struct mvdump_volume* volume, int i)
+{
+	memset(volume, 0, sizeof(*volume));
+	volume->device = name[i];
+	volume->name = name[i];
+	volume->write[0].offset = 4;
+	volume->write[0].data = stage0;
+	volume->write[0].size = sizeof(stage0);
+	volume->write[1].offset = BLOCK_SIZE + 4;
+	volume->write[1].data = stage1;
+	volume->write[1].size = sizeof(stage1);
+	volume->write[2].offset = (i + 8) * BLOCK_SIZE;
+	volume->write[2].data = start;
+	volume->write[2].size = sizeof(start);
+	volume->write_count = 3;
+	volume->commit.offset = 3 * BLOCK_SIZE;
+	volume->commit.data = stage2;
+	volume->commit.size = sizeof(stage2);
+}
+
+
+/* Return non-zero if record WRITE is found on volume FD */
+static int
+check_record(int fd, struct mvdump_write* write)
+{
+	char buffer[sizeof(start)];
+
+	assert(write->size <= sizeof(buffer));
+	if (pread(fd, buffer, write->size, write->offset) !=
+	    (ssize_t) write->size)
+		return 0;
+	return memcmp(buffer, write->data, write->size) == 0;
+}
+
+
+static void
+check_volume(struct mvdump_volume* volume, int committed)
+{
+	int fd;
+	int i;
+
+	fd = open(volume->device, O_RDONLY);
+	assert(fd != -1);
+	for (i = 0; i < volume->write_count; i++)
+		assert(check_record(fd, &volume->write[i]));
+	assert(check_record(fd, &volume->commit) == committed);
+	close(fd);
+}
+
+
+/* Check that volume I still contains only its previous contents */
+static void
+check_restored(int i)
+{
+	static char buffer[VOLUME_SIZE];
+	int fd;
+	int j;
+
+	fd = open(name[i], O_RDONLY);
+	assert(fd != -1);
+	assert(pread(fd, buffer, sizeof(buffer), 0) == sizeof(buffer));
+	for (j = 0; j < VOLUME_SIZE; j++)
+		assert(buffer[j] == OLD_DATA);
+	close(fd);
+}
+
+
+static void
+clear_volumes(void)
+{
+	static char buffer[VOLUME_SIZE];
+	int fd;
+	int i;
+
+	memset(buffer, OLD_DATA, sizeof(buffer));
+	for (i = 0; i < VOLUMES; i++) {
+		fd = open(name[i], O_RDWR | O_TRUNC);
+		assert(fd != -1);
+		assert(pwrite(fd, buffer, sizeof(buffer), 0) ==
+		       sizeof(buffer));
+		close(fd);
+	}
+}
+
+
+int
+main(void)
+{
+	struct mvdump_volume volume[VOLUMES];
+	int fd;
+	int i;
+
+	for (i = 0; i < (int) sizeof(start); i++)
+		start[i] = i % 251;
+	memset(stage0, 0x0a, sizeof(stage0));
+	memset(stage1, 0x1b, sizeof(stage1));
+	memset(stage2, 0x2c, sizeof(stage2));
+	for (i = 0; i < VOLUMES; i++) {
+		strcpy(name[i], "/tmp/test_mvdump.XXXXXX");
+		fd = mkstemp(name[i]);
+		assert(fd != -1);
+		close(fd);
+		init_volume(&volume[i], i);
+	}
+
+	/* All volumes prepared and committed */
+	clear_volumes();
+	assert(mvdump_write_volumes(volume, VOLUMES) == 0);
+	for (i = 0; i < VOLUMES; i++) {
+		assert(volume[i].text == NULL);
+		check_volume(&volume[i], 1);
+	}
+
+	/* Single volume */
+	clear_volumes();
+	assert(mvdump_write_volumes(volume, 1) == 0);
+	check_volume(&volume[0], 1);
+
+	/* One volume cannot be opened - all volumes are restored */
+	clear_volumes();
+	volume[5].device = "/tmp/test_mvdump.nonexistent/volume";
+	assert(mvdump_write_volumes(volume, VOLUMES) != 0);
+	assert(volume[5].text != NULL);
+	for (i = 0; i < VOLUMES; i++) {
+		if (i == 5)
+			continue;
+		assert(volume[i].text == NULL);
+		check_restored(i);
+	}
+	volume[5].device = name[5];
+
+	/* One volume is read-only - all volumes are restored */
+	clear_volumes();
+	assert(chmod(name[2], 0400) == 0);
+	if (access(name[2], W_OK) != 0) {
+		assert(mvdump_write_volumes(volume, VOLUMES) != 0);
+		assert(volume[2].text != NULL);
+		for (i = 0; i < VOLUMES; i++)
+			check_restored(i);
+	}
+	assert(chmod(name[2], 0600) == 0);
+
+	/* Commit fails on the last volume - committed volumes are restored */
+	clear_volumes();
+	volume[VOLUMES - 1].commit.data = NULL;
+	assert(mvdump_write_volumes(volume, VOLUMES) != 0);
+	assert(volume[VOLUMES - 1].text != NULL);
+	for (i = 0; i < VOLUMES; i++)
+		check_restored(i);
+	volume[VOLUMES - 1].commit.data = stage2;
+
+	for (i = 0; i < VOLUMES; i++)
+		unlink(name[i]);
+	return 0;
+}
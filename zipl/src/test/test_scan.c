@@ -0,0 +1,285 @@
+/*
+ * test_scan - Test program for the zipl.conf scanner
+ *
+ * Scans all files of the corpus directory given as first argument (default:
+ * scan_corpus) with the current scanner and with the reference scanner in
+ * scan_ref.c and checks that both return the same tokens or the same error
+ * reason. The same is done for randomly mutated copies of the corpus files.
+ * The number of mutations per file can be given as second argument.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <assert.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "scan.h"
+
+#define DEFAULT_MUTATIONS	200
+#define ERROR_STRING_SIZE	1024
+
+int scan_file_ref(const char* filename, struct scan_token** token);
+
+
+/* Characters used for mutations, including all characters with a meaning
+ * to the scanner. Bytes which read as EOF on platforms with signed chars
+ * are left out since the reference scanner does not terminate on them. */
+static const char mutation_chars[] = "[]:#=\"' \t\n\r\0adefgilmnoprstuvy"
+				     "ABTZ0123456789,./-_\x80";
+
+static char reason[ERROR_STRING_SIZE];
+static char tmp_name[] = "/tmp/test_scan.XXXXXX";
+
+
+/* The scanner reports errors with error_reason(), record the reason */
+void
+error_reason(const char* fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(reason, sizeof(reason), fmt, args);
+	va_end(args);
+}
+
+
+void
+error_text(const char* fmt, ...)
+{
+	(void) fmt;
+}
+
+
+static void
+check_tokens(struct scan_token* a, struct scan_token* b, const char* name)
+{
+	int i;
+
+	for (i = 0; a[i].id != 0 || b[i].id != 0; i++) {
+		if (a[i].id != b[i].id || a[i].line != b[i].line)
+			goto fail;
+		switch (a[i].id) {
+		case scan_id_section_heading:
+			if (strcmp(a[i].content.section.name,
+				   b[i].content.section.name) != 0)
+				goto fail;
+			break;
+		case scan_id_menu_heading:
+			if (strcmp(a[i].content.menu.name,
+				   b[i].content.menu.name) != 0)
+				goto fail;
+			break;
+		case scan_id_keyword_assignment:
+			if (a[i].content.keyword.keyword !=
+			    b[i].content.keyword.keyword ||
+			    strcmp(a[i].content.keyword.value,
+				   b[i].content.keyword.value) != 0)
+				goto fail;
+			break;
+		case scan_id_number_assignment:
+			if (a[i].content.number.number !=
+			    b[i].content.number.number ||
+			    strcmp(a[i].content.number.value,
+				   b[i].content.number.value) != 0)
+				goto fail;
+			break;
+		default:
+			goto fail;
+		}
+	}
+	return;
+fail:
+	fprintf(stderr, "%s: token %d differs (line %d/%d)\n", name, i,
+		a[i].line, b[i].line);
+	exit(1);
+}
+
+
+/* Scan file NAME with both scanners and compare the results. Return the
+ * number of tokens or -1 if the file contains an error. */
+static int
+check_file(const char* name)
+{
+	char ref_reason[ERROR_STRING_SIZE];
+	struct scan_token* ref;
+	struct scan_token* scan;
+	int ref_rc;
+	int rc;
+	int i;
+
+	reason[0] = 0;
+	ref_rc = scan_file_ref(name, &ref);
+	strcpy(ref_reason, reason);
+	reason[0] = 0;
+	rc = scan_file(name, &scan);
+	if ((rc == 0) != (ref_rc == 0) || strcmp(reason, ref_reason) != 0) {
+		fprintf(stderr, "%s: rc %d/%d, reason '%s'/'%s'\n", name, rc,
+			ref_rc, reason, ref_reason);
+		exit(1);
+	}
+	if (rc)
+		return -1;
+	check_tokens(scan, ref, name);
+	for (i = 0; scan[i].id != 0; i++)
+		;
+	scan_free(scan);
+	scan_free(ref);
+	return i;
+}
+
+
+static void
+write_file(const char* name, const char* data, size_t size)
+{
+	FILE* file;
+
+	file = fopen(name, "w");
+	assert(file);
+	assert(fwrite(data, 1, size, file) == size);
+	assert(fclose(file) == 0);
+}
+
+
+static char*
+read_file(const char* name, size_t* size)
+{
+	FILE* file;
+	char* data;
+	long length;
+
+	file = fopen(name, "r");
+	assert(file);
+	assert(fseek(file, 0, SEEK_END) == 0);
+	length = ftell(file);
+	assert(length >= 0);
+	rewind(file);
+	data = malloc(length + 1);
+	assert(data);
+	assert(fread(data, 1, length, file) == (size_t) length);
+	fclose(file);
+	*size = length;
+	return data;
+}
+
+
+/* Check COUNT random mutations of DATA */
+static void
+check_mutations(const char* data, size_t size, int count)
+{
+	char* buf;
+	size_t len;
+	size_t pos;
+	int changes;
+
+	buf = malloc(size + 64);
+	assert(buf);
+	for (; count > 0; count--) {
+		memcpy(buf, data, size);
+		len = size;
+		for (changes = rand() % 4 + 1; changes > 0; changes--) {
+			pos = len ? (size_t) rand() % len : 0;
+			switch (rand() % 3) {
+			case 0:
+				if (len == 0)
+					break;
+				buf[pos] = mutation_chars[rand() %
+						(sizeof(mutation_chars) - 1)];
+				break;
+			case 1:
+				memmove(buf + pos + 1, buf + pos, len - pos);
+				buf[pos] = mutation_chars[rand() %
+						(sizeof(mutation_chars) - 1)];
+				len++;
+				break;
+			default:
+				if (len == 0)
+					break;
+				memmove(buf + pos, buf + pos + 1,
+					len - pos - 1);
+				len--;
+				break;
+			}
+		}
+		write_file(tmp_name, buf, len);
+		check_file(tmp_name);
+	}
+	free(buf);
+}
+
+
+/* Check a configuration with many lines, which needs several array
+ * enlargements, and all keywords */
+static void
+check_large(void)
+{
+	char line[PATH_MAX];
+	FILE* file;
+	int i;
+
+	file = fopen(tmp_name, "w");
+	assert(file);
+	for (i = 0; i < 1000; i++) {
+		fprintf(file, "[section%d]\n", i);
+		snprintf(line, sizeof(line), "%s = value%d\n",
+			 scan_keyword_name(i % SCAN_KEYWORD_NUM), i);
+		fputs(line, file);
+	}
+	fprintf(file, ":menu\n");
+	for (i = 1; i < 100; i++)
+		fprintf(file, "%d = section%d\n", i, i);
+	assert(fclose(file) == 0);
+	assert(check_file(tmp_name) == 2000 + 100);
+}
+
+
+int
+main(int argc, char* argv[])
+{
+	const char* dir = argc > 1 ? argv[1] : "scan_corpus";
+	int mutations = argc > 2 ? atoi(argv[2]) : DEFAULT_MUTATIONS;
+	char name[PATH_MAX];
+	struct dirent* entry;
+	struct scan_token* scan;
+	char* data;
+	size_t size;
+	DIR* corpus;
+	int files;
+	int fd;
+
+	fd = mkstemp(tmp_name);
+	assert(fd != -1);
+	close(fd);
+	srand(4711);
+	corpus = opendir(dir);
+	assert(corpus);
+	files = 0;
+	while ((entry = readdir(corpus)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(name, sizeof(name), "%s/%s", dir, entry->d_name);
+		check_file(name);
+		data = read_file(name, &size);
+		check_mutations(data, size, mutations);
+		free(data);
+		files++;
+	}
+	closedir(corpus);
+	assert(files > 0);
+	check_large();
+
+	/* Numbers which do not fit into an int */
+	write_file(tmp_name, ":menu\n2147483647 = a\n", 21);
+	assert(check_file(tmp_name) == 2);
+	write_file(tmp_name, ":menu\n2147483648 = a\n", 21);
+	assert(check_file(tmp_name) == -1);
+	assert(strcmp(reason, "Line 2: number too large") == 0);
+	unlink(tmp_name);
+	assert(scan_file(tmp_name, &scan) != 0);
+	return 0;
+}
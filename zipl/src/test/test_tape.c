@@ -0,0 +1,153 @@
+/*
+ * test_tape - Test program for the tape writer functions
+ *
+ * Writes the components of a boot tape to a file which emulates a tape and
+ * checks the resulting records and tape marks. Files of different sizes
+ * are written, including sizes which are no multiple of the block size and
+ * of the read ahead window.
+ *
+ * Copyright IBM Corp. 2009
+ */
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tape.h"
+
+#define BLOCKSIZE	1024
+
+
+static char tape_name[] = "/tmp/test_tape.XXXXXX";
+static char file_name[] = "/tmp/test_tape_file.XXXXXX";
+
+
+static char*
+create_data(size_t size)
+{
+	char* data;
+	size_t i;
+
+	data = malloc(size + 1);
+	assert(data);
+	for (i = 0; i < size; i++)
+		data[i] = rand();
+	return data;
+}
+
+
+static void
+write_file(const char* data, size_t size)
+{
+	int fd;
+
+	fd = open(file_name, O_WRONLY | O_TRUNC);
+	assert(fd != -1);
+	assert(write(fd, data, size) == (ssize_t) size);
+	close(fd);
+}
+
+
+/* Read the next record from the tape file FD. Return its length, 0 for a
+ * tape mark. */
+static size_t
+read_record(int fd, char* buffer)
+{
+	uint32_t length;
+
+	assert(read(fd, &length, sizeof(length)) == sizeof(length));
+	length = ntohl(length);
+	assert(length <= BLOCKSIZE);
+	if (length > 0)
+		assert(read(fd, buffer, length) == (ssize_t) length);
+	return length;
+}
+
+
+/* Check that the next records on tape FD contain the SIZE bytes of DATA,
+ * followed by a tape mark */
+static void
+check_records(int fd, const char* data, size_t size)
+{
+	char buffer[BLOCKSIZE];
+	size_t offset;
+	size_t length;
+
+	for (offset = 0; offset < size; offset += length) {
+		length = read_record(fd, buffer);
+		assert(length == BLOCKSIZE || offset + length == size);
+		assert(memcmp(buffer, data + offset, length) == 0);
+	}
+	assert(read_record(fd, buffer) == 0);
+}
+
+
+static void
+check_tape(size_t size)
+{
+	struct tape_stats stats;
+	char* loader;
+	char* data;
+	int fd;
+
+	loader = create_data(2 * BLOCKSIZE + 17);
+	data = create_data(size);
+	write_file(data, size);
+	fd = open(tape_name, O_RDWR);
+	assert(fd != -1);
+	/* Boot loader, file and empty file like an IPL tape */
+	assert(tape_rewind(fd) == 0);
+	assert(tape_write_buffer(fd, loader, 2 * BLOCKSIZE + 17,
+				 BLOCKSIZE) == 0);
+	assert(tape_write_mark(fd, 1) == 0);
+	memset(&stats, 0, sizeof(stats));
+	assert(tape_write_file(fd, file_name, BLOCKSIZE, &stats) == 0);
+	assert(stats.bytes == size);
+	assert(stats.records == (size + BLOCKSIZE - 1) / BLOCKSIZE);
+	assert(tape_write_mark(fd, 1) == 0);
+	assert(tape_write_mark(fd, 1) == 0);
+	assert(tape_rewind(fd) == 0);
+	check_records(fd, loader, 2 * BLOCKSIZE + 17);
+	check_records(fd, data, size);
+	check_records(fd, NULL, 0);
+	/* Nothing behind the last tape mark */
+	assert(read(fd, loader, 1) == 0);
+	close(fd);
+	free(loader);
+	free(data);
+}
+
+
+int
+main(void)
+{
+	struct tape_stats stats;
+	size_t sizes[] = { 0, 1, BLOCKSIZE, 1024 * 1024 + 5,
+			   3 * 1024 * 1024 };
+	unsigned int i;
+	int fd;
+
+	fd = mkstemp(tape_name);
+	assert(fd != -1);
+	close(fd);
+	fd = mkstemp(file_name);
+	assert(fd != -1);
+	close(fd);
+	srand(4711);
+	/* Write larger file first to check that the tape is truncated */
+	for (i = sizeof(sizes) / sizeof(sizes[0]); i > 0; i--)
+		check_tape(sizes[i - 1]);
+	fd = open(tape_name, O_RDWR);
+	assert(fd != -1);
+	assert(tape_write_file(fd, "/", BLOCKSIZE, &stats) != 0);
+	assert(tape_write_file(fd, file_name, 1000, &stats) != 0);
+	close(fd);
+	unlink(tape_name);
+	unlink(file_name);
+	return 0;
+}